@@ -0,0 +1,119 @@
+// kernel/arch/aarch64/cpu.c
+#include "arch/cpu.h"
+#include "arch/aarch64/gic.h"
+#include "time.h"
+
+static uint32_t cpus_online = 1;
+
+extern char exception_vectors[];
+
+void arch_cpu_init(void) {
+    __asm__ volatile("msr vbar_el1, %0; isb" :: "r"(exception_vectors));
+
+    // Cycle counter: enable PMU, reset and start PMCCNTR_EL0
+    __asm__ volatile("msr pmcr_el0, %0; msr pmcntenset_el0, %1; isb"
+                     :: "r"((uint64_t)((1 << 0) | (1 << 2))), "r"((uint64_t)(1U << 31)));
+
+    gic_init(arch_cpu_id());
+    gic_enable_irq(IRQ_VIRTUAL_TIMER);
+    gic_enable_irq(IRQ_PHYS_TIMER);
+    if (arch_cpu_id() == 0) {
+        gic_enable_irq(IRQ_UART0);
+    }
+
+    // Event timer starts masked; the scheduler programs it on first use.
+    // The profiling timer stays masked until profile_start().
+    __asm__ volatile("msr cntv_ctl_el0, %0; msr cntp_ctl_el0, %0; isb" :: "r"((uint64_t)2));
+
+    if (arch_cpu_id() + 1 > cpus_online) {
+        cpus_online = arch_cpu_id() + 1;
+    }
+}
+
+uint32_t arch_cpu_id(void) {
+    uint64_t mpidr;
+    __asm__ volatile("mrs %0, mpidr_el1" : "=r"(mpidr));
+    return (uint32_t)(mpidr & 0xff) % MAX_CPUS;
+}
+
+uint32_t arch_cpu_count(void) {
+    return cpus_online;
+}
+
+void arch_cpu_idle(void) {
+    __asm__ volatile("dsb sy; wfi" ::: "memory");
+}
+
+void arch_cpu_relax(void) {
+    __asm__ volatile("yield" ::: "memory");
+}
+
+void arch_cpu_kick(uint32_t cpu) {
+    gic_send_sgi(cpu, IPI_RESCHEDULE);
+}
+
+uint64_t arch_cycles(void) {
+    uint64_t cycles;
+    __asm__ volatile("mrs %0, pmccntr_el0" : "=r"(cycles));
+    return cycles;
+}
+
+uint64_t arch_irq_save(void) {
+    uint64_t flags;
+    __asm__ volatile("mrs %0, daif; msr daifset, #2" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+void arch_irq_restore(uint64_t flags) {
+    __asm__ volatile("msr daif, %0" :: "r"(flags) : "memory");
+}
+
+void arch_irq_enable(void) {
+    __asm__ volatile("msr daifclr, #2; isb" ::: "memory");
+}
+
+// CNTV compares against CNTVCT, the clocksource the timeline runs on
+void arch_timer_program(uint64_t deadline_ns) {
+    __asm__ volatile("msr cntv_cval_el0, %0; msr cntv_ctl_el0, %1; isb"
+                     :: "r"(time_ns_to_cycles(deadline_ns)), "r"((uint64_t)1));
+}
+
+void arch_timer_stop(void) {
+    __asm__ volatile("msr cntv_ctl_el0, %0; isb" :: "r"((uint64_t)2));
+}
+
+// Profiling timer period in CNTPCT ticks, 0 while stopped
+static uint64_t profile_period[MAX_CPUS];
+
+void arch_profile_timer_start(uint64_t period_ns) {
+    uint64_t ticks = time_ns_to_cycle_delta(period_ns);
+    uint64_t now;
+    if (!ticks) ticks = 1;
+    profile_period[arch_cpu_id()] = ticks;
+    __asm__ volatile("isb; mrs %0, cntpct_el0" : "=r"(now));
+    __asm__ volatile("msr cntp_cval_el0, %0; msr cntp_ctl_el0, %1; isb"
+                     :: "r"(now + ticks), "r"((uint64_t)1));
+}
+
+void arch_profile_timer_stop(void) {
+    profile_period[arch_cpu_id()] = 0;
+    __asm__ volatile("msr cntp_ctl_el0, %0; isb" :: "r"((uint64_t)2));
+}
+
+// Advance from the previous deadline rather than from now so the sampling
+// rate does not drift with interrupt latency; skip periods that were missed
+void arch_profile_timer_rearm(void) {
+    uint64_t period = profile_period[arch_cpu_id()];
+    if (!period) {
+        arch_profile_timer_stop();
+        return;
+    }
+
+    uint64_t cval;
+    uint64_t now;
+    __asm__ volatile("mrs %0, cntp_cval_el0" : "=r"(cval));
+    __asm__ volatile("isb; mrs %0, cntpct_el0" : "=r"(now));
+    cval += period;
+    if (cval <= now) cval = now + period;
+    __asm__ volatile("msr cntp_cval_el0, %0; isb" :: "r"(cval));
+}
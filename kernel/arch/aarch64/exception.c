@@ -1,7 +1,22 @@
 // kernel/arch/aarch64/exception.c
 #include <stdint.h>
+#include "arch/aarch64/trap.h"
+#include "syscall.h"
 
-void handle_syscall(uint64_t syscall_number, uint64_t arg1, uint64_t arg2, uint64_t arg3) {
-    uint64_t result = syscall_handler(syscall_number, arg1, arg2, arg3);
-    // Set return value in appropriate register (e.g., x0)
+_Static_assert(sizeof(trap_frame_t) == TRAP_FRAME_SIZE, "trap frame layout mismatch");
+
+// SVC from EL0: number in x8, arguments in x0-x5, result back to x0
+void handle_syscall(trap_frame_t* frame) {
+    frame->x[0] = syscall_handler(frame->x[8], frame->x[0], frame->x[1], frame->x[2],
+                                  frame->x[3], frame->x[4], frame->x[5]);
+}
+
+// Any other synchronous exception
+void handle_sync_exception(trap_frame_t* frame, uint64_t esr) {
+    (void)frame;
+    (void)esr;
+    // Unhandled: park the CPU
+    while (1) {
+        __asm__ volatile("wfe");
+    }
 }
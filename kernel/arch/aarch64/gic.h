@@ -0,0 +1,29 @@
+#ifndef ARCH_AARCH64_GIC_H
+#define ARCH_AARCH64_GIC_H
+
+#include <stdint.h>
+#include "arch/aarch64/trap.h"
+
+// GICv2 on the QEMU "virt" machine
+#define GICD_BASE 0x08000000UL
+#define GICC_BASE 0x08010000UL
+
+// Interrupt IDs
+#define IPI_RESCHEDULE      0   // SGI
+#define IRQ_PHYS_TIMER      30  // PPI, CNTP (sampling profiler)
+#define IRQ_VIRTUAL_TIMER   27  // PPI, CNTV
+#define IRQ_UART0           33  // SPI 1, PL011
+#define IRQ_SPURIOUS        1023
+
+void gic_init(uint32_t cpu);
+void gic_enable_irq(uint32_t irq);
+void gic_disable_irq(uint32_t irq);
+void gic_send_sgi(uint32_t cpu, uint32_t sgi);
+
+// IRQ entry from the exception vector, with the interrupted context
+void arch_handle_irq(trap_frame_t* frame);
+
+// Move the profiling timer's compare value on by one period (cpu.c)
+void arch_profile_timer_rearm(void);
+
+#endif // ARCH_AARCH64_GIC_H
@@ -0,0 +1,79 @@
+// kernel/arch/aarch64/irq.c
+#include "arch/aarch64/gic.h"
+#include "scheduler.h"
+#include "drivers/console.h"
+#include "profile.h"
+#include "timer.h"
+
+#define GICD_CTLR       0x000
+#define GICD_ISENABLER  0x100
+#define GICD_ICENABLER  0x180
+#define GICD_ITARGETSR  0x800
+#define GICD_SGIR       0xF00
+
+#define GICC_CTLR       0x000
+#define GICC_PMR        0x004
+#define GICC_IAR        0x00C
+#define GICC_EOIR       0x010
+
+#define GICD_REG(off) (*(volatile uint32_t*)(GICD_BASE + (off)))
+#define GICC_REG(off) (*(volatile uint32_t*)(GICC_BASE + (off)))
+
+// Initialize distributor (boot CPU) and this CPU's interface
+void gic_init(uint32_t cpu) {
+    if (cpu == 0) {
+        GICD_REG(GICD_CTLR) = 1;
+    }
+    GICC_REG(GICC_PMR) = 0xFF;
+    GICC_REG(GICC_CTLR) = 1;
+    gic_enable_irq(IPI_RESCHEDULE);
+}
+
+void gic_enable_irq(uint32_t irq) {
+    // Shared peripheral interrupts are delivered to CPU 0
+    if (irq >= 32) {
+        *(volatile uint8_t*)(GICD_BASE + GICD_ITARGETSR + irq) = 1;
+    }
+    GICD_REG(GICD_ISENABLER + (irq / 32) * 4) = 1U << (irq % 32);
+}
+
+void gic_disable_irq(uint32_t irq) {
+    GICD_REG(GICD_ICENABLER + (irq / 32) * 4) = 1U << (irq % 32);
+}
+
+void gic_send_sgi(uint32_t cpu, uint32_t sgi) {
+    __asm__ volatile("dsb ishst" ::: "memory");
+    GICD_REG(GICD_SGIR) = (1U << (16 + cpu)) | (sgi & 0xF);
+}
+
+// Acknowledge, dispatch and complete one interrupt
+void arch_handle_irq(trap_frame_t* frame) {
+    uint32_t iar = GICC_REG(GICC_IAR);
+    uint32_t irq = iar & 0x3FF;
+
+    if (irq == IRQ_SPURIOUS) return;
+
+    switch (irq) {
+        case IRQ_VIRTUAL_TIMER:
+            profile_sync();
+            timer_interrupt();
+            scheduler_tick();
+            break;
+        case IRQ_PHYS_TIMER:
+            arch_profile_timer_rearm();
+            // SPSR.M[3:0] == 0: interrupted at EL0
+            profile_sample(frame->elr, frame->x[29], (frame->spsr & 0xF) == 0);
+            break;
+        case IPI_RESCHEDULE:
+            profile_sync();
+            scheduler_ipi();
+            break;
+        case IRQ_UART0:
+            console_irq();
+            break;
+        default:
+            break;
+    }
+
+    GICC_REG(GICC_EOIR) = iar;
+}
@@ -0,0 +1,34 @@
+// kernel/arch/aarch64/time.c
+#include "arch/time.h"
+#include "clocksource.h"
+#include "vdso.h"
+
+static uint64_t cntvct_read(void) {
+    uint64_t counter;
+    __asm__ volatile("isb; mrs %0, cntvct_el0" : "=r"(counter) :: "memory");
+    return counter;
+}
+
+// The system counter is at least 56 bits wide and sits in the always-on
+// power domain, so it keeps counting while the cores are suspended
+static clocksource_t cntvct_clocksource = {
+    .name = "cntvct",
+    .read = cntvct_read,
+    .mask = CLOCKSOURCE_MASK(56),
+    .rating = 300,
+    .flags = CLOCKSOURCE_SUSPEND_NONSTOP,
+    .vdso_mode = VDSO_CLOCK_CNTVCT,
+};
+
+void arch_time_init(void) {
+    // CNTVCT_EL0 is enabled by firmware; let EL0 read it for the vDSO clock
+    uint64_t cntkctl;
+    __asm__ volatile("mrs %0, cntkctl_el1" : "=r"(cntkctl));
+    cntkctl |= (1 << 1); // EL0VCTEN
+    __asm__ volatile("msr cntkctl_el1, %0; isb" :: "r"(cntkctl));
+
+    uint64_t freq;
+    __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(freq));
+    cntvct_clocksource.freq_hz = freq;
+    clocksource_register(&cntvct_clocksource);
+}
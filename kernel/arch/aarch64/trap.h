@@ -0,0 +1,26 @@
+#ifndef ARCH_AARCH64_TRAP_H
+#define ARCH_AARCH64_TRAP_H
+
+#include <stdint.h>
+
+// Register state saved by the exception vector (syscalls/exceptions_vector.s).
+// Layout must match the stp/ldp offsets there.
+typedef struct {
+    uint64_t x[31];     // x0-x30
+    uint64_t sp_el0;    // Interrupted user stack pointer
+    uint64_t elr;       // Return address
+    uint64_t spsr;      // Saved processor state
+} trap_frame_t;
+
+#define TRAP_FRAME_SIZE 272
+
+// ESR_EL1 exception classes
+#define ESR_EC_SHIFT        26
+#define ESR_EC_SVC64        0x15
+#define ESR_EC_DABT_LOW     0x24
+#define ESR_EC_DABT_CUR     0x25
+
+void handle_syscall(trap_frame_t* frame);
+void handle_sync_exception(trap_frame_t* frame, uint64_t esr);
+
+#endif // ARCH_AARCH64_TRAP_H
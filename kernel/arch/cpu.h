@@ -0,0 +1,46 @@
+#ifndef ARCH_CPU_H
+#define ARCH_CPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_CPUS 8
+
+// Per-CPU setup: interrupt controller, timer and (for the boot CPU) the IRQ vector
+void arch_cpu_init(void);
+
+// Index of the executing CPU, in [0, MAX_CPUS)
+uint32_t arch_cpu_id(void);
+
+// Number of CPUs brought up
+uint32_t arch_cpu_count(void);
+
+// Wait for an interrupt. Called with interrupts masked; a pending
+// interrupt still wakes the CPU and is taken once the caller unmasks.
+void arch_cpu_idle(void);
+
+// Spin-wait hint
+void arch_cpu_relax(void);
+
+// Ask another CPU to re-evaluate its run queue (reschedule IPI)
+void arch_cpu_kick(uint32_t cpu);
+
+// Free-running CPU cycle counter
+uint64_t arch_cycles(void);
+
+// Local interrupt masking. IRQs start masked; each CPU unmasks them with
+// arch_irq_enable once its bring-up is complete.
+uint64_t arch_irq_save(void);
+void arch_irq_restore(uint64_t flags);
+void arch_irq_enable(void);
+
+// One-shot per-CPU event timer, deadline on the time_get_ns() timeline
+void arch_timer_program(uint64_t deadline_ns);
+void arch_timer_stop(void);
+
+// Periodic sampling timer for this CPU, independent of the event timer.
+// Each expiry calls profile_sample() with the interrupted context.
+void arch_profile_timer_start(uint64_t period_ns);
+void arch_profile_timer_stop(void);
+
+#endif // ARCH_CPU_H
@@ -0,0 +1,10 @@
+#ifndef ARCH_TIME_H
+#define ARCH_TIME_H
+
+#include <stdint.h>
+
+// Start the free-running system counter(s) and register them with
+// clocksource_register(); time_init() builds the timeline on the best one
+void arch_time_init(void);
+
+#endif // ARCH_TIME_H
@@ -0,0 +1,97 @@
+// kernel/arch/x86_64/time.c
+#include "arch/time.h"
+#include "clocksource.h"
+#include "vdso.h"
+#include <stdbool.h>
+
+#define PIT_TICK_RATE       1193182ULL
+#define PIT_CALIBRATE_MS    50
+
+static inline void cpuid(uint32_t leaf, uint32_t* a, uint32_t* b, uint32_t* c, uint32_t* d) {
+    __asm__ volatile("cpuid" : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d) : "a"(leaf), "c"(0));
+}
+
+static inline uint8_t inb(uint16_t port) {
+    uint8_t value;
+    __asm__ volatile("inb %1, %0" : "=a"(value) : "Nd"(port));
+    return value;
+}
+
+static inline void outb(uint16_t port, uint8_t value) {
+    __asm__ volatile("outb %0, %1" :: "a"(value), "Nd"(port));
+}
+
+static uint64_t tsc_read(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("lfence; rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Invariant TSC runs at a constant rate through P-, C- and T-states but
+// is reset across S3, so it does not count suspended time
+static clocksource_t tsc_clocksource = {
+    .name = "tsc",
+    .read = tsc_read,
+    .mask = CLOCKSOURCE_MASK(64),
+    .rating = 300,
+    .flags = 0,
+    .vdso_mode = VDSO_CLOCK_TSC,
+};
+
+// Leaf 0x15 gives the TSC/crystal ratio (and usually the crystal); leaf
+// 0x16 the nominal base frequency. 0 if neither is reported.
+static uint64_t tsc_freq_cpuid(void) {
+    uint32_t max_leaf, b, c, d;
+    cpuid(0, &max_leaf, &b, &c, &d);
+
+    if (max_leaf >= 0x15) {
+        uint32_t denominator, numerator, crystal_hz;
+        cpuid(0x15, &denominator, &numerator, &crystal_hz, &d);
+        if (denominator && numerator && crystal_hz) {
+            return (uint64_t)crystal_hz * numerator / denominator;
+        }
+    }
+    if (max_leaf >= 0x16) {
+        uint32_t base_mhz;
+        cpuid(0x16, &base_mhz, &b, &c, &d);
+        if (base_mhz) return (uint64_t)base_mhz * 1000000ULL;
+    }
+    return 0;
+}
+
+// Count TSC ticks across a PIT channel 2 one-shot of known length
+static uint64_t tsc_freq_pit(void) {
+    // Gate channel 2 on, speaker off
+    outb(0x61, (uint8_t)((inb(0x61) & ~0x02) | 0x01));
+
+    // Channel 2, lobyte/hibyte, mode 0 (interrupt on terminal count)
+    uint32_t latch = (uint32_t)(PIT_TICK_RATE * PIT_CALIBRATE_MS / 1000);
+    outb(0x43, 0xB0);
+    outb(0x42, (uint8_t)(latch & 0xFF));
+    outb(0x42, (uint8_t)(latch >> 8));
+
+    uint64_t start = tsc_read();
+    while (!(inb(0x61) & 0x20)) {
+    }
+    uint64_t end = tsc_read();
+
+    return (end - start) * 1000 / PIT_CALIBRATE_MS;
+}
+
+void arch_time_init(void) {
+    uint32_t a, b, c, d;
+    cpuid(0x80000000, &a, &b, &c, &d);
+    bool invariant = false;
+    if (a >= 0x80000007) {
+        cpuid(0x80000007, &a, &b, &c, &d);
+        invariant = (d >> 8) & 1;
+    }
+
+    uint64_t freq = tsc_freq_cpuid();
+    if (!freq) freq = tsc_freq_pit();
+
+    tsc_clocksource.freq_hz = freq;
+    // A TSC that changes rate with P-states still works, just less well
+    if (!invariant) tsc_clocksource.rating = 100;
+    clocksource_register(&tsc_clocksource);
+}
@@ -15,5 +15,9 @@ _start:
     b 1b
 
 .section .bss
+// Bounds are global so the profiler can validate frame pointers
+.global _stack_bottom
+.global _stack_top
+_stack_bottom:
 .space 4096
 _stack_top:
@@ -0,0 +1,68 @@
+#include "clocksource.h"
+#include "spinlock.h"
+#include "time.h"
+#include <stddef.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+
+static clocksource_t* clocksources = NULL;
+static spinlock_t clocksource_lock = SPINLOCK_INIT;
+
+// Pick the largest shift (most precise mult) for which max_seconds of
+// input, times mult, stays inside 64 bits
+void clocksource_calc_mult_shift(uint32_t* mult, uint32_t* shift, uint64_t from_hz, uint64_t to_hz,
+                                 uint64_t max_seconds) {
+    // Bits the largest input value needs beyond 32
+    uint32_t accumulated = 32;
+    uint64_t tmp = (max_seconds * from_hz) >> 32;
+    while (tmp) {
+        tmp >>= 1;
+        accumulated--;
+    }
+
+    uint32_t sft;
+    for (sft = 32; sft > 0; sft--) {
+        if (to_hz >> (64 - sft)) continue;     // to_hz << sft would overflow
+        tmp = ((to_hz << sft) + from_hz / 2) / from_hz;
+        if ((tmp >> accumulated) == 0) break;
+    }
+    *mult = (uint32_t)tmp;
+    *shift = sft;
+}
+
+bool clocksource_register(clocksource_t* cs) {
+    if (!cs || !cs->read || !cs->freq_hz || !cs->mask) return false;
+
+    // Cover CLOCKSOURCE_MAX_SECONDS, or less if the counter wraps sooner
+    uint64_t max_seconds = cs->mask / cs->freq_hz;
+    if (max_seconds > CLOCKSOURCE_MAX_SECONDS) max_seconds = CLOCKSOURCE_MAX_SECONDS;
+    if (!max_seconds) max_seconds = 1;
+
+    clocksource_calc_mult_shift(&cs->mult, &cs->shift, cs->freq_hz, NSEC_PER_SEC, max_seconds);
+    cs->max_cycles = max_seconds * cs->freq_hz;
+    if (cs->max_cycles > cs->mask) cs->max_cycles = cs->mask;
+    cs->max_idle_ns = clocksource_cyc2ns(cs, cs->max_cycles);
+
+    uint64_t flags = spin_lock_irqsave(&clocksource_lock);
+    cs->next = clocksources;
+    clocksources = cs;
+    spin_unlock_irqrestore(&clocksource_lock, flags);
+
+    // Before time_init() this only records the clocksource; time_init()
+    // then starts on the best one
+    const clocksource_t* current = time_get_clocksource();
+    if (current && cs->rating > current->rating) {
+        time_set_clocksource(cs);
+    }
+    return true;
+}
+
+clocksource_t* clocksource_best(void) {
+    uint64_t flags = spin_lock_irqsave(&clocksource_lock);
+    clocksource_t* best = NULL;
+    for (clocksource_t* cs = clocksources; cs; cs = cs->next) {
+        if (!best || cs->rating > best->rating) best = cs;
+    }
+    spin_unlock_irqrestore(&clocksource_lock, flags);
+    return best;
+}
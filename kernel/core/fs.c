@@ -1,57 +1,507 @@
 #include "fs.h"
+#include "fs/tmpfs.h"
+#include "fs/initrd.h"
+#include "fs/sysimg.h"
+#include "fs/lambdafs.h"
+#include "memory.h"
+#include "spinlock.h"
+#include "process.h"
+#include "scheduler.h"
+#include "trace.h"
+#include <stddef.h>
 #include <string.h>
 
-#define MAX_FILES 32
-#define MAX_FILE_SIZE 1024
+TRACE_EVENT(fs, fs_open, "flags", "ino", "size", "result");
+TRACE_EVENT(fs, fs_read, "ino", "pos", "size", "result");
+TRACE_EVENT(fs, fs_write, "ino", "pos", "size", "result");
+TRACE_EVENT(fs, fs_mmap, "ino", "pos", "size", "result");
 
-typedef struct file_entry {
-    file_t file;
-    uint8_t data[MAX_FILE_SIZE];
-} file_entry_t;
+// A mapping handed out by fs_mmap, found again by its address
+typedef struct {
+    vfs_mapping_t* mapping;
+    vfs_dentry_t* dentry;           // Keeps the inode cached while mapped
+    uint64_t owner_pid;
+    bool active;
+} fs_mapping_t;
 
-static file_entry_t files[MAX_FILES];
-static uint32_t file_count = 0;
+// Live mappings, under files_lock, which also guards the processes'
+// pointers to their descriptor tables
+static fs_mapping_t mappings[FS_MAX_MAPPINGS];
+static spinlock_t files_lock = SPINLOCK_INIT;
+
+// A bit per descriptor in use, and a summary bit per word of those that is
+// full, so finding the lowest free descriptor takes two scans. The slots
+// grow by doubling; the bitmaps are sized for FS_MAX_FDS up front.
+struct fs_fd_table {
+    spinlock_t lock;
+    uint32_t refcount;              // The process's, and each lookup's
+    uint32_t size;                  // Slots in files, a multiple of 64
+    uint64_t full;
+    uint64_t used[FS_MAX_FDS / 64];
+    file_t** files;
+};
+
+typedef struct fs_fd_table fs_fd_table_t;
+
+_Static_assert(FS_MAX_FDS <= 64 * 64, "one summary word covers the descriptor bitmap");
+
+// For code running outside any process
+static fs_fd_table_t kernel_fds = { .lock = SPINLOCK_INIT, .refcount = 1 };
+
+static initrd_source_t initrd;
+static sysimg_source_t sysimg;
+
+static uint64_t current_pid(void) {
+    process_control_block_t* current = scheduler_get_current();
+    return current ? current->pid : 0;
+}
 
 void fs_init(void) {
-    memset(files, 0, sizeof(files));
-    file_count = 0;
+    memset(mappings, 0, sizeof(mappings));
+
+    vfs_init();
+    tmpfs_init();
+    initrd_init();
+    sysimg_init();
+    lambdafs_init();
+
+    if (initrd.start && vfs_mount("initrd", NULL, "/", VFS_MOUNT_RDONLY, &initrd) == 0) {
+        vfs_mount("tmpfs", NULL, "/tmp", 0, NULL);
+    } else {
+        vfs_mount("tmpfs", NULL, "/", 0, NULL);
+    }
+
+    if (sysimg.start) {
+        // Already there on an initrd root; made on a tmpfs one
+        fs_mkdir("/system");
+        vfs_mount("sysimg", NULL, "/system", VFS_MOUNT_RDONLY, &sysimg);
+    }
 }
 
-file_t* fs_open(const char* path, uint32_t flags) {
-    if (file_count >= MAX_FILES) {
-        return NULL;
+void fs_set_initrd(const void* start, uint64_t size) {
+    initrd.start = start;
+    initrd.size = size;
+}
+
+void fs_set_sysimg(const void* start, uint64_t size) {
+    sysimg.start = start;
+    sysimg.size = size;
+}
+
+static int open_dentry(const char* path, uint32_t flags, vfs_dentry_t** result) {
+    if (!(flags & FS_O_CREAT)) return vfs_lookup(path, result);
+    return vfs_create(path, VFS_TYPE_FILE, (flags & FS_O_EXCL) != 0, result);
+}
+
+static int open_file(const char* path, uint32_t flags, file_t** result) {
+    vfs_dentry_t* dentry;
+    int err = open_dentry(path, flags, &dentry);
+    if (err) {
+        TRACE(fs_open, flags, 0, 0, err);
+        return err;
+    }
+
+    vfs_inode_t* inode = dentry->inode;
+    bool writable = (flags & FS_O_ACCMODE) != FS_O_RDONLY;
+    if (inode->type == VFS_TYPE_DIR && writable) {
+        err = VFS_ERR_ISDIR;
+    } else if (inode->type != VFS_TYPE_DIR && (flags & FS_O_DIRECTORY)) {
+        err = VFS_ERR_NOTDIR;
+    } else if ((flags & FS_O_TRUNC) && writable && inode->size) {
+        err = vfs_truncate(inode, 0);
+    }
+
+    file_t* file = NULL;
+    if (!err) {
+        file = memory_alloc(sizeof(file_t));
+        if (!file) err = VFS_ERR_NOMEM;
+    }
+    if (err) {
+        vfs_dput(dentry);
+        TRACE(fs_open, flags, inode->ino, inode->size, err);
+        return err;
     }
-    file_entry_t* entry = &files[file_count];
-    strncpy(entry->file.name, path, FS_MAX_FILENAME - 1);
-    entry->file.id = file_count;
-    entry->file.size = 0;
-    entry->file.pos = 0;
-    file_count++;
-    return &entry->file;
+
+    file->refcount = 1;
+    file->flags = flags;
+    file->pos = 0;
+    memset(&file->ra, 0, sizeof(file->ra));
+    file->dentry = dentry;
+    file->inode = inode;
+    TRACE(fs_open, flags, inode->ino, inode->size, 0);
+    *result = file;
+    return 0;
+}
+
+file_t* fs_open(const char* path, uint32_t flags) {
+    file_t* file;
+    return open_file(path, flags, &file) ? NULL : file;
+}
+
+file_t* fs_file_get(file_t* file) {
+    __atomic_fetch_add(&file->refcount, 1, __ATOMIC_RELAXED);
+    return file;
+}
+
+void fs_close(file_t* file) {
+    if (!file || __atomic_sub_fetch(&file->refcount, 1, __ATOMIC_ACQ_REL)) return;
+    vfs_dput(file->dentry);
+    memory_free(file);
+}
+
+// Take [pos, pos + size) off the shared position before the I/O runs, so
+// callers sharing a description never read or write the same bytes
+static uint64_t pos_claim(file_t* file, uint64_t size) {
+    return __atomic_fetch_add(&file->pos, size, __ATOMIC_ACQ_REL);
+}
+
+// Hand back what the I/O did not use, unless someone has claimed past it
+static void pos_settle(file_t* file, uint64_t pos, uint64_t size, int64_t result) {
+    uint64_t done = result > 0 ? (uint64_t)result : 0;
+    if (done == size) return;
+    uint64_t expected = pos + size;
+    __atomic_compare_exchange_n(&file->pos, &expected, pos + done, false,
+                                __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+int fs_pread(file_t* file, void* buffer, uint64_t size, uint64_t offset) {
+    if ((file->flags & FS_O_ACCMODE) == FS_O_WRONLY) return VFS_ERR_INVAL;
+
+    int64_t result = vfs_read(file->inode, &file->ra, offset, buffer, size);
+    TRACE(fs_read, file->inode->ino, offset, size, result);
+    return (int)result;
+}
+
+int fs_pwrite(file_t* file, const void* buffer, uint64_t size, uint64_t offset) {
+    if ((file->flags & FS_O_ACCMODE) == FS_O_RDONLY) return VFS_ERR_INVAL;
+
+    int64_t result = vfs_write(file->inode, offset, buffer, size);
+    TRACE(fs_write, file->inode->ino, offset, size, result);
+    return (int)result;
 }
 
 int fs_read(file_t* file, void* buffer, uint64_t size) {
-    if (file->pos >= file->size) {
-        return 0;
-    }
-    uint64_t to_read = (file->pos + size > file->size) ? (file->size - file->pos) : size;
-    memcpy(buffer, files[file->id].data + file->pos, to_read);
-    file->pos += to_read;
-    return to_read;
+    uint64_t pos = pos_claim(file, size);
+    int result = fs_pread(file, buffer, size, pos);
+    pos_settle(file, pos, size, result);
+    return result;
 }
 
 int fs_write(file_t* file, const void* buffer, uint64_t size) {
-    if (file->pos + size > MAX_FILE_SIZE) {
-        return -1;
+    if (!(file->flags & FS_O_APPEND)) {
+        uint64_t pos = pos_claim(file, size);
+        int result = fs_pwrite(file, buffer, size, pos);
+        pos_settle(file, pos, size, result);
+        return result;
+    }
+
+    if ((file->flags & FS_O_ACCMODE) == FS_O_RDONLY) return VFS_ERR_INVAL;
+    uint64_t pos = 0;
+    int64_t result = vfs_append(file->inode, buffer, size, &pos);
+    TRACE(fs_write, file->inode->ino, pos, size, result);
+    if (result > 0) __atomic_store_n(&file->pos, pos + (uint64_t)result, __ATOMIC_RELEASE);
+    return (int)result;
+}
+
+// Write the file's dirty pages back to its filesystem
+int fs_fsync(file_t* file) {
+    return vfs_fsync(file->inode);
+}
+
+// The position is the directory's readdir cookie
+int fs_readdir(file_t* dir, fs_dirent_t* dirent) {
+    uint64_t cookie = __atomic_load_n(&dir->pos, __ATOMIC_ACQUIRE);
+    int result = vfs_readdir(dir->inode, &cookie, dirent);
+    __atomic_store_n(&dir->pos, cookie, __ATOMIC_RELEASE);
+    return result;
+}
+
+int fs_stat(const char* path, fs_stat_t* stat) {
+    vfs_dentry_t* dentry;
+    int err = vfs_lookup(path, &dentry);
+    if (err) return err;
+    vfs_stat(dentry->inode, stat);
+    vfs_dput(dentry);
+    return 0;
+}
+
+int fs_mkdir(const char* path) {
+    vfs_dentry_t* dentry;
+    int err = vfs_create(path, VFS_TYPE_DIR, true, &dentry);
+    if (err) return err;
+    vfs_dput(dentry);
+    return 0;
+}
+
+int fs_unlink(const char* path) {
+    return vfs_unlink(path, false);
+}
+
+int fs_rmdir(const char* path) {
+    return vfs_unlink(path, true);
+}
+
+int fs_mount(const char* type, const char* source, const char* target, uint32_t flags) {
+    return vfs_mount(type, source, target, flags, NULL);
+}
+
+int fs_mmap(file_t* file, uint64_t offset, uint64_t length, void** addr) {
+    if ((file->flags & FS_O_ACCMODE) == FS_O_WRONLY) return VFS_ERR_INVAL;
+
+    vfs_mapping_t* mapping;
+    int err = vfs_mmap(file->inode, offset, length, &mapping);
+    if (err) {
+        TRACE(fs_mmap, file->inode->ino, offset, length, err);
+        return err;
+    }
+
+    uint64_t flags = spin_lock_irqsave(&files_lock);
+    fs_mapping_t* slot = NULL;
+    for (uint32_t i = 0; i < FS_MAX_MAPPINGS; i++) {
+        if (!mappings[i].active) {
+            slot = &mappings[i];
+            slot->mapping = mapping;
+            slot->dentry = vfs_dget(file->dentry);
+            slot->owner_pid = current_pid();
+            slot->active = true;
+            break;
+        }
     }
-    memcpy(files[file->id].data + file->pos, buffer, size);
-    file->pos += size;
-    if (file->pos > file->size) {
-        file->size = file->pos;
+    spin_unlock_irqrestore(&files_lock, flags);
+
+    if (!slot) {
+        vfs_munmap(mapping);
+        TRACE(fs_mmap, file->inode->ino, offset, length, VFS_ERR_BUSY);
+        return VFS_ERR_BUSY;
     }
-    return size;
+    TRACE(fs_mmap, file->inode->ino, offset, length, 0);
+    *addr = mapping->addr;
+    return 0;
 }
 
-void fs_close(file_t* file) {
-    // For now, just a stub
-} 
\ No newline at end of file
+// Take the first mapping matching addr (any with addr NULL) owned by pid
+static bool mapping_take(void* addr, uint64_t pid, vfs_mapping_t** mapping, vfs_dentry_t** dentry) {
+    bool found = false;
+    uint64_t flags = spin_lock_irqsave(&files_lock);
+    for (uint32_t i = 0; i < FS_MAX_MAPPINGS; i++) {
+        fs_mapping_t* slot = &mappings[i];
+        if (slot->active && slot->owner_pid == pid && (!addr || slot->mapping->addr == addr)) {
+            *mapping = slot->mapping;
+            *dentry = slot->dentry;
+            slot->active = false;
+            found = true;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&files_lock, flags);
+    return found;
+}
+
+int fs_munmap(void* addr) {
+    vfs_mapping_t* mapping;
+    vfs_dentry_t* dentry;
+    if (!addr || !mapping_take(addr, current_pid(), &mapping, &dentry)) return VFS_ERR_INVAL;
+
+    vfs_munmap(mapping);
+    vfs_dput(dentry);
+    return 0;
+}
+
+// --- File descriptors ---
+
+// The table of process pid, or the caller's for 0; made if create is set.
+// Referenced, for fd_table_put(): the ring of another process looks up
+// descriptors while that process may be exiting. The process's pointer is
+// read and dropped under files_lock so a lookup never takes a table that
+// is already on its way out.
+static fs_fd_table_t* fd_table(uint64_t pid, bool create) {
+    process_control_block_t* process = pid ? process_get(pid) : scheduler_get_current();
+    if (!process) {
+        if (pid) return NULL;
+        __atomic_fetch_add(&kernel_fds.refcount, 1, __ATOMIC_RELAXED);
+        return &kernel_fds;
+    }
+
+    fs_fd_table_t* fresh = NULL;
+    if (create && !__atomic_load_n(&process->files, __ATOMIC_ACQUIRE)) {
+        fresh = memory_alloc(sizeof(fs_fd_table_t));
+        if (fresh) {
+            memset(fresh, 0, sizeof(fs_fd_table_t));
+            spinlock_init(&fresh->lock);
+            fresh->refcount = 1;
+        }
+    }
+
+    uint64_t flags = spin_lock_irqsave(&files_lock);
+    fs_fd_table_t* table = process->files;
+    if (!table && fresh) {
+        table = fresh;
+        fresh = NULL;
+        __atomic_store_n(&process->files, table, __ATOMIC_RELEASE);
+    }
+    if (table) __atomic_fetch_add(&table->refcount, 1, __ATOMIC_RELAXED);
+    spin_unlock_irqrestore(&files_lock, flags);
+
+    if (fresh) memory_free(fresh);
+    if (pid) process_put(process);
+    return table;
+}
+
+// The last reference is gone: the process has exited and no lookup is
+// still using the table
+static void fd_table_release(fs_fd_table_t* table) {
+    for (uint32_t fd = 0; fd < table->size; fd++) {
+        if (table->files[fd]) fs_close(table->files[fd]);
+    }
+    if (table->files) memory_free(table->files);
+    memory_free(table);
+}
+
+static void fd_table_put(fs_fd_table_t* table) {
+    if (__atomic_sub_fetch(&table->refcount, 1, __ATOMIC_ACQ_REL) == 0) fd_table_release(table);
+}
+
+// Lowest free descriptor, -1 if every slot is taken; under the table lock
+static int fd_lowest_free(const fs_fd_table_t* table) {
+    if (table->full == UINT64_MAX) return -1;
+    uint32_t word = (uint32_t)__builtin_ctzll(~table->full);
+    uint32_t fd = word * 64 + (uint32_t)__builtin_ctzll(~table->used[word]);
+    return fd < table->size ? (int)fd : -1;
+}
+
+static void fd_mark(fs_fd_table_t* table, int fd, bool used) {
+    uint32_t word = (uint32_t)fd / 64;
+    uint64_t bit = 1ULL << (fd % 64);
+    if (used) {
+        table->used[word] |= bit;
+        if (table->used[word] == UINT64_MAX) table->full |= 1ULL << word;
+    } else {
+        table->used[word] &= ~bit;
+        table->full &= ~(1ULL << word);
+    }
+}
+
+// Double a table that had size slots, unless someone already has; false
+// at FS_MAX_FDS or out of memory
+static bool fd_table_grow(fs_fd_table_t* table, uint32_t size) {
+    if (size >= FS_MAX_FDS) return false;
+    uint32_t new_size = size ? size * 2 : 64;
+    file_t** files = memory_alloc(new_size * sizeof(file_t*));
+    if (!files) return false;
+    memset(files, 0, new_size * sizeof(file_t*));
+
+    file_t** old = NULL;
+    uint64_t flags = spin_lock_irqsave(&table->lock);
+    if (table->size == size) {
+        if (size) memcpy(files, table->files, size * sizeof(file_t*));
+        old = table->files;
+        table->files = files;
+        table->size = new_size;
+        files = NULL;
+    }
+    spin_unlock_irqrestore(&table->lock, flags);
+
+    if (files) memory_free(files);
+    if (old) memory_free(old);
+    return true;
+}
+
+static int fd_insert(fs_fd_table_t* table, file_t* file) {
+    for (;;) {
+        uint64_t flags = spin_lock_irqsave(&table->lock);
+        int fd = fd_lowest_free(table);
+        uint32_t size = table->size;
+        if (fd >= 0) {
+            table->files[fd] = file;
+            fd_mark(table, fd, true);
+        }
+        spin_unlock_irqrestore(&table->lock, flags);
+
+        if (fd >= 0) return fd;
+        if (!fd_table_grow(table, size)) return VFS_ERR_BUSY;
+    }
+}
+
+static file_t* fd_take(fs_fd_table_t* table, int fd) {
+    file_t* file = NULL;
+    uint64_t flags = spin_lock_irqsave(&table->lock);
+    if (fd >= 0 && (uint32_t)fd < table->size && table->files[fd]) {
+        file = table->files[fd];
+        table->files[fd] = NULL;
+        fd_mark(table, fd, false);
+    }
+    spin_unlock_irqrestore(&table->lock, flags);
+    return file;
+}
+
+int fs_fd_install(file_t* file) {
+    fs_fd_table_t* table = fd_table(0, true);
+    if (!table) return VFS_ERR_NOMEM;
+    int fd = fd_insert(table, file);
+    fd_table_put(table);
+    return fd;
+}
+
+int fs_fd_open(const char* path, uint32_t flags) {
+    file_t* file;
+    int err = open_file(path, flags, &file);
+    if (err) return err;
+
+    int fd = fs_fd_install(file);
+    if (fd < 0) fs_close(file);
+    return fd;
+}
+
+int fs_fd_close(int fd) {
+    fs_fd_table_t* table = fd_table(0, false);
+    if (!table) return VFS_ERR_INVAL;
+    file_t* file = fd_take(table, fd);
+    fd_table_put(table);
+    if (!file) return VFS_ERR_INVAL;
+    fs_close(file);
+    return 0;
+}
+
+int fs_fd_dup(int fd) {
+    file_t* file = fs_fd_get(0, fd);
+    if (!file) return VFS_ERR_INVAL;
+
+    int copy = fs_fd_install(file);
+    if (copy < 0) fs_close(file);
+    return copy;
+}
+
+file_t* fs_fd_get(uint64_t pid, int fd) {
+    fs_fd_table_t* table = fd_table(pid, false);
+    if (!table) return NULL;
+
+    file_t* file = NULL;
+    uint64_t flags = spin_lock_irqsave(&table->lock);
+    if (fd >= 0 && (uint32_t)fd < table->size && table->files[fd]) {
+        file = fs_file_get(table->files[fd]);
+    }
+    spin_unlock_irqrestore(&table->lock, flags);
+    fd_table_put(table);
+    return file;
+}
+
+void fs_release_process(uint64_t pid) {
+    vfs_mapping_t* mapping;
+    vfs_dentry_t* dentry;
+    while (mapping_take(NULL, pid, &mapping, &dentry)) {
+        vfs_munmap(mapping);
+        vfs_dput(dentry);
+    }
+
+    process_control_block_t* process = process_get(pid);
+    fs_fd_table_t* table = NULL;
+    if (process) {
+        uint64_t flags = spin_lock_irqsave(&files_lock);
+        table = process->files;
+        __atomic_store_n(&process->files, NULL, __ATOMIC_RELEASE);
+        spin_unlock_irqrestore(&files_lock, flags);
+    }
+    process_put(process);
+    // Lookups in flight keep it until they are done
+    if (table) fd_table_put(table);
+}
@@ -3,21 +3,96 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "fs/vfs.h"
 
-#define FS_MAX_FILENAME 64
+#define FS_MAX_FDS        4096      // Per process
+#define FS_MAX_MAPPINGS   256
 
+// Open flags
+#define FS_O_RDONLY     0x0
+#define FS_O_WRONLY     0x1
+#define FS_O_RDWR       0x2
+#define FS_O_ACCMODE    0x3
+#define FS_O_CREAT      0x40
+#define FS_O_EXCL       0x80
+#define FS_O_TRUNC      0x200
+#define FS_O_APPEND     0x400
+#define FS_O_DIRECTORY  0x10000
+
+// An open file description: opening the same path twice gives two of these
+// on one inode, each with its own position. Descriptors duplicated from one
+// share it, position included, and it lives until the last is closed.
 typedef struct file {
-    uint32_t id;
-    char name[FS_MAX_FILENAME];
-    uint64_t size;
-    uint64_t pos;
-    void* fs_data;
+    uint32_t refcount;
+    uint32_t flags;
+    uint64_t pos;                   // Updated atomically
+    vfs_dentry_t* dentry;
+    vfs_inode_t* inode;
+    vfs_readahead_t ra;
 } file_t;
 
+typedef vfs_stat_t fs_stat_t;
+typedef vfs_dirent_t fs_dirent_t;
+
+// Boot code hands over the initrd before fs_init; it then becomes the
+// read-only root, with a tmpfs on /tmp if the image has that directory
+void fs_set_initrd(const void* start, uint64_t size);
+
+// Likewise for the compressed system image, mounted read-only on /system
+void fs_set_sysimg(const void* start, uint64_t size);
+
 void fs_init(void);
+
+// fs_open returns a description holding one reference, which fs_close
+// drops; fs_file_get takes another
 file_t* fs_open(const char* path, uint32_t flags);
+file_t* fs_file_get(file_t* file);
+void fs_close(file_t* file);
+
 int fs_read(file_t* file, void* buffer, uint64_t size);
 int fs_write(file_t* file, const void* buffer, uint64_t size);
-void fs_close(file_t* file);
+int fs_fsync(file_t* file);
+
+// At an explicit offset, leaving the position alone
+int fs_pread(file_t* file, void* buffer, uint64_t size, uint64_t offset);
+int fs_pwrite(file_t* file, const void* buffer, uint64_t size, uint64_t offset);
+
+// Next directory entry; 1 with an entry, 0 at the end, negative on error
+int fs_readdir(file_t* dir, fs_dirent_t* dirent);
+
+int fs_stat(const char* path, fs_stat_t* stat);
+int fs_mkdir(const char* path);
+int fs_unlink(const char* path);
+int fs_rmdir(const char* path);
+int fs_mount(const char* type, const char* source, const char* target, uint32_t flags);
+
+// Map length bytes of a readable file from a page-aligned offset, shared
+// and read-only: *addr points at the cached file data itself. The mapping
+// belongs to the calling process and outlives the file being closed.
+int fs_mmap(file_t* file, uint64_t offset, uint64_t length, void** addr);
+int fs_munmap(void* addr);
+
+// Drop every mapping a process still holds and close its descriptors
+void fs_release_process(uint64_t pid);
+
+// --- File descriptors ---
+//
+// Each process has its own table, made on first use; code running outside
+// any process shares one kernel table. New descriptors are always the
+// lowest free number.
+
+// Give the calling process a descriptor for file, which takes over the
+// caller's reference; negative, the reference still the caller's, if the
+// table is full
+int fs_fd_install(file_t* file);
+int fs_fd_open(const char* path, uint32_t flags);
+int fs_fd_close(int fd);
+
+// A second descriptor on the same description
+int fs_fd_dup(int fd);
+
+// The description behind a descriptor of process pid (0 for the caller),
+// with a reference for the caller to fs_close; NULL if none
+file_t* fs_fd_get(uint64_t pid, int fd);
 
-#endif // FS_H 
\ No newline at end of file
+#endif // FS_H
@@ -8,23 +8,59 @@
 #include "net.h"
 #include "log.h"
 #include "security.h"
+#include "ioring.h"
+#include "vdso.h"
+#include "time.h"
+#include "arch/cpu.h"
+#include "drivers/console.h"
+#include "trace.h"
+#include "profile.h"
+#include "timer.h"
+#include "power.h"
+
+// Linked in by boot/images.s; empty unless the build names an image
+extern const uint8_t __initrd_start[];
+extern const uint8_t __initrd_end[];
+extern const uint8_t __sysimg_start[];
+extern const uint8_t __sysimg_end[];
 
 void kernel_init(void) {
+    console_init(CONSOLE_MODE_SYNC);
     log_init();
+    trace_init();
+    profile_init();
     memory_init();
+    arch_cpu_init();
+    console_set_mode(CONSOLE_MODE_IRQ);
+    vdso_init();
+    time_init();
     process_init(); // You may want to implement this
     scheduler_init(SCHED_RR);
+    timer_init();
+    time_late_init();
+    power_init();
     ipc_init();
     device_init();
+    uint64_t initrd_size = (uint64_t)(__initrd_end - __initrd_start);
+    if (initrd_size) fs_set_initrd(__initrd_start, initrd_size);
+    uint64_t sysimg_size = (uint64_t)(__sysimg_end - __sysimg_start);
+    if (sysimg_size) fs_set_sysimg(__sysimg_start, sysimg_size);
     fs_init();
     net_init();
+    ioring_init();
     security_init();
+
+    // Bring-up is complete: the tick, IPIs, the console and the profiler
+    // all need interrupts from here on
+    arch_irq_enable();
 }
 
 void kernel_start(void) {
-    // Start the first process, enter main scheduling loop, etc.
-    // For now, just a stub
+    // Idle loop: run whatever is runnable, otherwise sleep in WFI with
+    // the tick stopped until the next timer event or IPI
     while (1) {
         scheduler_schedule();
+        log_flush();
+        scheduler_idle();
     }
 } 
\ No newline at end of file
@@ -0,0 +1,368 @@
+#include "ioring.h"
+#include "memory.h"
+#include "mutex.h"
+#include "process.h"
+#include "scheduler.h"
+#include "spinlock.h"
+#include "time.h"
+#include "fs.h"
+#include "ipc.h"
+#include "net/network.h"
+#include <stddef.h>
+#include <string.h>
+
+// How long the SQ poller spins on empty rings before it parks
+#define IORING_SQPOLL_IDLE_NS    (2 * 1000 * 1000ULL)
+#define IORING_SQPOLL_STACK_SIZE 8192
+
+typedef struct {
+    bool active;
+    bool reserved;          // Being set up, under rings_lock
+    uint64_t owner_pid;
+    uint32_t flags;
+    ioring_shared_t* shared;
+    ioring_sqe_t* sqes;
+    ioring_cqe_t* cqes;
+    // Serializes consumers, ioring_enter and the SQ poller, and covers the
+    // fields above once set up. Operations run under it and may sleep on
+    // the disk, so it is a mutex; both consumers are tasks.
+    mutex_t lock;
+    ioring_stats_t stats;
+} ioring_t;
+
+static ioring_t rings[IORING_MAX_RINGS];
+static spinlock_t rings_lock = SPINLOCK_INIT;
+
+static process_control_block_t* sqpoll_task = NULL;
+
+static inline uint32_t load_acquire(volatile uint32_t* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void store_release(volatile uint32_t* p, uint32_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static uint32_t round_up_pow2(uint32_t n) {
+    uint32_t v = 1;
+    while (v < n) v <<= 1;
+    return v;
+}
+
+static uint64_t current_pid(void) {
+    process_control_block_t* current = scheduler_get_current();
+    return current ? current->pid : 0;
+}
+
+static ioring_t* ioring_lookup(uint64_t ring_id) {
+    if (ring_id >= IORING_MAX_RINGS || !rings[ring_id].active) {
+        return NULL;
+    }
+    return &rings[ring_id];
+}
+
+// File I/O on one of the ring owner's descriptors, at an explicit offset
+// or at the description's shared position
+static int64_t ioring_fs_rw(const ioring_t* ring, const ioring_sqe_t* sqe) {
+    if (sqe->fd > INT32_MAX) return IORING_ERR_BADF;
+    if (!sqe->addr && sqe->len) return IORING_ERR_INVAL;
+    file_t* file = fs_fd_get(ring->owner_pid, (int)sqe->fd);
+    if (!file) return IORING_ERR_BADF;
+
+    int result;
+    if (sqe->opcode == IORING_OP_FS_READ) {
+        result = sqe->off == IORING_OFF_CURRENT ? fs_read(file, (void*)sqe->addr, sqe->len)
+                                                : fs_pread(file, (void*)sqe->addr, sqe->len, sqe->off);
+    } else {
+        result = sqe->off == IORING_OFF_CURRENT ? fs_write(file, (const void*)sqe->addr, sqe->len)
+                                                : fs_pwrite(file, (const void*)sqe->addr, sqe->len, sqe->off);
+    }
+    // The last reference if the owner closed the descriptor meanwhile;
+    // releasing it may sleep, which the ring lock allows
+    fs_close(file);
+    return result < 0 ? IORING_ERR_IO : result;
+}
+
+static int64_t ioring_execute(const ioring_t* ring, const ioring_sqe_t* sqe) {
+    switch (sqe->opcode) {
+        case IORING_OP_NOP:
+            return 0;
+        case IORING_OP_FS_READ:
+        case IORING_OP_FS_WRITE:
+            return ioring_fs_rw(ring, sqe);
+        case IORING_OP_NET_SEND:
+            if (!sqe->addr && sqe->len) return IORING_ERR_INVAL;
+            return network_send(sqe->fd, (const void*)sqe->addr, sqe->len) ? (int64_t)sqe->len : IORING_ERR_IO;
+        case IORING_OP_IPC_SEND:
+            if (!sqe->addr && sqe->len) return IORING_ERR_INVAL;
+            return ipc_send_message(sqe->fd, ring->owner_pid, sqe->off, (const void*)sqe->addr, sqe->len)
+                ? (int64_t)sqe->len : IORING_ERR_IO;
+        default:
+            return IORING_ERR_INVAL;
+    }
+}
+
+// Consume up to max SQEs, posting one CQE each. Stops early when the CQ is
+// full so completions are never dropped; the remaining SQEs stay queued.
+static uint32_t ioring_submit(ioring_t* ring, uint32_t max) {
+    uint32_t submitted = 0;
+
+    mutex_lock(&ring->lock);
+    if (!ring->active) {
+        mutex_unlock(&ring->lock);
+        return 0;
+    }
+    ioring_queue_t* sq = &ring->shared->sq;
+    ioring_queue_t* cq = &ring->shared->cq;
+    uint32_t head = sq->head;
+    uint32_t tail = load_acquire(&sq->tail);
+    uint32_t cq_tail = cq->tail;
+
+    while (head != tail && submitted < max) {
+        if (cq_tail - load_acquire(&cq->head) >= cq->entries) {
+            ring->stats.cq_full_stalls++;
+            break;
+        }
+
+        // Copy before releasing the slot: the process may refill it at once
+        ioring_sqe_t sqe = ring->sqes[head & sq->mask];
+        store_release(&sq->head, ++head);
+
+        ioring_cqe_t* cqe = &ring->cqes[cq_tail & cq->mask];
+        cqe->user_data = sqe.user_data;
+        cqe->res = ioring_execute(ring, &sqe);
+        if (cqe->res == IORING_ERR_INVAL) sq->dropped++;
+        store_release(&cq->tail, ++cq_tail);
+
+        submitted++;
+    }
+
+    ring->stats.submitted += submitted;
+    ring->stats.completed += submitted;
+    mutex_unlock(&ring->lock);
+    return submitted;
+}
+
+static bool ioring_is_sqpoll(const ioring_t* ring) {
+    return ring->active && (ring->flags & IORING_SETUP_SQPOLL);
+}
+
+// Set or clear IORING_SQ_NEED_WAKEUP. When setting, returns whether SQEs
+// arrived in the meantime: a submission racing with the flag store is either
+// seen by this re-check or sees the flag and wakes the poller.
+static bool ioring_sqpoll_park(ioring_t* ring, bool park) {
+    bool pending = false;
+    mutex_lock(&ring->lock);
+    if (ring->active) {
+        ioring_queue_t* sq = &ring->shared->sq;
+        if (park) {
+            __atomic_fetch_or(&sq->flags, IORING_SQ_NEED_WAKEUP, __ATOMIC_SEQ_CST);
+            pending = __atomic_load_n(&sq->tail, __ATOMIC_SEQ_CST) != sq->head;
+        } else {
+            __atomic_fetch_and(&sq->flags, ~IORING_SQ_NEED_WAKEUP, __ATOMIC_SEQ_CST);
+        }
+    }
+    mutex_unlock(&ring->lock);
+    return pending;
+}
+
+// Kernel-side SQ poller shared by every IORING_SETUP_SQPOLL ring. Spins while
+// there is work, then advertises IORING_SQ_NEED_WAKEUP and parks.
+static void ioring_sqpoll_main(void) {
+    uint64_t idle_since = time_get_ns();
+
+    while (1) {
+        uint32_t work = 0;
+        for (uint32_t i = 0; i < IORING_MAX_RINGS; i++) {
+            if (ioring_is_sqpoll(&rings[i])) {
+                work += ioring_submit(&rings[i], UINT32_MAX);
+            }
+        }
+
+        if (work) {
+            idle_since = time_get_ns();
+            continue;
+        }
+        if (time_get_ns() - idle_since < IORING_SQPOLL_IDLE_NS) {
+            scheduler_yield();
+            continue;
+        }
+
+        // Blocked before the flags go up: a wakeup sent as soon as a
+        // process sees one is then never lost. Sleeping on a ring lock in
+        // between only wakes the poller early.
+        scheduler_prepare_block();
+        bool pending = false;
+        for (uint32_t i = 0; i < IORING_MAX_RINGS; i++) {
+            if (ioring_is_sqpoll(&rings[i]) && ioring_sqpoll_park(&rings[i], true)) {
+                pending = true;
+            }
+        }
+        if (pending) {
+            scheduler_wakeup(sqpoll_task);
+        } else {
+            scheduler_yield();
+        }
+        for (uint32_t i = 0; i < IORING_MAX_RINGS; i++) {
+            if (ioring_is_sqpoll(&rings[i])) {
+                ioring_sqpoll_park(&rings[i], false);
+            }
+        }
+        idle_since = time_get_ns();
+    }
+}
+
+static bool ioring_start_sqpoll(void) {
+    if (sqpoll_task) return true;
+
+    int pid = process_create(ioring_sqpoll_main, IORING_SQPOLL_STACK_SIZE);
+    if (pid < 0) return false;
+
+    sqpoll_task = process_get((uint64_t)pid);
+    scheduler_set_priority(sqpoll_task, PRIORITY_LOW);
+    return true;
+}
+
+// Tear down owner's ring. Taking the ring lock waits out an in-flight
+// submit before the region goes; the owner is checked under it, since
+// the slot may have been torn down and set up again meanwhile.
+static bool ioring_teardown(uint64_t ring_id, uint64_t owner_pid) {
+    if (ring_id >= IORING_MAX_RINGS) return false;
+    ioring_t* ring = &rings[ring_id];
+
+    mutex_lock(&ring->lock);
+    bool owned = ring->active && ring->owner_pid == owner_pid;
+    ioring_shared_t* region = owned ? ring->shared : NULL;
+    if (owned) {
+        ring->active = false;
+        ring->shared = NULL;
+    }
+    mutex_unlock(&ring->lock);
+
+    if (region) memory_free(region);
+    return owned;
+}
+
+void ioring_init(void) {
+    uint64_t flags = spin_lock_irqsave(&rings_lock);
+    memset(rings, 0, sizeof(rings));
+    for (uint32_t i = 0; i < IORING_MAX_RINGS; i++) {
+        mutex_init(&rings[i].lock);
+    }
+    spin_unlock_irqrestore(&rings_lock, flags);
+}
+
+int64_t ioring_setup(uint32_t sq_entries, uint32_t flags, ioring_shared_t** shared) {
+    if (!sq_entries || sq_entries > IORING_MAX_ENTRIES || !shared) {
+        return -1;
+    }
+
+    uint32_t sq_size = round_up_pow2(sq_entries);
+    uint32_t cq_size = sq_size * 2;
+    uint64_t sq_offset = sizeof(ioring_shared_t);
+    uint64_t cq_offset = sq_offset + (uint64_t)sq_size * sizeof(ioring_sqe_t);
+    uint64_t region_size = cq_offset + (uint64_t)cq_size * sizeof(ioring_cqe_t);
+
+    // Single address space for now: the region is visible to the process
+    // as allocated. Once per-process page tables exist it is mapped into
+    // both the kernel and the owner.
+    ioring_shared_t* region = memory_alloc(region_size);
+    if (!region) return -1;
+    memset(region, 0, region_size);
+    region->sq.mask = sq_size - 1;
+    region->sq.entries = sq_size;
+    region->sq.offset = sq_offset;
+    region->cq.mask = cq_size - 1;
+    region->cq.entries = cq_size;
+    region->cq.offset = cq_offset;
+    // The poller may be parked already: until it has seen this ring, a
+    // submission must wake it
+    if (flags & IORING_SETUP_SQPOLL) {
+        region->sq.flags = IORING_SQ_NEED_WAKEUP;
+    }
+
+    // Reserve a free slot, then fill it in under its own lock, which a
+    // consumer still waiting on it from the slot's last ring may hold
+    uint64_t lock_flags = spin_lock_irqsave(&rings_lock);
+    int64_t id = -1;
+    for (uint32_t i = 0; i < IORING_MAX_RINGS; i++) {
+        if (!rings[i].active && !rings[i].reserved) {
+            id = i;
+            rings[i].reserved = true;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&rings_lock, lock_flags);
+    if (id < 0) {
+        memory_free(region);
+        return -1;
+    }
+
+    ioring_t* ring = &rings[id];
+    uint64_t owner_pid = current_pid();
+    mutex_lock(&ring->lock);
+    ring->owner_pid = owner_pid;
+    ring->flags = flags;
+    ring->shared = region;
+    ring->sqes = ioring_sqes(region);
+    ring->cqes = ioring_cqes(region);
+    memset(&ring->stats, 0, sizeof(ring->stats));
+    ring->active = true;
+    mutex_unlock(&ring->lock);
+
+    lock_flags = spin_lock_irqsave(&rings_lock);
+    ring->reserved = false;
+    spin_unlock_irqrestore(&rings_lock, lock_flags);
+
+    if (flags & IORING_SETUP_SQPOLL) {
+        if (!ioring_start_sqpoll()) {
+            ioring_teardown((uint64_t)id, owner_pid);
+            return -1;
+        }
+        scheduler_wakeup(sqpoll_task);
+    }
+
+    *shared = region;
+    return id;
+}
+
+int64_t ioring_enter(uint64_t ring_id, uint32_t to_submit, uint32_t flags) {
+    ioring_t* ring = ioring_lookup(ring_id);
+    if (!ring || ring->owner_pid != current_pid()) {
+        return -1;
+    }
+    ring->stats.enters++;
+
+    // With a poller the SQ is consumed in the background; entering is only
+    // needed to wake it once it has parked
+    if (ring->flags & IORING_SETUP_SQPOLL) {
+        if ((flags & IORING_ENTER_SQ_WAKEUP) && sqpoll_task) {
+            ring->stats.sqpoll_wakeups++;
+            scheduler_wakeup(sqpoll_task);
+        }
+        return 0;
+    }
+
+    return ioring_submit(ring, to_submit);
+}
+
+bool ioring_destroy(uint64_t ring_id) {
+    ioring_t* ring = ioring_lookup(ring_id);
+    if (!ring) return false;
+    return ioring_teardown(ring_id, current_pid());
+}
+
+void ioring_release_process(uint64_t pid) {
+    for (uint32_t i = 0; i < IORING_MAX_RINGS; i++) {
+        if (rings[i].active && rings[i].owner_pid == pid) {
+            ioring_teardown(i, pid);
+        }
+    }
+}
+
+bool ioring_get_stats(uint64_t ring_id, ioring_stats_t* stats) {
+    ioring_t* ring = ioring_lookup(ring_id);
+    if (!ring || !stats) return false;
+    memcpy(stats, &ring->stats, sizeof(ioring_stats_t));
+    return true;
+}
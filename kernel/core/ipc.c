@@ -1,12 +1,16 @@
 #include "ipc.h"
 #include "process.h"
 #include "memory.h"
+#include "trace.h"
 #include <string.h>
 
 #define MAX_IPC_CHANNELS 1024
 #define MAX_IPC_MESSAGES 1024
 #define IPC_MESSAGE_SIZE 4096
 
+TRACE_EVENT(ipc, ipc_send, "channel", "sender", "receiver", "size");
+TRACE_EVENT(ipc, ipc_receive, "channel", "receiver", "sender", "size");
+
 // IPC message structure
 typedef struct {
     uint64_t sender_pid;
@@ -93,6 +97,7 @@ bool ipc_send_message(uint64_t channel_id, uint64_t sender_pid, uint64_t receive
     // Copy message data
     memcpy(message->data, data, size);
 
+    TRACE(ipc_send, channel_id, sender_pid, receiver_pid, size);
     return true;
 }
 
@@ -115,6 +120,7 @@ bool ipc_receive_message(uint64_t channel_id, uint64_t receiver_pid, void* data,
             memcpy(data, message->data, message->size);
             *size = message->size;
             message->delivered = true;
+            TRACE(ipc_receive, channel_id, receiver_pid, message->sender_pid, message->size);
 
             return true;
         }
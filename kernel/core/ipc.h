@@ -17,4 +17,10 @@ void ipc_init(void);
 bool ipc_send(uint32_t receiver_pid, const void* data, uint32_t size);
 bool ipc_receive(uint32_t* sender_pid, void* buffer, uint32_t* size);
 
+// Channel-based messaging
+uint64_t ipc_create_channel(uint64_t owner_pid);
+bool ipc_destroy_channel(uint64_t channel_id);
+bool ipc_send_message(uint64_t channel_id, uint64_t sender_pid, uint64_t receiver_pid, const void* data, uint64_t size);
+bool ipc_receive_message(uint64_t channel_id, uint64_t receiver_pid, void* data, uint64_t* size);
+
 #endif // IPC_H 
\ No newline at end of file
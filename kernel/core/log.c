@@ -1 +1,328 @@
- 
\ No newline at end of file
+#include "log.h"
+#include "format.h"
+#include "time.h"
+#include "spinlock.h"
+#include "drivers/console.h"
+#include "arch/cpu.h"
+#include <stdbool.h>
+
+// Binary log: the hot path stores the format pointer, raw argument values
+// and a timestamp into a ring owned by the calling CPU. Nothing is
+// formatted until a reader drains the rings.
+
+#define LOG_RING_WORDS       2048   // 16KB per CPU, power of two
+#define LOG_MAX_STRING       128    // Bytes copied per %s argument, with NUL
+#define LOG_MAX_STRING_BYTES 256    // Per record
+#define LOG_LINE_MAX         256
+#define LOG_FMT_CACHE_SIZE   64     // Per CPU, power of two
+
+// Record header, three 64-bit words. Followed by nargs argument words and
+// then the bytes of any %s arguments: those are copied because the
+// caller's buffer may be gone by the time the record is formatted.
+typedef struct {
+    uint16_t words;         // Whole record, in 64-bit words
+    uint8_t level;
+    uint8_t nargs;
+    uint16_t string_mask;   // Bit i: args[i] is an offset into the string bytes
+    uint16_t flags;
+    uint64_t timestamp_ns;
+    const char* fmt;
+} log_record_t;
+
+#define LOG_HEADER_WORDS (sizeof(log_record_t) / sizeof(uint64_t))
+#define LOG_RECORD_MAX_WORDS (LOG_HEADER_WORDS + FORMAT_MAX_ARGS + LOG_MAX_STRING_BYTES / 8)
+
+// Filler at the end of the ring when a record does not fit before the wrap;
+// only its first word is written
+#define LOG_RECORD_PAD 0x1
+
+_Static_assert(sizeof(log_record_t) == 24, "log record header must be three words");
+
+// Parsed argument classes of recently used formats, so the hot path does
+// not rescan the format string on every call
+typedef struct {
+    const char* fmt;
+    uint32_t nargs;
+    format_arg_t args[FORMAT_MAX_ARGS];
+} log_fmt_cache_t;
+
+// Single producer (the owning CPU, with interrupts masked) and a single
+// consumer (the reader holding reader_lock)
+typedef struct {
+    volatile uint64_t head;
+    volatile uint64_t tail;
+    uint64_t recorded;
+    uint64_t dropped;
+    uint64_t truncated;
+    log_fmt_cache_t fmt_cache[LOG_FMT_CACHE_SIZE];
+    uint64_t words[LOG_RING_WORDS];
+} __attribute__((aligned(64))) log_ring_t;
+
+static log_ring_t rings[MAX_CPUS];
+static spinlock_t reader_lock = SPINLOCK_INIT;
+static volatile log_level_t min_level = LOG_LEVEL_INFO;
+static uint64_t records_read = 0;
+
+static const char level_tags[] = { 'I', 'W', 'E', 'P' };
+
+void log_init(void) {
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        log_ring_t* ring = &rings[cpu];
+        ring->head = 0;
+        ring->tail = 0;
+        ring->recorded = 0;
+        ring->dropped = 0;
+        ring->truncated = 0;
+        for (uint32_t i = 0; i < LOG_FMT_CACHE_SIZE; i++) {
+            ring->fmt_cache[i].fmt = NULL;
+        }
+    }
+    records_read = 0;
+}
+
+void log_set_level(log_level_t level) {
+    min_level = level;
+}
+
+static const log_fmt_cache_t* log_parse_fmt(log_ring_t* ring, const char* fmt) {
+    log_fmt_cache_t* entry = &ring->fmt_cache[((uintptr_t)fmt >> 3) & (LOG_FMT_CACHE_SIZE - 1)];
+    if (entry->fmt != fmt) {
+        entry->nargs = format_parse_args(fmt, entry->args, FORMAT_MAX_ARGS);
+        entry->fmt = fmt;
+    }
+    return entry;
+}
+
+static void log_record(log_level_t level, const char* fmt, va_list ap) {
+    if (level < min_level || !fmt) return;
+
+    uint64_t flags = arch_irq_save();
+    log_ring_t* ring = &rings[arch_cpu_id()];
+    const log_fmt_cache_t* parsed = log_parse_fmt(ring, fmt);
+
+    // Capture the arguments; strings are measured now and copied below
+    uint64_t args[FORMAT_MAX_ARGS];
+    const char* strings[FORMAT_MAX_ARGS];
+    uint32_t string_lens[FORMAT_MAX_ARGS];
+    uint16_t string_mask = 0;
+    uint32_t string_bytes = 0;
+    bool truncated = false;
+
+    for (uint32_t i = 0; i < parsed->nargs; i++) {
+        const format_arg_t* arg = &parsed->args[i];
+        switch (arg->cls) {
+            case FORMAT_ARG_INT:
+                args[i] = arg->size == 8 ? (uint64_t)va_arg(ap, long long) : (uint64_t)(int64_t)va_arg(ap, int);
+                break;
+            case FORMAT_ARG_UINT:
+                args[i] = arg->size == 8 ? va_arg(ap, unsigned long long) : va_arg(ap, unsigned int);
+                break;
+            case FORMAT_ARG_POINTER:
+                args[i] = (uint64_t)(uintptr_t)va_arg(ap, void*);
+                break;
+            case FORMAT_ARG_STRING: {
+                const char* s = va_arg(ap, const char*);
+                if (!s) s = "(null)";
+                uint32_t len = 0;
+                while (s[len] && len < LOG_MAX_STRING - 1) len++;
+                if (s[len]) truncated = true;
+                if (string_bytes == LOG_MAX_STRING_BYTES) {
+                    // No room left at all: log an empty string instead
+                    args[i] = (uint64_t)(uintptr_t)"";
+                    truncated = true;
+                    break;
+                }
+                if (string_bytes + len + 1 > LOG_MAX_STRING_BYTES) {
+                    len = LOG_MAX_STRING_BYTES - string_bytes - 1;
+                    truncated = true;
+                }
+                strings[i] = s;
+                string_lens[i] = len;
+                args[i] = string_bytes;
+                string_mask |= (uint16_t)(1U << i);
+                string_bytes += len + 1;
+                break;
+            }
+        }
+    }
+
+    uint32_t words = LOG_HEADER_WORDS + parsed->nargs + (string_bytes + 7) / 8;
+    uint64_t tail = ring->tail;
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t offset = tail & (LOG_RING_WORDS - 1);
+    uint32_t contiguous = LOG_RING_WORDS - offset;
+    uint32_t needed = words + (contiguous < words ? contiguous : 0);
+
+    if (LOG_RING_WORDS - (tail - head) < needed) {
+        ring->dropped++;
+        arch_irq_restore(flags);
+        return;
+    }
+
+    if (contiguous < words) {
+        log_record_t* pad = (log_record_t*)&ring->words[offset];
+        pad->words = (uint16_t)contiguous;
+        pad->flags = LOG_RECORD_PAD;
+        tail += contiguous;
+        offset = 0;
+    }
+
+    log_record_t* record = (log_record_t*)&ring->words[offset];
+    record->words = (uint16_t)words;
+    record->level = (uint8_t)level;
+    record->nargs = (uint8_t)parsed->nargs;
+    record->string_mask = string_mask;
+    record->flags = 0;
+    record->timestamp_ns = time_get_ns();
+    record->fmt = fmt;
+
+    uint64_t* arg_words = &ring->words[offset + LOG_HEADER_WORDS];
+    for (uint32_t i = 0; i < parsed->nargs; i++) {
+        arg_words[i] = args[i];
+    }
+
+    char* string_area = (char*)&arg_words[parsed->nargs];
+    for (uint32_t i = 0; i < parsed->nargs; i++) {
+        if (!(string_mask & (1U << i))) continue;
+        char* dst = string_area + args[i];
+        for (uint32_t j = 0; j < string_lens[i]; j++) {
+            dst[j] = strings[i][j];
+        }
+        dst[string_lens[i]] = '\0';
+    }
+
+    __atomic_store_n(&ring->tail, tail + words, __ATOMIC_RELEASE);
+    ring->recorded++;
+    if (truncated) ring->truncated++;
+    arch_irq_restore(flags);
+}
+
+// Skip filler and return the oldest record of a ring, or NULL if empty.
+// Caller holds reader_lock.
+static const log_record_t* log_peek(log_ring_t* ring) {
+    while (1) {
+        uint64_t head = ring->head;
+        if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) return NULL;
+
+        const log_record_t* record = (const log_record_t*)&ring->words[head & (LOG_RING_WORDS - 1)];
+        if (!(record->flags & LOG_RECORD_PAD)) return record;
+        __atomic_store_n(&ring->head, head + record->words, __ATOMIC_RELEASE);
+    }
+}
+
+size_t log_read(char* buf, size_t size) {
+    uint64_t copy[LOG_RECORD_MAX_WORDS];
+    if (size < 2) return 0;     // No room for even an empty line
+
+    // Take the oldest record across CPUs and copy it out, so formatting
+    // happens without the lock and the ring space is released at once
+    uint64_t flags = spin_lock_irqsave(&reader_lock);
+    log_ring_t* oldest_ring = NULL;
+    const log_record_t* oldest = NULL;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        const log_record_t* record = log_peek(&rings[cpu]);
+        if (record && (!oldest || record->timestamp_ns < oldest->timestamp_ns)) {
+            oldest = record;
+            oldest_ring = &rings[cpu];
+        }
+    }
+    if (!oldest) {
+        spin_unlock_irqrestore(&reader_lock, flags);
+        return 0;
+    }
+
+    uint32_t cpu = (uint32_t)(oldest_ring - rings);
+    const uint64_t* src = (const uint64_t*)oldest;
+    for (uint32_t i = 0; i < oldest->words; i++) {
+        copy[i] = src[i];
+    }
+    __atomic_store_n(&oldest_ring->head, oldest_ring->head + oldest->words, __ATOMIC_RELEASE);
+    records_read++;
+    spin_unlock_irqrestore(&reader_lock, flags);
+
+    const log_record_t* record = (const log_record_t*)copy;
+    uint64_t* args = &copy[LOG_HEADER_WORDS];
+    const char* string_area = (const char*)&args[record->nargs];
+    for (uint32_t i = 0; i < record->nargs; i++) {
+        if (record->string_mask & (1U << i)) {
+            args[i] = (uint64_t)(uintptr_t)(string_area + args[i]);
+        }
+    }
+
+    uint64_t prefix_args[] = {
+        record->timestamp_ns / 1000000000ULL,
+        (record->timestamp_ns / 1000) % 1000000,
+        (uint64_t)level_tags[record->level & 3],
+        cpu,
+    };
+    size_t len = format_args(buf, size, "[%5llu.%06llu] %c%u: ", prefix_args, 4);
+    if (len < size) {
+        len += format_args(buf + len, size - len, record->fmt, args, record->nargs);
+    }
+
+    // Always end on a newline, truncating the message if needed
+    if (len + 1 >= size) len = size - 2;
+    if (!len || buf[len - 1] != '\n') buf[len++] = '\n';
+    buf[len] = '\0';
+    return len;
+}
+
+void log_flush(void) {
+    char line[LOG_LINE_MAX];
+    size_t len;
+    while ((len = log_read(line, sizeof(line))) != 0) {
+        console_write_buffer(line, len);
+    }
+}
+
+void log_get_stats(log_stats_t* stats) {
+    if (!stats) return;
+    stats->recorded = 0;
+    stats->dropped = 0;
+    stats->truncated = 0;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        stats->recorded += rings[cpu].recorded;
+        stats->dropped += rings[cpu].dropped;
+        stats->truncated += rings[cpu].truncated;
+    }
+    stats->read = records_read;
+}
+
+void log_info(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    log_record(LOG_LEVEL_INFO, fmt, ap);
+    va_end(ap);
+}
+
+void log_warn(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    log_record(LOG_LEVEL_WARN, fmt, ap);
+    va_end(ap);
+}
+
+void log_error(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    log_record(LOG_LEVEL_ERROR, fmt, ap);
+    va_end(ap);
+}
+
+// Switch the console to synchronous output, write out everything still
+// buffered, then the panic message itself, and stop the CPU
+void log_panic(const char* fmt, ...) {
+    arch_irq_save();
+    console_panic();
+    log_flush();
+
+    va_list ap;
+    va_start(ap, fmt);
+    log_record(LOG_LEVEL_PANIC, fmt, ap);
+    va_end(ap);
+    log_flush();
+
+    while (1) {
+        arch_cpu_idle();
+    }
+}
@@ -3,6 +3,22 @@
 
 #include <stdint.h>
 #include <stdarg.h>
+#include <stddef.h>
+
+// Log levels, lowest first
+typedef enum {
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_PANIC
+} log_level_t;
+
+typedef struct {
+    uint64_t recorded;
+    uint64_t dropped;       // Ring full
+    uint64_t truncated;     // Too many arguments or string bytes
+    uint64_t read;
+} log_stats_t;
 
 void log_init(void);
 void log_info(const char* fmt, ...);
@@ -10,4 +26,16 @@ void log_warn(const char* fmt, ...);
 void log_error(const char* fmt, ...);
 void log_panic(const char* fmt, ...);
 
-#endif // LOG_H 
\ No newline at end of file
+// Records below this level are discarded at the call site
+void log_set_level(log_level_t level);
+
+// Format the oldest record (across all CPUs) into buf as one line ending in
+// '\n'. Returns its length, 0 if the log is empty or size is below 2.
+size_t log_read(char* buf, size_t size);
+
+// Format everything recorded so far to the console
+void log_flush(void);
+
+void log_get_stats(log_stats_t* stats);
+
+#endif // LOG_H
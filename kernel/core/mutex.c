@@ -0,0 +1,76 @@
+#include "mutex.h"
+#include "scheduler.h"
+#include <stddef.h>
+
+// Lives on the waiting task's stack until granted is set
+typedef struct mutex_waiter {
+    process_control_block_t* task;
+    struct mutex_waiter* next;
+    volatile bool granted;
+} mutex_waiter_t;
+
+void mutex_init(mutex_t* mutex) {
+    spinlock_init(&mutex->lock);
+    mutex->locked = false;
+    mutex->head = NULL;
+    mutex->tail = NULL;
+}
+
+bool mutex_trylock(mutex_t* mutex) {
+    uint64_t flags = spin_lock_irqsave(&mutex->lock);
+    bool taken = !mutex->locked;
+    mutex->locked = true;
+    spin_unlock_irqrestore(&mutex->lock, flags);
+    return taken;
+}
+
+void mutex_lock(mutex_t* mutex) {
+    process_control_block_t* current = scheduler_get_current();
+    mutex_waiter_t waiter = { current, NULL, false };
+
+    uint64_t flags = spin_lock_irqsave(&mutex->lock);
+    if (!mutex->locked || !current) {
+        bool taken = !mutex->locked;
+        mutex->locked = true;
+        spin_unlock_irqrestore(&mutex->lock, flags);
+        // Without a task to put to sleep (early boot, the idle loop) spin
+        while (!taken) {
+            arch_cpu_relax();
+            taken = mutex_trylock(mutex);
+        }
+        return;
+    }
+    if (mutex->tail) {
+        mutex->tail->next = &waiter;
+    } else {
+        mutex->head = &waiter;
+    }
+    mutex->tail = &waiter;
+    spin_unlock_irqrestore(&mutex->lock, flags);
+
+    while (1) {
+        scheduler_prepare_block();
+        if (__atomic_load_n(&waiter.granted, __ATOMIC_SEQ_CST)) break;
+        scheduler_yield();
+    }
+    scheduler_wakeup(current);
+}
+
+void mutex_unlock(mutex_t* mutex) {
+    process_control_block_t* next = NULL;
+
+    uint64_t flags = spin_lock_irqsave(&mutex->lock);
+    mutex_waiter_t* waiter = mutex->head;
+    if (waiter) {
+        mutex->head = waiter->next;
+        if (!mutex->head) mutex->tail = NULL;
+        next = waiter->task;
+        // The waiter may return as soon as it sees this: touch it no more
+        __atomic_store_n(&waiter->granted, true, __ATOMIC_SEQ_CST);
+    } else {
+        mutex->locked = false;
+    }
+    spin_unlock_irqrestore(&mutex->lock, flags);
+
+    if (next) scheduler_wakeup(next);
+}
@@ -0,0 +1,28 @@
+#ifndef MUTEX_H
+#define MUTEX_H
+
+#include <stdbool.h>
+#include "spinlock.h"
+
+struct process_control_block;
+struct mutex_waiter;
+
+// Sleeping lock for long critical sections: the holder runs with
+// interrupts enabled and may block, and waiters sleep in FIFO order
+// instead of spinning. Ownership is handed straight to the first waiter.
+// Not for interrupt context.
+typedef struct {
+    spinlock_t lock;                    // Guards the fields below
+    bool locked;
+    struct mutex_waiter* head;
+    struct mutex_waiter* tail;
+} mutex_t;
+
+#define MUTEX_INIT { SPINLOCK_INIT, false, NULL, NULL }
+
+void mutex_init(mutex_t* mutex);
+void mutex_lock(mutex_t* mutex);
+bool mutex_trylock(mutex_t* mutex);
+void mutex_unlock(mutex_t* mutex);
+
+#endif // MUTEX_H
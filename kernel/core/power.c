@@ -1,5 +1,6 @@
 #include "power.h"
 #include "driver.h"
+#include "time.h"
 #include <string.h>
 
 #define MAX_POWER_STATES 8
@@ -37,7 +38,7 @@ void power_init(void) {
 // Register power state
 bool power_register_state(power_state_t state, const char* name, uint64_t power_usage) {
     // Find free state slot
-    uint64_t index = 0;
+    uint64_t index = MAX_POWER_STATES;
     for (uint64_t i = 0; i < MAX_POWER_STATES; i++) {
         if (!power_states[i].active) {
             index = i;
@@ -45,7 +46,7 @@ bool power_register_state(power_state_t state, const char* name, uint64_t power_
         }
     }
 
-    if (index == 0) return false; // No free slots
+    if (index == MAX_POWER_STATES) return false; // No free slots
 
     // Initialize state
     power_state_info_t* state_info = &power_states[index];
@@ -57,6 +58,11 @@ bool power_register_state(power_state_t state, const char* name, uint64_t power_
     return true;
 }
 
+// States in which the timekeeper is frozen
+static bool power_state_is_suspend(power_state_t state) {
+    return state == POWER_STATE_SLEEP || state == POWER_STATE_HIBERNATE;
+}
+
 // Set power state
 bool power_set_state(power_state_t state) {
     // Find state
@@ -70,14 +76,23 @@ bool power_set_state(power_state_t state) {
 
     if (!state_info) return false;
 
+    bool was_suspended = power_state_is_suspend(current_state);
+    bool suspending = power_state_is_suspend(state);
+
+    // Continue the timeline before anyone looks at the clock again
+    if (was_suspended && !suspending) time_resume();
+
     // Notify power state change
     power_event_t event = {
         .type = POWER_EVENT_STATE_CHANGE,
         .state = state,
-        .timestamp = 0 // TODO: Get system time
+        .timestamp = time_get_ns()
     };
     power_notify_event(&event);
 
+    // Handlers run on a live clock; freeze it last on the way down
+    if (suspending && !was_suspended) time_suspend();
+
     // Update current state
     current_state = state;
 
@@ -92,7 +107,7 @@ power_state_t power_get_state(void) {
 // Register power event handler
 uint64_t power_register_event_handler(power_event_t type, const char* name, power_event_handler_t handler, void* context) {
     // Find free event slot
-    uint64_t index = 0;
+    uint64_t index = MAX_POWER_EVENTS;
     for (uint64_t i = 0; i < MAX_POWER_EVENTS; i++) {
         if (!power_events[i].active) {
             index = i;
@@ -100,7 +115,7 @@ uint64_t power_register_event_handler(power_event_t type, const char* name, powe
         }
     }
 
-    if (index == 0) return 0; // No free slots
+    if (index == MAX_POWER_EVENTS) return 0; // No free slots
 
     // Initialize event handler
     power_event_info_t* event_info = &power_events[index];
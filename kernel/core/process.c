@@ -1,66 +1,281 @@
 #include "process.h"
+#include "fs.h"
+#include "ioring.h"
 #include "memory.h"
+#include "scheduler.h"
+#include "spinlock.h"
+#include "time.h"
+#include "arch/cpu.h"
 #include <stddef.h>
 #include <string.h>
 
-// Simple process control block structure
-#define MAX_PROCESSES 32
+// PID space: allocated from a bitmap that doubles as the task count grows,
+// PCBs found through a chained hash table keyed by PID
+#define PID_FIRST            1
+#define PID_MAX              (1ULL << 22)
+#define PID_BITMAP_INITIAL   1024
+#define PID_HASH_INITIAL     64
 
-typedef struct {
-    int pid;
-    void* stack;
-    size_t stack_size;
-    int used;
-} simple_process_t;
+static uint64_t* pid_bitmap = NULL;
+static uint64_t pid_bitmap_bits = 0;
+static uint64_t last_pid = 0;
 
-static simple_process_t processes[MAX_PROCESSES];
-static int next_pid = 1;
+static process_control_block_t** pid_hash = NULL;
+static uint64_t pid_hash_size = 0;
+static uint64_t process_count = 0;
 
-void process_init(void) {
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        processes[i].pid = 0;
-        processes[i].stack = NULL;
-        processes[i].stack_size = 0;
-        processes[i].used = 0;
+static spinlock_t process_lock = SPINLOCK_INIT;
+
+// Per-process state kept by other subsystems. Weak so that hosted builds
+// of the scheduler link without them.
+#pragma weak fs_release_process
+#pragma weak ioring_release_process
+
+static inline uint64_t pid_hash_index(uint64_t pid, uint64_t size) {
+    return pid & (size - 1);
+}
+
+// Double the bitmap; keeps at least half of the PID space free so the
+// next-fit scan below finds a slot within a word or two
+static bool pid_bitmap_grow(void) {
+    uint64_t new_bits = pid_bitmap_bits ? pid_bitmap_bits * 2 : PID_BITMAP_INITIAL;
+    if (new_bits > PID_MAX) return false;
+
+    uint64_t* bitmap = memory_alloc(new_bits / 8);
+    if (!bitmap) return false;
+
+    memset(bitmap, 0, new_bits / 8);
+    if (pid_bitmap) {
+        memcpy(bitmap, pid_bitmap, pid_bitmap_bits / 8);
+        memory_free(pid_bitmap);
+    } else {
+        bitmap[0] = (1ULL << PID_FIRST) - 1; // PID 0 is never handed out
     }
-    next_pid = 1;
+
+    pid_bitmap = bitmap;
+    pid_bitmap_bits = new_bits;
+    return true;
 }
 
-int process_create(void (*entry)(void), size_t stack_size) {
-    int slot = -1;
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (!processes[i].used) {
-            slot = i;
-            break;
+// Rehash into a table twice the size once the load factor reaches 1
+static bool pid_hash_grow(void) {
+    uint64_t new_size = pid_hash_size ? pid_hash_size * 2 : PID_HASH_INITIAL;
+    process_control_block_t** table = memory_alloc(new_size * sizeof(*table));
+    if (!table) return false;
+
+    memset(table, 0, new_size * sizeof(*table));
+    for (uint64_t i = 0; i < pid_hash_size; i++) {
+        process_control_block_t* process = pid_hash[i];
+        while (process) {
+            process_control_block_t* next = process->hash_next;
+            uint64_t index = pid_hash_index(process->pid, new_size);
+            process->hash_next = table[index];
+            table[index] = process;
+            process = next;
+        }
+    }
+
+    if (pid_hash) memory_free(pid_hash);
+    pid_hash = table;
+    pid_hash_size = new_size;
+    return true;
+}
+
+// Scan one bitmap range for a clear bit, word at a time
+static uint64_t pid_find_free(uint64_t from, uint64_t to) {
+    uint64_t pid = from;
+    while (pid < to) {
+        uint64_t word = ~pid_bitmap[pid / 64] & (~0ULL << (pid % 64));
+        if (word) {
+            uint64_t found = (pid & ~63ULL) + __builtin_ctzll(word);
+            return found < to ? found : 0;
         }
+        pid = (pid & ~63ULL) + 64;
     }
-    if (slot == -1) {
-        return -1; // No free slots
+    return 0;
+}
+
+// Next-fit allocation: continue after the last PID handed out so a freed
+// PID is not reused until the space wraps around
+static uint64_t pid_alloc(void) {
+    if ((process_count + 1) * 2 > pid_bitmap_bits) {
+        pid_bitmap_grow();
+    }
+
+    uint64_t pid = pid_find_free(last_pid + 1, pid_bitmap_bits);
+    if (!pid) pid = pid_find_free(PID_FIRST, last_pid + 1);
+    if (!pid) return 0;
+
+    pid_bitmap[pid / 64] |= 1ULL << (pid % 64);
+    last_pid = pid;
+    return pid;
+}
+
+static void pid_free(uint64_t pid) {
+    pid_bitmap[pid / 64] &= ~(1ULL << (pid % 64));
+}
+
+static process_control_block_t* pid_hash_lookup(uint64_t pid) {
+    if (!pid_hash_size) return NULL;
+    process_control_block_t* process = pid_hash[pid_hash_index(pid, pid_hash_size)];
+    while (process && process->pid != pid) {
+        process = process->hash_next;
+    }
+    return process;
+}
+
+static void pid_hash_remove(process_control_block_t* process) {
+    process_control_block_t** link = &pid_hash[pid_hash_index(process->pid, pid_hash_size)];
+    while (*link && *link != process) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) *link = process->hash_next;
+    process->hash_next = NULL;
+}
+
+void process_init(void) {
+    uint64_t flags = spin_lock_irqsave(&process_lock);
+    process_count = 0;
+    last_pid = 0;
+    pid_bitmap_grow();
+    pid_hash_grow();
+    spin_unlock_irqrestore(&process_lock, flags);
+}
+
+int process_create(void (*entry)(void), size_t stack_size) {
+    process_control_block_t* process = memory_alloc(sizeof(process_control_block_t));
+    if (!process) {
+        return -1; // Memory allocation failed
     }
     void* stack = memory_alloc(stack_size);
     if (!stack) {
+        memory_free(process);
         return -1; // Memory allocation failed
     }
-    processes[slot].pid = next_pid++;
-    processes[slot].stack = stack;
-    processes[slot].stack_size = stack_size;
-    processes[slot].used = 1;
-    // TODO: Set up stack frame for process entry if needed
-    (void)entry; // Suppress unused warning
-    return processes[slot].pid;
+
+    memset(process, 0, sizeof(process_control_block_t));
+    process->state = PROCESS_STATE_NEW;
+    process->refcount = 1;          // The PID table's
+    process->priority = PRIORITY_NORMAL;
+    process->memory_start = (uint64_t)stack;
+    process->memory_size = stack_size;
+    process->stack_pointer = (uint64_t)stack + stack_size;
+    process->program_counter = (uint64_t)entry;
+    process->creation_time = time_get_ns();
+    process->cpu = arch_cpu_id();
+
+    process_control_block_t* parent = scheduler_get_current();
+    process->parent_pid = parent ? parent->pid : 0;
+    process->affinity = parent ? parent->affinity : scheduler_get_default_affinity();
+
+    uint64_t flags = spin_lock_irqsave(&process_lock);
+    if (process_count + 1 > pid_hash_size) {
+        pid_hash_grow();
+    }
+    uint64_t pid = pid_alloc();
+    if (!pid) {
+        spin_unlock_irqrestore(&process_lock, flags);
+        memory_free(stack);
+        memory_free(process);
+        return -1; // PID space exhausted
+    }
+    process->pid = pid;
+    uint64_t index = pid_hash_index(pid, pid_hash_size);
+    process->hash_next = pid_hash[index];
+    pid_hash[index] = process;
+    process_count++;
+    spin_unlock_irqrestore(&process_lock, flags);
+
+    scheduler_enqueue(process);
+    return (int)pid;
+}
+
+// Free the PCB and its stack once nothing references it
+static void process_release(process_control_block_t* process) {
+    if (process->memory_start) {
+        memory_free((void*)process->memory_start);
+    }
+    memory_free(process);
+}
+
+void process_hold(process_control_block_t* process) {
+    __atomic_fetch_add(&process->refcount, 1, __ATOMIC_RELAXED);
+}
+
+void process_put(process_control_block_t* process) {
+    if (process && __atomic_sub_fetch(&process->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        process_release(process);
+    }
 }
 
 void process_destroy(int pid) {
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (processes[i].used && processes[i].pid == pid) {
-            if (processes[i].stack) {
-                memory_free(processes[i].stack);
-            }
-            processes[i].pid = 0;
-            processes[i].stack = NULL;
-            processes[i].stack_size = 0;
-            processes[i].used = 0;
-            break;
+    // Rings first, as they use the descriptors; both find the process by
+    // PID, so before it leaves the table
+    if (ioring_release_process) ioring_release_process((uint64_t)pid);
+    if (fs_release_process) fs_release_process((uint64_t)pid);
+
+    uint64_t flags = spin_lock_irqsave(&process_lock);
+    process_control_block_t* process = pid_hash_lookup((uint64_t)pid);
+    if (!process) {
+        spin_unlock_irqrestore(&process_lock, flags);
+        return;
+    }
+    pid_hash_remove(process);
+    pid_free(process->pid);
+    process_count--;
+    spin_unlock_irqrestore(&process_lock, flags);
+
+    // A task still on a CPU keeps that CPU's reference until it switches out
+    scheduler_terminate(process);
+    process_put(process);
+}
+
+process_control_block_t* process_get(uint64_t pid) {
+    uint64_t flags = spin_lock_irqsave(&process_lock);
+    process_control_block_t* process = pid_hash_lookup(pid);
+    if (process) process_hold(process);
+    spin_unlock_irqrestore(&process_lock, flags);
+    return process;
+}
+
+uint64_t process_get_count(void) {
+    return process_count;
+}
+
+bool process_get_name(uint64_t pid, char* name, size_t size) {
+    if (!size) return false;
+    uint64_t flags = spin_lock_irqsave(&process_lock);
+    process_control_block_t* process = pid_hash_lookup(pid);
+    if (process) {
+        size_t len = 0;
+        while (len + 1 < size && len < sizeof(process->name) && process->name[len]) {
+            name[len] = process->name[len];
+            len++;
         }
+        name[len] = '\0';
     }
-} 
\ No newline at end of file
+    spin_unlock_irqrestore(&process_lock, flags);
+    return process != NULL;
+}
+
+// Referenced either way, for process_put()
+static process_control_block_t* process_get_or_current(uint64_t pid) {
+    if (pid) return process_get(pid);
+    process_control_block_t* current = scheduler_get_current();
+    if (current) process_hold(current);
+    return current;
+}
+
+bool process_set_affinity(uint64_t pid, uint64_t mask) {
+    process_control_block_t* process = process_get_or_current(pid);
+    bool ok = scheduler_set_affinity(process, mask);
+    process_put(process);
+    return ok;
+}
+
+uint64_t process_get_affinity(uint64_t pid) {
+    process_control_block_t* process = process_get_or_current(pid);
+    uint64_t mask = scheduler_get_affinity(process);
+    process_put(process);
+    return mask;
+}
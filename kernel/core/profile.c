@@ -0,0 +1,249 @@
+#include "profile.h"
+#include "format.h"
+#include "scheduler.h"
+#include "process.h"
+#include "spinlock.h"
+#include "time.h"
+#include "arch/cpu.h"
+
+#define PROFILE_BUFFER_SAMPLES 1024 // Per CPU, power of two (144KB)
+#define PROFILE_LINE_MAX       512
+#define PROFILE_MAX_PIDS       64   // Distinct processes named per export
+
+// Boot stack, from boot/boot.s; interrupts taken at EL1 run on it
+extern char _stack_bottom[] __attribute__((weak));
+extern char _stack_top[] __attribute__((weak));
+
+// Single producer (the owning CPU's timer interrupt) and a single consumer
+// (profile_export under export_lock)
+typedef struct {
+    volatile uint64_t head;
+    volatile uint64_t tail;
+    uint64_t samples;
+    uint64_t lost;
+    uint64_t truncated;
+    uint32_t generation;    // Last start/stop applied to this CPU's timer
+    profile_sample_t ring[PROFILE_BUFFER_SAMPLES];
+} __attribute__((aligned(64))) profile_buffer_t;
+
+static profile_buffer_t buffers[MAX_CPUS];
+static volatile uint32_t profile_hz;
+static volatile uint32_t profile_generation;
+static spinlock_t control_lock = SPINLOCK_INIT;
+static spinlock_t export_lock = SPINLOCK_INIT;
+
+void profile_init(void) {
+    profile_hz = 0;
+    profile_generation = 0;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        buffers[cpu].head = 0;
+        buffers[cpu].tail = 0;
+        buffers[cpu].samples = 0;
+        buffers[cpu].lost = 0;
+        buffers[cpu].truncated = 0;
+        buffers[cpu].generation = 0;
+    }
+}
+
+void profile_sync(void) {
+    uint64_t flags = arch_irq_save();
+    profile_buffer_t* buffer = &buffers[arch_cpu_id()];
+    uint32_t generation = __atomic_load_n(&profile_generation, __ATOMIC_ACQUIRE);
+
+    if (buffer->generation != generation) {
+        uint32_t hz = profile_hz;
+        if (hz) {
+            arch_profile_timer_start(1000000000ULL / hz);
+        } else {
+            arch_profile_timer_stop();
+        }
+        buffer->generation = generation;
+    }
+    arch_irq_restore(flags);
+}
+
+// Apply a new rate here and kick the other CPUs to apply it in profile_sync
+static void profile_set_rate(uint32_t hz) {
+    uint64_t flags = spin_lock_irqsave(&control_lock);
+    profile_hz = hz;
+    __atomic_store_n(&profile_generation, profile_generation + 1, __ATOMIC_RELEASE);
+    spin_unlock_irqrestore(&control_lock, flags);
+
+    profile_sync();
+    uint32_t self = arch_cpu_id();
+    uint32_t cpus = arch_cpu_count();
+    for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+        if (cpu != self) arch_cpu_kick(cpu);
+    }
+}
+
+bool profile_start(uint32_t frequency_hz) {
+    if (frequency_hz < PROFILE_MIN_HZ || frequency_hz > PROFILE_MAX_HZ) return false;
+    profile_set_rate(frequency_hz);
+    return true;
+}
+
+void profile_stop(void) {
+    profile_set_rate(0);
+}
+
+// The frame chain may only be followed within one known stack: the
+// current process's stack or the boot stack. Anything else is either
+// garbage in a frame-pointer-less function or memory we must not touch
+// from an interrupt.
+static bool stack_bounds(const process_control_block_t* current, uint64_t fp, uint64_t* low, uint64_t* high) {
+    if (current && current->memory_start &&
+        fp >= current->memory_start && fp < current->memory_start + current->memory_size) {
+        *low = current->memory_start;
+        *high = current->memory_start + current->memory_size;
+        return true;
+    }
+    if (_stack_bottom && fp >= (uint64_t)(uintptr_t)_stack_bottom && fp < (uint64_t)(uintptr_t)_stack_top) {
+        *low = (uint64_t)(uintptr_t)_stack_bottom;
+        *high = (uint64_t)(uintptr_t)_stack_top;
+        return true;
+    }
+    return false;
+}
+
+// Frame records are { caller's fp, return address } on both aarch64 (x29)
+// and x86-64 (rbp), and callers' records sit at higher addresses
+static uint32_t walk_frames(profile_sample_t* sample, const process_control_block_t* current, uint64_t fp,
+                            bool* truncated) {
+    uint32_t depth = 1;
+    uint64_t low;
+    uint64_t high;
+
+    if (!stack_bounds(current, fp, &low, &high)) return depth;
+
+    while (fp >= low && fp + 16 <= high && !(fp & 7)) {
+        const uint64_t* record = (const uint64_t*)(uintptr_t)fp;
+        uint64_t next = record[0];
+        uint64_t ret = record[1];
+        if (!ret) break;
+        if (depth == PROFILE_MAX_DEPTH) {
+            *truncated = true;
+            break;
+        }
+        sample->pc[depth++] = ret;
+        if (next <= fp) break;
+        fp = next;
+    }
+    return depth;
+}
+
+void profile_sample(uint64_t pc, uint64_t fp, bool user) {
+    uint64_t flags = arch_irq_save();
+    uint32_t cpu = arch_cpu_id();
+    profile_buffer_t* buffer = &buffers[cpu];
+
+    uint64_t tail = buffer->tail;
+    if (tail - __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE) >= PROFILE_BUFFER_SAMPLES) {
+        buffer->lost++;
+        arch_irq_restore(flags);
+        return;
+    }
+
+    process_control_block_t* current = scheduler_get_current();
+    profile_sample_t* sample = &buffer->ring[tail & (PROFILE_BUFFER_SAMPLES - 1)];
+    bool truncated = false;
+    sample->timestamp_ns = time_get_ns();
+    sample->pid = current ? (uint32_t)current->pid : 0;
+    sample->cpu = (uint16_t)cpu;
+    sample->user = user;
+    sample->pc[0] = pc;
+    sample->depth = (uint8_t)walk_frames(sample, current, fp, &truncated);
+
+    __atomic_store_n(&buffer->tail, tail + 1, __ATOMIC_RELEASE);
+    buffer->samples++;
+    if (truncated) buffer->truncated++;
+    arch_irq_restore(flags);
+}
+
+static void profile_emit(size_t (*write)(const char*, size_t), const char* fmt, const uint64_t* args, uint32_t nargs) {
+    char line[PROFILE_LINE_MAX];
+    size_t len = format_args(line, sizeof(line), fmt, args, nargs);
+    write(line, len < sizeof(line) ? len : sizeof(line) - 1);
+}
+
+// Remember a PID so its name can be written after the samples
+static void note_pid(uint32_t* pids, uint32_t* count, uint32_t pid) {
+    for (uint32_t i = 0; i < *count; i++) {
+        if (pids[i] == pid) return;
+    }
+    if (*count < PROFILE_MAX_PIDS) pids[(*count)++] = pid;
+}
+
+// Output format, one record per line:
+//   PROFILE begin <version> <cpus> <frequency_hz>
+//   PROFILE S <cpu> <timestamp_ns> <pid> <k|u> <pc0>,<pc1>,...
+//   PROFILE P <pid> <name>
+//   PROFILE end <samples> <lost> <truncated>
+// Addresses are hex; pc1 onwards are return addresses. Names are only
+// known for processes still alive at export time.
+bool profile_export(size_t (*write)(const char* buf, size_t len)) {
+    static uint32_t pids[PROFILE_MAX_PIDS];
+    uint32_t pid_count = 0;
+
+    if (!write) return false;
+
+    // As with trace_export, interrupts stay enabled while the console
+    // drains, and a second exporter gives up rather than spin
+    if (!spin_trylock(&export_lock)) return false;
+
+    uint64_t header[] = { 1, arch_cpu_count(), profile_hz };
+    profile_emit(write, "PROFILE begin %llu %llu %llu\n", header, 3);
+
+    uint64_t samples = 0;
+    uint64_t lost = 0;
+    uint64_t truncated = 0;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        profile_buffer_t* buffer = &buffers[cpu];
+        uint64_t tail = __atomic_load_n(&buffer->tail, __ATOMIC_ACQUIRE);
+        for (uint64_t head = buffer->head; head != tail; head++) {
+            const profile_sample_t* sample = &buffer->ring[head & (PROFILE_BUFFER_SAMPLES - 1)];
+            char line[PROFILE_LINE_MAX];
+            uint64_t args[] = { sample->cpu, sample->timestamp_ns, sample->pid, sample->user ? 'u' : 'k' };
+            size_t len = format_args(line, sizeof(line), "PROFILE S %llu %llu %llu %c ", args, 4);
+            for (uint32_t i = 0; i < sample->depth && len < sizeof(line); i++) {
+                uint64_t pc = sample->pc[i];
+                len += format_args(line + len, sizeof(line) - len, i ? ",%llx" : "%llx", &pc, 1);
+            }
+            if (len < sizeof(line) - 1) {
+                line[len++] = '\n';
+                write(line, len);
+            }
+            note_pid(pids, &pid_count, sample->pid);
+            __atomic_store_n(&buffer->head, head + 1, __ATOMIC_RELEASE);
+        }
+        samples += buffer->samples;
+        lost += buffer->lost;
+        truncated += buffer->truncated;
+    }
+
+    for (uint32_t i = 0; i < pid_count; i++) {
+        char name[PROCESS_NAME_MAX];
+        if (!pids[i] || !process_get_name(pids[i], name, sizeof(name))) continue;
+        uint64_t args[] = { pids[i], (uint64_t)(uintptr_t)name };
+        profile_emit(write, "PROFILE P %llu %s\n", args, 2);
+    }
+
+    uint64_t footer[] = { samples, lost, truncated };
+    profile_emit(write, "PROFILE end %llu %llu %llu\n", footer, 3);
+
+    spin_unlock(&export_lock);
+    return true;
+}
+
+void profile_get_stats(profile_stats_t* stats) {
+    if (!stats) return;
+    stats->samples = 0;
+    stats->lost = 0;
+    stats->truncated = 0;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        stats->samples += buffers[cpu].samples;
+        stats->lost += buffers[cpu].lost;
+        stats->truncated += buffers[cpu].truncated;
+    }
+    stats->frequency_hz = profile_hz;
+}
@@ -0,0 +1,53 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Timer-interrupt sampling profiler. While running, every CPU takes a
+// sample at the configured rate: the interrupted PC, the frame-pointer
+// call chain above it and the current PID. tools/profile2folded.py
+// symbolizes the exported samples into flame graph input.
+
+#define PROFILE_MAX_DEPTH   16
+#define PROFILE_MIN_HZ      10
+#define PROFILE_MAX_HZ      10000
+
+typedef struct {
+    uint64_t timestamp_ns;
+    uint32_t pid;           // 0 when no process was current
+    uint16_t cpu;
+    uint8_t user;           // Interrupted at EL0
+    uint8_t depth;          // Valid entries in pc[]
+    uint64_t pc[PROFILE_MAX_DEPTH]; // pc[0] interrupted PC, then return addresses
+} profile_sample_t;
+
+typedef struct {
+    uint64_t samples;
+    uint64_t lost;          // Buffer full
+    uint64_t truncated;     // Chain longer than PROFILE_MAX_DEPTH
+    uint32_t frequency_hz;  // 0 while stopped
+} profile_stats_t;
+
+void profile_init(void);
+
+// Start sampling on every CPU at frequency_hz, or change the rate
+bool profile_start(uint32_t frequency_hz);
+void profile_stop(void);
+
+// Bring this CPU's sampling timer in line with the last start/stop; called
+// from interrupt context so other CPUs pick up changes when kicked
+void profile_sync(void);
+
+// Sampling timer interrupt: record the interrupted context
+void profile_sample(uint64_t pc, uint64_t fp, bool user);
+
+// Write the samples out as text lines prefixed with "PROFILE ", for
+// tools/profile2folded.py. Consumes the buffers. As with trace_export,
+// returns false if another export is in progress.
+bool profile_export(size_t (*write)(const char* buf, size_t len));
+
+void profile_get_stats(profile_stats_t* stats);
+
+#endif // PROFILE_H
@@ -1,38 +1,666 @@
 #include "scheduler.h"
 #include "process.h"
+#include "spinlock.h"
+#include "time.h"
+#include "trace.h"
+#include "arch/cpu.h"
 #include <stddef.h>
+#include <string.h>
+
+#define SCHED_NUM_QUEUES (PRIORITY_REALTIME + 1)
+
+// Per-CPU run queue
+typedef struct {
+    spinlock_t lock;
+    process_control_block_t* head[SCHED_NUM_QUEUES];
+    process_control_block_t* tail[SCHED_NUM_QUEUES];
+    uint32_t queue_bitmap;              // Bit per non-empty queue
+    uint32_t nr_running;                // Queued tasks plus the current one
+    process_control_block_t* current;
+    uint64_t slice_end_ns;
+    uint64_t next_event_ns;             // Earliest timer event, SCHED_NO_EVENT if none
+    uint64_t programmed_ns;             // Deadline loaded in the timer, 0 once it fired
+    uint64_t tick_ns;                   // Next periodic tick while the tick runs
+    uint64_t next_balance_ns;
+    bool tick_stopped;
+    bool need_resched;
+    sched_latency_stats_t priority_stats[SCHED_NUM_QUEUES]; // Summed across CPUs on read
+} run_queue_t;
+
+TRACE_EVENT(sched, sched_switch, "prev_pid", "prev_state", "next_pid", "next_priority");
+TRACE_EVENT(sched, sched_wakeup, "pid", "priority", "cpu", NULL);
+TRACE_EVENT(sched, sched_migrate, "pid", "from_cpu", "to_cpu", NULL);
 
 static scheduler_policy_t current_policy = SCHED_RR;
-static process_control_block_t* current_process = NULL;
+static run_queue_t run_queues[MAX_CPUS];
+static uint64_t default_affinity = SCHED_CPU_MASK_ALL;
+
+static inline run_queue_t* this_rq(void) {
+    return &run_queues[arch_cpu_id()];
+}
+
+// Round-robin keeps every task in one queue; priority mode uses one per level
+static inline uint32_t queue_index(const process_control_block_t* process) {
+    return current_policy == SCHED_PRIORITY ? (uint32_t)process->priority : PRIORITY_NORMAL;
+}
+
+static void rq_add(run_queue_t* rq, process_control_block_t* process) {
+    uint32_t q = queue_index(process);
+    process->next = NULL;
+    process->prev = rq->tail[q];
+    if (rq->tail[q]) {
+        rq->tail[q]->next = process;
+    } else {
+        rq->head[q] = process;
+    }
+    rq->tail[q] = process;
+    rq->queue_bitmap |= 1U << q;
+    process->queued = true;
+}
+
+static void rq_remove(run_queue_t* rq, process_control_block_t* process) {
+    uint32_t q = queue_index(process);
+    if (process->prev) {
+        process->prev->next = process->next;
+    } else {
+        rq->head[q] = process->next;
+    }
+    if (process->next) {
+        process->next->prev = process->prev;
+    } else {
+        rq->tail[q] = process->prev;
+    }
+    if (!rq->head[q]) {
+        rq->queue_bitmap &= ~(1U << q);
+    }
+    process->next = NULL;
+    process->prev = NULL;
+    process->queued = false;
+}
+
+// Take the first task of the highest non-empty queue
+static process_control_block_t* rq_pick(run_queue_t* rq) {
+    if (!rq->queue_bitmap) return NULL;
+    uint32_t q = 31 - __builtin_clz(rq->queue_bitmap);
+    process_control_block_t* process = rq->head[q];
+    rq_remove(rq, process);
+    return process;
+}
+
+static inline uint64_t online_mask(void) {
+    return arch_cpu_count() >= 64 ? ~0ULL : (1ULL << arch_cpu_count()) - 1;
+}
+
+// CPUs a task may run on; an affinity with no online CPU falls back to all
+static inline uint64_t allowed_mask(const process_control_block_t* process) {
+    uint64_t allowed = process->affinity & online_mask();
+    return allowed ? allowed : online_mask();
+}
+
+// Wakeup placement: stay on the previous CPU if it is allowed and idle,
+// otherwise take the least loaded allowed CPU
+static uint32_t select_cpu(const process_control_block_t* process) {
+    uint64_t allowed = allowed_mask(process);
+    uint32_t prev = process->cpu % MAX_CPUS;
+
+    if ((allowed & (1ULL << prev)) && run_queues[prev].nr_running == 0) {
+        return prev;
+    }
+
+    uint32_t best = MAX_CPUS;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (!(allowed & (1ULL << cpu))) continue;
+        if (best == MAX_CPUS || run_queues[cpu].nr_running < run_queues[best].nr_running) {
+            best = cpu;
+        }
+    }
+    return best;
+}
+
+static void hist_record(sched_histogram_t* hist, uint64_t ns) {
+    uint32_t bucket = 63 - __builtin_clzll(ns | 1);
+    if (bucket >= SCHED_HIST_BUCKETS) bucket = SCHED_HIST_BUCKETS - 1;
+    hist->buckets[bucket]++;
+    hist->count++;
+    hist->total_ns += ns;
+    if (ns > hist->max_ns) hist->max_ns = ns;
+}
+
+static void hist_merge(sched_histogram_t* dst, const sched_histogram_t* src) {
+    for (uint32_t i = 0; i < SCHED_HIST_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+    dst->count += src->count;
+    dst->total_ns += src->total_ns;
+    if (src->max_ns > dst->max_ns) dst->max_ns = src->max_ns;
+}
+
+// Switch-in accounting, run queue lock held
+static void stats_switch_in(run_queue_t* rq, process_control_block_t* process, uint64_t now) {
+    sched_latency_stats_t* prio = &rq->priority_stats[process->priority % SCHED_NUM_QUEUES];
+    uint64_t wait = now - process->enqueue_ns;
+    hist_record(&process->sched_stats.runqueue_wait, wait);
+    hist_record(&prio->runqueue_wait, wait);
+    if (process->wakeup_ns) {
+        uint64_t latency = now - process->wakeup_ns;
+        hist_record(&process->sched_stats.wakeup_latency, latency);
+        hist_record(&prio->wakeup_latency, latency);
+        process->wakeup_ns = 0;
+    }
+}
+
+// Switch-out accounting, run queue lock held
+static void stats_switch_out(run_queue_t* rq, process_control_block_t* process, uint64_t now) {
+    sched_latency_stats_t* prio = &rq->priority_stats[process->priority % SCHED_NUM_QUEUES];
+    uint64_t slice = now - process->last_run_ns;
+    hist_record(&process->sched_stats.time_slice, slice);
+    hist_record(&prio->time_slice, slice);
+}
+
+// Program this CPU's event timer. The periodic tick only runs while tasks
+// compete for the CPU; an idle or single-task CPU sleeps until its next
+// real event. Called with the run queue lock held.
+static void rq_update_tick(run_queue_t* rq, uint64_t now) {
+    uint64_t deadline = rq->next_event_ns;
+
+    if (rq->nr_running > 1) {
+        // Keep the tick phase; only (re)start it once it has passed
+        if (rq->tick_stopped || rq->tick_ns <= now) {
+            rq->tick_ns = now + SCHED_TICK_NS;
+        }
+        if (rq->tick_ns < deadline) deadline = rq->tick_ns;
+        rq->tick_stopped = false;
+    } else {
+        rq->tick_stopped = true;
+    }
+
+    if (deadline == rq->programmed_ns) return;
+    rq->programmed_ns = deadline;
+    if (deadline == SCHED_NO_EVENT) {
+        arch_timer_stop();
+    } else {
+        arch_timer_program(deadline);
+    }
+}
 
 void scheduler_init(scheduler_policy_t policy) {
     current_policy = policy;
-    current_process = NULL;
+    memset(run_queues, 0, sizeof(run_queues));
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        spinlock_init(&run_queues[cpu].lock);
+        run_queues[cpu].next_event_ns = SCHED_NO_EVENT;
+        run_queues[cpu].programmed_ns = 0;
+    }
+    default_affinity = SCHED_CPU_MASK_ALL & ~SCHED_RESERVED_CPUS;
 }
 
+// Pull one queued task from the busiest CPU when it runs at least two
+// more tasks than this one. Only tasks whose affinity allows this CPU move.
+static void scheduler_balance(uint32_t this_cpu) {
+    uint32_t busiest = MAX_CPUS;
+    uint32_t max_running = run_queues[this_cpu].nr_running + 1;
+
+    for (uint32_t cpu = 0; cpu < arch_cpu_count() && cpu < MAX_CPUS; cpu++) {
+        if (cpu != this_cpu && run_queues[cpu].nr_running > max_running) {
+            busiest = cpu;
+            max_running = run_queues[cpu].nr_running;
+        }
+    }
+    if (busiest == MAX_CPUS) return;
+
+    run_queue_t* dst = &run_queues[this_cpu];
+    run_queue_t* src = &run_queues[busiest];
+    run_queue_t* first = this_cpu < busiest ? dst : src;
+    run_queue_t* second = this_cpu < busiest ? src : dst;
+
+    uint64_t flags = arch_irq_save();
+    spin_lock(&first->lock);
+    spin_lock(&second->lock);
+
+    process_control_block_t* moved = NULL;
+    if (src->nr_running > dst->nr_running + 1) {
+        // Lowest priority first so the busy CPU keeps its urgent work
+        for (uint32_t q = 0; q < SCHED_NUM_QUEUES && !moved; q++) {
+            for (process_control_block_t* p = src->head[q]; p; p = p->next) {
+                if (allowed_mask(p) & (1ULL << this_cpu)) {
+                    moved = p;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (moved) {
+        rq_remove(src, moved);
+        src->nr_running--;
+        moved->cpu = this_cpu;
+        rq_add(dst, moved);
+        dst->nr_running++;
+        TRACE(sched_migrate, moved->pid, busiest, this_cpu, 0);
+        if (!dst->current) dst->need_resched = true;
+        rq_update_tick(dst, time_get_ns());
+    }
+
+    spin_unlock(&second->lock);
+    spin_unlock(&first->lock);
+    arch_irq_restore(flags);
+}
+
+// Timer interrupt: account the running slice and re-arm the timer
 void scheduler_tick(void) {
-    // For now, just a stub
+    run_queue_t* rq = this_rq();
+    uint64_t now = time_get_ns();
+    uint64_t flags = spin_lock_irqsave(&rq->lock);
+
+    // One-shot timer has fired; whoever owns the next event re-arms it
+    rq->programmed_ns = 0;
+    if (rq->next_event_ns <= now) {
+        rq->next_event_ns = SCHED_NO_EVENT;
+    }
+
+    if (rq->current && rq->queue_bitmap && now >= rq->slice_end_ns) {
+        rq->need_resched = true;
+    }
+
+    bool balance = now >= rq->next_balance_ns;
+    if (balance) {
+        rq->next_balance_ns = now + SCHED_BALANCE_INTERVAL_NS;
+    }
+
+    rq_update_tick(rq, now);
+    spin_unlock_irqrestore(&rq->lock, flags);
+
+    if (balance) {
+        scheduler_balance(arch_cpu_id());
+    }
 }
 
 void scheduler_schedule(void) {
-    if (current_policy == SCHED_RR) {
-        // Round-robin: switch to next process
-        if (current_process) {
-            // In a real implementation, you would switch to the next process in the ready queue
-            // For now, just a stub
+    run_queue_t* rq = this_rq();
+    uint64_t now = time_get_ns();
+    uint64_t flags = spin_lock_irqsave(&rq->lock);
+
+    process_control_block_t* prev = rq->current;
+    process_control_block_t* migrate = NULL;
+    if (prev && prev->state == PROCESS_STATE_RUNNING && !rq->need_resched) {
+        spin_unlock_irqrestore(&rq->lock, flags);
+        return;
+    }
+    rq->need_resched = false;
+
+    if (prev) {
+        prev->cpu_time += now - prev->last_run_ns;
+        stats_switch_out(rq, prev, now);
+        if (prev->state == PROCESS_STATE_RUNNING &&
+            !(allowed_mask(prev) & (1ULL << arch_cpu_id()))) {
+            // Affinity changed while running: requeue on an allowed CPU
+            prev->state = PROCESS_STATE_READY;
+            rq->nr_running--;
+            migrate = prev;
+        } else if (prev->state == PROCESS_STATE_RUNNING) {
+            // Preempted: back to the tail of its queue
+            prev->state = PROCESS_STATE_READY;
+            prev->enqueue_ns = now;
+            rq_add(rq, prev);
+        } else {
+            // Blocked or terminated: leaves the CPU
+            rq->nr_running--;
         }
     }
+
+    process_control_block_t* next = rq_pick(rq);
+    rq->current = next;
+    if (next && next != prev) process_hold(next);     // The CPU's reference
+    if (prev != next) {
+        TRACE(sched_switch, prev ? prev->pid : 0, prev ? prev->state : 0,
+              next ? next->pid : 0, next ? next->priority : 0);
+    }
+    if (next) {
+        next->state = PROCESS_STATE_RUNNING;
+        stats_switch_in(rq, next, now);
+        next->last_run_ns = now;
+        rq->slice_end_ns = now + SCHED_TIME_SLICE_NS;
+    }
+
+    rq_update_tick(rq, now);
+    spin_unlock_irqrestore(&rq->lock, flags);
+
+    if (migrate) {
+        scheduler_enqueue(migrate);
+    }
+
+    // Frees it if it was destroyed while it ran
+    if (prev && prev != next) {
+        process_put(prev);
+    }
 }
 
 void scheduler_set_policy(scheduler_policy_t policy) {
+    if (policy == current_policy) return;
+
+    // Queue layout depends on the policy: drain every CPU, switch, requeue
+    process_control_block_t* pending[MAX_CPUS];
+    uint64_t flags = arch_irq_save();
+
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        run_queue_t* rq = &run_queues[cpu];
+        spin_lock(&rq->lock);
+        process_control_block_t* tail = NULL;
+        process_control_block_t* process;
+        pending[cpu] = NULL;
+        while ((process = rq_pick(rq)) != NULL) {
+            if (tail) {
+                tail->next = process;
+            } else {
+                pending[cpu] = process;
+            }
+            tail = process;
+        }
+    }
+
     current_policy = policy;
+
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        run_queue_t* rq = &run_queues[cpu];
+        process_control_block_t* process = pending[cpu];
+        while (process) {
+            process_control_block_t* next = process->next;
+            rq_add(rq, process);
+            process = next;
+        }
+        spin_unlock(&rq->lock);
+    }
+
+    arch_irq_restore(flags);
 }
 
 process_control_block_t* scheduler_get_current(void) {
-    return current_process;
+    return this_rq()->current;
 }
 
 void scheduler_yield(void) {
-    // In a real implementation, you would switch to the next process
-    // For now, just a stub
-} 
\ No newline at end of file
+    this_rq()->need_resched = true;
+    scheduler_schedule();
+}
+
+// Make a task runnable on the CPU picked by select_cpu()
+void scheduler_enqueue(process_control_block_t* process) {
+    if (!process || process->queued) return;
+
+    uint32_t cpu = select_cpu(process);
+    run_queue_t* rq = &run_queues[cpu];
+    uint64_t now = time_get_ns();
+    uint64_t flags = spin_lock_irqsave(&rq->lock);
+
+    // Pairs with scheduler_terminate(): either this sees the task is
+    // terminated, or that sees which CPU it was queued on
+    __atomic_store_n(&process->cpu, cpu, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&process->state, __ATOMIC_SEQ_CST) == PROCESS_STATE_TERMINATED) {
+        spin_unlock_irqrestore(&rq->lock, flags);
+        return;
+    }
+    process->state = PROCESS_STATE_READY;
+    process->enqueue_ns = now;
+    rq_add(rq, process);
+    rq->nr_running++;
+
+    // A second runnable task needs the tick back for time slicing
+    bool restart_tick = rq->tick_stopped && rq->nr_running > 1;
+    if (!rq->current ||
+        (current_policy == SCHED_PRIORITY && process->priority > rq->current->priority)) {
+        rq->need_resched = true;
+    }
+    bool kick = restart_tick || rq->need_resched;
+
+    if (cpu == arch_cpu_id()) {
+        if (restart_tick) rq_update_tick(rq, now);
+        spin_unlock_irqrestore(&rq->lock, flags);
+    } else {
+        spin_unlock_irqrestore(&rq->lock, flags);
+        if (kick) arch_cpu_kick(cpu);
+    }
+}
+
+// Remove a task from its run queue. A task that is currently running is
+// flagged for a reschedule instead and switched out by the next
+// scheduler_schedule() on its CPU; returns true in that case.
+bool scheduler_dequeue(process_control_block_t* process) {
+    if (!process) return false;
+
+    run_queue_t* rq = &run_queues[process->cpu % MAX_CPUS];
+    uint64_t flags = spin_lock_irqsave(&rq->lock);
+
+    bool running = false;
+    if (process->queued) {
+        rq_remove(rq, process);
+        rq->nr_running--;
+    } else if (rq->current == process) {
+        rq->need_resched = true;
+        running = true;
+    }
+
+    spin_unlock_irqrestore(&rq->lock, flags);
+
+    if (running && process->cpu != arch_cpu_id()) {
+        arch_cpu_kick(process->cpu);
+    }
+    return running;
+}
+
+// Take a destroyed task off the CPUs for good: out of its run queue, or
+// off its CPU at the next scheduler_schedule() there. The state is set
+// under the run queue lock; if a concurrent scheduler_enqueue() moved the
+// task meanwhile, the queue it moved to is handled too.
+void scheduler_terminate(process_control_block_t* process) {
+    __atomic_store_n(&process->state, PROCESS_STATE_TERMINATED, __ATOMIC_SEQ_CST);
+    uint32_t cpu = __atomic_load_n(&process->cpu, __ATOMIC_SEQ_CST);
+
+    for (;;) {
+        run_queue_t* rq = &run_queues[cpu % MAX_CPUS];
+        uint64_t flags = spin_lock_irqsave(&rq->lock);
+        process->state = PROCESS_STATE_TERMINATED;
+        bool running = false;
+        if (process->queued && process->cpu == cpu) {
+            rq_remove(rq, process);
+            rq->nr_running--;
+        } else if (rq->current == process) {
+            rq->need_resched = true;
+            running = true;
+        }
+        spin_unlock_irqrestore(&rq->lock, flags);
+
+        if (running && cpu != arch_cpu_id()) {
+            arch_cpu_kick(cpu);
+        }
+
+        uint32_t moved = __atomic_load_n(&process->cpu, __ATOMIC_SEQ_CST);
+        if (moved == cpu) return;
+        cpu = moved;
+    }
+}
+
+uint32_t scheduler_nr_running(uint32_t cpu) {
+    return cpu < MAX_CPUS ? run_queues[cpu].nr_running : 0;
+}
+
+bool scheduler_tick_stopped(uint32_t cpu) {
+    return cpu < MAX_CPUS ? run_queues[cpu].tick_stopped : false;
+}
+
+// Idle entry: try to pull work first; with nothing runnable the tick is
+// stopped and the CPU waits in WFI until the next programmed event or an
+// IPI. Returns with interrupts enabled.
+void scheduler_idle(void) {
+    run_queue_t* rq = this_rq();
+    scheduler_balance(arch_cpu_id());
+    uint64_t flags = spin_lock_irqsave(&rq->lock);
+
+    if (rq->current || rq->queue_bitmap) {
+        spin_unlock_irqrestore(&rq->lock, flags);
+        return;
+    }
+
+    rq_update_tick(rq, time_get_ns());
+    spin_unlock(&rq->lock);
+
+    // The run queue was checked with interrupts masked and they stay masked
+    // into WFI, which still wakes on a pending one: a wakeup arriving after
+    // the check cannot be lost. Unmasking then takes it at once. Unmasking
+    // before WFI instead would let the interrupt run first and WFI sleep
+    // through the work it queued.
+    arch_cpu_idle();
+    arch_irq_enable();
+}
+
+void scheduler_set_next_event(uint64_t deadline_ns) {
+    run_queue_t* rq = this_rq();
+    uint64_t flags = spin_lock_irqsave(&rq->lock);
+
+    rq->next_event_ns = deadline_ns;
+    if (deadline_ns < rq->programmed_ns) {
+        rq->programmed_ns = deadline_ns;
+        arch_timer_program(deadline_ns);
+    }
+
+    spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+// Another CPU queued work here: restart the tick if needed
+void scheduler_ipi(void) {
+    run_queue_t* rq = this_rq();
+    uint64_t flags = spin_lock_irqsave(&rq->lock);
+    rq_update_tick(rq, time_get_ns());
+    spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+// Restrict a task to a set of CPUs. A queued task moves immediately; a
+// running one migrates when it is next switched out.
+bool scheduler_set_affinity(process_control_block_t* process, uint64_t mask) {
+    if (!process || !(mask & online_mask())) return false;
+
+    // Under the run queue lock that balancing and scheduler_schedule() read it with
+    uint32_t cpu = __atomic_load_n(&process->cpu, __ATOMIC_SEQ_CST);
+    run_queue_t* rq = &run_queues[cpu % MAX_CPUS];
+    uint64_t flags = spin_lock_irqsave(&rq->lock);
+    process->affinity = mask;
+    bool stays = allowed_mask(process) & (1ULL << (process->cpu % MAX_CPUS));
+    spin_unlock_irqrestore(&rq->lock, flags);
+    if (stays) {
+        return true;
+    }
+
+    if (scheduler_dequeue(process)) {
+        // Running: scheduler_dequeue() flagged a reschedule on its CPU
+        return true;
+    }
+    if (process->state == PROCESS_STATE_READY) {
+        scheduler_enqueue(process);
+    }
+    return true;
+}
+
+uint64_t scheduler_get_affinity(const process_control_block_t* process) {
+    return process ? process->affinity : 0;
+}
+
+void scheduler_set_default_affinity(uint64_t mask) {
+    default_affinity = mask ? mask : SCHED_CPU_MASK_ALL;
+}
+
+uint64_t scheduler_get_default_affinity(void) {
+    return default_affinity;
+}
+
+// Change a task's priority; a queued task moves to its new queue
+void scheduler_set_priority(process_control_block_t* process, process_priority_t priority) {
+    if (!process || (uint32_t)priority >= SCHED_NUM_QUEUES) return;
+
+    bool requeue = process->queued && !scheduler_dequeue(process);
+    process->priority = priority;
+    if (requeue) {
+        scheduler_enqueue(process);
+    }
+}
+
+// Mark the running task blocked; it keeps running until scheduler_yield().
+// Set under the run queue lock so that scheduler_wakeup() either sees it
+// or was over before it.
+void scheduler_prepare_block(void) {
+    process_control_block_t* current = scheduler_get_current();
+    if (!current) return;
+    run_queue_t* rq = this_rq();
+    uint64_t flags = spin_lock_irqsave(&rq->lock);
+    __atomic_store_n(&current->state, PROCESS_STATE_BLOCKED, __ATOMIC_SEQ_CST);
+    spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+// Block the running task until scheduler_wakeup()
+void scheduler_block(void) {
+    scheduler_prepare_block();
+    scheduler_yield();
+}
+
+// Make a blocked task runnable; starts its wakeup-to-run measurement. A
+// task that marked itself blocked but has not switched out yet is simply
+// set running again.
+void scheduler_wakeup(process_control_block_t* process) {
+    if (!process || __atomic_load_n(&process->state, __ATOMIC_SEQ_CST) != PROCESS_STATE_BLOCKED) return;
+
+    run_queue_t* rq = &run_queues[process->cpu % MAX_CPUS];
+    uint64_t flags = spin_lock_irqsave(&rq->lock);
+    bool on_cpu = rq->current == process && process->state == PROCESS_STATE_BLOCKED;
+    if (on_cpu) process->state = PROCESS_STATE_RUNNING;
+    spin_unlock_irqrestore(&rq->lock, flags);
+    if (on_cpu) return;
+
+    process->wakeup_ns = time_get_ns();
+    scheduler_enqueue(process);
+    TRACE(sched_wakeup, process->pid, process->priority, process->cpu, 0);
+}
+
+bool scheduler_get_task_stats(const process_control_block_t* process, sched_latency_stats_t* stats) {
+    if (!process || !stats) return false;
+    memcpy(stats, &process->sched_stats, sizeof(sched_latency_stats_t));
+    return true;
+}
+
+bool scheduler_get_priority_stats(process_priority_t priority, sched_latency_stats_t* stats) {
+    if (!stats || (uint32_t)priority >= SCHED_NUM_QUEUES) return false;
+
+    memset(stats, 0, sizeof(sched_latency_stats_t));
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        run_queue_t* rq = &run_queues[cpu];
+        uint64_t flags = spin_lock_irqsave(&rq->lock);
+        const sched_latency_stats_t* src = &rq->priority_stats[priority];
+        hist_merge(&stats->wakeup_latency, &src->wakeup_latency);
+        hist_merge(&stats->runqueue_wait, &src->runqueue_wait);
+        hist_merge(&stats->time_slice, &src->time_slice);
+        spin_unlock_irqrestore(&rq->lock, flags);
+    }
+    return true;
+}
+
+void scheduler_reset_stats(void) {
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        run_queue_t* rq = &run_queues[cpu];
+        uint64_t flags = spin_lock_irqsave(&rq->lock);
+        memset(rq->priority_stats, 0, sizeof(rq->priority_stats));
+        spin_unlock_irqrestore(&rq->lock, flags);
+    }
+}
+
+// Upper bound of the bucket holding the given percentile (0-100)
+uint64_t sched_histogram_percentile(const sched_histogram_t* hist, uint32_t percentile) {
+    if (!hist || !hist->count) return 0;
+
+    uint64_t target = (hist->count * percentile + 99) / 100;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < SCHED_HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= target) {
+            uint64_t upper = (1ULL << (i + 1)) - 1;
+            return upper < hist->max_ns ? upper : hist->max_ns;
+        }
+    }
+    return hist->max_ns;
+}
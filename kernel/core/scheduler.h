@@ -4,6 +4,24 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "process.h"
+#include "arch/cpu.h"
+
+// Periodic tick and default time slice
+#define SCHED_TICK_NS        10000000ULL  // 10 ms
+#define SCHED_TIME_SLICE_NS  20000000ULL  // 20 ms
+
+// No pending timer event
+#define SCHED_NO_EVENT       UINT64_MAX
+
+// Load balancing period while the tick runs
+#define SCHED_BALANCE_INTERVAL_NS 50000000ULL // 50 ms
+
+// CPU affinity masks, bit per CPU
+#define SCHED_CPU_MASK_ALL   ((1ULL << MAX_CPUS) - 1)
+
+// CPUs kept free of tasks using the default affinity. Core 0 is reserved
+// for input and display; pin those threads with scheduler_set_affinity().
+#define SCHED_RESERVED_CPUS  0x1ULL
 
 typedef enum {
     SCHED_RR,      // Round-robin
@@ -17,4 +35,46 @@ void scheduler_set_policy(scheduler_policy_t policy);
 process_control_block_t* scheduler_get_current(void);
 void scheduler_yield(void);
 
-#endif // SCHEDULER_H 
\ No newline at end of file
+// Run queue management
+void scheduler_enqueue(process_control_block_t* process);
+bool scheduler_dequeue(process_control_block_t* process);
+void scheduler_terminate(process_control_block_t* process);
+uint32_t scheduler_nr_running(uint32_t cpu);
+
+// Tickless idle: stop the periodic tick on an idle or single-task CPU,
+// program the timer for the next real event and wait for an interrupt
+void scheduler_idle(void);
+bool scheduler_tick_stopped(uint32_t cpu);
+
+// Earliest pending timer event on this CPU (SCHED_NO_EVENT for none)
+void scheduler_set_next_event(uint64_t deadline_ns);
+
+// Reschedule IPI handler
+void scheduler_ipi(void);
+
+// CPU affinity; the load balancer never moves a task off its mask
+bool scheduler_set_affinity(process_control_block_t* process, uint64_t mask);
+uint64_t scheduler_get_affinity(const process_control_block_t* process);
+
+// Priority change; a waiting task moves to the matching queue
+void scheduler_set_priority(process_control_block_t* process, process_priority_t priority);
+
+// Blocking and wakeup of the running task. To wait for a condition without
+// losing a wakeup that races with the check: scheduler_prepare_block(),
+// test the condition, then scheduler_yield() to sleep or scheduler_wakeup()
+// on the task itself to carry on.
+void scheduler_prepare_block(void);
+void scheduler_block(void);
+void scheduler_wakeup(process_control_block_t* process);
+
+// Latency statistics: per task, and per priority level across all CPUs
+bool scheduler_get_task_stats(const process_control_block_t* process, sched_latency_stats_t* stats);
+bool scheduler_get_priority_stats(process_priority_t priority, sched_latency_stats_t* stats);
+void scheduler_reset_stats(void);
+uint64_t sched_histogram_percentile(const sched_histogram_t* hist, uint32_t percentile);
+
+// Affinity given to tasks created without a parent
+void scheduler_set_default_affinity(uint64_t mask);
+uint64_t scheduler_get_default_affinity(void);
+
+#endif // SCHEDULER_H
@@ -0,0 +1,51 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdint.h>
+#include "arch/cpu.h"
+
+// Ticket spinlock, FIFO fair between CPUs
+typedef struct {
+    volatile uint16_t next;
+    volatile uint16_t owner;
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0, 0 }
+
+static inline void spinlock_init(spinlock_t* lock) {
+    lock->next = 0;
+    lock->owner = 0;
+}
+
+static inline void spin_lock(spinlock_t* lock) {
+    uint16_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+        arch_cpu_relax();
+    }
+}
+
+// Take the lock only if it is free right now
+static inline bool spin_trylock(spinlock_t* lock) {
+    uint16_t owner = __atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE);
+    uint16_t ticket = owner;
+    return __atomic_compare_exchange_n(&lock->next, &ticket, (uint16_t)(owner + 1), false,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static inline void spin_unlock(spinlock_t* lock) {
+    __atomic_store_n(&lock->owner, (uint16_t)(lock->owner + 1), __ATOMIC_RELEASE);
+}
+
+// Lock variants that also mask interrupts on the local CPU
+static inline uint64_t spin_lock_irqsave(spinlock_t* lock) {
+    uint64_t flags = arch_irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t* lock, uint64_t flags) {
+    spin_unlock(lock);
+    arch_irq_restore(flags);
+}
+
+#endif // SPINLOCK_H
@@ -1,28 +1,199 @@
 #include "time.h"
+#include "clocksource.h"
+#include "spinlock.h"
+#include "timer.h"
+#include "vdso.h"
 #include "arch/time.h"
+#include "arch/cpu.h"
+#include <stddef.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+
+// The timeline: ns = base_ns + cyc2ns((counter - cycle_last) & mask).
+// Readers go lock-free under a sequence count; writers (clocksource
+// switch, re-anchoring, suspend/resume) take tk_lock. Re-anchoring at
+// least every max_idle_ns / 2 keeps the delta within one counter wrap and
+// within the range of the 64-bit conversion.
+typedef struct {
+    volatile uint32_t seq;
+    clocksource_t* cs;
+    uint64_t cycle_last;
+    uint64_t base_ns;
+    uint32_t inv_mult;          // ns to cycles, for event timer deadlines
+    uint32_t inv_shift;
+    bool suspended;
+} timekeeper_t;
+
+static timekeeper_t tk;
+static spinlock_t tk_lock = SPINLOCK_INIT;
+static timer_list_t accumulate_timer;
+
+static inline void tk_write_begin(void) {
+    __atomic_store_n(&tk.seq, tk.seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void tk_write_end(void) {
+    __atomic_store_n(&tk.seq, tk.seq + 1, __ATOMIC_RELEASE);
+}
+
+// Time at a given counter value; caller holds the lock or the read seq
+static inline uint64_t tk_ns_at(uint64_t cycles) {
+    if (tk.suspended) return tk.base_ns;
+    return tk.base_ns + clocksource_cyc2ns(tk.cs, (cycles - tk.cycle_last) & tk.cs->mask);
+}
+
+static void tk_publish(void) {
+    clocksource_t* cs = tk.cs;
+    vdso_update_clock(tk.suspended ? VDSO_CLOCK_NONE : cs->vdso_mode, cs->mult, cs->shift, cs->mask,
+                      tk.cycle_last, tk.base_ns, cs->freq_hz);
+}
+
+// Fold the elapsed cycles into base_ns; called with tk_lock held
+static void tk_anchor(void) {
+    uint64_t now = tk.cs->read();
+    uint64_t ns = tk_ns_at(now);
+    tk_write_begin();
+    tk.base_ns = ns;
+    tk.cycle_last = now;
+    tk_write_end();
+}
 
 // Initialize time system
 void time_init(void) {
-    // Initialize hardware timer
+    // Registers the architecture's clocksources
     arch_time_init();
+
+    clocksource_t* cs = clocksource_best();
+    if (cs) time_set_clocksource(cs);
 }
 
-// Get current system time in milliseconds since boot
-uint64_t time_get_ms(void) {
-    return arch_time_get_ms();
+static void time_accumulate(void* data) {
+    (void)data;
+    uint64_t flags = spin_lock_irqsave(&tk_lock);
+    if (tk.cs && !tk.suspended) {
+        tk_anchor();
+        tk_publish();
+    }
+    uint64_t interval = tk.cs ? tk.cs->max_idle_ns / 2 : NSEC_PER_SEC;
+    spin_unlock_irqrestore(&tk_lock, flags);
+
+    timer_add(&accumulate_timer, interval);
 }
 
-// Get current system time in microseconds since boot
-uint64_t time_get_us(void) {
-    return arch_time_get_us();
+void time_late_init(void) {
+    timer_setup(&accumulate_timer, time_accumulate, NULL);
+    time_accumulate(NULL);
+}
+
+void time_set_clocksource(clocksource_t* cs) {
+    if (!cs) return;
+
+    uint64_t flags = spin_lock_irqsave(&tk_lock);
+    uint64_t ns = tk.cs ? tk_ns_at(tk.cs->read()) : 0;
+
+    uint32_t inv_mult;
+    uint32_t inv_shift;
+    clocksource_calc_mult_shift(&inv_mult, &inv_shift, NSEC_PER_SEC, cs->freq_hz, CLOCKSOURCE_MAX_SECONDS);
+
+    // Continue the timeline from where the old clocksource left it
+    tk_write_begin();
+    tk.cs = cs;
+    tk.cycle_last = cs->read();
+    tk.base_ns = ns;
+    tk.inv_mult = inv_mult;
+    tk.inv_shift = inv_shift;
+    tk_write_end();
+
+    tk_publish();
+    spin_unlock_irqrestore(&tk_lock, flags);
+}
+
+const clocksource_t* time_get_clocksource(void) {
+    return tk.cs;
 }
 
 // Get current system time in nanoseconds since boot
 uint64_t time_get_ns(void) {
-    return arch_time_get_ns();
+    uint32_t seq;
+    uint64_t ns;
+    do {
+        seq = __atomic_load_n(&tk.seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            arch_cpu_relax();
+            continue;
+        }
+        ns = tk.cs ? tk_ns_at(tk.cs->read()) : 0;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&tk.seq, __ATOMIC_RELAXED));
+    return ns;
+}
+
+uint64_t time_ns_to_cycle_delta(uint64_t ns) {
+    return (uint64_t)(((unsigned __int128)ns * tk.inv_mult) >> tk.inv_shift);
+}
+
+uint64_t time_ns_to_cycles(uint64_t deadline_ns) {
+    uint32_t seq;
+    uint64_t cycles;
+    do {
+        seq = __atomic_load_n(&tk.seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            arch_cpu_relax();
+            continue;
+        }
+        // Deadlines already passed map to the anchor, which is in the past
+        uint64_t delta = deadline_ns > tk.base_ns ? deadline_ns - tk.base_ns : 0;
+        cycles = tk.cycle_last + time_ns_to_cycle_delta(delta);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&tk.seq, __ATOMIC_RELAXED));
+    return cycles;
+}
+
+void time_suspend(void) {
+    uint64_t flags = spin_lock_irqsave(&tk_lock);
+    if (tk.cs && !tk.suspended) {
+        tk_anchor();
+        tk_write_begin();
+        tk.suspended = true;
+        tk_write_end();
+        tk_publish();
+    }
+    spin_unlock_irqrestore(&tk_lock, flags);
+}
+
+void time_resume(void) {
+    uint64_t flags = spin_lock_irqsave(&tk_lock);
+    if (tk.cs && tk.suspended) {
+        uint64_t now = tk.cs->read();
+        uint64_t slept = 0;
+        if (tk.cs->flags & CLOCKSOURCE_SUSPEND_NONSTOP) {
+            // Only exact if the counter did not wrap while suspended
+            slept = clocksource_cyc2ns(tk.cs, (now - tk.cycle_last) & tk.cs->mask);
+        }
+        // A counter that stopped or was reset simply continues from the
+        // suspend point, so time never runs backwards either way
+        tk_write_begin();
+        tk.base_ns += slept;
+        tk.cycle_last = now;
+        tk.suspended = false;
+        tk_write_end();
+        tk_publish();
+    }
+    spin_unlock_irqrestore(&tk_lock, flags);
+}
+
+// Get current system time in microseconds since boot
+uint64_t time_get_us(void) {
+    return time_get_ns() / 1000;
+}
+
+// Get current system time in milliseconds since boot
+uint64_t time_get_ms(void) {
+    return time_get_ns() / 1000000;
 }
 
 // Get current system time in seconds since boot
 uint64_t time_get_seconds(void) {
     return time_get_ms() / 1000;
-} 
\ No newline at end of file
+}
@@ -0,0 +1,478 @@
+#include "timer.h"
+#include "scheduler.h"
+#include "process.h"
+#include "spinlock.h"
+#include "time.h"
+#include "trace.h"
+#include "arch/cpu.h"
+#include <stddef.h>
+
+#define WHEEL_MASK          (TIMER_WHEEL_SLOTS - 1)
+#define WHEEL_RANGE         (1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+#define LEVEL_EXPIRING      0xFF    // Detached from the wheel, about to run
+
+// Per-CPU timer base. The wheel is the classic cascading kind: level L
+// holds timers due 64^L to 64^(L+1) ticks out, one slot per 64^L ticks.
+// Whenever the clock crosses a level-L slot boundary that slot's timers
+// are re-inserted one level down, so every timer reaches level 0 and runs
+// on its exact tick. Empty stretches are skipped using the per-level
+// occupancy bitmaps, so a CPU idle for minutes catches up in a few steps.
+typedef struct {
+    spinlock_t lock;
+    uint64_t clock;                                         // Next tick to process
+    uint64_t occupied[TIMER_WHEEL_LEVELS];                  // Bit per non-empty slot
+    timer_list_t* slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    timer_list_t* expiring;                                 // Slot being run
+    hrtimer_t* heap[HRTIMER_MAX_PER_CPU];                   // Min-heap on expires_ns
+    uint32_t heap_size;
+    uint64_t next_event_ns;                                 // Last deadline given to the scheduler
+    const void* volatile running;                           // Timer whose callback runs now
+    timer_stats_t stats;
+} __attribute__((aligned(64))) timer_base_t;
+
+typedef struct {
+    process_control_block_t* task;
+    volatile bool done;
+} sleeper_t;
+
+TRACE_EVENT(timer, timer_expire, "fn", "expires_ns", "late_ns", "hrtimer");
+
+static timer_base_t bases[MAX_CPUS];
+
+// First tick at or after ns
+static inline uint64_t ns_to_tick(uint64_t ns) {
+    return ns / TIMER_TICK_NS + (ns % TIMER_TICK_NS != 0);
+}
+
+static inline uint64_t deadline_after(uint64_t delay_ns) {
+    uint64_t now = time_get_ns();
+    return delay_ns > UINT64_MAX - now ? UINT64_MAX : now + delay_ns;
+}
+
+void timer_init(void) {
+    uint64_t tick = time_get_ns() / TIMER_TICK_NS;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        timer_base_t* base = &bases[cpu];
+        spinlock_init(&base->lock);
+        base->clock = tick;
+        for (uint32_t level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+            base->occupied[level] = 0;
+            for (uint32_t slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+                base->slots[level][slot] = NULL;
+            }
+        }
+        base->expiring = NULL;
+        base->heap_size = 0;
+        base->next_event_ns = SCHED_NO_EVENT;
+        base->running = NULL;
+        base->stats = (timer_stats_t){ 0 };
+    }
+}
+
+// Wheel
+
+static void wheel_insert(timer_base_t* base, timer_list_t* timer) {
+    uint64_t expires = ns_to_tick(timer->expires_ns);
+    if (expires < base->clock) expires = base->clock;
+
+    uint64_t delta = expires - base->clock;
+    if (delta >= WHEEL_RANGE) {
+        // Beyond the top level: park in its last slot, cascading re-files it
+        expires = base->clock + WHEEL_RANGE - 1;
+        delta = WHEEL_RANGE - 1;
+    }
+
+    uint32_t level = 0;
+    while (level + 1 < TIMER_WHEEL_LEVELS && delta >= (1ULL << (TIMER_WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+    uint32_t slot = (uint32_t)(expires >> (TIMER_WHEEL_BITS * level)) & WHEEL_MASK;
+
+    timer_list_t** head = &base->slots[level][slot];
+    timer->level = (uint8_t)level;
+    timer->slot = (uint8_t)slot;
+    timer->prev = NULL;
+    timer->next = *head;
+    if (*head) (*head)->prev = timer;
+    *head = timer;
+    base->occupied[level] |= 1ULL << slot;
+}
+
+static void wheel_remove(timer_base_t* base, timer_list_t* timer) {
+    timer_list_t** head = timer->level == LEVEL_EXPIRING ? &base->expiring
+                                                         : &base->slots[timer->level][timer->slot];
+    if (timer->prev) {
+        timer->prev->next = timer->next;
+    } else {
+        *head = timer->next;
+    }
+    if (timer->next) timer->next->prev = timer->prev;
+    timer->next = timer->prev = NULL;
+
+    if (!*head && timer->level != LEVEL_EXPIRING) {
+        base->occupied[timer->level] &= ~(1ULL << timer->slot);
+    }
+}
+
+// Earliest tick at which the wheel has work: running a level-0 slot or
+// cascading a higher one. UINT64_MAX when empty.
+static uint64_t wheel_next_tick(const timer_base_t* base) {
+    uint64_t best = UINT64_MAX;
+
+    for (uint32_t level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        uint64_t occupied = base->occupied[level];
+        if (!occupied) continue;
+
+        uint32_t shift = TIMER_WHEEL_BITS * level;
+        uint64_t current = base->clock >> shift;
+        uint32_t index = (uint32_t)current & WHEEL_MASK;
+        uint64_t rotated = index ? (occupied >> index) | (occupied << (TIMER_WHEEL_SLOTS - index)) : occupied;
+        uint64_t tick = (current + (uint64_t)__builtin_ctzll(rotated)) << shift;
+        if (tick < base->clock) {
+            // This level's current slot was cascaded already; anything
+            // in it now is a full round out
+            tick += (uint64_t)TIMER_WHEEL_SLOTS << shift;
+        }
+        if (tick < best) best = tick;
+    }
+    return best;
+}
+
+// Run one callback with the base unlocked
+static void run_callback(timer_base_t* base, uint64_t* flags, const void* timer, timer_fn_t fn, void* data,
+                         uint64_t expires_ns, bool hr) {
+    uint64_t now = time_get_ns();
+    uint64_t late = now > expires_ns ? now - expires_ns : 0;
+    if (late > base->stats.max_late_ns) base->stats.max_late_ns = late;
+
+    base->running = timer;
+    spin_unlock_irqrestore(&base->lock, *flags);
+    TRACE(timer_expire, (uintptr_t)fn, expires_ns, late, hr);
+    fn(data);
+    *flags = spin_lock_irqsave(&base->lock);
+    base->running = NULL;
+}
+
+// Cascade and run the wheel tick base->clock
+static void wheel_run_tick(timer_base_t* base, uint64_t* flags) {
+    uint64_t tick = base->clock;
+
+    for (uint32_t level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        uint32_t shift = TIMER_WHEEL_BITS * level;
+        if (tick & ((1ULL << shift) - 1)) break;
+
+        uint32_t slot = (uint32_t)(tick >> shift) & WHEEL_MASK;
+        timer_list_t* timer = base->slots[level][slot];
+        base->slots[level][slot] = NULL;
+        base->occupied[level] &= ~(1ULL << slot);
+        while (timer) {
+            timer_list_t* next = timer->next;
+            wheel_insert(base, timer);
+            base->stats.cascaded++;
+            timer = next;
+        }
+    }
+
+    // Move the slot aside and advance the clock first, so a callback that
+    // re-arms for "now" lands on the next tick instead of looping here
+    uint32_t slot = (uint32_t)tick & WHEEL_MASK;
+    base->expiring = base->slots[0][slot];
+    base->slots[0][slot] = NULL;
+    base->occupied[0] &= ~(1ULL << slot);
+    for (timer_list_t* timer = base->expiring; timer; timer = timer->next) {
+        timer->level = LEVEL_EXPIRING;
+    }
+    base->clock = tick + 1;
+
+    timer_list_t* timer;
+    while ((timer = base->expiring) != NULL) {
+        wheel_remove(base, timer);
+        timer->pending = false;
+        base->stats.pending--;
+        base->stats.expired++;
+        run_callback(base, flags, timer, timer->fn, timer->data, timer->expires_ns, false);
+    }
+}
+
+// High-resolution heap
+
+static void heap_place(timer_base_t* base, uint32_t index, hrtimer_t* timer) {
+    base->heap[index] = timer;
+    timer->index = index;
+}
+
+static void heap_sift_up(timer_base_t* base, uint32_t index) {
+    hrtimer_t* timer = base->heap[index];
+    while (index > 0) {
+        uint32_t parent = (index - 1) / 2;
+        if (base->heap[parent]->expires_ns <= timer->expires_ns) break;
+        heap_place(base, index, base->heap[parent]);
+        index = parent;
+    }
+    heap_place(base, index, timer);
+}
+
+static void heap_sift_down(timer_base_t* base, uint32_t index) {
+    hrtimer_t* timer = base->heap[index];
+    while (1) {
+        uint32_t child = index * 2 + 1;
+        if (child >= base->heap_size) break;
+        if (child + 1 < base->heap_size && base->heap[child + 1]->expires_ns < base->heap[child]->expires_ns) {
+            child++;
+        }
+        if (timer->expires_ns <= base->heap[child]->expires_ns) break;
+        heap_place(base, index, base->heap[child]);
+        index = child;
+    }
+    heap_place(base, index, timer);
+}
+
+static void heap_remove(timer_base_t* base, hrtimer_t* timer) {
+    uint32_t index = timer->index;
+    hrtimer_t* last = base->heap[--base->heap_size];
+    if (last != timer) {
+        heap_place(base, index, last);
+        heap_sift_down(base, index);
+        heap_sift_up(base, last->index);
+    }
+}
+
+// Hand this CPU's earliest deadline to the scheduler, which owns the event
+// timer. Moving it later is left to the next interrupt: an early wakeup
+// only costs a recomputation. force republishes unconditionally.
+static void timer_update_event(timer_base_t* base, bool force) {
+    uint64_t next = base->heap_size ? base->heap[0]->expires_ns : SCHED_NO_EVENT;
+    uint64_t tick = wheel_next_tick(base);
+    if (tick <= UINT64_MAX / TIMER_TICK_NS && tick * TIMER_TICK_NS < next) {
+        next = tick * TIMER_TICK_NS;
+    }
+
+    if (force || next < base->next_event_ns) {
+        base->next_event_ns = next;
+        scheduler_set_next_event(next);
+    }
+}
+
+// Wheel timers
+
+void timer_setup(timer_list_t* timer, timer_fn_t fn, void* data) {
+    timer->next = timer->prev = NULL;
+    timer->expires_ns = 0;
+    timer->fn = fn;
+    timer->data = data;
+    timer->cpu = 0;
+    timer->level = 0;
+    timer->slot = 0;
+    timer->pending = false;
+}
+
+// Take a pending timer off whichever base holds it
+static bool timer_detach(timer_list_t* timer) {
+    bool was_pending = false;
+    timer_base_t* base = &bases[timer->cpu % MAX_CPUS];
+    uint64_t flags = spin_lock_irqsave(&base->lock);
+    if (timer->pending) {
+        wheel_remove(base, timer);
+        timer->pending = false;
+        base->stats.pending--;
+        was_pending = true;
+    }
+    spin_unlock_irqrestore(&base->lock, flags);
+    return was_pending;
+}
+
+// Arming and cancelling one timer concurrently from two CPUs is the
+// caller's to serialize, as with any other field of the owning object
+void timer_add(timer_list_t* timer, uint64_t delay_ns) {
+    if (!timer || !timer->fn) return;
+    timer_detach(timer);
+
+    uint64_t flags = arch_irq_save();
+    uint32_t cpu = arch_cpu_id();
+    timer_base_t* base = &bases[cpu];
+    spin_lock(&base->lock);
+
+    timer->expires_ns = deadline_after(delay_ns);
+    timer->cpu = (uint16_t)cpu;
+    timer->pending = true;
+    wheel_insert(base, timer);
+    base->stats.added++;
+    base->stats.pending++;
+    timer_update_event(base, false);
+
+    spin_unlock(&base->lock);
+    arch_irq_restore(flags);
+}
+
+bool timer_cancel(timer_list_t* timer) {
+    if (!timer) return false;
+    bool was_pending = timer_detach(timer);
+
+    timer_base_t* base = &bases[timer->cpu % MAX_CPUS];
+    if (was_pending) {
+        uint64_t flags = spin_lock_irqsave(&base->lock);
+        base->stats.cancelled++;
+        spin_unlock_irqrestore(&base->lock, flags);
+    }
+
+    // A callback cannot wait for itself
+    if (timer->cpu != arch_cpu_id()) {
+        while (base->running == timer) arch_cpu_relax();
+    }
+    return was_pending;
+}
+
+// High-resolution timers
+
+void hrtimer_setup(hrtimer_t* timer, timer_fn_t fn, void* data) {
+    timer->expires_ns = 0;
+    timer->fn = fn;
+    timer->data = data;
+    timer->index = 0;
+    timer->cpu = 0;
+    timer->pending = false;
+}
+
+static bool hrtimer_detach(hrtimer_t* timer) {
+    bool was_pending = false;
+    timer_base_t* base = &bases[timer->cpu % MAX_CPUS];
+    uint64_t flags = spin_lock_irqsave(&base->lock);
+    if (timer->pending) {
+        heap_remove(base, timer);
+        timer->pending = false;
+        base->stats.hr_pending--;
+        was_pending = true;
+    }
+    spin_unlock_irqrestore(&base->lock, flags);
+    return was_pending;
+}
+
+bool hrtimer_start(hrtimer_t* timer, uint64_t deadline_ns) {
+    if (!timer || !timer->fn) return false;
+    hrtimer_detach(timer);
+
+    uint64_t flags = arch_irq_save();
+    uint32_t cpu = arch_cpu_id();
+    timer_base_t* base = &bases[cpu];
+    spin_lock(&base->lock);
+
+    bool ok = base->heap_size < HRTIMER_MAX_PER_CPU;
+    if (ok) {
+        timer->expires_ns = deadline_ns;
+        timer->cpu = (uint16_t)cpu;
+        timer->pending = true;
+        base->heap[base->heap_size] = timer;
+        timer->index = base->heap_size++;
+        heap_sift_up(base, timer->index);
+        base->stats.hr_pending++;
+        timer_update_event(base, false);
+    }
+
+    spin_unlock(&base->lock);
+    arch_irq_restore(flags);
+    return ok;
+}
+
+bool hrtimer_cancel(hrtimer_t* timer) {
+    if (!timer) return false;
+    bool was_pending = hrtimer_detach(timer);
+
+    timer_base_t* base = &bases[timer->cpu % MAX_CPUS];
+    if (timer->cpu != arch_cpu_id()) {
+        while (base->running == timer) arch_cpu_relax();
+    }
+    return was_pending;
+}
+
+// Expiry
+
+void timer_interrupt(void) {
+    uint64_t flags = arch_irq_save();
+    timer_base_t* base = &bases[arch_cpu_id()];
+    spin_lock(&base->lock);
+
+    uint64_t now = time_get_ns();
+    while (base->heap_size && base->heap[0]->expires_ns <= now) {
+        hrtimer_t* timer = base->heap[0];
+        heap_remove(base, timer);
+        timer->pending = false;
+        base->stats.hr_pending--;
+        base->stats.hr_expired++;
+        run_callback(base, &flags, timer, timer->fn, timer->data, timer->expires_ns, true);
+        now = time_get_ns();
+    }
+
+    // Tick T is due once now reaches T * TIMER_TICK_NS
+    uint64_t now_tick = now / TIMER_TICK_NS;
+    while (base->clock <= now_tick) {
+        uint64_t next = wheel_next_tick(base);
+        if (next > now_tick) {
+            base->clock = now_tick + 1;
+            break;
+        }
+        base->clock = next;
+        wheel_run_tick(base, &flags);
+    }
+
+    timer_update_event(base, true);
+    spin_unlock(&base->lock);
+    arch_irq_restore(flags);
+}
+
+// Sleeping
+
+static void sleep_expired(void* data) {
+    sleeper_t* sleeper = data;
+    __atomic_store_n(&sleeper->done, true, __ATOMIC_SEQ_CST);
+    scheduler_wakeup(sleeper->task);
+}
+
+// The timer may fire on another CPU if the task migrated after arming it,
+// so masking interrupts here is not enough: the task is marked blocked
+// before done is checked, and an expiry in between sets it running again
+static void sleep_wait(sleeper_t* sleeper) {
+    while (1) {
+        scheduler_prepare_block();
+        if (__atomic_load_n(&sleeper->done, __ATOMIC_SEQ_CST)) break;
+        scheduler_yield();
+    }
+    scheduler_wakeup(sleeper->task);
+}
+
+void timer_sleep_ns(uint64_t ns) {
+    sleeper_t sleeper = { scheduler_get_current(), false };
+    if (!sleeper.task || !ns) return;
+
+    hrtimer_t timer;
+    hrtimer_setup(&timer, sleep_expired, &sleeper);
+    if (hrtimer_start(&timer, deadline_after(ns))) {
+        sleep_wait(&sleeper);
+        hrtimer_cancel(&timer);
+        return;
+    }
+
+    // High-resolution slots exhausted: the wheel still guarantees at least ns
+    timer_list_t coarse;
+    timer_setup(&coarse, sleep_expired, &sleeper);
+    timer_add(&coarse, ns);
+    sleep_wait(&sleeper);
+    timer_cancel(&coarse);
+}
+
+void timer_get_stats(timer_stats_t* stats) {
+    if (!stats) return;
+    *stats = (timer_stats_t){ 0 };
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        timer_base_t* base = &bases[cpu];
+        uint64_t flags = spin_lock_irqsave(&base->lock);
+        stats->pending += base->stats.pending;
+        stats->hr_pending += base->stats.hr_pending;
+        stats->added += base->stats.added;
+        stats->cancelled += base->stats.cancelled;
+        stats->expired += base->stats.expired;
+        stats->cascaded += base->stats.cascaded;
+        stats->hr_expired += base->stats.hr_expired;
+        if (base->stats.max_late_ns > stats->max_late_ns) stats->max_late_ns = base->stats.max_late_ns;
+        spin_unlock_irqrestore(&base->lock, flags);
+    }
+}
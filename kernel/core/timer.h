@@ -0,0 +1,84 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Kernel timers. Both kinds are owned by the caller (usually embedded in
+// the object that times out), run their callback in interrupt context on
+// the CPU that armed them, and share that CPU's event timer through
+// scheduler_set_next_event().
+//
+// timer_list_t: coarse timeouts on a hierarchical timer wheel. Insert and
+// cancel are O(1); expiry is rounded up to the next TIMER_TICK_NS.
+//
+// hrtimer_t: nanosecond deadlines kept in a per-CPU heap and programmed
+// into the generic timer directly. For sleeps and short, precise delays.
+
+#define TIMER_TICK_NS           1000000ULL  // Wheel granularity, 1 ms
+#define TIMER_WHEEL_BITS        6
+#define TIMER_WHEEL_SLOTS       (1U << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS      6           // 64^6 ticks, about 2 years
+#define HRTIMER_MAX_PER_CPU     1024
+
+typedef void (*timer_fn_t)(void* data);
+
+typedef struct timer_list {
+    struct timer_list* next;    // Wheel slot links
+    struct timer_list* prev;
+    uint64_t expires_ns;
+    timer_fn_t fn;
+    void* data;
+    uint16_t cpu;               // Base holding the timer while pending
+    uint8_t level;              // Wheel position while pending
+    uint8_t slot;
+    bool pending;
+} timer_list_t;
+
+typedef struct {
+    uint64_t expires_ns;
+    timer_fn_t fn;
+    void* data;
+    uint32_t index;             // Heap position while pending
+    uint16_t cpu;
+    bool pending;
+} hrtimer_t;
+
+typedef struct {
+    uint64_t pending;           // Wheel timers armed now
+    uint64_t hr_pending;        // High-resolution timers armed now
+    uint64_t added;
+    uint64_t cancelled;
+    uint64_t expired;
+    uint64_t cascaded;          // Moved down a wheel level
+    uint64_t hr_expired;
+    uint64_t max_late_ns;       // Worst expiry lateness seen
+} timer_stats_t;
+
+void timer_init(void);
+
+void timer_setup(timer_list_t* timer, timer_fn_t fn, void* data);
+
+// Arm (or re-arm) to fire delay_ns from now
+void timer_add(timer_list_t* timer, uint64_t delay_ns);
+
+// Disarm; returns true if it was pending. Waits for a callback running on
+// another CPU to finish, so the timer may be freed afterwards.
+bool timer_cancel(timer_list_t* timer);
+
+void hrtimer_setup(hrtimer_t* timer, timer_fn_t fn, void* data);
+
+// Arm (or re-arm) for an absolute time_get_ns() deadline. Fails when this
+// CPU already has HRTIMER_MAX_PER_CPU timers pending.
+bool hrtimer_start(hrtimer_t* timer, uint64_t deadline_ns);
+bool hrtimer_cancel(hrtimer_t* timer);
+
+// Block the running task for at least ns nanoseconds
+void timer_sleep_ns(uint64_t ns);
+
+// Event timer interrupt: run everything due on this CPU
+void timer_interrupt(void);
+
+void timer_get_stats(timer_stats_t* stats);
+
+#endif // TIMER_H
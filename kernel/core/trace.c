@@ -0,0 +1,225 @@
+#include "trace.h"
+#include "format.h"
+#include "scheduler.h"
+#include "process.h"
+#include "spinlock.h"
+#include "time.h"
+#include "arch/cpu.h"
+
+#define TRACE_BUFFER_RECORDS 4096   // Per CPU, power of two (192KB)
+#define TRACE_LINE_MAX       192
+
+// Section bounds, provided by the linker
+extern trace_event_t __start_trace_events[] __attribute__((weak));
+extern trace_event_t __stop_trace_events[] __attribute__((weak));
+extern trace_site_t __start_trace_sites[] __attribute__((weak));
+extern trace_site_t __stop_trace_sites[] __attribute__((weak));
+
+// Single producer (the owning CPU, with interrupts masked) and a single
+// consumer (trace_export under export_lock)
+typedef struct {
+    volatile uint64_t head;
+    volatile uint64_t tail;
+    uint64_t recorded;
+    uint64_t lost;
+    trace_record_t records[TRACE_BUFFER_RECORDS];
+} __attribute__((aligned(64))) trace_buffer_t;
+
+static trace_buffer_t buffers[MAX_CPUS];
+static spinlock_t control_lock = SPINLOCK_INIT;
+static spinlock_t export_lock = SPINLOCK_INIT;
+
+static inline uint32_t event_count(void) {
+    return (uint32_t)(__stop_trace_events - __start_trace_events);
+}
+
+static inline uint32_t site_count(void) {
+    return (uint32_t)(__stop_trace_sites - __start_trace_sites);
+}
+
+#if defined(__aarch64__)
+#define INSN_NOP 0xD503201FU
+
+// Rewrite one site as NOP or as "b target". A single aligned 32-bit store
+// of either instruction is safe against concurrent execution on other CPUs.
+static void trace_patch_site(const trace_site_t* site, bool enabled) {
+    volatile uint32_t* insn = (volatile uint32_t*)(uintptr_t)site->code;
+    int64_t offset = (int64_t)(site->target - site->code);
+    uint32_t branch = 0x14000000U | ((uint32_t)(offset >> 2) & 0x03FFFFFFU);
+
+    *insn = enabled ? branch : INSN_NOP;
+    __asm__ volatile("dc cvau, %0\n\t"
+                     "dsb ish\n\t"
+                     "ic ivau, %0\n\t"
+                     "dsb ish\n\t"
+                     "isb"
+                     :: "r"(insn) : "memory");
+}
+#else
+static void trace_patch_site(const trace_site_t* site, bool enabled) {
+    (void)site;
+    (void)enabled;
+}
+#endif
+
+void trace_init(void) {
+    uint32_t events = event_count();
+    for (uint32_t i = 0; i < events; i++) {
+        __start_trace_events[i].id = (uint16_t)i;
+        __start_trace_events[i].enabled = 0;
+    }
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        buffers[cpu].head = 0;
+        buffers[cpu].tail = 0;
+        buffers[cpu].recorded = 0;
+        buffers[cpu].lost = 0;
+    }
+}
+
+void trace_record(trace_event_t* event, uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3) {
+    uint64_t flags = arch_irq_save();
+    uint32_t cpu = arch_cpu_id();
+    trace_buffer_t* buffer = &buffers[cpu];
+
+    uint64_t tail = buffer->tail;
+    if (tail - __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE) >= TRACE_BUFFER_RECORDS) {
+        buffer->lost++;
+        arch_irq_restore(flags);
+        return;
+    }
+
+    process_control_block_t* current = scheduler_get_current();
+    trace_record_t* record = &buffer->records[tail & (TRACE_BUFFER_RECORDS - 1)];
+    record->timestamp_ns = time_get_ns();
+    record->event = event->id;
+    record->cpu = (uint16_t)cpu;
+    record->pid = current ? (uint32_t)current->pid : 0;
+    record->args[0] = a0;
+    record->args[1] = a1;
+    record->args[2] = a2;
+    record->args[3] = a3;
+
+    __atomic_store_n(&buffer->tail, tail + 1, __ATOMIC_RELEASE);
+    buffer->recorded++;
+    arch_irq_restore(flags);
+}
+
+static bool str_equal(const char* a, const char* b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+// "*", "subsystem:*" or an exact event name
+static bool trace_match(const trace_event_t* event, const char* pattern) {
+    if (str_equal(pattern, "*")) return true;
+
+    const char* sub = event->subsystem;
+    const char* p = pattern;
+    while (*sub && *sub == *p) {
+        sub++;
+        p++;
+    }
+    if (!*sub && str_equal(p, ":*")) return true;
+
+    return str_equal(pattern, event->name);
+}
+
+uint32_t trace_set_enabled(const char* pattern, bool enabled) {
+    if (!pattern) return 0;
+
+    uint32_t changed = 0;
+    uint64_t flags = spin_lock_irqsave(&control_lock);
+    uint32_t events = event_count();
+    for (uint32_t i = 0; i < events; i++) {
+        trace_event_t* event = &__start_trace_events[i];
+        if (!trace_match(event, pattern) || (event->enabled != 0) == enabled) continue;
+
+        event->enabled = enabled;
+        uint32_t sites = site_count();
+        for (uint32_t s = 0; s < sites; s++) {
+            if (__start_trace_sites[s].event == event) {
+                trace_patch_site(&__start_trace_sites[s], enabled);
+            }
+        }
+        changed++;
+    }
+    spin_unlock_irqrestore(&control_lock, flags);
+    return changed;
+}
+
+static void trace_emit(size_t (*write)(const char*, size_t), const char* fmt, const uint64_t* args, uint32_t nargs) {
+    char line[TRACE_LINE_MAX];
+    size_t len = format_args(line, sizeof(line), fmt, args, nargs);
+    write(line, len < sizeof(line) ? len : sizeof(line) - 1);
+}
+
+// Output format, one record per line:
+//   TRACE begin <version> <cpus>
+//   TRACE E <id> <subsystem> <name> <arg0>,<arg1>,<arg2>,<arg3>
+//   TRACE R <cpu> <timestamp_ns> <pid> <id> <a0> <a1> <a2> <a3>
+//   TRACE end <recorded> <lost>
+// Records from each CPU are in time order; the host tool merges them.
+bool trace_export(size_t (*write)(const char* buf, size_t len)) {
+    if (!write) return false;
+
+    // Interrupts stay enabled: writing out a full buffer over a serial
+    // line takes seconds, and producers never wait on this lock. Nor do
+    // other exporters, so write may yield while it is held.
+    if (!spin_trylock(&export_lock)) return false;
+
+    uint64_t header[] = { 1, arch_cpu_count() };
+    trace_emit(write, "TRACE begin %llu %llu\n", header, 2);
+
+    uint32_t events = event_count();
+    for (uint32_t i = 0; i < events; i++) {
+        const trace_event_t* event = &__start_trace_events[i];
+        uint64_t args[7] = { event->id, (uint64_t)(uintptr_t)event->subsystem, (uint64_t)(uintptr_t)event->name };
+        for (uint32_t a = 0; a < TRACE_MAX_ARGS; a++) {
+            args[3 + a] = (uint64_t)(uintptr_t)(event->arg_names[a] ? event->arg_names[a] : "-");
+        }
+        trace_emit(write, "TRACE E %llu %s %s %s,%s,%s,%s\n", args, 7);
+    }
+
+    uint64_t recorded = 0;
+    uint64_t lost = 0;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        trace_buffer_t* buffer = &buffers[cpu];
+        uint64_t tail = __atomic_load_n(&buffer->tail, __ATOMIC_ACQUIRE);
+        for (uint64_t head = buffer->head; head != tail; head++) {
+            const trace_record_t* record = &buffer->records[head & (TRACE_BUFFER_RECORDS - 1)];
+            uint64_t args[] = {
+                record->cpu, record->timestamp_ns, record->pid, record->event,
+                record->args[0], record->args[1], record->args[2], record->args[3],
+            };
+            trace_emit(write, "TRACE R %llu %llu %llu %llu %llx %llx %llx %llx\n", args, 8);
+            __atomic_store_n(&buffer->head, head + 1, __ATOMIC_RELEASE);
+        }
+        recorded += buffer->recorded;
+        lost += buffer->lost;
+    }
+
+    uint64_t footer[] = { recorded, lost };
+    trace_emit(write, "TRACE end %llu %llu\n", footer, 2);
+
+    spin_unlock(&export_lock);
+    return true;
+}
+
+void trace_get_stats(trace_stats_t* stats) {
+    if (!stats) return;
+    stats->recorded = 0;
+    stats->lost = 0;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        stats->recorded += buffers[cpu].recorded;
+        stats->lost += buffers[cpu].lost;
+    }
+    stats->events = event_count();
+    stats->sites = site_count();
+    stats->enabled_events = 0;
+    for (uint32_t i = 0; i < stats->events; i++) {
+        if (__start_trace_events[i].enabled) stats->enabled_events++;
+    }
+}
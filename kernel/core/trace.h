@@ -0,0 +1,106 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Static tracepoints.
+//
+// An event is declared once, at file scope, in the subsystem that emits it:
+//
+//     TRACE_EVENT(ipc, ipc_send, "channel", "sender", "receiver", "size");
+//
+// and fired with up to four integer arguments:
+//
+//     TRACE(ipc_send, channel_id, sender_pid, receiver_pid, size);
+//
+// On aarch64 each TRACE site is a single NOP while the event is disabled;
+// enabling the event patches every one of its sites into a branch to the
+// recording code. Other targets test a flag instead.
+
+#define TRACE_MAX_ARGS 4
+#define TRACE_PATTERN_MAX 64    // "subsystem:name" patterns, with the NUL
+
+typedef struct {
+    const char* subsystem;
+    const char* name;
+    const char* arg_names[TRACE_MAX_ARGS];
+    volatile uint32_t enabled;
+    uint16_t id;            // Assigned by trace_init, in section order
+} trace_event_t;
+
+// One patchable branch, emitted into the trace_sites section by TRACE
+typedef struct {
+    uint64_t code;          // Address of the NOP
+    uint64_t target;        // Address of the recording path
+    trace_event_t* event;
+} trace_site_t;
+
+// Recorded event
+typedef struct {
+    uint64_t timestamp_ns;
+    uint16_t event;
+    uint16_t cpu;
+    uint32_t pid;
+    uint64_t args[TRACE_MAX_ARGS];
+} trace_record_t;
+
+typedef struct {
+    uint64_t recorded;
+    uint64_t lost;          // Buffer full
+    uint32_t events;
+    uint32_t sites;
+    uint32_t enabled_events;
+} trace_stats_t;
+
+// The explicit alignment stops the compiler from padding descriptors apart
+// (x86-64 aligns large globals to 32 bytes), so the section is a plain array
+#define TRACE_EVENT(sub, ev, a0, a1, a2, a3)                                            \
+    trace_event_t __trace_event_##ev                                                    \
+        __attribute__((section("trace_events"), used, aligned(8))) = {                  \
+        .subsystem = #sub, .name = #ev, .arg_names = { a0, a1, a2, a3 } }
+
+#if defined(__aarch64__)
+static inline __attribute__((always_inline)) bool trace_branch(trace_event_t* event) {
+    __asm__ goto("1: nop\n\t"
+                 ".pushsection trace_sites, \"aw\"\n\t"
+                 ".balign 8\n\t"
+                 ".quad 1b, %l[enabled], %c0\n\t"
+                 ".popsection"
+                 :: "i"(event) :: enabled);
+    return false;
+enabled:
+    return true;
+}
+#else
+static inline __attribute__((always_inline)) bool trace_branch(trace_event_t* event) {
+    return __builtin_expect(event->enabled != 0, 0);
+}
+#endif
+
+#define TRACE(ev, a0, a1, a2, a3)                                                       \
+    do {                                                                                \
+        if (trace_branch(&__trace_event_##ev)) {                                        \
+            trace_record(&__trace_event_##ev, (uint64_t)(a0), (uint64_t)(a1),           \
+                         (uint64_t)(a2), (uint64_t)(a3));                               \
+        }                                                                               \
+    } while (0)
+
+void trace_init(void);
+
+// Out-of-line slow path behind an enabled tracepoint
+void trace_record(trace_event_t* event, uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3);
+
+// Enable or disable events by name; "*" matches every event and
+// "subsystem:*" every event of one subsystem. Returns the number changed.
+uint32_t trace_set_enabled(const char* pattern, bool enabled);
+
+// Write the recorded events out as text lines prefixed with "TRACE ", for
+// tools/trace2json.py. Consumes the buffers. write may sleep; returns
+// false without writing anything if another export is in progress.
+bool trace_export(size_t (*write)(const char* buf, size_t len));
+
+void trace_get_stats(trace_stats_t* stats);
+
+#endif // TRACE_H
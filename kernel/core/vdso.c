@@ -0,0 +1,41 @@
+#include "vdso.h"
+#include "mmu.h"
+#include <string.h>
+
+// One page on its own so it can be mapped read-only into user space
+// without exposing any neighbouring kernel data
+static union {
+    vdso_clock_page_t clock;
+    uint8_t bytes[PAGE_SIZE];
+} vdso_page __attribute__((aligned(PAGE_SIZE)));
+
+void vdso_init(void) {
+    memset(&vdso_page, 0, sizeof(vdso_page));
+    vdso_page.clock.version = VDSO_CLOCK_VERSION;
+    vdso_page.clock.clock_mode = VDSO_CLOCK_NONE;
+}
+
+void vdso_update_clock(uint32_t clock_mode, uint64_t mult, uint32_t shift, uint64_t mask,
+                       uint64_t cycle_last, uint64_t base_ns, uint64_t freq_hz) {
+    vdso_clock_page_t* page = &vdso_page.clock;
+
+    // Odd seq marks the update; the fences order it against the field stores
+    __atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    page->clock_mode = clock_mode;
+    page->mult = mult;
+    page->shift = shift;
+    page->mask = mask;
+    page->cycle_last = cycle_last;
+    page->base_ns = base_ns;
+    page->freq_hz = freq_hz;
+
+    __atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELEASE);
+}
+
+// Single address space for now, so the kernel address is also the user
+// one; with per-process page tables this becomes the fixed user mapping
+const vdso_clock_page_t* vdso_get_clock_page(void) {
+    return &vdso_page.clock;
+}
@@ -0,0 +1,350 @@
+// kernel/drivers/console.c
+//
+// Buffered console on the PL011 UART. Writers append to a ring owned by
+// their CPU and return; the writer itself pushes bytes into the TX FIFO
+// until it fills, and the UART's TX interrupt (or, where the interrupt is
+// not available, a low-priority drain thread) sends the rest. A UART that
+// never reports a full FIFO, like QEMU's, is fed entirely by the writers.
+// A panic switches to synchronous polled output.
+#include "console.h"
+#include "spinlock.h"
+#include "scheduler.h"
+#include "process.h"
+#include "arch/cpu.h"
+#include <stddef.h>
+
+// PL011 on the QEMU "virt" machine
+#define UART0_BASE      0x09000000UL
+#define UART_DR         0x000
+#define UART_FR         0x018
+#define UART_LCR_H      0x02C
+#define UART_CR         0x030
+#define UART_IFLS       0x034
+#define UART_IMSC       0x038
+#define UART_ICR        0x044
+
+#define UART_FR_TXFF    (1U << 5)   // TX FIFO full
+#define UART_LCR_H_FEN  (1U << 4)   // FIFOs enabled; otherwise a 1-byte holding register
+#define UART_LCR_H_8BIT (3U << 5)
+#define UART_CR_UARTEN  (1U << 0)
+#define UART_CR_TXE     (1U << 8)
+#define UART_CR_RXE     (1U << 9)
+#define UART_INT_TX     (1U << 5)
+#define UART_IFLS_TX_1_8 0x0        // TX interrupt when FIFO drops to 1/8 full
+
+#define UART_REG(off) (*(volatile uint32_t*)(UART0_BASE + (off)))
+
+#define CONSOLE_RING_SIZE       4096    // Per CPU, power of two
+#define CONSOLE_DRAIN_STACK     4096
+
+// Single producer (the owning CPU, with interrupts masked) and a single
+// consumer (whoever holds drain_lock), so head and tail need no lock
+typedef struct {
+    volatile uint32_t head;     // Next byte to drain
+    volatile uint32_t tail;     // Next free slot
+    uint64_t queued;
+    uint64_t dropped;
+    char data[CONSOLE_RING_SIZE];
+} __attribute__((aligned(64))) console_ring_t;
+
+static console_ring_t rings[MAX_CPUS];
+
+static spinlock_t drain_lock = SPINLOCK_INIT;
+static uint32_t drain_cpu = 0;          // Ring being drained; kept until end of line
+static bool tx_irq_armed = false;
+static console_mode_t mode = CONSOLE_MODE_SYNC;
+static process_control_block_t* drain_task = NULL;
+static uint64_t bytes_written = 0;      // Under drain_lock
+static uint64_t tx_interrupts = 0;      // Updated atomically
+
+static inline bool uart_tx_full(void) {
+    return UART_REG(UART_FR) & UART_FR_TXFF;
+}
+
+static void uart_putc_sync(char c) {
+    while (uart_tx_full()) {
+        arch_cpu_relax();
+    }
+    UART_REG(UART_DR) = (uint32_t)(uint8_t)c;
+}
+
+static inline uint32_t ring_used(const console_ring_t* ring) {
+    return __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) - ring->head;
+}
+
+// Move bytes from the rings into the TX FIFO until it fills or all rings
+// are empty. A ring is drained up to a newline before moving to the next,
+// so a line queued in one write is not split by other CPUs' output; a
+// line built from several writes can be, if the drain catches up with it
+// in between. Returns true once everything buffered has been written.
+// Caller holds drain_lock.
+static bool console_drain_locked(void) {
+    uint32_t idle_rings = 0;
+
+    while (idle_rings < MAX_CPUS) {
+        console_ring_t* ring = &rings[drain_cpu];
+        uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        uint32_t head = ring->head;
+
+        if (head == tail) {
+            drain_cpu = (drain_cpu + 1) % MAX_CPUS;
+            idle_rings++;
+            continue;
+        }
+        idle_rings = 0;
+
+        while (head != tail) {
+            if (uart_tx_full()) {
+                __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+                return false;
+            }
+            char c = ring->data[head & (CONSOLE_RING_SIZE - 1)];
+            UART_REG(UART_DR) = (uint32_t)(uint8_t)c;
+            head++;
+            bytes_written++;
+            if (c == '\n') break;
+        }
+        __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+
+        if (head == tail || ring->data[(head - 1) & (CONSOLE_RING_SIZE - 1)] == '\n') {
+            drain_cpu = (drain_cpu + 1) % MAX_CPUS;
+        }
+    }
+    return true;
+}
+
+static void uart_set_tx_irq(bool enable) {
+    if (enable == tx_irq_armed) return;
+    tx_irq_armed = enable;
+    if (enable) {
+        UART_REG(UART_IMSC) |= UART_INT_TX;
+    } else {
+        UART_REG(UART_IMSC) &= ~UART_INT_TX;
+    }
+}
+
+static bool console_pending(void) {
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (ring_used(&rings[cpu])) return true;
+    }
+    return false;
+}
+
+// Fill the FIFO and arm the TX interrupt if output remains. A writer whose
+// trylock fails leaves its bytes to the lock holder, so the holder
+// re-checks the rings after unlocking.
+static void console_pump(void) {
+    do {
+        if (!spin_trylock(&drain_lock)) return;
+        bool done = console_drain_locked();
+        uart_set_tx_irq(!done);
+        spin_unlock(&drain_lock);
+        if (!done) return;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    } while (console_pending());
+}
+
+// Start output after new bytes were queued. The TX interrupt only fires on
+// FIFO level transitions, so the first bytes are pushed by hand.
+static void console_kick(void) {
+    if (mode == CONSOLE_MODE_THREAD) {
+        if (drain_task) scheduler_wakeup(drain_task);
+        return;
+    }
+    console_pump();
+}
+
+// Append to this CPU's ring; returns how many bytes fit. The rest are
+// counted as dropped if drop is set.
+static size_t console_enqueue(const char* buf, size_t len, bool drop) {
+    uint64_t flags = arch_irq_save();
+    console_ring_t* ring = &rings[arch_cpu_id()];
+
+    uint32_t tail = ring->tail;
+    uint32_t space = CONSOLE_RING_SIZE - (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE));
+    size_t n = len < space ? len : space;
+    for (size_t i = 0; i < n; i++) {
+        ring->data[(tail + i) & (CONSOLE_RING_SIZE - 1)] = buf[i];
+    }
+    __atomic_store_n(&ring->tail, tail + (uint32_t)n, __ATOMIC_RELEASE);
+    ring->queued += n;
+    if (drop) ring->dropped += len - n;
+
+    console_kick();
+    arch_irq_restore(flags);
+    return n;
+}
+
+// Low-priority fallback drainer for when the TX interrupt is unavailable
+static void console_drain_main(void) {
+    while (1) {
+        uint64_t flags = spin_lock_irqsave(&drain_lock);
+        bool done = console_drain_locked();
+        spin_unlock_irqrestore(&drain_lock, flags);
+
+        if (done) {
+            // Writers only wake a blocked drainer, so look once more after
+            // marking ourselves blocked
+            scheduler_prepare_block();
+            if (console_pending()) {
+                scheduler_wakeup(drain_task);
+            } else {
+                scheduler_yield();
+            }
+        } else {
+            scheduler_yield(); // FIFO full; let it empty
+        }
+    }
+}
+
+void console_init(console_mode_t initial_mode) {
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        rings[cpu].head = 0;
+        rings[cpu].tail = 0;
+        rings[cpu].queued = 0;
+        rings[cpu].dropped = 0;
+    }
+    // The TX interrupt needs the FIFOs; the line settings may only change
+    // with the UART disabled
+    UART_REG(UART_CR) = 0;
+    UART_REG(UART_LCR_H) = UART_LCR_H_FEN | UART_LCR_H_8BIT;
+    UART_REG(UART_IMSC) = 0;
+    UART_REG(UART_ICR) = 0x7FF;
+    UART_REG(UART_IFLS) = UART_IFLS_TX_1_8;
+    UART_REG(UART_CR) = UART_CR_UARTEN | UART_CR_TXE | UART_CR_RXE;
+    tx_irq_armed = false;
+    mode = initial_mode;
+}
+
+// Once the scheduler runs, switch to buffered output drained by a thread
+bool console_start_drain_thread(void) {
+    if (!drain_task) {
+        int pid = process_create(console_drain_main, CONSOLE_DRAIN_STACK);
+        if (pid < 0) return false;
+        // Never put: the drain thread outlives every caller
+        drain_task = process_get((uint64_t)pid);
+        scheduler_set_priority(drain_task, PRIORITY_IDLE);
+    }
+    mode = CONSOLE_MODE_THREAD;
+    console_kick();
+    return true;
+}
+
+void console_set_mode(console_mode_t new_mode) {
+    if (new_mode == CONSOLE_MODE_THREAD) {
+        console_start_drain_thread();
+        return;
+    }
+    if (new_mode == CONSOLE_MODE_SYNC) {
+        console_flush();
+    }
+    mode = new_mode;
+}
+
+// UART TX interrupt: the FIFO has room again
+void console_irq(void) {
+    UART_REG(UART_ICR) = UART_INT_TX;
+    __atomic_fetch_add(&tx_interrupts, 1, __ATOMIC_RELAXED);
+    console_pump();
+}
+
+// Write out everything buffered, polling the UART. Interrupts are masked
+// only for one FIFO's worth at a time: draining a full ring at 115200 baud
+// takes a third of a second.
+void console_flush(void) {
+    while (1) {
+        uint64_t flags = spin_lock_irqsave(&drain_lock);
+        bool done = console_drain_locked();
+        if (done) uart_set_tx_irq(false);
+        spin_unlock_irqrestore(&drain_lock, flags);
+        if (done) return;
+        while (uart_tx_full()) {
+            arch_cpu_relax();
+        }
+    }
+}
+
+// Panic path: take over the UART without waiting for a drain that may
+// never finish (its owner could be the CPU that crashed), flush what is
+// buffered and write synchronously from here on
+void console_panic(void) {
+    mode = CONSOLE_MODE_PANIC;
+    UART_REG(UART_IMSC) = 0;
+    tx_irq_armed = false;
+    while (!console_drain_locked()) {
+        arch_cpu_relax();
+    }
+}
+
+size_t console_write_buffer(const char* buf, size_t len) {
+    if (!buf || !len) return 0;
+
+    if (mode == CONSOLE_MODE_SYNC || mode == CONSOLE_MODE_PANIC) {
+        for (size_t i = 0; i < len; i++) {
+            uart_putc_sync(buf[i]);
+        }
+        return len;
+    }
+    return console_enqueue(buf, len, true);
+}
+
+size_t console_write_all(const char* buf, size_t len) {
+    if (!buf || !len) return 0;
+    if (mode == CONSOLE_MODE_SYNC || mode == CONSOLE_MODE_PANIC) {
+        return console_write_buffer(buf, len);
+    }
+
+    size_t done = console_enqueue(buf, len, false);
+    while (done < len) {
+        console_flush();
+        done += console_enqueue(buf + done, len - done, false);
+    }
+    return len;
+}
+
+void console_putc(char c) {
+    console_write_buffer(&c, 1);
+}
+
+void console_write(const char* str) {
+    size_t len = 0;
+    while (str[len]) len++;
+    console_write_buffer(str, len);
+}
+
+void console_clear() {
+    console_write("\033[2J\033[H");
+}
+
+void console_write_hex(uint64_t value) {
+    char buf[18] = "0x";
+    for (int i = 0; i < 16; i++) {
+        uint32_t nibble = (value >> ((15 - i) * 4)) & 0xF;
+        buf[2 + i] = (char)(nibble < 10 ? '0' + nibble : 'a' + nibble - 10);
+    }
+    console_write_buffer(buf, sizeof(buf));
+}
+
+void console_write_dec(uint64_t value) {
+    char buf[20];
+    int pos = sizeof(buf);
+    do {
+        buf[--pos] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    console_write_buffer(buf + pos, sizeof(buf) - pos);
+}
+
+void console_get_stats(console_stats_t* stats) {
+    if (!stats) return;
+    stats->bytes_queued = 0;
+    stats->bytes_dropped = 0;
+    stats->bytes_buffered = 0;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        stats->bytes_queued += rings[cpu].queued;
+        stats->bytes_dropped += rings[cpu].dropped;
+        stats->bytes_buffered += ring_used(&rings[cpu]);
+    }
+    stats->bytes_written = bytes_written;
+    stats->tx_interrupts = tx_interrupts;
+}
@@ -2,6 +2,28 @@
 #define CONSOLE_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// How queued output reaches the UART
+typedef enum {
+    CONSOLE_MODE_SYNC,      // Poll the UART on every write (early boot)
+    CONSOLE_MODE_IRQ,       // Per-CPU rings drained from the TX interrupt
+    CONSOLE_MODE_THREAD,    // Per-CPU rings drained by a low-priority thread
+    CONSOLE_MODE_PANIC      // Synchronous again, buffered output flushed
+} console_mode_t;
+
+typedef struct {
+    uint64_t bytes_queued;
+    uint64_t bytes_written;
+    uint64_t bytes_dropped;     // Rings full
+    uint64_t bytes_buffered;    // Waiting in the rings right now
+    uint64_t tx_interrupts;
+} console_stats_t;
+
+void console_init(console_mode_t mode);
+void console_set_mode(console_mode_t mode);
+bool console_start_drain_thread(void);
 
 void console_clear();
 void console_putc(char c);
@@ -9,4 +31,22 @@ void console_write(const char* str);
 void console_write_hex(uint64_t value);
 void console_write_dec(uint64_t value);
 
+// Queue len bytes; returns how many were accepted
+size_t console_write_buffer(const char* buf, size_t len);
+
+// Queue all len bytes, flushing whenever this CPU's ring is full; for
+// bulk output such as trace and profile exports
+size_t console_write_all(const char* buf, size_t len);
+
+// Block until everything buffered has reached the UART
+void console_flush(void);
+
+// Switch to synchronous output for a panic, flushing the rings first
+void console_panic(void);
+
+// UART TX interrupt handler
+void console_irq(void);
+
+void console_get_stats(console_stats_t* stats);
+
 #endif // CONSOLE_H
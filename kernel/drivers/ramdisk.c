@@ -0,0 +1,118 @@
+#include "ramdisk.h"
+#include "fs/vfs.h"
+#include "memory.h"
+#include <string.h>
+
+#define CHUNK_BLOCKS    64      // 256 KB allocated at a time
+
+typedef struct {
+    blockdev_t dev;
+    char name[32];
+    uint8_t** chunks;           // NULL until something is written there
+    uint64_t chunk_count;
+    spinlock_t lock;            // Allocating chunks
+} ramdisk_t;
+
+static inline ramdisk_t* ramdisk_of(blockdev_t* dev) {
+    return dev->driver_data;
+}
+
+static uint8_t* chunk_get(ramdisk_t* disk, uint64_t chunk, bool create) {
+    uint8_t* data = disk->chunks[chunk];
+    if (data || !create) return data;
+
+    uint8_t* fresh = memory_alloc(CHUNK_BLOCKS * RAMDISK_BLOCK_SIZE);
+    if (!fresh) return NULL;
+    memset(fresh, 0, CHUNK_BLOCKS * RAMDISK_BLOCK_SIZE);
+
+    uint64_t flags = spin_lock_irqsave(&disk->lock);
+    data = disk->chunks[chunk];
+    if (!data) {
+        disk->chunks[chunk] = fresh;
+        data = fresh;
+        fresh = NULL;
+    }
+    spin_unlock_irqrestore(&disk->lock, flags);
+    if (fresh) memory_free(fresh);
+    return data;
+}
+
+static int ramdisk_read(blockdev_t* dev, uint64_t block, uint32_t count, void* buffer) {
+    ramdisk_t* disk = ramdisk_of(dev);
+    uint8_t* out = buffer;
+    while (count) {
+        uint64_t offset = block % CHUNK_BLOCKS;
+        uint32_t run = CHUNK_BLOCKS - offset < count ? (uint32_t)(CHUNK_BLOCKS - offset) : count;
+        uint8_t* data = chunk_get(disk, block / CHUNK_BLOCKS, false);
+        if (data) {
+            memcpy(out, data + offset * RAMDISK_BLOCK_SIZE, (uint64_t)run * RAMDISK_BLOCK_SIZE);
+        } else {
+            memset(out, 0, (uint64_t)run * RAMDISK_BLOCK_SIZE);
+        }
+        out += (uint64_t)run * RAMDISK_BLOCK_SIZE;
+        block += run;
+        count -= run;
+    }
+    return 0;
+}
+
+static int ramdisk_write(blockdev_t* dev, uint64_t block, uint32_t count, const void* buffer) {
+    ramdisk_t* disk = ramdisk_of(dev);
+    const uint8_t* in = buffer;
+    while (count) {
+        uint64_t offset = block % CHUNK_BLOCKS;
+        uint32_t run = CHUNK_BLOCKS - offset < count ? (uint32_t)(CHUNK_BLOCKS - offset) : count;
+        uint8_t* data = chunk_get(disk, block / CHUNK_BLOCKS, true);
+        if (!data) return VFS_ERR_NOMEM;
+        memcpy(data + offset * RAMDISK_BLOCK_SIZE, in, (uint64_t)run * RAMDISK_BLOCK_SIZE);
+        in += (uint64_t)run * RAMDISK_BLOCK_SIZE;
+        block += run;
+        count -= run;
+    }
+    return 0;
+}
+
+static const blockdev_ops_t ramdisk_ops = {
+    .read = ramdisk_read,
+    .write = ramdisk_write,
+};
+
+blockdev_t* ramdisk_create(const char* name, uint64_t block_count) {
+    if (!name || !block_count) return NULL;
+    ramdisk_t* disk = memory_alloc(sizeof(ramdisk_t));
+    if (!disk) return NULL;
+    memset(disk, 0, sizeof(ramdisk_t));
+
+    disk->chunk_count = (block_count + CHUNK_BLOCKS - 1) / CHUNK_BLOCKS;
+    disk->chunks = memory_alloc(disk->chunk_count * sizeof(uint8_t*));
+    if (!disk->chunks) {
+        memory_free(disk);
+        return NULL;
+    }
+    memset(disk->chunks, 0, disk->chunk_count * sizeof(uint8_t*));
+    spinlock_init(&disk->lock);
+
+    strncpy(disk->name, name, sizeof(disk->name) - 1);
+    disk->dev.name = disk->name;
+    disk->dev.block_size = RAMDISK_BLOCK_SIZE;
+    disk->dev.block_count = block_count;
+    disk->dev.ops = &ramdisk_ops;
+    disk->dev.driver_data = disk;
+    if (!blockdev_register(&disk->dev)) {
+        memory_free(disk->chunks);
+        memory_free(disk);
+        return NULL;
+    }
+    return &disk->dev;
+}
+
+void ramdisk_destroy(blockdev_t* dev) {
+    if (!dev) return;
+    ramdisk_t* disk = ramdisk_of(dev);
+    blockdev_unregister(dev);
+    for (uint64_t i = 0; i < disk->chunk_count; i++) {
+        if (disk->chunks[i]) memory_free(disk->chunks[i]);
+    }
+    memory_free(disk->chunks);
+    memory_free(disk);
+}
@@ -0,0 +1,16 @@
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include <stdint.h>
+#include "fs/blockdev.h"
+
+// Block device in memory. Storage is allocated in chunks on first write,
+// and unwritten blocks read as zeros, so a large disk only costs what is
+// actually written to it.
+
+#define RAMDISK_BLOCK_SIZE  4096
+
+blockdev_t* ramdisk_create(const char* name, uint64_t block_count);
+void ramdisk_destroy(blockdev_t* dev);
+
+#endif // RAMDISK_H
@@ -0,0 +1,88 @@
+#include "fs/blockdev.h"
+#include "fs/vfs.h"
+#include <string.h>
+
+static blockdev_t* devices;
+static spinlock_t devices_lock = SPINLOCK_INIT;
+
+bool blockdev_register(blockdev_t* dev) {
+    if (!dev || !dev->name || !dev->ops || !dev->block_size) return false;
+    if (dev->block_size & (dev->block_size - 1)) return false;
+
+    uint64_t flags = spin_lock_irqsave(&devices_lock);
+    for (blockdev_t* other = devices; other; other = other->next) {
+        if (other == dev || strcmp(other->name, dev->name) == 0) {
+            spin_unlock_irqrestore(&devices_lock, flags);
+            return false;
+        }
+    }
+    spinlock_init(&dev->lock);
+    memset(&dev->stats, 0, sizeof(dev->stats));
+    dev->next = devices;
+    devices = dev;
+    spin_unlock_irqrestore(&devices_lock, flags);
+    return true;
+}
+
+void blockdev_unregister(blockdev_t* dev) {
+    uint64_t flags = spin_lock_irqsave(&devices_lock);
+    blockdev_t** link = &devices;
+    while (*link && *link != dev) {
+        link = &(*link)->next;
+    }
+    if (*link) *link = dev->next;
+    spin_unlock_irqrestore(&devices_lock, flags);
+}
+
+blockdev_t* blockdev_find(const char* name) {
+    if (!name) return NULL;
+    uint64_t flags = spin_lock_irqsave(&devices_lock);
+    blockdev_t* dev = devices;
+    while (dev && strcmp(dev->name, name) != 0) {
+        dev = dev->next;
+    }
+    spin_unlock_irqrestore(&devices_lock, flags);
+    return dev;
+}
+
+static bool blockdev_range_ok(const blockdev_t* dev, uint64_t block, uint32_t count) {
+    return block < dev->block_count && count <= dev->block_count - block;
+}
+
+int blockdev_read(blockdev_t* dev, uint64_t block, uint32_t count, void* buffer) {
+    if (!blockdev_range_ok(dev, block, count)) return VFS_ERR_INVAL;
+    int err = dev->ops->read(dev, block, count, buffer);
+
+    uint64_t flags = spin_lock_irqsave(&dev->lock);
+    dev->stats.reads++;
+    dev->stats.blocks_read += count;
+    spin_unlock_irqrestore(&dev->lock, flags);
+    return err;
+}
+
+int blockdev_write(blockdev_t* dev, uint64_t block, uint32_t count, const void* buffer) {
+    if (!blockdev_range_ok(dev, block, count)) return VFS_ERR_INVAL;
+    int err = dev->ops->write(dev, block, count, buffer);
+
+    uint64_t flags = spin_lock_irqsave(&dev->lock);
+    dev->stats.writes++;
+    dev->stats.blocks_written += count;
+    spin_unlock_irqrestore(&dev->lock, flags);
+    return err;
+}
+
+int blockdev_flush(blockdev_t* dev) {
+    int err = dev->ops->flush ? dev->ops->flush(dev) : 0;
+
+    uint64_t flags = spin_lock_irqsave(&dev->lock);
+    dev->stats.flushes++;
+    spin_unlock_irqrestore(&dev->lock, flags);
+    return err;
+}
+
+void blockdev_get_stats(blockdev_t* dev, blockdev_stats_t* out) {
+    if (!dev || !out) return;
+    uint64_t flags = spin_lock_irqsave(&dev->lock);
+    *out = dev->stats;
+    spin_unlock_irqrestore(&dev->lock, flags);
+}
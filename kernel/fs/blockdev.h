@@ -0,0 +1,51 @@
+#ifndef BLOCKDEV_H
+#define BLOCKDEV_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "spinlock.h"
+
+// Block devices for disk filesystems. Drivers register a device under a
+// name, which is what a filesystem is given as its mount source. Transfers
+// are whole blocks; a write is only durable once a later flush returns.
+
+struct blockdev;
+
+typedef struct {
+    int (*read)(struct blockdev* dev, uint64_t block, uint32_t count, void* buffer);
+    int (*write)(struct blockdev* dev, uint64_t block, uint32_t count, const void* buffer);
+    int (*flush)(struct blockdev* dev);
+} blockdev_ops_t;
+
+typedef struct {
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t flushes;
+    uint64_t blocks_read;
+    uint64_t blocks_written;
+} blockdev_stats_t;
+
+typedef struct blockdev {
+    const char* name;
+    uint32_t block_size;            // Bytes, a power of two
+    uint64_t block_count;
+    const blockdev_ops_t* ops;
+    void* driver_data;
+
+    spinlock_t lock;                // Guards stats
+    blockdev_stats_t stats;
+    struct blockdev* next;
+} blockdev_t;
+
+bool blockdev_register(blockdev_t* dev);
+void blockdev_unregister(blockdev_t* dev);
+blockdev_t* blockdev_find(const char* name);
+
+// Return 0 or a negative VFS error
+int blockdev_read(blockdev_t* dev, uint64_t block, uint32_t count, void* buffer);
+int blockdev_write(blockdev_t* dev, uint64_t block, uint32_t count, const void* buffer);
+int blockdev_flush(blockdev_t* dev);
+
+void blockdev_get_stats(blockdev_t* dev, blockdev_stats_t* stats);
+
+#endif // BLOCKDEV_H
@@ -0,0 +1,412 @@
+#include "fs/initrd.h"
+#include "fs/vfs.h"
+#include "inflate.h"
+#include "memory.h"
+#include "spinlock.h"
+#include "time.h"
+#include <string.h>
+
+#define INITRD_ROOT_INO         1
+#define INITRD_NODES_INITIAL    64
+#define INITRD_HASH_INITIAL     128
+
+// newc: "070701" (or "070702" with checksums), thirteen 8-digit hex fields,
+// then the NUL-terminated name; name and data are each padded to 4 bytes
+#define CPIO_HEADER_SIZE    110
+#define CPIO_FIELD_MODE     14
+#define CPIO_FIELD_FILESIZE 54
+#define CPIO_FIELD_NAMESIZE 94
+#define CPIO_TRAILER        "TRAILER!!!"
+
+#define CPIO_MODE_TYPE      0170000
+#define CPIO_MODE_DIR       0040000
+#define CPIO_MODE_FILE      0100000
+
+// Nodes are numbered in archive order after the root. A directory's
+// children are chained in that order, which is also readdir order, and
+// names resolve through one hash table keyed by (parent, name).
+typedef struct {
+    uint32_t type;
+    uint32_t parent;
+    uint32_t first_child;
+    uint32_t last_child;
+    uint32_t next_sibling;
+    uint16_t name_len;
+    const char* name;           // In the image, not NUL-terminated
+    const uint8_t* data;        // In the image
+    uint64_t size;
+} initrd_node_t;
+
+typedef struct {
+    const uint8_t* image;
+    uint64_t image_size;
+    bool owns_image;            // Inflated at mount rather than used in place
+
+    initrd_node_t* nodes;       // Node 0 is unused
+    uint32_t node_count;
+    uint32_t node_slots;
+    uint32_t* hash;             // Node numbers, 0 for an empty slot
+    uint32_t hash_size;
+
+    uint64_t next_header;       // Offset of the next entry to index
+    bool complete;              // Trailer reached
+    int error;
+    initrd_stats_t stats;
+} initrd_sb_t;
+
+static initrd_stats_t last_stats;
+static spinlock_t stats_lock = SPINLOCK_INIT;
+
+static inline uint64_t align4(uint64_t offset) {
+    return (offset + 3) & ~3ULL;
+}
+
+// --- Index ---
+
+static uint32_t name_hash(uint32_t parent, const char* name, size_t len) {
+    uint32_t hash = 2166136261u ^ (parent * 0x9E3779B1u);
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t initrd_find(const initrd_sb_t* fs, uint32_t parent, const char* name, size_t len) {
+    uint32_t mask = fs->hash_size - 1;
+    for (uint32_t slot = name_hash(parent, name, len) & mask;; slot = (slot + 1) & mask) {
+        uint32_t ino = fs->hash[slot];
+        if (!ino) return 0;
+        const initrd_node_t* node = &fs->nodes[ino];
+        if (node->parent == parent && node->name_len == len && memcmp(node->name, name, len) == 0) {
+            return ino;
+        }
+    }
+}
+
+static void hash_insert(initrd_sb_t* fs, uint32_t ino) {
+    const initrd_node_t* node = &fs->nodes[ino];
+    uint32_t mask = fs->hash_size - 1;
+    uint32_t slot = name_hash(node->parent, node->name, node->name_len) & mask;
+    while (fs->hash[slot]) slot = (slot + 1) & mask;
+    fs->hash[slot] = ino;
+}
+
+// Kept at most half full so probes stay short
+static bool hash_grow(initrd_sb_t* fs) {
+    uint32_t size = fs->hash_size ? fs->hash_size * 2 : INITRD_HASH_INITIAL;
+    uint32_t* hash = memory_alloc(size * sizeof(uint32_t));
+    if (!hash) return false;
+    memset(hash, 0, size * sizeof(uint32_t));
+
+    if (fs->hash) memory_free(fs->hash);
+    fs->hash = hash;
+    fs->hash_size = size;
+    for (uint32_t ino = INITRD_ROOT_INO + 1; ino < fs->node_count; ino++) {
+        hash_insert(fs, ino);
+    }
+    return true;
+}
+
+static bool nodes_grow(initrd_sb_t* fs) {
+    uint32_t slots = fs->node_slots ? fs->node_slots * 2 : INITRD_NODES_INITIAL;
+    initrd_node_t* nodes = memory_alloc(slots * sizeof(initrd_node_t));
+    if (!nodes) return false;
+    if (fs->nodes) {
+        memcpy(nodes, fs->nodes, fs->node_count * sizeof(initrd_node_t));
+        memory_free(fs->nodes);
+    }
+    fs->nodes = nodes;
+    fs->node_slots = slots;
+    return true;
+}
+
+static uint32_t initrd_add(initrd_sb_t* fs, uint32_t parent, const char* name, size_t len, uint32_t type) {
+    if (fs->node_count == fs->node_slots && !nodes_grow(fs)) return 0;
+    if (fs->node_count * 2 >= fs->hash_size && !hash_grow(fs)) return 0;
+
+    uint32_t ino = fs->node_count++;
+    initrd_node_t* node = &fs->nodes[ino];
+    memset(node, 0, sizeof(initrd_node_t));
+    node->type = type;
+    node->parent = parent;
+    node->name = name;
+    node->name_len = (uint16_t)len;
+
+    initrd_node_t* dir = &fs->nodes[parent];
+    if (dir->last_child) fs->nodes[dir->last_child].next_sibling = ino;
+    else dir->first_child = ino;
+    dir->last_child = ino;
+
+    hash_insert(fs, ino);
+    if (type == VFS_TYPE_DIR) fs->stats.directories++;
+    else fs->stats.files++;
+    return ino;
+}
+
+// Add one archive entry. Directories missing from the archive are made up
+// from the paths beneath them.
+static int initrd_add_entry(initrd_sb_t* fs, const char* path, size_t len, uint32_t mode,
+                            const uint8_t* data, uint64_t size) {
+    uint32_t type;
+    if ((mode & CPIO_MODE_TYPE) == CPIO_MODE_DIR) {
+        type = VFS_TYPE_DIR;
+    } else if ((mode & CPIO_MODE_TYPE) == CPIO_MODE_FILE) {
+        type = VFS_TYPE_FILE;
+    } else {
+        fs->stats.skipped++;
+        return 0;
+    }
+
+    // Names are relative to the archive root: ".", "./bin/sh" or "bin/sh"
+    while (len && (path[0] == '/' || (len >= 2 && path[0] == '.' && path[1] == '/'))) {
+        size_t skip = path[0] == '/' ? 1 : 2;
+        path += skip;
+        len -= skip;
+    }
+    if (!len || (len == 1 && path[0] == '.')) return 0;
+
+    uint32_t parent = INITRD_ROOT_INO;
+    const char* slash;
+    while ((slash = memchr(path, '/', len))) {
+        size_t component = (size_t)(slash - path);
+        if (component) {
+            uint32_t dir = initrd_find(fs, parent, path, component);
+            if (!dir) dir = initrd_add(fs, parent, path, component, VFS_TYPE_DIR);
+            if (!dir) return VFS_ERR_NOMEM;
+            if (fs->nodes[dir].type != VFS_TYPE_DIR) return VFS_ERR_NOTDIR;
+            parent = dir;
+        }
+        path += component + 1;
+        len -= component + 1;
+    }
+    if (!len) return 0;
+    if (len > VFS_NAME_MAX) {
+        fs->stats.skipped++;
+        return 0;
+    }
+
+    // Listed again, or already implied by an entry beneath it
+    uint32_t ino = initrd_find(fs, parent, path, len);
+    if (ino && fs->nodes[ino].type != type) return VFS_ERR_EXIST;
+    if (!ino) ino = initrd_add(fs, parent, path, len, type);
+    if (!ino) return VFS_ERR_NOMEM;
+
+    if (type == VFS_TYPE_FILE) {
+        fs->nodes[ino].data = data;
+        fs->nodes[ino].size = size;
+    }
+    return 0;
+}
+
+static bool cpio_field(const uint8_t* header, uint32_t offset, uint64_t* value) {
+    uint64_t result = 0;
+    for (uint32_t i = 0; i < 8; i++) {
+        uint8_t c = header[offset + i];
+        uint32_t digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else return false;
+        result = result << 4 | digit;
+    }
+    *value = result;
+    return true;
+}
+
+// Index every entry whose header and name lie within the first available
+// bytes of the image. Called as the decompressor produces output, so the
+// headers are read while they are still in cache; file data only needs
+// to have arrived by the time the mount completes.
+static bool initrd_index(void* ctx, size_t available) {
+    initrd_sb_t* fs = ctx;
+    while (!fs->complete && !fs->error) {
+        uint64_t pos = fs->next_header;
+        if (available < CPIO_HEADER_SIZE || pos > available - CPIO_HEADER_SIZE) break;
+
+        const uint8_t* header = fs->image + pos;
+        uint64_t mode;
+        uint64_t size;
+        uint64_t name_size;
+        if (memcmp(header, "07070", 5) != 0 || (header[5] != '1' && header[5] != '2') ||
+            !cpio_field(header, CPIO_FIELD_MODE, &mode) ||
+            !cpio_field(header, CPIO_FIELD_FILESIZE, &size) ||
+            !cpio_field(header, CPIO_FIELD_NAMESIZE, &name_size) || !name_size) {
+            fs->error = VFS_ERR_IO;
+            break;
+        }
+
+        uint64_t name_end = pos + CPIO_HEADER_SIZE + name_size;
+        if (name_end > available) break;
+        uint64_t data_start = align4(name_end);
+        if (data_start > fs->image_size || size > fs->image_size - data_start) {
+            fs->error = VFS_ERR_IO;
+            break;
+        }
+
+        const char* name = (const char*)header + CPIO_HEADER_SIZE;
+        size_t name_len = name_size - 1;
+        if (name_len == sizeof(CPIO_TRAILER) - 1 && memcmp(name, CPIO_TRAILER, name_len) == 0) {
+            fs->complete = true;
+            break;
+        }
+
+        fs->error = initrd_add_entry(fs, name, name_len, (uint32_t)mode, fs->image + data_start, size);
+        fs->next_header = align4(data_start + size);
+    }
+    return !fs->error;
+}
+
+// --- Operations ---
+
+static initrd_node_t* initrd_node(const vfs_inode_t* inode) {
+    return inode->fs_data;
+}
+
+static int initrd_lookup(vfs_inode_t* dir, const char* name, size_t len, vfs_ino_t* ino) {
+    uint32_t found = initrd_find(dir->sb->fs_data, (uint32_t)dir->ino, name, len);
+    if (!found) return VFS_ERR_NOENT;
+    *ino = found;
+    return 0;
+}
+
+// The cookie is the next child's node number, UINT64_MAX past the last
+static int initrd_readdir(vfs_inode_t* dir, uint64_t* cookie, vfs_dirent_t* dirent) {
+    initrd_sb_t* fs = dir->sb->fs_data;
+    uint64_t ino = *cookie ? *cookie : initrd_node(dir)->first_child;
+    if (!ino || ino >= fs->node_count || fs->nodes[ino].parent != dir->ino) return 0;
+
+    const initrd_node_t* node = &fs->nodes[ino];
+    dirent->ino = ino;
+    dirent->type = node->type;
+    dirent->name_len = node->name_len;
+    memcpy(dirent->name, node->name, node->name_len);
+    dirent->name[node->name_len] = '\0';
+    *cookie = node->next_sibling ? node->next_sibling : UINT64_MAX;
+    return 1;
+}
+
+static int64_t initrd_read(vfs_inode_t* inode, uint64_t pos, void* buffer, uint64_t len) {
+    const initrd_node_t* node = initrd_node(inode);
+    if (pos >= node->size) return 0;
+    if (len > node->size - pos) len = node->size - pos;
+    memcpy(buffer, node->data + pos, len);
+    return (int64_t)len;
+}
+
+// The image never moves, so mappings need no bookkeeping
+static int initrd_map(vfs_inode_t* inode, uint64_t pos, uint64_t len, void** addr) {
+    *addr = (void*)(initrd_node(inode)->data + pos);
+    return 0;
+}
+
+static const vfs_inode_ops_t initrd_inode_ops = {
+    .lookup = initrd_lookup,
+    .readdir = initrd_readdir,
+    .read = initrd_read,
+    .map = initrd_map,
+};
+
+static int initrd_read_inode(vfs_inode_t* inode) {
+    initrd_sb_t* fs = inode->sb->fs_data;
+    if (inode->ino < INITRD_ROOT_INO || inode->ino >= fs->node_count) return VFS_ERR_NOENT;
+
+    initrd_node_t* node = &fs->nodes[inode->ino];
+    inode->type = node->type;
+    inode->nlink = node->type == VFS_TYPE_DIR ? 2 : 1;
+    inode->size = node->size;
+    inode->ops = &initrd_inode_ops;
+    inode->fs_data = node;
+    return 0;
+}
+
+static void initrd_free(initrd_sb_t* fs) {
+    if (fs->owns_image) memory_free((void*)fs->image);
+    if (fs->nodes) memory_free(fs->nodes);
+    if (fs->hash) memory_free(fs->hash);
+    memory_free(fs);
+}
+
+static void initrd_unmount(vfs_super_t* sb) {
+    initrd_free(sb->fs_data);
+}
+
+static const vfs_super_ops_t initrd_super_ops = {
+    .read_inode = initrd_read_inode,
+    .unmount = initrd_unmount,
+};
+
+// A gzip'd archive is inflated into one buffer sized from the gzip trailer,
+// indexing entries as they come out; a plain one is used where it lies
+static int initrd_unpack(initrd_sb_t* fs, const initrd_source_t* source) {
+    const uint8_t* in = source->start;
+    if (!gzip_is_gzip(in, source->size)) {
+        fs->image = in;
+        fs->image_size = source->size;
+        initrd_index(fs, source->size);
+        return fs->error;
+    }
+
+    fs->stats.compressed_bytes = source->size;
+    fs->image_size = gzip_original_size(in, source->size);
+    uint8_t* image = memory_alloc(fs->image_size ? fs->image_size : 1);
+    if (!image) return VFS_ERR_NOMEM;
+    fs->image = image;
+    fs->owns_image = true;
+
+    int err = gzip_inflate(in, source->size, image, fs->image_size, NULL, initrd_index, fs);
+    if (fs->error) return fs->error;
+    return err ? VFS_ERR_IO : 0;
+}
+
+static int initrd_mount(vfs_super_t* sb, const char* source, const void* data) {
+    const initrd_source_t* image = data;
+    if (!image || !image->start || !image->size) return VFS_ERR_INVAL;
+
+    uint64_t start = time_get_ns();
+    initrd_sb_t* fs = memory_alloc(sizeof(initrd_sb_t));
+    if (!fs) return VFS_ERR_NOMEM;
+    memset(fs, 0, sizeof(initrd_sb_t));
+
+    int err = nodes_grow(fs) && hash_grow(fs) ? 0 : VFS_ERR_NOMEM;
+    if (!err) {
+        fs->node_count = INITRD_ROOT_INO + 1;
+        memset(&fs->nodes[INITRD_ROOT_INO], 0, sizeof(initrd_node_t));
+        fs->nodes[INITRD_ROOT_INO].type = VFS_TYPE_DIR;
+        fs->stats.directories = 1;
+        err = initrd_unpack(fs, image);
+    }
+    if (!err && !fs->complete) err = VFS_ERR_IO;
+    if (err) {
+        initrd_free(fs);
+        return err;
+    }
+
+    fs->stats.image_bytes = fs->image_size;
+    fs->stats.unpack_ns = time_get_ns() - start;
+    uint64_t flags = spin_lock_irqsave(&stats_lock);
+    last_stats = fs->stats;
+    spin_unlock_irqrestore(&stats_lock, flags);
+
+    sb->flags |= VFS_MOUNT_RDONLY;
+    sb->ops = &initrd_super_ops;
+    sb->root_ino = INITRD_ROOT_INO;
+    sb->fs_data = fs;
+    return 0;
+}
+
+static vfs_fs_type_t initrd_type = {
+    .name = "initrd",
+    .mount = initrd_mount,
+};
+
+void initrd_init(void) {
+    vfs_register_fs(&initrd_type);
+}
+
+void initrd_get_stats(initrd_stats_t* out) {
+    if (!out) return;
+    uint64_t flags = spin_lock_irqsave(&stats_lock);
+    *out = last_stats;
+    spin_unlock_irqrestore(&stats_lock, flags);
+}
@@ -0,0 +1,31 @@
+#ifndef INITRD_H
+#define INITRD_H
+
+#include <stdint.h>
+
+// Read-only filesystem over the initrd: a newc cpio archive, gzip'd as
+// tools/mkinitrd.sh builds it or plain. A compressed image is inflated
+// once at mount; file data is then read from the archive in place.
+// Entries other than files and directories are skipped.
+
+// Mount data: where the bootloader left the image
+typedef struct {
+    const void* start;
+    uint64_t size;
+} initrd_source_t;
+
+typedef struct {
+    uint64_t compressed_bytes;      // 0 for a plain archive
+    uint64_t image_bytes;
+    uint64_t files;
+    uint64_t directories;
+    uint64_t skipped;
+    uint64_t unpack_ns;             // Decompressing and indexing
+} initrd_stats_t;
+
+void initrd_init(void);
+
+// Figures for the last initrd mounted
+void initrd_get_stats(initrd_stats_t* stats);
+
+#endif // INITRD_H
@@ -0,0 +1,2728 @@
+#include "fs/lambdafs.h"
+#include "fs/vfs.h"
+#include "arch/cpu.h"
+#include "inflate.h"
+#include "memory.h"
+#include "mutex.h"
+#include "process.h"
+#include "scheduler.h"
+#include "time.h"
+#include "timer.h"
+#include <string.h>
+
+// Everything below runs under the filesystem's lock, which nests inside
+// the VFS and inode locks. It sleeps, so a buffer miss or eviction may go
+// to the disk while holding it. Metadata blocks are cached in buffers;
+// file data goes between the page cache and the disk directly.
+//
+// A buffer changed since the last commit is dirty and belongs to the
+// running transaction. Committing copies it into the log and records the
+// commit's sequence in jseq; until a checkpoint writes it home, that
+// commit's log space stays in use. Nothing reaches its home block before
+// the commit holding it is on disk.
+
+#define BLOCK_SIZE          LAMBDAFS_BLOCK_SIZE
+#define BLOCKS_PER_GROUP    LAMBDAFS_BLOCKS_PER_GROUP
+#define BUF_HASH_SIZE       1024
+#define BUF_MAX             2048        // 8 MB of clean metadata
+#define MAX_RUN             8192        // Largest allocation, 32 MB
+#define META_RESERVE        64          // Blocks kept back from reservations
+#define DIRENT_HEADER       8
+#define READDIR_MINOR_BITS  16          // Cookie bits counting colliding names
+#define READDIR_MINOR_MASK  ((1ULL << READDIR_MINOR_BITS) - 1)
+#define MIN_BLOCKS          64
+
+#define JOURNAL_MIN_BLOCKS  128
+#define JOURNAL_MAX_BLOCKS  8192        // 32 MB
+#define JOURNAL_DESC_SIZE   sizeof(lambdafs_journal_desc_t)
+#define COMMIT_INTERVAL_NS  1000000000ULL
+#define CHECKPOINT_BATCH    64
+#define JOURNAL_STACK_SIZE  16384
+
+typedef struct buf {
+    uint64_t block;
+    uint8_t* data;
+    uint32_t refcount;
+    bool dirty;
+    uint64_t jseq;                  // Commit holding the newest image, or 0
+    uint8_t* freeing;               // Bitmaps: blocks freed but not committed
+    uint64_t freed_seq;             // Bitmaps: transaction that last freed
+    struct buf* hash_next;
+    struct buf* lru_prev;
+    struct buf* lru_next;
+    struct buf* dirty_prev;
+    struct buf* dirty_next;
+} buf_t;
+
+// Logical blocks [start, start + length)
+typedef struct {
+    uint32_t start;
+    uint32_t length;
+} range_t;
+
+// Physical blocks [start, start + length)
+typedef struct {
+    uint64_t start;
+    uint64_t length;
+} extent_range_t;
+
+typedef struct inode_info {
+    vfs_inode_t* inode;
+    lambdafs_extent_t* extents;     // Sorted by logical block
+    uint32_t extent_count;
+    uint32_t extent_slots;
+    uint64_t* chain;                // Extent blocks on disk
+    uint32_t chain_count;
+    range_t* delayed;               // Dirty pages with no block yet
+    uint32_t delayed_count;
+    uint32_t delayed_slots;
+    uint64_t delayed_blocks;
+    lambdafs_extent_t window;       // Allocated ahead of writeback
+    uint32_t flags;
+    bool dirty;
+    struct inode_info* dirty_prev;
+    struct inode_info* dirty_next;
+} inode_info_t;
+
+// A commit in the log
+typedef struct {
+    uint64_t seq;
+    uint32_t start;                 // Log offset, once written
+    uint32_t span;                  // Blocks, with any skipped at the log's end
+    uint32_t pending;               // Buffers whose newest image is here
+} journal_tx_t;
+
+typedef struct lambdafs {
+    blockdev_t* dev;
+    mutex_t lock;
+    buf_t* super_buf;               // Pinned, as are the descriptors
+    lambdafs_super_t* super;
+    buf_t** desc_bufs;
+    uint64_t free_blocks;
+    uint64_t free_inodes;
+    uint64_t reserved;              // Delayed blocks, promised but not taken
+
+    buf_t* buf_hash[BUF_HASH_SIZE];
+    buf_t* lru_head;
+    buf_t* lru_tail;
+    uint32_t buf_count;
+    inode_info_t* dirty_inodes;
+
+    // Running transaction
+    uint64_t running_seq;
+    uint64_t running_since;         // First change, 0 while empty
+    buf_t* dirty_bufs;
+    uint32_t dirty_count;
+    extent_range_t* revokes;        // Freed metadata: older images must not replay
+    uint32_t revoke_count;
+    uint32_t revoke_slots;
+
+    // Log
+    uint64_t journal_id;
+    uint64_t log_start;             // First log block on disk
+    uint32_t log_blocks;
+    uint32_t log_head;              // Where the next commit goes
+    uint32_t log_used;
+    uint32_t log_tail;              // As last written to the header
+    uint64_t committed_seq;         // Newest commit known to be on disk
+    uint64_t last_commit_ns;
+    uint64_t tail_seq;
+    journal_tx_t* txs;              // Ring, oldest first
+    uint32_t tx_slots;
+    uint32_t tx_first;
+    uint32_t tx_count;
+    mutex_t journal_lock;           // Held by the commit or checkpoint writing the log
+    int journal_error;              // A log write failed; no more commits
+
+    lambdafs_stats_t stats;
+    struct lambdafs* next;
+} lambdafs_t;
+
+static lambdafs_t* mounts;
+static mutex_t mounts_lock = MUTEX_INIT;
+static process_control_block_t* journal_task;
+
+// --- Transactions ---
+
+static journal_tx_t* tx_find(lambdafs_t* fs, uint64_t seq) {
+    if (!fs->tx_count || seq < fs->txs[fs->tx_first].seq) return NULL;
+    uint64_t index = seq - fs->txs[fs->tx_first].seq;
+    if (index >= fs->tx_count) return NULL;
+    return &fs->txs[(fs->tx_first + index) % fs->tx_slots];
+}
+
+// The buffer's newest image no longer lives in the log
+static void buf_release_jseq(lambdafs_t* fs, buf_t* buf) {
+    if (!buf->jseq) return;
+    journal_tx_t* tx = tx_find(fs, buf->jseq);
+    if (tx) tx->pending--;
+    buf->jseq = 0;
+}
+
+static inline void tx_touch(lambdafs_t* fs) {
+    if (!fs->running_since) fs->running_since = time_get_ns() | 1;
+}
+
+static inline bool tx_empty(const lambdafs_t* fs) {
+    return !fs->dirty_bufs && !fs->revoke_count && !fs->dirty_inodes;
+}
+
+// --- Buffers ---
+
+static inline uint32_t buf_hash_index(uint64_t block) {
+    return (uint32_t)((block * 0x9E3779B97F4A7C15ULL) >> 54) & (BUF_HASH_SIZE - 1);
+}
+
+static void buf_lru_remove(lambdafs_t* fs, buf_t* buf) {
+    if (buf->lru_prev) buf->lru_prev->lru_next = buf->lru_next;
+    else fs->lru_head = buf->lru_next;
+    if (buf->lru_next) buf->lru_next->lru_prev = buf->lru_prev;
+    else fs->lru_tail = buf->lru_prev;
+    buf->lru_prev = buf->lru_next = NULL;
+}
+
+static void buf_lru_append(lambdafs_t* fs, buf_t* buf) {
+    buf->lru_prev = fs->lru_tail;
+    buf->lru_next = NULL;
+    if (fs->lru_tail) fs->lru_tail->lru_next = buf;
+    else fs->lru_head = buf;
+    fs->lru_tail = buf;
+}
+
+static void buf_unhash(lambdafs_t* fs, buf_t* buf) {
+    buf_t** link = &fs->buf_hash[buf_hash_index(buf->block)];
+    while (*link && *link != buf) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) *link = buf->hash_next;
+}
+
+static void buf_undirty(lambdafs_t* fs, buf_t* buf) {
+    if (!buf->dirty) return;
+    if (buf->dirty_prev) buf->dirty_prev->dirty_next = buf->dirty_next;
+    else fs->dirty_bufs = buf->dirty_next;
+    if (buf->dirty_next) buf->dirty_next->dirty_prev = buf->dirty_prev;
+    buf->dirty_prev = buf->dirty_next = NULL;
+    buf->dirty = false;
+    fs->dirty_count--;
+}
+
+static inline void buf_dirty(lambdafs_t* fs, buf_t* buf) {
+    if (buf->dirty) return;
+    buf->dirty = true;
+    buf->dirty_prev = NULL;
+    buf->dirty_next = fs->dirty_bufs;
+    if (fs->dirty_bufs) fs->dirty_bufs->dirty_prev = buf;
+    fs->dirty_bufs = buf;
+    fs->dirty_count++;
+    tx_touch(fs);
+}
+
+static void buf_free(lambdafs_t* fs, buf_t* buf) {
+    buf_undirty(fs, buf);
+    buf_release_jseq(fs, buf);
+    buf_unhash(fs, buf);
+    buf_lru_remove(fs, buf);
+    fs->buf_count--;
+    if (buf->freeing) memory_free(buf->freeing);
+    memory_free(buf->data);
+    memory_free(buf);
+}
+
+// Write a committed image home. The log keeps it until the next
+// checkpoint flushes the disk and moves the tail.
+static int buf_write_home(lambdafs_t* fs, buf_t* buf) {
+    int err = blockdev_write(fs->dev, buf->block, 1, buf->data);
+    if (err) return err;
+    buf_release_jseq(fs, buf);
+    fs->stats.buffer_writes++;
+    return 0;
+}
+
+// Drop the least recently used buffer that can go. Uncommitted changes
+// cannot, so the cache overshoots until the next commit.
+static void buf_shrink(lambdafs_t* fs) {
+    for (buf_t* buf = fs->lru_head; buf; buf = buf->lru_next) {
+        if (buf->refcount || buf->dirty || buf->freeing) continue;
+        if (buf->jseq > fs->committed_seq) continue;
+        if (buf->jseq && buf_write_home(fs, buf)) continue;
+        buf_free(fs, buf);
+        return;
+    }
+}
+
+static buf_t* buf_find(lambdafs_t* fs, uint64_t block) {
+    buf_t* buf = fs->buf_hash[buf_hash_index(block)];
+    while (buf && buf->block != block) {
+        buf = buf->hash_next;
+    }
+    return buf;
+}
+
+// Pinned buffer for a block. Without read the contents start zeroed, for
+// blocks about to be filled in whole.
+static buf_t* buf_get(lambdafs_t* fs, uint64_t block, bool read, int* error) {
+    buf_t* buf = buf_find(fs, block);
+    if (buf) {
+        buf->refcount++;
+        buf_lru_remove(fs, buf);
+        buf_lru_append(fs, buf);
+        fs->stats.buffer_hits++;
+        if (!read) memset(buf->data, 0, BLOCK_SIZE);
+        return buf;
+    }
+
+    fs->stats.buffer_misses++;
+    if (fs->buf_count >= BUF_MAX) buf_shrink(fs);
+    buf = memory_alloc(sizeof(buf_t));
+    uint8_t* data = buf ? memory_alloc(BLOCK_SIZE) : NULL;
+    if (!data) {
+        if (buf) memory_free(buf);
+        *error = VFS_ERR_NOMEM;
+        return NULL;
+    }
+    memset(buf, 0, sizeof(buf_t));
+    buf->block = block;
+    buf->data = data;
+    int err = read ? blockdev_read(fs->dev, block, 1, data) : 0;
+    if (err) {
+        memory_free(data);
+        memory_free(buf);
+        *error = err;
+        return NULL;
+    }
+    if (!read) memset(data, 0, BLOCK_SIZE);
+
+    buf->refcount = 1;
+    uint32_t index = buf_hash_index(block);
+    buf->hash_next = fs->buf_hash[index];
+    fs->buf_hash[index] = buf;
+    buf_lru_append(fs, buf);
+    fs->buf_count++;
+    return buf;
+}
+
+static inline void buf_put(buf_t* buf) {
+    buf->refcount--;
+}
+
+// A freed block must not be overwritten later by its stale buffer
+static void buf_forget(lambdafs_t* fs, uint64_t block) {
+    buf_t* buf = buf_find(fs, block);
+    if (!buf) return;
+    if (buf->refcount) {
+        buf_undirty(fs, buf);
+        buf_release_jseq(fs, buf);
+    } else {
+        buf_free(fs, buf);
+    }
+}
+
+// Older log images of freed metadata must not be replayed over whatever
+// the blocks hold next
+static void journal_revoke(lambdafs_t* fs, uint64_t start, uint64_t length) {
+    if (fs->revoke_count) {
+        extent_range_t* last = &fs->revokes[fs->revoke_count - 1];
+        if (last->start + last->length == start) {
+            last->length += length;
+            return;
+        }
+    }
+    if (fs->revoke_count == fs->revoke_slots) {
+        uint32_t slots = fs->revoke_slots ? fs->revoke_slots * 2 : 16;
+        extent_range_t* revokes = memory_alloc(slots * sizeof(extent_range_t));
+        if (!revokes) {
+            // Replay could now resurrect these blocks; stop committing
+            fs->journal_error = VFS_ERR_NOMEM;
+            return;
+        }
+        if (fs->revokes) {
+            memcpy(revokes, fs->revokes, fs->revoke_count * sizeof(extent_range_t));
+            memory_free(fs->revokes);
+        }
+        fs->revokes = revokes;
+        fs->revoke_slots = slots;
+    }
+    fs->revokes[fs->revoke_count++] = (extent_range_t){ .start = start, .length = length };
+    tx_touch(fs);
+}
+
+// --- Groups and bitmaps ---
+
+static inline lambdafs_group_t* group_desc(lambdafs_t* fs, uint32_t group) {
+    buf_t* buf = fs->desc_bufs[group / LAMBDAFS_GROUPS_PER_BLOCK];
+    return (lambdafs_group_t*)buf->data + group % LAMBDAFS_GROUPS_PER_BLOCK;
+}
+
+static inline void group_dirty(lambdafs_t* fs, uint32_t group) {
+    buf_dirty(fs, fs->desc_bufs[group / LAMBDAFS_GROUPS_PER_BLOCK]);
+}
+
+static inline uint64_t group_first(uint32_t group) {
+    return (uint64_t)group * BLOCKS_PER_GROUP;
+}
+
+static inline uint32_t group_length(const lambdafs_t* fs, uint32_t group) {
+    uint64_t left = fs->super->block_count - group_first(group);
+    return left < BLOCKS_PER_GROUP ? (uint32_t)left : BLOCKS_PER_GROUP;
+}
+
+static inline uint32_t itable_blocks(const lambdafs_t* fs) {
+    return fs->super->inodes_per_group / LAMBDAFS_INODES_PER_BLOCK;
+}
+
+// Where a group's data blocks begin
+static inline uint64_t group_data_start(lambdafs_t* fs, uint32_t group) {
+    return group_desc(fs, group)->inode_table + itable_blocks(fs);
+}
+
+static inline uint32_t ino_group(const lambdafs_t* fs, vfs_ino_t ino) {
+    return (uint32_t)((ino - 1) / fs->super->inodes_per_group);
+}
+
+static inline bool bit_test(const uint8_t* map, uint32_t bit) {
+    return map[bit / 8] & (1u << (bit % 8));
+}
+
+static void bits_set(uint8_t* map, uint32_t start, uint32_t count) {
+    for (uint32_t bit = start; bit < start + count; bit++) map[bit / 8] |= (uint8_t)(1u << (bit % 8));
+}
+
+static void bits_clear(uint8_t* map, uint32_t start, uint32_t count) {
+    for (uint32_t bit = start; bit < start + count; bit++) map[bit / 8] &= (uint8_t)~(1u << (bit % 8));
+}
+
+// First bit in [start, end) equal to value, or end. A bit counts as set
+// if it is set in either map; shadow may be NULL.
+static uint32_t bit_find(const uint8_t* map, const uint8_t* shadow, uint32_t start, uint32_t end, bool value) {
+    const uint64_t* words = (const uint64_t*)map;
+    const uint64_t* shadow_words = (const uint64_t*)shadow;
+    uint32_t bit = start;
+    while (bit < end) {
+        uint64_t word = words[bit / 64];
+        if (shadow_words) word |= shadow_words[bit / 64];
+        if (!value) word = ~word;
+        word &= ~0ULL << (bit % 64);
+        if (word) {
+            uint32_t found = (bit & ~63u) + (uint32_t)__builtin_ctzll(word);
+            return found < end ? found : end;
+        }
+        bit = (bit & ~63u) + 64;
+    }
+    return end;
+}
+
+static int take_blocks(lambdafs_t* fs, uint32_t group, uint32_t bit, uint32_t count) {
+    int err = 0;
+    buf_t* bitmap = buf_get(fs, group_desc(fs, group)->block_bitmap, true, &err);
+    if (!bitmap) return err;
+    bits_set(bitmap->data, bit, count);
+    buf_dirty(fs, bitmap);
+    buf_put(bitmap);
+
+    group_desc(fs, group)->free_blocks -= count;
+    group_dirty(fs, group);
+    fs->free_blocks -= count;
+    fs->stats.allocations++;
+    fs->stats.blocks_allocated += count;
+    return 0;
+}
+
+// Up to want contiguous blocks, as close to goal as possible. Free space
+// at the goal is taken even if it is short, since it continues the run the
+// caller already has; otherwise the first run long enough wins, scanning
+// groups from the goal's, and failing that the longest run seen. Blocks
+// freed since the last commit stay off limits: until the free is on disk,
+// a crash would hand them back to their old owner.
+static int alloc_blocks(lambdafs_t* fs, uint64_t goal, uint32_t want, uint64_t* start, uint32_t* count) {
+    if (!fs->free_blocks) return VFS_ERR_NOSPC;
+    if (goal >= fs->super->block_count) goal = 0;
+    uint32_t groups = fs->super->group_count;
+    uint32_t goal_group = (uint32_t)(goal / BLOCKS_PER_GROUP);
+    uint32_t goal_bit = (uint32_t)(goal - group_first(goal_group));
+
+    uint32_t best_group = 0;
+    uint32_t best_bit = 0;
+    uint32_t best_length = 0;
+    for (uint32_t pass = 0; pass <= groups; pass++) {
+        uint32_t group = (goal_group + pass) % groups;
+        if (!group_desc(fs, group)->free_blocks) continue;
+        uint32_t length = group_length(fs, group);
+        uint32_t from = pass == 0 ? goal_bit : 0;
+        uint32_t to = pass == groups ? goal_bit : length;
+
+        int err = 0;
+        buf_t* bitmap = buf_get(fs, group_desc(fs, group)->block_bitmap, true, &err);
+        if (!bitmap) return err;
+        const uint8_t* shadow = bitmap->freeing;
+        if (pass == 0 && !bit_test(bitmap->data, goal_bit) && !(shadow && bit_test(shadow, goal_bit))) {
+            uint32_t limit = goal_bit + want < length ? goal_bit + want : length;
+            uint32_t end = bit_find(bitmap->data, shadow, goal_bit, limit, true);
+            buf_put(bitmap);
+            *start = goal;
+            *count = end - goal_bit;
+            fs->stats.goal_hits++;
+            return take_blocks(fs, group, goal_bit, *count);
+        }
+
+        uint32_t bit = from;
+        while (bit < to) {
+            uint32_t run = bit_find(bitmap->data, shadow, bit, to, false);
+            if (run >= to) break;
+            uint32_t end = bit_find(bitmap->data, shadow, run, length, true);
+            if (end - run >= want) {
+                buf_put(bitmap);
+                *start = group_first(group) + run;
+                *count = want;
+                return take_blocks(fs, group, run, want);
+            }
+            if (end - run > best_length) {
+                best_group = group;
+                best_bit = run;
+                best_length = end - run;
+            }
+            bit = end;
+        }
+        buf_put(bitmap);
+    }
+
+    if (!best_length) return VFS_ERR_NOSPC;
+    *start = group_first(best_group) + best_bit;
+    *count = best_length;
+    return take_blocks(fs, best_group, best_bit, best_length);
+}
+
+static void free_blocks(lambdafs_t* fs, uint64_t start, uint64_t count) {
+    while (count) {
+        uint32_t group = (uint32_t)(start / BLOCKS_PER_GROUP);
+        uint32_t bit = (uint32_t)(start - group_first(group));
+        uint32_t run = group_length(fs, group) - bit;
+        if (run > count) run = (uint32_t)count;
+
+        int err = 0;
+        buf_t* bitmap = buf_get(fs, group_desc(fs, group)->block_bitmap, true, &err);
+        if (!bitmap) return;
+        if (!bitmap->freeing) {
+            bitmap->freeing = memory_alloc(BLOCK_SIZE);
+            if (!bitmap->freeing) {
+                // Cannot keep them from early reuse; leak them instead
+                buf_put(bitmap);
+                return;
+            }
+            memset(bitmap->freeing, 0, BLOCK_SIZE);
+        }
+        bitmap->freed_seq = fs->running_seq;
+        bits_set(bitmap->freeing, bit, run);
+        bits_clear(bitmap->data, bit, run);
+        buf_dirty(fs, bitmap);
+        buf_put(bitmap);
+        for (uint32_t i = 0; i < run; i++) buf_forget(fs, start + i);
+
+        group_desc(fs, group)->free_blocks += run;
+        group_dirty(fs, group);
+        fs->free_blocks += run;
+        start += run;
+        count -= run;
+    }
+}
+
+// Directory and extent blocks
+static void free_meta(lambdafs_t* fs, uint64_t start, uint64_t count) {
+    journal_revoke(fs, start, count);
+    free_blocks(fs, start, count);
+}
+
+// Directories spread out to the group with the most free blocks among
+// those with at least their share of free inodes; files stay with their
+// directory while it has room
+static uint32_t inode_group(lambdafs_t* fs, uint32_t parent_group, bool directory) {
+    uint32_t groups = fs->super->group_count;
+    if (directory) {
+        uint64_t average = fs->free_inodes / groups;
+        uint32_t best = parent_group;
+        uint32_t best_free = 0;
+        for (uint32_t group = 0; group < groups; group++) {
+            lambdafs_group_t* desc = group_desc(fs, group);
+            if (!desc->free_inodes || desc->free_inodes < average) continue;
+            if (desc->free_blocks > best_free || !best_free) {
+                best = group;
+                best_free = desc->free_blocks;
+            }
+        }
+        return best;
+    }
+    for (uint32_t pass = 0; pass < groups; pass++) {
+        uint32_t group = (parent_group + pass) % groups;
+        lambdafs_group_t* desc = group_desc(fs, group);
+        if (desc->free_inodes && (desc->free_blocks || pass == groups - 1)) return group;
+    }
+    return parent_group;
+}
+
+static int alloc_inode(lambdafs_t* fs, uint32_t parent_group, bool directory, vfs_ino_t* ino) {
+    if (!fs->free_inodes) return VFS_ERR_NOSPC;
+    uint32_t groups = fs->super->group_count;
+    uint32_t first = inode_group(fs, parent_group, directory);
+    for (uint32_t pass = 0; pass < groups; pass++) {
+        uint32_t group = (first + pass) % groups;
+        lambdafs_group_t* desc = group_desc(fs, group);
+        if (!desc->free_inodes) continue;
+
+        int err = 0;
+        buf_t* bitmap = buf_get(fs, desc->inode_bitmap, true, &err);
+        if (!bitmap) return err;
+        uint32_t bit = bit_find(bitmap->data, NULL, 0, fs->super->inodes_per_group, false);
+        if (bit < fs->super->inodes_per_group) {
+            bits_set(bitmap->data, bit, 1);
+            buf_dirty(fs, bitmap);
+            buf_put(bitmap);
+            desc->free_inodes--;
+            if (directory) desc->directories++;
+            group_dirty(fs, group);
+            fs->free_inodes--;
+            *ino = (vfs_ino_t)group * fs->super->inodes_per_group + bit + 1;
+            return 0;
+        }
+        buf_put(bitmap);
+    }
+    return VFS_ERR_NOSPC;
+}
+
+static void free_inode(lambdafs_t* fs, vfs_ino_t ino, bool directory) {
+    uint32_t group = ino_group(fs, ino);
+    uint32_t bit = (uint32_t)((ino - 1) % fs->super->inodes_per_group);
+    lambdafs_group_t* desc = group_desc(fs, group);
+    int err = 0;
+    buf_t* bitmap = buf_get(fs, desc->inode_bitmap, true, &err);
+    if (!bitmap) return;
+    bits_clear(bitmap->data, bit, 1);
+    buf_dirty(fs, bitmap);
+    buf_put(bitmap);
+    desc->free_inodes++;
+    if (directory) desc->directories--;
+    group_dirty(fs, group);
+    fs->free_inodes++;
+}
+
+// --- Extent maps ---
+
+// Index of the last extent starting at or before logical, or -1
+static int64_t extent_search(const inode_info_t* info, uint32_t logical) {
+    int64_t low = 0;
+    int64_t high = (int64_t)info->extent_count - 1;
+    int64_t found = -1;
+    while (low <= high) {
+        int64_t mid = (low + high) / 2;
+        if (info->extents[mid].logical <= logical) {
+            found = mid;
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return found;
+}
+
+// Physical block for a logical one, 0 for a hole
+static uint64_t extent_map(const inode_info_t* info, uint32_t logical) {
+    int64_t index = extent_search(info, logical);
+    if (index < 0) return 0;
+    const lambdafs_extent_t* extent = &info->extents[index];
+    if (logical - extent->logical >= extent->length) return 0;
+    return extent->physical + (logical - extent->logical);
+}
+
+static bool extents_reserve(inode_info_t* info, uint32_t count) {
+    if (count <= info->extent_slots) return true;
+    uint32_t slots = info->extent_slots ? info->extent_slots : 8;
+    while (slots < count) slots *= 2;
+    lambdafs_extent_t* extents = memory_alloc(slots * sizeof(lambdafs_extent_t));
+    if (!extents) return false;
+    if (info->extents) {
+        memcpy(extents, info->extents, info->extent_count * sizeof(lambdafs_extent_t));
+        memory_free(info->extents);
+    }
+    info->extents = extents;
+    info->extent_slots = slots;
+    return true;
+}
+
+// Map one unmapped logical block, growing a neighbouring extent if the
+// physical block continues it
+static int extent_add(inode_info_t* info, uint32_t logical, uint64_t physical) {
+    int64_t index = extent_search(info, logical);
+    lambdafs_extent_t* prev = index >= 0 ? &info->extents[index] : NULL;
+    lambdafs_extent_t* next = (uint64_t)(index + 1) < info->extent_count ? &info->extents[index + 1] : NULL;
+    bool joins_prev = prev && prev->logical + prev->length == logical &&
+                      prev->physical + prev->length == physical;
+    bool joins_next = next && next->logical == logical + 1 && next->physical == physical + 1;
+
+    if (joins_prev && joins_next) {
+        prev->length += 1 + next->length;
+        memmove(next, next + 1, (info->extent_count - index - 2) * sizeof(lambdafs_extent_t));
+        info->extent_count--;
+    } else if (joins_prev) {
+        prev->length++;
+    } else if (joins_next) {
+        next->logical--;
+        next->physical--;
+        next->length++;
+    } else {
+        if (!extents_reserve(info, info->extent_count + 1)) return VFS_ERR_NOMEM;
+        uint32_t at = (uint32_t)(index + 1);
+        memmove(&info->extents[at + 1], &info->extents[at],
+                (info->extent_count - at) * sizeof(lambdafs_extent_t));
+        info->extents[at] = (lambdafs_extent_t){ .logical = logical, .length = 1, .physical = physical };
+        info->extent_count++;
+    }
+    return 0;
+}
+
+// Unmap and free every block from logical first on. Directory blocks are
+// journaled metadata; file data is not.
+static void extent_truncate(lambdafs_t* fs, inode_info_t* info, uint32_t first) {
+    void (*release)(lambdafs_t*, uint64_t, uint64_t) =
+        info->inode->type == VFS_TYPE_DIR ? free_meta : free_blocks;
+    while (info->extent_count) {
+        lambdafs_extent_t* last = &info->extents[info->extent_count - 1];
+        if (last->logical + last->length <= first) break;
+        if (last->logical >= first) {
+            release(fs, last->physical, last->length);
+            info->extent_count--;
+        } else {
+            uint32_t keep = first - last->logical;
+            release(fs, last->physical + keep, last->length - keep);
+            last->length = keep;
+        }
+    }
+}
+
+// --- Delayed allocation ---
+
+static int64_t delayed_find(const inode_info_t* info, uint32_t logical) {
+    for (uint32_t i = 0; i < info->delayed_count; i++) {
+        const range_t* range = &info->delayed[i];
+        if (logical < range->start) break;
+        if (logical - range->start < range->length) return i;
+    }
+    return -1;
+}
+
+static bool delayed_insert_at(inode_info_t* info, uint32_t at, range_t range) {
+    if (info->delayed_count == info->delayed_slots) {
+        uint32_t slots = info->delayed_slots ? info->delayed_slots * 2 : 4;
+        range_t* ranges = memory_alloc(slots * sizeof(range_t));
+        if (!ranges) return false;
+        if (info->delayed) {
+            memcpy(ranges, info->delayed, info->delayed_count * sizeof(range_t));
+            memory_free(info->delayed);
+        }
+        info->delayed = ranges;
+        info->delayed_slots = slots;
+    }
+    memmove(&info->delayed[at + 1], &info->delayed[at], (info->delayed_count - at) * sizeof(range_t));
+    info->delayed[at] = range;
+    info->delayed_count++;
+    return true;
+}
+
+static void delayed_remove_at(inode_info_t* info, uint32_t at) {
+    memmove(&info->delayed[at], &info->delayed[at + 1], (info->delayed_count - at - 1) * sizeof(range_t));
+    info->delayed_count--;
+}
+
+// Record an unreserved logical block, merging with its neighbours
+static bool delayed_add(inode_info_t* info, uint32_t logical) {
+    uint32_t at = 0;
+    while (at < info->delayed_count && info->delayed[at].start < logical) at++;
+    range_t* prev = at ? &info->delayed[at - 1] : NULL;
+    range_t* next = at < info->delayed_count ? &info->delayed[at] : NULL;
+    bool joins_prev = prev && prev->start + prev->length == logical;
+    bool joins_next = next && next->start == logical + 1;
+
+    if (joins_prev && joins_next) {
+        prev->length += 1 + next->length;
+        delayed_remove_at(info, at);
+    } else if (joins_prev) {
+        prev->length++;
+    } else if (joins_next) {
+        next->start--;
+        next->length++;
+    } else if (!delayed_insert_at(info, at, (range_t){ .start = logical, .length = 1 })) {
+        return false;
+    }
+    info->delayed_blocks++;
+    return true;
+}
+
+static void delayed_remove(inode_info_t* info, uint32_t at, uint32_t logical) {
+    range_t* range = &info->delayed[at];
+    uint32_t end = range->start + range->length;
+    if (range->length == 1) {
+        delayed_remove_at(info, at);
+    } else if (logical == range->start) {
+        range->start++;
+        range->length--;
+    } else if (logical == end - 1) {
+        range->length--;
+    } else {
+        range->length = logical - range->start;
+        if (!delayed_insert_at(info, at + 1, (range_t){ .start = logical + 1, .length = end - logical - 1 })) {
+            // Out of memory: forget the tail; its pages allocate unreserved
+            info->delayed_blocks -= end - logical - 1;
+        }
+    }
+    info->delayed_blocks--;
+}
+
+// Drop reservations from logical first on; returns how many
+static uint64_t delayed_truncate(inode_info_t* info, uint32_t first) {
+    uint64_t dropped = 0;
+    while (info->delayed_count) {
+        range_t* last = &info->delayed[info->delayed_count - 1];
+        if (last->start + last->length <= first) break;
+        if (last->start >= first) {
+            dropped += last->length;
+            info->delayed_count--;
+        } else {
+            dropped += last->start + last->length - first;
+            last->length = first - last->start;
+        }
+    }
+    info->delayed_blocks -= dropped;
+    return dropped;
+}
+
+// Give back the unused part of the preallocation window
+static void window_discard(lambdafs_t* fs, inode_info_t* info) {
+    lambdafs_extent_t* window = &info->window;
+    uint32_t run = 0;
+    for (uint32_t i = 0; i <= window->length; i++) {
+        bool unused = i < window->length &&
+                      extent_map(info, window->logical + i) != window->physical + i;
+        if (unused) {
+            run++;
+        } else if (run) {
+            free_blocks(fs, window->physical + i - run, run);
+            run = 0;
+        }
+    }
+    window->length = 0;
+}
+
+// Continue the extent before logical, or start in the inode's group
+static uint64_t alloc_goal(lambdafs_t* fs, const inode_info_t* info, uint32_t logical) {
+    int64_t index = extent_search(info, logical);
+    if (index >= 0) {
+        const lambdafs_extent_t* prev = &info->extents[index];
+        return prev->physical + prev->length + (logical - prev->logical - prev->length);
+    }
+    return group_data_start(fs, ino_group(fs, info->inode->ino));
+}
+
+// --- Inodes ---
+
+static void inode_dirty(lambdafs_t* fs, inode_info_t* info) {
+    if (info->dirty) return;
+    info->dirty = true;
+    info->dirty_prev = NULL;
+    info->dirty_next = fs->dirty_inodes;
+    if (fs->dirty_inodes) fs->dirty_inodes->dirty_prev = info;
+    fs->dirty_inodes = info;
+    tx_touch(fs);
+}
+
+static void inode_clean(lambdafs_t* fs, inode_info_t* info) {
+    if (!info->dirty) return;
+    if (info->dirty_prev) info->dirty_prev->dirty_next = info->dirty_next;
+    else fs->dirty_inodes = info->dirty_next;
+    if (info->dirty_next) info->dirty_next->dirty_prev = info->dirty_prev;
+    info->dirty = false;
+}
+
+static buf_t* inode_buf(lambdafs_t* fs, vfs_ino_t ino, lambdafs_inode_t** raw, int* error) {
+    uint32_t index = (uint32_t)((ino - 1) % fs->super->inodes_per_group);
+    uint64_t block = group_desc(fs, ino_group(fs, ino))->inode_table + index / LAMBDAFS_INODES_PER_BLOCK;
+    buf_t* buf = buf_get(fs, block, true, error);
+    if (buf) *raw = (lambdafs_inode_t*)(buf->data + (index % LAMBDAFS_INODES_PER_BLOCK) * LAMBDAFS_INODE_SIZE);
+    return buf;
+}
+
+static bool ino_allocated(lambdafs_t* fs, vfs_ino_t ino) {
+    int err = 0;
+    buf_t* bitmap = buf_get(fs, group_desc(fs, ino_group(fs, ino))->inode_bitmap, true, &err);
+    if (!bitmap) return false;
+    bool allocated = bit_test(bitmap->data, (uint32_t)((ino - 1) % fs->super->inodes_per_group));
+    buf_put(bitmap);
+    return allocated;
+}
+
+// Write the inode and its extent chain into their buffers
+static int inode_store(lambdafs_t* fs, inode_info_t* info) {
+    uint32_t overflow = info->extent_count > LAMBDAFS_INLINE_EXTENTS
+                      ? info->extent_count - LAMBDAFS_INLINE_EXTENTS : 0;
+    uint32_t need = (overflow + LAMBDAFS_CHAIN_EXTENTS - 1) / LAMBDAFS_CHAIN_EXTENTS;
+
+    if (need > info->chain_count) {
+        uint64_t* chain = memory_alloc(need * sizeof(uint64_t));
+        if (!chain) return VFS_ERR_NOMEM;
+        if (info->chain) {
+            memcpy(chain, info->chain, info->chain_count * sizeof(uint64_t));
+            memory_free(info->chain);
+        }
+        info->chain = chain;
+        while (info->chain_count < need) {
+            uint64_t goal = info->chain_count ? info->chain[info->chain_count - 1] + 1
+                                              : group_data_start(fs, ino_group(fs, info->inode->ino));
+            uint32_t got;
+            int err = alloc_blocks(fs, goal, 1, &info->chain[info->chain_count], &got);
+            if (err) return err;
+            info->chain_count++;
+        }
+    }
+    while (info->chain_count > need) {
+        free_meta(fs, info->chain[--info->chain_count], 1);
+    }
+
+    for (uint32_t i = 0; i < info->chain_count; i++) {
+        int err = 0;
+        buf_t* buf = buf_get(fs, info->chain[i], false, &err);
+        if (!buf) return err;
+        lambdafs_extent_block_t* block = (lambdafs_extent_block_t*)buf->data;
+        uint32_t first = LAMBDAFS_INLINE_EXTENTS + i * LAMBDAFS_CHAIN_EXTENTS;
+        uint32_t count = info->extent_count - first;
+        if (count > LAMBDAFS_CHAIN_EXTENTS) count = LAMBDAFS_CHAIN_EXTENTS;
+        block->next = i + 1 < info->chain_count ? info->chain[i + 1] : 0;
+        block->count = count;
+        memcpy(block->extents, &info->extents[first], count * sizeof(lambdafs_extent_t));
+        buf_dirty(fs, buf);
+        buf_put(buf);
+    }
+
+    lambdafs_inode_t* raw;
+    int err = 0;
+    buf_t* buf = inode_buf(fs, info->inode->ino, &raw, &err);
+    if (!buf) return err;
+    raw->type = info->inode->type;
+    raw->nlink = info->inode->nlink;
+    raw->size = info->inode->size;
+    raw->flags = info->flags;
+    raw->extent_count = info->extent_count;
+    raw->extent_block = info->chain_count ? info->chain[0] : 0;
+    uint32_t inline_count = info->extent_count < LAMBDAFS_INLINE_EXTENTS
+                          ? info->extent_count : LAMBDAFS_INLINE_EXTENTS;
+    memset(raw->extents, 0, sizeof(raw->extents));
+    if (inline_count) memcpy(raw->extents, info->extents, inline_count * sizeof(lambdafs_extent_t));
+    buf_dirty(fs, buf);
+    buf_put(buf);
+    inode_clean(fs, info);
+    return 0;
+}
+
+static bool extent_valid(const lambdafs_t* fs, const lambdafs_extent_t* extent, uint64_t next_logical) {
+    return extent->length && extent->logical >= next_logical && extent->physical &&
+           extent->physical < fs->super->block_count &&
+           extent->length <= fs->super->block_count - extent->physical;
+}
+
+// Read the extent list, checking that it is ordered and on the disk
+static int inode_load(lambdafs_t* fs, inode_info_t* info, const lambdafs_inode_t* raw) {
+    uint32_t count = raw->extent_count;
+    if (count > LAMBDAFS_INLINE_EXTENTS && !raw->extent_block) return VFS_ERR_IO;
+    if (!extents_reserve(info, count)) return VFS_ERR_NOMEM;
+    uint32_t inline_count = count < LAMBDAFS_INLINE_EXTENTS ? count : LAMBDAFS_INLINE_EXTENTS;
+    if (inline_count) memcpy(info->extents, raw->extents, inline_count * sizeof(lambdafs_extent_t));
+    info->extent_count = inline_count;
+
+    uint32_t need = count > inline_count ? (count - inline_count + LAMBDAFS_CHAIN_EXTENTS - 1) / LAMBDAFS_CHAIN_EXTENTS : 0;
+    if (need) {
+        info->chain = memory_alloc(need * sizeof(uint64_t));
+        if (!info->chain) return VFS_ERR_NOMEM;
+    }
+    uint64_t next = raw->extent_block;
+    while (info->extent_count < count) {
+        if (info->chain_count == need || !next || next >= fs->super->block_count) return VFS_ERR_IO;
+        int err = 0;
+        buf_t* buf = buf_get(fs, next, true, &err);
+        if (!buf) return err;
+        const lambdafs_extent_block_t* block = (const lambdafs_extent_block_t*)buf->data;
+        uint32_t take = block->count;
+        if (!take || take > LAMBDAFS_CHAIN_EXTENTS || take > count - info->extent_count) {
+            buf_put(buf);
+            return VFS_ERR_IO;
+        }
+        memcpy(&info->extents[info->extent_count], block->extents, take * sizeof(lambdafs_extent_t));
+        info->extent_count += take;
+        info->chain[info->chain_count++] = next;
+        next = block->next;
+        buf_put(buf);
+    }
+
+    uint64_t next_logical = 0;
+    for (uint32_t i = 0; i < info->extent_count; i++) {
+        if (!extent_valid(fs, &info->extents[i], next_logical)) return VFS_ERR_IO;
+        next_logical = (uint64_t)info->extents[i].logical + info->extents[i].length;
+    }
+    return 0;
+}
+
+static void info_free(inode_info_t* info) {
+    if (info->extents) memory_free(info->extents);
+    if (info->chain) memory_free(info->chain);
+    if (info->delayed) memory_free(info->delayed);
+    memory_free(info);
+}
+
+// --- Directories ---
+
+static inline uint32_t dirent_size(uint32_t name_len) {
+    return (DIRENT_HEADER + name_len + 7) & ~7u;
+}
+
+// Entry at offset, or NULL if the block is corrupt there
+static lambdafs_dirent_t* dirent_at(uint8_t* block, uint32_t offset) {
+    if (offset % 8 || offset + DIRENT_HEADER > BLOCK_SIZE) return NULL;
+    lambdafs_dirent_t* entry = (lambdafs_dirent_t*)(block + offset);
+    if (entry->rec_len < DIRENT_HEADER || entry->rec_len % 8 || offset + entry->rec_len > BLOCK_SIZE) return NULL;
+    if (entry->ino && dirent_size(entry->name_len) > entry->rec_len) return NULL;
+    return entry;
+}
+
+static buf_t* dir_block(lambdafs_t* fs, inode_info_t* dir, uint32_t logical, int* error) {
+    uint64_t physical = extent_map(dir, logical);
+    if (!physical) {
+        *error = VFS_ERR_IO;
+        return NULL;
+    }
+    return buf_get(fs, physical, true, error);
+}
+
+static inline uint32_t dir_blocks(const inode_info_t* dir) {
+    return (uint32_t)(dir->inode->size / BLOCK_SIZE);
+}
+
+static inline bool dir_indexed(const inode_info_t* dir) {
+    return dir->flags & LAMBDAFS_INODE_INDEXED;
+}
+
+typedef struct {
+    uint32_t logical;
+    uint32_t offset;
+    uint32_t prev;                  // Offset of the entry before, or UINT32_MAX
+    vfs_ino_t ino;
+} dir_slot_t;
+
+// Append an empty block to a directory
+static buf_t* dir_grow(lambdafs_t* fs, inode_info_t* dir, int* error) {
+    uint32_t logical = dir_blocks(dir);
+    uint64_t physical;
+    uint32_t got;
+    int err = alloc_blocks(fs, alloc_goal(fs, dir, logical), 1, &physical, &got);
+    if (!err) err = extent_add(dir, logical, physical);
+    buf_t* buf = err ? NULL : buf_get(fs, physical, false, &err);
+    if (!buf) {
+        *error = err;
+        return NULL;
+    }
+    lambdafs_dirent_t* entry = (lambdafs_dirent_t*)buf->data;
+    entry->ino = 0;
+    entry->rec_len = BLOCK_SIZE;
+    buf_dirty(fs, buf);
+    dir->inode->size += BLOCK_SIZE;
+    inode_dirty(fs, dir);
+    return buf;
+}
+
+// --- Entry blocks ---
+
+static int leaf_find(buf_t* buf, const char* name, size_t len, dir_slot_t* slot) {
+    uint32_t prev = UINT32_MAX;
+    for (uint32_t offset = 0; offset < BLOCK_SIZE;) {
+        lambdafs_dirent_t* entry = dirent_at(buf->data, offset);
+        if (!entry) return VFS_ERR_IO;
+        if (entry->ino && entry->name_len == len && memcmp(entry->name, name, len) == 0) {
+            slot->offset = offset;
+            slot->prev = prev;
+            slot->ino = entry->ino;
+            return 0;
+        }
+        prev = offset;
+        offset += entry->rec_len;
+    }
+    return VFS_ERR_NOENT;
+}
+
+// 1 once placed, 0 if the block has no room
+static int leaf_add(lambdafs_t* fs, buf_t* buf, const char* name, size_t len, vfs_ino_t ino, uint32_t type) {
+    uint32_t need = dirent_size((uint32_t)len);
+    for (uint32_t offset = 0; offset < BLOCK_SIZE;) {
+        lambdafs_dirent_t* entry = dirent_at(buf->data, offset);
+        if (!entry) return VFS_ERR_IO;
+        uint32_t used = entry->ino ? dirent_size(entry->name_len) : 0;
+        if (entry->rec_len - used >= need) {
+            if (used) {
+                // Split the slack off the end of a live entry
+                lambdafs_dirent_t* fresh = (lambdafs_dirent_t*)(buf->data + offset + used);
+                fresh->rec_len = (uint16_t)(entry->rec_len - used);
+                entry->rec_len = (uint16_t)used;
+                entry = fresh;
+            }
+            entry->ino = (uint32_t)ino;
+            entry->name_len = (uint8_t)len;
+            entry->type = (uint8_t)type;
+            memcpy(entry->name, name, len);
+            buf_dirty(fs, buf);
+            return 1;
+        }
+        offset += entry->rec_len;
+    }
+    return 0;
+}
+
+static int leaf_empty(buf_t* buf) {
+    for (uint32_t offset = 0; offset < BLOCK_SIZE;) {
+        lambdafs_dirent_t* entry = dirent_at(buf->data, offset);
+        if (!entry) return VFS_ERR_IO;
+        if (entry->ino) return VFS_ERR_NOTEMPTY;
+        offset += entry->rec_len;
+    }
+    return 0;
+}
+
+// 64-bit name hash, seeded per filesystem. Entries are ordered by it; the
+// top half orders the index and keeps its low bit clear for continuation
+// marks.
+static uint64_t dx_hash(const lambdafs_t* fs, const char* name, size_t len) {
+    uint64_t hash = 14695981039346656037ULL ^ ((uint64_t)fs->super->hash_seed * 0x9E3779B97F4A7C15ULL);
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    return hash & ~(1ULL << 32);
+}
+
+static inline uint32_t dx_major(uint64_t hash) {
+    return (uint32_t)(hash >> 32);
+}
+
+// A readdir position. Entries are ordered by hash, then by name.
+typedef struct {
+    uint64_t hash;
+    const char* name;
+    size_t len;
+} dir_pos_t;
+
+static int dir_pos_cmp(uint64_t hash, const char* name, size_t len, const dir_pos_t* pos) {
+    if (hash != pos->hash) return hash < pos->hash ? -1 : 1;
+    int diff = memcmp(name, pos->name, len < pos->len ? len : pos->len);
+    if (diff) return diff;
+    return len < pos->len ? -1 : len > pos->len;
+}
+
+typedef struct {
+    uint64_t hash;                  // UINT64_MAX until an entry is found
+    uint64_t next;                  // Lowest hash of the other entries seen
+} dir_best_t;
+
+// The first entry past after, if it comes before the best so far
+static int leaf_next(lambdafs_t* fs, buf_t* buf, const dir_pos_t* after, dir_best_t* best, vfs_dirent_t* dirent) {
+    for (uint32_t offset = 0; offset < BLOCK_SIZE;) {
+        lambdafs_dirent_t* entry = dirent_at(buf->data, offset);
+        if (!entry) return VFS_ERR_IO;
+        if (entry->ino) {
+            uint64_t hash = dx_hash(fs, entry->name, entry->name_len);
+            if (dir_pos_cmp(hash, entry->name, entry->name_len, after) <= 0) {
+                // Already returned
+            } else if (best->hash == UINT64_MAX || dir_pos_cmp(hash, entry->name, entry->name_len, &(dir_pos_t){ best->hash, dirent->name, dirent->name_len }) < 0) {
+                if (best->hash < best->next) best->next = best->hash;
+                best->hash = hash;
+                dirent->ino = entry->ino;
+                dirent->type = entry->type;
+                dirent->name_len = entry->name_len;
+                memcpy(dirent->name, entry->name, entry->name_len);
+                dirent->name[entry->name_len] = '\0';
+            } else if (hash < best->next) {
+                best->next = hash;
+            }
+        }
+        offset += entry->rec_len;
+    }
+    return 0;
+}
+
+typedef struct {
+    uint64_t hash;
+    uint16_t offset;
+    uint16_t size;
+} leaf_sort_t;
+
+// Lay out entries [from, to) of a sorted block copy, the last taking the slack
+static void leaf_fill(uint8_t* block, const uint8_t* copy, const leaf_sort_t* sorted, uint32_t from, uint32_t to) {
+    lambdafs_dirent_t* entry = (lambdafs_dirent_t*)block;
+    entry->ino = 0;
+    entry->rec_len = BLOCK_SIZE;
+    uint32_t offset = 0;
+    for (uint32_t i = from; i < to; i++) {
+        entry = (lambdafs_dirent_t*)(block + offset);
+        memcpy(entry, copy + sorted[i].offset, sorted[i].size);
+        entry->rec_len = sorted[i].size;
+        offset += sorted[i].size;
+    }
+    if (offset) entry->rec_len = (uint16_t)(entry->rec_len + BLOCK_SIZE - offset);
+}
+
+// Move the upper half of a full block, by hash, into an empty one.
+// Returns the hash the new block starts at, marked as a continuation if
+// the halves share one.
+static int leaf_split(lambdafs_t* fs, buf_t* buf, buf_t* fresh, uint32_t* split) {
+    uint8_t* copy = memory_alloc(BLOCK_SIZE);
+    leaf_sort_t* sorted = memory_alloc(BLOCK_SIZE / DIRENT_HEADER * sizeof(leaf_sort_t));
+    int err = copy && sorted ? 0 : VFS_ERR_NOMEM;
+    uint32_t count = 0;
+    uint32_t total = 0;
+    if (!err) memcpy(copy, buf->data, BLOCK_SIZE);
+    for (uint32_t offset = 0; !err && offset < BLOCK_SIZE;) {
+        lambdafs_dirent_t* entry = dirent_at(copy, offset);
+        if (!entry) {
+            err = VFS_ERR_IO;
+            break;
+        }
+        if (entry->ino) {
+            leaf_sort_t item = {
+                .hash = dx_hash(fs, entry->name, entry->name_len),
+                .offset = (uint16_t)offset,
+                .size = (uint16_t)dirent_size(entry->name_len),
+            };
+            uint32_t at = count++;
+            while (at && sorted[at - 1].hash > item.hash) {
+                sorted[at] = sorted[at - 1];
+                at--;
+            }
+            sorted[at] = item;
+            total += item.size;
+        }
+        offset += entry->rec_len;
+    }
+    if (!err && count < 2) err = VFS_ERR_IO;
+
+    if (!err) {
+        uint32_t middle = 1;
+        for (uint32_t bytes = sorted[0].size; middle < count - 1 && bytes < total / 2; middle++) {
+            bytes += sorted[middle].size;
+        }
+        uint32_t major = dx_major(sorted[middle].hash);
+        *split = major | (dx_major(sorted[middle - 1].hash) == major);
+        leaf_fill(buf->data, copy, sorted, 0, middle);
+        leaf_fill(fresh->data, copy, sorted, middle, count);
+        buf_dirty(fs, buf);
+        buf_dirty(fs, fresh);
+    }
+    if (copy) memory_free(copy);
+    if (sorted) memory_free(sorted);
+    return err;
+}
+
+// --- Directory index ---
+
+#define DX_LIMIT        ((BLOCK_SIZE - sizeof(lambdafs_dx_node_t)) / sizeof(lambdafs_dx_entry_t))
+#define DX_MAX_LEVELS   1           // Below the root: 260k entry blocks
+
+typedef struct {
+    buf_t* buf;
+    uint32_t at;                    // Entry followed down
+} dx_frame_t;
+
+// Root first; the last frame's entry is the current entry block
+typedef struct {
+    dx_frame_t frames[DX_MAX_LEVELS + 1];
+    uint32_t depth;
+} dx_path_t;
+
+static inline lambdafs_dx_node_t* dx_node(buf_t* buf) {
+    return (lambdafs_dx_node_t*)buf->data;
+}
+
+static buf_t* dx_read_node(lambdafs_t* fs, inode_info_t* dir, uint32_t logical, int* error) {
+    buf_t* buf = dir_block(fs, dir, logical, error);
+    if (!buf) return NULL;
+    lambdafs_dx_node_t* node = dx_node(buf);
+    bool valid = node->limit == DX_LIMIT && node->count && node->count <= DX_LIMIT &&
+                 (logical || node->levels <= DX_MAX_LEVELS);
+    for (uint32_t i = 0; valid && i < node->count; i++) {
+        const lambdafs_dx_entry_t* entry = &node->entries[i];
+        valid = entry->block && entry->block < dir_blocks(dir) && (!i || entry->hash >= entry[-1].hash);
+    }
+    if (!valid) {
+        buf_put(buf);
+        *error = VFS_ERR_IO;
+        return NULL;
+    }
+    return buf;
+}
+
+static void dx_release(dx_path_t* path) {
+    while (path->depth) {
+        buf_put(path->frames[--path->depth].buf);
+    }
+}
+
+// Follow the index down to the first entry block that can hold major
+static int dx_probe(lambdafs_t* fs, inode_info_t* dir, uint32_t major, dx_path_t* path) {
+    int err = 0;
+    path->depth = 0;
+    buf_t* buf = dx_read_node(fs, dir, 0, &err);
+    if (!buf) return err;
+    uint32_t levels = dx_node(buf)->levels;
+    while (1) {
+        // The last entry at or below major. A continuation mark sorts
+        // after the unmarked hash, so this is where the hash begins.
+        lambdafs_dx_node_t* node = dx_node(buf);
+        uint32_t low = 1;
+        uint32_t high = node->count;
+        while (low < high) {
+            uint32_t mid = (low + high) / 2;
+            if (node->entries[mid].hash > major) high = mid;
+            else low = mid + 1;
+        }
+        path->frames[path->depth++] = (dx_frame_t){ .buf = buf, .at = low - 1 };
+        if (path->depth > levels) return 0;
+        buf = dx_read_node(fs, dir, node->entries[low - 1].block, &err);
+        if (!buf) {
+            dx_release(path);
+            return err;
+        }
+    }
+}
+
+static inline uint32_t dx_leaf(const dx_path_t* path) {
+    const dx_frame_t* frame = &path->frames[path->depth - 1];
+    return dx_node(frame->buf)->entries[frame->at].block;
+}
+
+// Hash the next entry block starts at; false after the last
+static bool dx_peek(const dx_path_t* path, uint32_t* hash) {
+    for (uint32_t level = path->depth; level--;) {
+        const dx_frame_t* frame = &path->frames[level];
+        const lambdafs_dx_node_t* node = dx_node(frame->buf);
+        if (frame->at + 1 < node->count) {
+            *hash = node->entries[frame->at + 1].hash;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Step to the next entry block: 1, 0 after the last, or an error
+static int dx_advance(lambdafs_t* fs, inode_info_t* dir, dx_path_t* path) {
+    uint32_t level = path->depth;
+    while (level && path->frames[level - 1].at + 1 >= dx_node(path->frames[level - 1].buf)->count) {
+        level--;
+    }
+    if (!level) return 0;
+    path->frames[level - 1].at++;
+    for (; level < path->depth; level++) {
+        dx_frame_t* parent = &path->frames[level - 1];
+        int err = 0;
+        buf_t* child = dx_read_node(fs, dir, dx_node(parent->buf)->entries[parent->at].block, &err);
+        if (!child) return err;
+        buf_put(path->frames[level].buf);
+        path->frames[level] = (dx_frame_t){ .buf = child, .at = 0 };
+    }
+    return 1;
+}
+
+static void dx_insert(buf_t* buf, uint32_t at, uint32_t hash, uint32_t block) {
+    lambdafs_dx_node_t* node = dx_node(buf);
+    memmove(&node->entries[at + 1], &node->entries[at], (node->count - at) * sizeof(lambdafs_dx_entry_t));
+    node->entries[at] = (lambdafs_dx_entry_t){ .hash = hash, .block = block };
+    node->count++;
+}
+
+static void dx_init(buf_t* buf, uint8_t levels) {
+    memset(buf->data, 0, BLOCK_SIZE);
+    lambdafs_dx_node_t* node = dx_node(buf);
+    node->limit = DX_LIMIT;
+    node->levels = levels;
+}
+
+// Make room for one more entry next to the current entry block. A full
+// root under a single level is pushed down into a new node first; a
+// full node is split in two.
+static int dx_make_room(lambdafs_t* fs, inode_info_t* dir, dx_path_t* path) {
+    dx_frame_t* frame = &path->frames[path->depth - 1];
+    if (dx_node(frame->buf)->count < DX_LIMIT) return 0;
+
+    int err = 0;
+    if (path->depth == 1) {
+        buf_t* child = dir_grow(fs, dir, &err);
+        if (!child) return err;
+        memcpy(child->data, frame->buf->data, BLOCK_SIZE);
+        dx_node(child)->levels = 0;
+        dx_init(frame->buf, 1);
+        dx_insert(frame->buf, 0, 0, dir_blocks(dir) - 1);
+        buf_dirty(fs, frame->buf);
+        path->frames[1] = (dx_frame_t){ .buf = child, .at = frame->at };
+        frame->at = 0;
+        path->depth = 2;
+        frame = &path->frames[1];
+    }
+
+    dx_frame_t* root = &path->frames[0];
+    if (dx_node(root->buf)->count >= DX_LIMIT) return VFS_ERR_NOSPC;
+    buf_t* sibling = dir_grow(fs, dir, &err);
+    if (!sibling) return err;
+    lambdafs_dx_node_t* node = dx_node(frame->buf);
+    uint32_t half = node->count / 2;
+    dx_init(sibling, 0);
+    memcpy(dx_node(sibling)->entries, &node->entries[half], (node->count - half) * sizeof(lambdafs_dx_entry_t));
+    dx_node(sibling)->count = (uint16_t)(node->count - half);
+    node->count = (uint16_t)half;
+    dx_insert(root->buf, root->at + 1, dx_node(sibling)->entries[0].hash, dir_blocks(dir) - 1);
+    buf_dirty(fs, root->buf);
+    buf_dirty(fs, frame->buf);
+    if (frame->at >= half) {
+        buf_put(frame->buf);
+        frame->buf = sibling;
+        frame->at -= half;
+        root->at++;
+    } else {
+        buf_put(sibling);
+    }
+    return 0;
+}
+
+static int dx_find(lambdafs_t* fs, inode_info_t* dir, const char* name, size_t len, dir_slot_t* slot) {
+    uint32_t major = dx_major(dx_hash(fs, name, len));
+    dx_path_t path;
+    int err = dx_probe(fs, dir, major, &path);
+    while (!err) {
+        uint32_t logical = dx_leaf(&path);
+        buf_t* buf = dir_block(fs, dir, logical, &err);
+        if (!buf) break;
+        err = leaf_find(buf, name, len, slot);
+        buf_put(buf);
+        if (!err) slot->logical = logical;
+        if (err != VFS_ERR_NOENT) break;
+
+        // The hash may run on into the next block
+        uint32_t next;
+        if (!dx_peek(&path, &next) || next != (major | 1)) break;
+        int moved = dx_advance(fs, dir, &path);
+        err = moved < 0 ? moved : moved ? 0 : VFS_ERR_NOENT;
+    }
+    dx_release(&path);
+    return err;
+}
+
+static int dx_add(lambdafs_t* fs, inode_info_t* dir, const char* name, size_t len, vfs_ino_t ino, uint32_t type) {
+    uint32_t major = dx_major(dx_hash(fs, name, len));
+    dx_path_t path;
+    int err = dx_probe(fs, dir, major, &path);
+    if (err) return err;
+    buf_t* buf = dir_block(fs, dir, dx_leaf(&path), &err);
+    int placed = buf ? leaf_add(fs, buf, name, len, ino, type) : err;
+    if (placed == 0) {
+        buf_t* fresh = NULL;
+        err = dx_make_room(fs, dir, &path);
+        if (!err) fresh = dir_grow(fs, dir, &err);
+        uint32_t split;
+        if (fresh) err = leaf_split(fs, buf, fresh, &split);
+        if (fresh && !err) {
+            dx_frame_t* frame = &path.frames[path.depth - 1];
+            dx_insert(frame->buf, frame->at + 1, split, dir_blocks(dir) - 1);
+            buf_dirty(fs, frame->buf);
+            placed = leaf_add(fs, major >= (split & ~1u) ? fresh : buf, name, len, ino, type);
+            if (placed == 0) placed = VFS_ERR_IO;
+        } else {
+            placed = err;
+        }
+        if (fresh) buf_put(fresh);
+    }
+    if (buf) buf_put(buf);
+    dx_release(&path);
+    return placed < 0 ? placed : 0;
+}
+
+// Turn a full one-block directory into an index over that block
+static int dx_create(lambdafs_t* fs, inode_info_t* dir) {
+    int err = 0;
+    buf_t* root = dir_block(fs, dir, 0, &err);
+    buf_t* leaf = root ? dir_grow(fs, dir, &err) : NULL;
+    if (leaf) {
+        memcpy(leaf->data, root->data, BLOCK_SIZE);
+        dx_init(root, 0);
+        dx_insert(root, 0, 0, 1);
+        buf_dirty(fs, root);
+        dir->flags |= LAMBDAFS_INODE_INDEXED;
+        inode_dirty(fs, dir);
+        buf_put(leaf);
+    }
+    if (root) buf_put(root);
+    return err;
+}
+
+// Entries past after, into the first leaf past the best
+static int dx_next(lambdafs_t* fs, inode_info_t* dir, const dir_pos_t* after, dir_best_t* best, vfs_dirent_t* dirent) {
+    dx_path_t path;
+    int err = dx_probe(fs, dir, dx_major(after->hash), &path);
+    while (!err) {
+        buf_t* buf = dir_block(fs, dir, dx_leaf(&path), &err);
+        if (!buf) break;
+        err = leaf_next(fs, buf, after, best, dirent);
+        buf_put(buf);
+        uint32_t next;
+        if (err || !dx_peek(&path, &next) || best->hash < (uint64_t)(next & ~1u) << 32) break;
+        int moved = dx_advance(fs, dir, &path);
+        if (moved <= 0) {
+            err = moved;
+            break;
+        }
+    }
+    dx_release(&path);
+    return err;
+}
+
+// --- Directory operations ---
+
+static int dir_next(lambdafs_t* fs, inode_info_t* dir, const dir_pos_t* after, dir_best_t* best, vfs_dirent_t* dirent) {
+    if (dir_indexed(dir)) return dx_next(fs, dir, after, best, dirent);
+    int err = 0;
+    for (uint32_t logical = 0; logical < dir_blocks(dir) && !err; logical++) {
+        buf_t* buf = dir_block(fs, dir, logical, &err);
+        if (!buf) break;
+        err = leaf_next(fs, buf, after, best, dirent);
+        buf_put(buf);
+    }
+    return err;
+}
+
+static int dir_find(lambdafs_t* fs, inode_info_t* dir, const char* name, size_t len, dir_slot_t* slot) {
+    if (dir_indexed(dir)) return dx_find(fs, dir, name, len, slot);
+    for (uint32_t logical = 0; logical < dir_blocks(dir); logical++) {
+        int err = 0;
+        buf_t* buf = dir_block(fs, dir, logical, &err);
+        if (!buf) return err;
+        err = leaf_find(buf, name, len, slot);
+        buf_put(buf);
+        if (!err) slot->logical = logical;
+        if (err != VFS_ERR_NOENT) return err;
+    }
+    return VFS_ERR_NOENT;
+}
+
+// Small directories are a list of blocks; one that fills its first block
+// is indexed from then on
+static int dir_add(lambdafs_t* fs, inode_info_t* dir, const char* name, size_t len, vfs_ino_t ino, uint32_t type) {
+    if (dir_indexed(dir)) return dx_add(fs, dir, name, len, ino, type);
+    uint32_t blocks = dir_blocks(dir);
+    for (uint32_t logical = 0; logical <= blocks; logical++) {
+        int err = 0;
+        buf_t* buf = NULL;
+        if (logical < blocks) {
+            buf = dir_block(fs, dir, logical, &err);
+        } else if (blocks == 1) {
+            err = dx_create(fs, dir);
+            return err ? err : dx_add(fs, dir, name, len, ino, type);
+        } else {
+            buf = dir_grow(fs, dir, &err);
+        }
+        if (!buf) return err;
+        int placed = leaf_add(fs, buf, name, len, ino, type);
+        buf_put(buf);
+        if (placed) return placed < 0 ? placed : 0;
+    }
+    return VFS_ERR_NOSPC;
+}
+
+static int dir_remove(lambdafs_t* fs, inode_info_t* dir, const dir_slot_t* slot) {
+    int err = 0;
+    buf_t* buf = dir_block(fs, dir, slot->logical, &err);
+    if (!buf) return err;
+    lambdafs_dirent_t* entry = (lambdafs_dirent_t*)(buf->data + slot->offset);
+    if (slot->prev != UINT32_MAX) {
+        lambdafs_dirent_t* prev = (lambdafs_dirent_t*)(buf->data + slot->prev);
+        prev->rec_len = (uint16_t)(prev->rec_len + entry->rec_len);
+    } else {
+        entry->ino = 0;
+    }
+    buf_dirty(fs, buf);
+    buf_put(buf);
+    return 0;
+}
+
+static int dir_empty(lambdafs_t* fs, inode_info_t* dir) {
+    if (dir_indexed(dir)) {
+        dx_path_t path;
+        int err = dx_probe(fs, dir, 0, &path);
+        while (!err) {
+            buf_t* buf = dir_block(fs, dir, dx_leaf(&path), &err);
+            if (!buf) break;
+            err = leaf_empty(buf);
+            buf_put(buf);
+            int moved = err ? 0 : dx_advance(fs, dir, &path);
+            if (moved <= 0) {
+                err = err ? err : moved;
+                break;
+            }
+        }
+        dx_release(&path);
+        return err;
+    }
+    for (uint32_t logical = 0; logical < dir_blocks(dir); logical++) {
+        int err = 0;
+        buf_t* buf = dir_block(fs, dir, logical, &err);
+        if (!buf) return err;
+        err = leaf_empty(buf);
+        buf_put(buf);
+        if (err) return err;
+    }
+    return 0;
+}
+
+// --- Journal ---
+
+static inline uint64_t log_block(const lambdafs_t* fs, uint32_t offset) {
+    return fs->log_start + offset;
+}
+
+static bool journal_block_valid(const lambdafs_journal_block_t* block, uint32_t type, uint64_t id, uint64_t seq) {
+    return block->magic == LAMBDAFS_JOURNAL_MAGIC && block->type == type &&
+           block->id == id && block->sequence == seq;
+}
+
+static int journal_write_header(blockdev_t* dev, uint64_t block, uint64_t id, uint64_t seq, uint32_t tail) {
+    uint8_t* data = memory_alloc(BLOCK_SIZE);
+    if (!data) return VFS_ERR_NOMEM;
+    memset(data, 0, BLOCK_SIZE);
+    lambdafs_journal_super_t* header = (lambdafs_journal_super_t*)data;
+    header->header = (lambdafs_journal_block_t){
+        .magic = LAMBDAFS_JOURNAL_MAGIC, .type = LAMBDAFS_JOURNAL_HEADER, .id = id, .sequence = seq,
+    };
+    header->tail = tail;
+    int err = blockdev_write(dev, block, 1, data);
+    memory_free(data);
+    return err;
+}
+
+// Only one commit or checkpoint writes the log at a time. The owner sleeps
+// on the disk, so anyone waiting for it sleeps too.
+static bool journal_claim(lambdafs_t* fs) {
+    return mutex_trylock(&fs->journal_lock);
+}
+
+static void journal_release(lambdafs_t* fs) {
+    mutex_unlock(&fs->journal_lock);
+}
+
+// Read the commit at offset into frame if it is complete. Returns its
+// length, 0 if there is none, or an error.
+static int64_t journal_read(lambdafs_t* fs, uint32_t offset, uint64_t seq, uint8_t* frame) {
+    int err = blockdev_read(fs->dev, log_block(fs, offset), 1, frame);
+    if (err) return err;
+    const lambdafs_journal_desc_t* desc = (const lambdafs_journal_desc_t*)frame;
+    if (!journal_block_valid(&desc->header, LAMBDAFS_JOURNAL_DESCRIPTOR, fs->journal_id, seq)) return 0;
+    uint64_t entries = desc->count + 2ULL * desc->revoke_count;
+    uint64_t desc_blocks = (JOURNAL_DESC_SIZE + entries * sizeof(uint64_t) + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint64_t length = desc_blocks + desc->count + 1;
+    if (desc->desc_blocks != desc_blocks || length > fs->log_blocks - offset) return 0;
+
+    err = blockdev_read(fs->dev, log_block(fs, offset), (uint32_t)length, frame);
+    if (err) return err;
+    const lambdafs_journal_commit_t* commit = (const lambdafs_journal_commit_t*)(frame + (length - 1) * BLOCK_SIZE);
+    if (!journal_block_valid(&commit->header, LAMBDAFS_JOURNAL_COMMIT, fs->journal_id, seq)) return 0;
+    if (commit->blocks != length) return 0;
+    if (commit->checksum != crc32_update(0, frame, (length - 1) * BLOCK_SIZE)) return 0;
+    return (int64_t)length;
+}
+
+// Drop the commits at the front of the log whose images are all home, and
+// work out where the tail is now: the oldest commit on disk, else where
+// the next one goes. Returns whether the header must be rewritten.
+static bool journal_trim(lambdafs_t* fs, uint32_t* tail, uint64_t* tail_seq) {
+    while (fs->tx_count) {
+        journal_tx_t* tx = &fs->txs[fs->tx_first];
+        if (tx->seq > fs->committed_seq || tx->pending) break;
+        fs->log_used -= tx->span;
+        fs->tx_first = (fs->tx_first + 1) % fs->tx_slots;
+        fs->tx_count--;
+    }
+    if (!fs->log_used) fs->log_head = 0;
+
+    journal_tx_t* oldest = fs->tx_count ? &fs->txs[fs->tx_first] : NULL;
+    bool on_disk = oldest && oldest->seq <= fs->committed_seq;
+    *tail = on_disk ? oldest->start : fs->log_head;
+    *tail_seq = on_disk ? oldest->seq : fs->committed_seq + 1;
+    return *tail != fs->log_tail || *tail_seq != fs->tail_seq;
+}
+
+// The freed log space is reused only once the new header is on disk
+static int journal_move_tail(lambdafs_t* fs, uint32_t tail, uint64_t tail_seq) {
+    int err = journal_write_header(fs->dev, fs->super->journal_start, fs->journal_id, tail_seq, tail);
+    if (!err) err = blockdev_flush(fs->dev);
+    return err;
+}
+
+// Write home the committed images of buffers changed again since. Each
+// keeps its commit in the log until the running transaction lands, and
+// the buffer already holds the newer contents, so the image is read back
+// from the log.
+static int journal_checkpoint_changed(lambdafs_t* fs, uint64_t* written) {
+    int err = 0;
+    // Only the log's owner adds or drops commits, so the ring holds still
+    for (uint32_t n = 0; !err; n++) {
+        mutex_lock(&fs->lock);
+        bool more = n < fs->tx_count;
+        journal_tx_t tx = more ? fs->txs[(fs->tx_first + n) % fs->tx_slots] : (journal_tx_t){ 0 };
+        bool pinned = more && tx.pending && tx.seq <= fs->committed_seq;
+        mutex_unlock(&fs->lock);
+        if (!more) break;
+        if (!pinned) continue;
+
+        uint8_t* frame = memory_alloc((uint64_t)tx.span * BLOCK_SIZE);
+        if (!frame) return VFS_ERR_NOMEM;
+        int64_t length = journal_read(fs, tx.start, tx.seq, frame);
+        if (length <= 0) err = length < 0 ? (int)length : VFS_ERR_IO;
+        const lambdafs_journal_desc_t* desc = (const lambdafs_journal_desc_t*)frame;
+        for (uint32_t i = 0; !err && i < desc->count; i++) {
+            mutex_lock(&fs->lock);
+            buf_t* buf = buf_find(fs, desc->entries[i]);
+            bool newest = buf && buf->jseq == tx.seq;
+            if (newest) buf->refcount++;
+            mutex_unlock(&fs->lock);
+            if (!newest) continue;
+
+            const uint8_t* image = frame + ((uint64_t)desc->desc_blocks + i) * BLOCK_SIZE;
+            err = blockdev_write(fs->dev, desc->entries[i], 1, image);
+            mutex_lock(&fs->lock);
+            if (!err) {
+                if (buf->jseq == tx.seq) buf_release_jseq(fs, buf);
+                fs->stats.buffer_writes++;
+                (*written)++;
+            }
+            buf_put(buf);
+            mutex_unlock(&fs->lock);
+        }
+        memory_free(frame);
+    }
+    return err;
+}
+
+// Write committed images home, then move the tail past every commit that
+// no longer holds a newest image. Images go out in batches copied under
+// the lock, so the filesystem keeps running meanwhile. An image whose
+// buffer has changed again is left to the running transaction, unless
+// all is set: then it comes back from the log and the whole log is freed.
+// Called with the log claimed.
+static int journal_checkpoint(lambdafs_t* fs, bool all) {
+    uint8_t* staging = memory_alloc(CHECKPOINT_BATCH * BLOCK_SIZE);
+    if (!staging) return VFS_ERR_NOMEM;
+    buf_t* batch[CHECKPOINT_BATCH];
+    uint64_t seqs[CHECKPOINT_BATCH];
+    uint64_t written = 0;
+    int err = 0;
+    while (!err) {
+        uint32_t count = 0;
+        mutex_lock(&fs->lock);
+        for (buf_t* buf = fs->lru_head; buf && count < CHECKPOINT_BATCH; buf = buf->lru_next) {
+            // A dirty buffer's image moves on with the running transaction
+            if (!buf->jseq || buf->jseq > fs->committed_seq || buf->dirty) continue;
+            memcpy(staging + (uint64_t)count * BLOCK_SIZE, buf->data, BLOCK_SIZE);
+            buf->refcount++;
+            batch[count] = buf;
+            seqs[count] = buf->jseq;
+            count++;
+        }
+        mutex_unlock(&fs->lock);
+        if (!count) break;
+
+        uint32_t done = 0;
+        while (done < count && !err) {
+            err = blockdev_write(fs->dev, batch[done]->block, 1, staging + (uint64_t)done * BLOCK_SIZE);
+            if (!err) done++;
+        }
+
+        mutex_lock(&fs->lock);
+        for (uint32_t i = 0; i < count; i++) {
+            if (i < done && batch[i]->jseq == seqs[i]) buf_release_jseq(fs, batch[i]);
+            buf_put(batch[i]);
+        }
+        fs->stats.buffer_writes += done;
+        mutex_unlock(&fs->lock);
+        written += done;
+    }
+    memory_free(staging);
+    if (!err && all) err = journal_checkpoint_changed(fs, &written);
+    // The images must be on disk before the log forgets them
+    if (!err) err = blockdev_flush(fs->dev);
+    if (err) return err;
+
+    uint32_t tail;
+    uint64_t tail_seq;
+    mutex_lock(&fs->lock);
+    bool moved = journal_trim(fs, &tail, &tail_seq);
+    fs->stats.checkpoints++;
+    fs->stats.checkpoint_blocks += written;
+    mutex_unlock(&fs->lock);
+    if (!moved) return 0;
+
+    err = journal_move_tail(fs, tail, tail_seq);
+    mutex_lock(&fs->lock);
+    if (err) {
+        // The trimmed log space may still be needed for replay
+        fs->journal_error = err;
+    } else {
+        fs->log_tail = tail;
+        fs->tail_seq = tail_seq;
+    }
+    mutex_unlock(&fs->lock);
+    return err;
+}
+
+// Commit the running transaction: snapshot it under the lock, then write
+// it to the log in one piece and flush once. A log short of room is
+// emptied first, outside the lock. With nothing to commit this is just
+// the flush, which still makes written file data durable. Called with the
+// log claimed.
+static int journal_commit(lambdafs_t* fs) {
+    int err;
+    int store_err = 0;
+    uint32_t count;
+    uint64_t desc_blocks;
+    uint64_t length;
+    uint32_t skip;
+    for (bool emptied = false;; emptied = true) {
+        mutex_lock(&fs->lock);
+        err = fs->journal_error;
+        while (!err && fs->dirty_inodes) {
+            inode_info_t* info = fs->dirty_inodes;
+            // Preallocated blocks are not worth leaking over a crash
+            window_discard(fs, info);
+            int stored = inode_store(fs, info);
+            if (stored) {
+                // Keep the last good copy rather than hold up the commit
+                store_err = stored;
+                inode_clean(fs, info);
+            }
+        }
+        if (err || tx_empty(fs)) {
+            mutex_unlock(&fs->lock);
+            if (!err) err = blockdev_flush(fs->dev);
+            return err ? err : store_err;
+        }
+
+        fs->super->free_blocks = fs->free_blocks;
+        fs->super->free_inodes = fs->free_inodes;
+        buf_dirty(fs, fs->super_buf);
+
+        count = fs->dirty_count;
+        uint64_t entries = count + 2ULL * fs->revoke_count;
+        desc_blocks = (JOURNAL_DESC_SIZE + entries * sizeof(uint64_t) + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        length = desc_blocks + count + 1;
+        // A commit never wraps; the end of the log is skipped instead
+        skip = fs->log_head + length > fs->log_blocks ? fs->log_blocks - fs->log_head : 0;
+        if (fs->log_blocks - fs->log_used >= skip + length) break;
+        mutex_unlock(&fs->lock);
+        // An empty log that is still too short means the transaction
+        // outgrew it, which journal_maybe_commit() is there to prevent
+        if (emptied) return VFS_ERR_NOSPC;
+        err = journal_checkpoint(fs, true);
+        if (err) return err;
+    }
+
+    uint8_t* frame = memory_alloc(length * BLOCK_SIZE);
+    if (!frame) {
+        mutex_unlock(&fs->lock);
+        return VFS_ERR_NOMEM;
+    }
+
+    uint64_t seq = fs->running_seq++;
+    journal_tx_t* tx = &fs->txs[(fs->tx_first + fs->tx_count++) % fs->tx_slots];
+    *tx = (journal_tx_t){ .seq = seq };
+
+    memset(frame, 0, desc_blocks * BLOCK_SIZE);
+    lambdafs_journal_desc_t* desc = (lambdafs_journal_desc_t*)frame;
+    desc->header = (lambdafs_journal_block_t){
+        .magic = LAMBDAFS_JOURNAL_MAGIC, .type = LAMBDAFS_JOURNAL_DESCRIPTOR, .id = fs->journal_id, .sequence = seq,
+    };
+    desc->desc_blocks = (uint32_t)desc_blocks;
+    desc->count = count;
+    desc->revoke_count = fs->revoke_count;
+
+    uint32_t i = 0;
+    for (buf_t* buf = fs->dirty_bufs; buf; i++) {
+        buf_t* next = buf->dirty_next;
+        desc->entries[i] = buf->block;
+        memcpy(frame + (desc_blocks + i) * BLOCK_SIZE, buf->data, BLOCK_SIZE);
+        buf_release_jseq(fs, buf);
+        buf->jseq = seq;
+        tx->pending++;
+        buf->dirty = false;
+        buf->dirty_prev = buf->dirty_next = NULL;
+        buf = next;
+    }
+    for (uint32_t r = 0; r < fs->revoke_count; r++) {
+        desc->entries[count + 2 * r] = fs->revokes[r].start;
+        desc->entries[count + 2 * r + 1] = fs->revokes[r].length;
+    }
+    fs->dirty_bufs = NULL;
+    fs->dirty_count = 0;
+    fs->revoke_count = 0;
+    fs->running_since = 0;
+
+    lambdafs_journal_commit_t* commit = (lambdafs_journal_commit_t*)(frame + (length - 1) * BLOCK_SIZE);
+    memset(commit, 0, BLOCK_SIZE);
+    commit->header = (lambdafs_journal_block_t){
+        .magic = LAMBDAFS_JOURNAL_MAGIC, .type = LAMBDAFS_JOURNAL_COMMIT, .id = fs->journal_id, .sequence = seq,
+    };
+    commit->checksum = crc32_update(0, frame, (length - 1) * BLOCK_SIZE);
+    commit->blocks = (uint32_t)length;
+
+    tx->start = skip ? 0 : fs->log_head;
+    tx->span = (uint32_t)(skip + length);
+    fs->log_head = (uint32_t)((tx->start + length) % fs->log_blocks);
+    fs->log_used += tx->span;
+    mutex_unlock(&fs->lock);
+
+    err = blockdev_write(fs->dev, log_block(fs, tx->start), (uint32_t)length, frame);
+    if (!err) err = blockdev_flush(fs->dev);
+    memory_free(frame);
+
+    mutex_lock(&fs->lock);
+    if (err) {
+        // The snapshot is gone; later commits would leave a hole
+        fs->journal_error = err;
+    } else {
+        fs->committed_seq = seq;
+        fs->last_commit_ns = time_get_ns();
+        fs->stats.commits++;
+        fs->stats.commit_blocks += length;
+        // Blocks whose free is now on disk can be handed out again
+        for (buf_t* buf = fs->lru_head; buf; buf = buf->lru_next) {
+            if (buf->freeing && buf->freed_seq <= seq) {
+                memory_free(buf->freeing);
+                buf->freeing = NULL;
+            }
+        }
+    }
+    mutex_unlock(&fs->lock);
+    return err ? err : store_err;
+}
+
+// Make everything done so far durable. A commit that starts after this
+// call began covers it, so callers arriving while one is in flight wait
+// for the log and then find their changes already committed.
+static int journal_sync(lambdafs_t* fs) {
+    mutex_lock(&fs->lock);
+    uint64_t target = fs->running_seq;
+    mutex_unlock(&fs->lock);
+
+    mutex_lock(&fs->journal_lock);
+    mutex_lock(&fs->lock);
+    int err = fs->journal_error;
+    bool joined = !err && fs->committed_seq >= target;
+    if (joined) fs->stats.commit_joins++;
+    mutex_unlock(&fs->lock);
+    if (!err && !joined) err = journal_commit(fs);
+    journal_release(fs);
+    return err;
+}
+
+// Keep the running transaction well inside the log. Called after a
+// namespace operation, or after a data operation once the inode lock is
+// dropped, never with a lock held that another writer may need. From a
+// quarter of the log on a busy log is left to its owner; from half on the
+// caller waits for it, so no transaction outgrows the log.
+static void journal_maybe_commit(lambdafs_t* fs) {
+    if (fs->dirty_count < fs->log_blocks / 4 || fs->journal_error) return;
+    if (fs->dirty_count >= fs->log_blocks / 2) {
+        mutex_lock(&fs->journal_lock);
+    } else if (!journal_claim(fs)) {
+        return;
+    }
+    journal_commit(fs);
+    journal_release(fs);
+}
+
+// Commit transactions that have waited long enough or grown to a quarter
+// of the log, and checkpoint once the log is a quarter full or the
+// filesystem has gone quiet
+static void journal_background(lambdafs_t* fs) {
+    uint64_t now = time_get_ns();
+    mutex_lock(&fs->lock);
+    bool commit = (fs->running_since && now - fs->running_since >= COMMIT_INTERVAL_NS) ||
+                  fs->dirty_count >= fs->log_blocks / 4;
+    mutex_unlock(&fs->lock);
+    if (commit) journal_commit(fs);
+
+    mutex_lock(&fs->lock);
+    bool quiet = now - fs->last_commit_ns >= COMMIT_INTERVAL_NS;
+    bool checkpoint = fs->log_used && (fs->log_used >= fs->log_blocks / 4 || quiet) && !fs->journal_error;
+    mutex_unlock(&fs->lock);
+    if (checkpoint) journal_checkpoint(fs, false);
+}
+
+static void journal_main(void) {
+    while (1) {
+        timer_sleep_ns(COMMIT_INTERVAL_NS);
+        for (uint32_t n = 0;; n++) {
+            // Claiming under the mounts lock keeps unmount from freeing it
+            mutex_lock(&mounts_lock);
+            lambdafs_t* fs = mounts;
+            for (uint32_t i = 0; fs && i < n; i++) {
+                fs = fs->next;
+            }
+            bool claimed = fs && journal_claim(fs);
+            mutex_unlock(&mounts_lock);
+            if (!fs) break;
+            if (!claimed) continue;
+            journal_background(fs);
+            journal_release(fs);
+        }
+    }
+}
+
+// Without the thread, commits still happen on sync and as transactions
+// grow; checkpoints then wait until the log fills
+static void journal_start_thread(void) {
+    if (journal_task) return;
+    int pid = process_create(journal_main, JOURNAL_STACK_SIZE);
+    if (pid < 0) return;
+    journal_task = process_get((uint64_t)pid);
+    scheduler_set_priority(journal_task, PRIORITY_LOW);
+}
+
+// --- Replay ---
+
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+    uint64_t seq;
+} replay_tx_t;
+
+typedef struct {
+    uint64_t start;
+    uint64_t length;
+    uint64_t seq;
+} replay_revoke_t;
+
+static bool replay_revoked(const replay_revoke_t* revokes, uint32_t count, uint64_t block, uint64_t seq) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (revokes[i].seq > seq && block - revokes[i].start < revokes[i].length) return true;
+    }
+    return false;
+}
+
+// Bring home blocks up to date with every complete commit in the log,
+// from the header's tail on. Revokes are gathered first: an image is
+// skipped when a later commit freed its block. Leaves the log empty.
+static int journal_replay(lambdafs_t* fs, const lambdafs_super_t* super) {
+    uint8_t* frame = memory_alloc((uint64_t)fs->log_blocks * BLOCK_SIZE);
+    replay_tx_t* txs = memory_alloc((fs->log_blocks / 3 + 1) * sizeof(replay_tx_t));
+    replay_revoke_t* revokes = NULL;
+    uint32_t tx_count = 0;
+    uint32_t revoke_count = 0;
+    uint32_t revoke_slots = 0;
+    int err = frame && txs ? blockdev_read(fs->dev, super->journal_start, 1, frame) : VFS_ERR_NOMEM;
+
+    const lambdafs_journal_super_t* header = (const lambdafs_journal_super_t*)frame;
+    if (!err && (header->header.magic != LAMBDAFS_JOURNAL_MAGIC || header->header.type != LAMBDAFS_JOURNAL_HEADER ||
+                 header->tail >= fs->log_blocks || !header->header.sequence)) {
+        err = VFS_ERR_IO;
+    }
+    uint64_t seq = 0;
+    uint32_t offset = 0;
+    if (!err) {
+        fs->journal_id = header->header.id;
+        seq = header->header.sequence;
+        offset = header->tail;
+    }
+
+    // Find the complete commits; one that never finished ends the log
+    bool torn = false;
+    for (uint64_t walked = 0; !err && walked < fs->log_blocks;) {
+        int64_t length = journal_read(fs, offset, seq, frame);
+        if (length == 0 && offset != 0) {
+            // A commit that would have run off the end starts the log again
+            walked += fs->log_blocks - offset;
+            offset = 0;
+            length = journal_read(fs, 0, seq, frame);
+        }
+        if (length < 0) err = (int)length;
+        if (length <= 0) {
+            const lambdafs_journal_block_t* block = (const lambdafs_journal_block_t*)frame;
+            torn = !err && journal_block_valid(block, LAMBDAFS_JOURNAL_DESCRIPTOR, fs->journal_id, seq);
+            break;
+        }
+
+        const lambdafs_journal_desc_t* desc = (const lambdafs_journal_desc_t*)frame;
+        for (uint32_t i = 0; i < desc->count; i++) {
+            uint64_t block = desc->entries[i];
+            bool in_journal = block - super->journal_start < super->journal_blocks;
+            if (block >= super->block_count || in_journal) err = VFS_ERR_IO;
+        }
+        for (uint32_t r = 0; !err && r < desc->revoke_count; r++) {
+            if (revoke_count == revoke_slots) {
+                uint32_t slots = revoke_slots ? revoke_slots * 2 : 64;
+                replay_revoke_t* grown = memory_alloc(slots * sizeof(replay_revoke_t));
+                if (!grown) {
+                    err = VFS_ERR_NOMEM;
+                    break;
+                }
+                if (revokes) {
+                    memcpy(grown, revokes, revoke_count * sizeof(replay_revoke_t));
+                    memory_free(revokes);
+                }
+                revokes = grown;
+                revoke_slots = slots;
+            }
+            revokes[revoke_count++] = (replay_revoke_t){
+                .start = desc->entries[desc->count + 2 * r],
+                .length = desc->entries[desc->count + 2 * r + 1],
+                .seq = seq,
+            };
+        }
+        if (tx_count > fs->log_blocks / 3) err = VFS_ERR_IO;
+        if (err) break;
+        txs[tx_count++] = (replay_tx_t){ .offset = offset, .length = (uint32_t)length, .seq = seq };
+        walked += (uint64_t)length;
+        offset = (uint32_t)((offset + length) % fs->log_blocks);
+        seq++;
+    }
+
+    // Write the images home, oldest commit first
+    for (uint32_t t = 0; !err && t < tx_count; t++) {
+        int64_t length = journal_read(fs, txs[t].offset, txs[t].seq, frame);
+        if (length != txs[t].length) {
+            err = VFS_ERR_IO;
+            break;
+        }
+        const lambdafs_journal_desc_t* desc = (const lambdafs_journal_desc_t*)frame;
+        for (uint32_t i = 0; !err && i < desc->count; i++) {
+            if (replay_revoked(revokes, revoke_count, desc->entries[i], txs[t].seq)) continue;
+            const uint8_t* image = frame + ((uint64_t)desc->desc_blocks + i) * BLOCK_SIZE;
+            err = blockdev_write(fs->dev, desc->entries[i], 1, image);
+        }
+        fs->stats.replayed++;
+    }
+
+    // A torn commit's number is never reused, so its blocks cannot pass
+    // for a later commit
+    if (torn) seq++;
+    if (!err && (tx_count || torn)) {
+        err = blockdev_flush(fs->dev);
+        if (!err) err = journal_write_header(fs->dev, super->journal_start, fs->journal_id, seq, 0);
+        if (!err) err = blockdev_flush(fs->dev);
+        offset = 0;
+    }
+    if (!err) {
+        fs->log_head = offset;
+        fs->log_tail = offset;
+        fs->tail_seq = seq;
+        fs->running_seq = seq;
+        fs->committed_seq = seq - 1;
+    }
+
+    if (frame) memory_free(frame);
+    if (txs) memory_free(txs);
+    if (revokes) memory_free(revokes);
+    return err;
+}
+
+// --- Operations ---
+
+static inline lambdafs_t* fs_of(const vfs_inode_t* inode) {
+    return inode->sb->fs_data;
+}
+
+static inline inode_info_t* info_of(const vfs_inode_t* inode) {
+    return inode->fs_data;
+}
+
+static int lambdafs_lookup(vfs_inode_t* dir, const char* name, size_t len, vfs_ino_t* ino) {
+    lambdafs_t* fs = fs_of(dir);
+    mutex_lock(&fs->lock);
+    dir_slot_t slot;
+    int err = dir_find(fs, info_of(dir), name, len, &slot);
+    mutex_unlock(&fs->lock);
+    if (!err) *ino = slot.ino;
+    return err;
+}
+
+static int lambdafs_create(vfs_inode_t* dir, const char* name, size_t len, uint32_t type, vfs_ino_t* ino) {
+    if (len > 255) return VFS_ERR_NAMETOOLONG;
+    lambdafs_t* fs = fs_of(dir);
+    mutex_lock(&fs->lock);
+
+    bool directory = type == VFS_TYPE_DIR;
+    vfs_ino_t fresh = 0;
+    int err = alloc_inode(fs, ino_group(fs, dir->ino), directory, &fresh);
+    if (!err) {
+        lambdafs_inode_t* raw;
+        buf_t* buf = inode_buf(fs, fresh, &raw, &err);
+        if (buf) {
+            memset(raw, 0, LAMBDAFS_INODE_SIZE);
+            raw->type = type;
+            raw->nlink = directory ? 2 : 1;
+            buf_dirty(fs, buf);
+            buf_put(buf);
+            err = dir_add(fs, info_of(dir), name, len, fresh, type);
+        }
+        if (err) free_inode(fs, fresh, directory);
+    }
+    mutex_unlock(&fs->lock);
+    journal_maybe_commit(fs);
+    if (!err) *ino = fresh;
+    return err;
+}
+
+// The inode itself goes when the VFS evicts it
+static int lambdafs_unlink(vfs_inode_t* dir, const char* name, size_t len, vfs_inode_t* inode) {
+    lambdafs_t* fs = fs_of(dir);
+    mutex_lock(&fs->lock);
+    dir_slot_t slot;
+    int err = dir_find(fs, info_of(dir), name, len, &slot);
+    if (!err && inode->type == VFS_TYPE_DIR) err = dir_empty(fs, info_of(inode));
+    if (!err) err = dir_remove(fs, info_of(dir), &slot);
+    if (!err) inode->nlink = 0;
+    mutex_unlock(&fs->lock);
+    journal_maybe_commit(fs);
+    return err;
+}
+
+// Entries come back in order of hash, then name. The cookie keeps the
+// hash above its low READDIR_MINOR_BITS and counts the entries sharing
+// those bits that were already returned, so names whose hashes collide
+// are all listed. Entries that a split moves are neither missed nor
+// repeated, and the order holds as a directory becomes indexed; only an
+// insert or removal among names sharing a cookie's hash can shift the
+// count.
+static int lambdafs_readdir(vfs_inode_t* dir, uint64_t* cookie, vfs_dirent_t* dirent) {
+    lambdafs_t* fs = fs_of(dir);
+    inode_info_t* info = info_of(dir);
+    uint64_t group = *cookie & ~READDIR_MINOR_MASK;
+    uint64_t minor = *cookie & READDIR_MINOR_MASK;
+    char name[VFS_NAME_MAX + 1];
+    dir_pos_t after = { group, name, 0 };
+    dir_best_t best;
+    uint64_t rank;
+    int err;
+    mutex_lock(&fs->lock);
+    for (rank = 0;; rank++) {
+        best = (dir_best_t){ UINT64_MAX, UINT64_MAX };
+        err = dir_next(fs, info, &after, &best, dirent);
+        if (err || best.hash == UINT64_MAX) break;
+        if ((best.hash & ~READDIR_MINOR_MASK) != group) {
+            rank = 0;
+            break;
+        }
+        if (rank == minor) break;
+        memcpy(name, dirent->name, dirent->name_len);
+        after.hash = best.hash;
+        after.len = dirent->name_len;
+    }
+    mutex_unlock(&fs->lock);
+    if (err) return err;
+    if (best.hash == UINT64_MAX) return 0;
+    // Hashes keep bit 32 clear, so stepping past the last group cannot wrap
+    group = best.hash & ~READDIR_MINOR_MASK;
+    if ((best.next & ~READDIR_MINOR_MASK) == group) *cookie = group | (rank + 1);
+    else *cookie = group + READDIR_MINOR_MASK + 1;
+    return 1;
+}
+
+static int lambdafs_readpage(vfs_inode_t* inode, uint64_t index, void* page) {
+    lambdafs_t* fs = fs_of(inode);
+    mutex_lock(&fs->lock);
+    uint64_t physical = index <= UINT32_MAX ? extent_map(info_of(inode), (uint32_t)index) : 0;
+    if (physical) fs->stats.data_reads++;
+    mutex_unlock(&fs->lock);
+
+    if (physical) {
+        int err = blockdev_read(fs->dev, physical, 1, page);
+        if (err) return err;
+    } else {
+        memset(page, 0, BLOCK_SIZE);
+    }
+    // A block keeps whatever followed the end of the file when it was written
+    uint64_t pos = index * BLOCK_SIZE;
+    if (inode->size - pos < BLOCK_SIZE) {
+        memset((uint8_t*)page + (inode->size - pos), 0, BLOCK_SIZE - (inode->size - pos));
+    }
+    return 0;
+}
+
+// Reserve a block for a page that has none
+static int lambdafs_dirty_page(vfs_inode_t* inode, uint64_t index) {
+    if (index > UINT32_MAX) return VFS_ERR_NOSPC;
+    lambdafs_t* fs = fs_of(inode);
+    inode_info_t* info = info_of(inode);
+    mutex_lock(&fs->lock);
+    int err = 0;
+    if (!extent_map(info, (uint32_t)index) && delayed_find(info, (uint32_t)index) < 0) {
+        if (fs->free_blocks <= fs->reserved + META_RESERVE) {
+            err = VFS_ERR_NOSPC;
+        } else if (!delayed_add(info, (uint32_t)index)) {
+            err = VFS_ERR_NOMEM;
+        } else {
+            fs->reserved++;
+        }
+    }
+    mutex_unlock(&fs->lock);
+    return err;
+}
+
+// Allocation happens here. The page's reserved run is allocated whole
+// into the window, which the following pages then take from in turn.
+static int lambdafs_writepage(vfs_inode_t* inode, uint64_t index, const void* page) {
+    if (index > UINT32_MAX) return VFS_ERR_NOSPC;
+    lambdafs_t* fs = fs_of(inode);
+    inode_info_t* info = info_of(inode);
+    uint32_t logical = (uint32_t)index;
+    mutex_lock(&fs->lock);
+
+    int err = 0;
+    uint64_t physical = extent_map(info, logical);
+    if (!physical) {
+        int64_t delayed = delayed_find(info, logical);
+        lambdafs_extent_t* window = &info->window;
+        if (window->length && logical >= window->logical && logical - window->logical < window->length) {
+            physical = window->physical + (logical - window->logical);
+        } else {
+            uint32_t want = 1;
+            if (delayed >= 0) {
+                const range_t* range = &info->delayed[delayed];
+                want = range->start + range->length - logical;
+                if (want > MAX_RUN) want = MAX_RUN;
+            }
+            window_discard(fs, info);
+            uint32_t got = 0;
+            err = alloc_blocks(fs, alloc_goal(fs, info, logical), want, &physical, &got);
+            if (!err) *window = (lambdafs_extent_t){ .logical = logical, .length = got, .physical = physical };
+        }
+        if (!err) err = extent_add(info, logical, physical);
+        if (!err) {
+            if (window->length && window->logical == logical) {
+                window->logical++;
+                window->physical++;
+                window->length--;
+            }
+            if (delayed >= 0) {
+                delayed_remove(info, (uint32_t)delayed, logical);
+                fs->reserved--;
+            }
+        }
+    }
+    if (!err) {
+        inode_dirty(fs, info);
+        fs->stats.data_writes++;
+    }
+    mutex_unlock(&fs->lock);
+
+    // Data goes out before any commit that makes the inode point at it
+    if (!err) err = blockdev_write(fs->dev, physical, 1, page);
+    return err;
+}
+
+static int lambdafs_truncate(vfs_inode_t* inode, uint64_t size) {
+    lambdafs_t* fs = fs_of(inode);
+    inode_info_t* info = info_of(inode);
+    if ((size + BLOCK_SIZE - 1) / BLOCK_SIZE > UINT32_MAX) return VFS_ERR_NOSPC;
+    mutex_lock(&fs->lock);
+
+    int err = 0;
+    if (size < inode->size) {
+        uint32_t first = (uint32_t)((size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+        window_discard(fs, info);
+        extent_truncate(fs, info, first);
+        fs->reserved -= delayed_truncate(info, first);
+
+        // Zero the new tail on disk so a later extension reads zeros
+        uint64_t physical = size % BLOCK_SIZE ? extent_map(info, (uint32_t)(size / BLOCK_SIZE)) : 0;
+        if (physical) {
+            uint8_t* block = memory_alloc(BLOCK_SIZE);
+            err = block ? blockdev_read(fs->dev, physical, 1, block) : VFS_ERR_NOMEM;
+            if (!err) {
+                memset(block + size % BLOCK_SIZE, 0, BLOCK_SIZE - size % BLOCK_SIZE);
+                err = blockdev_write(fs->dev, physical, 1, block);
+            }
+            if (block) memory_free(block);
+        }
+    }
+    if (!err) {
+        inode->size = size;
+        inode_dirty(fs, info);
+    }
+    mutex_unlock(&fs->lock);
+    return err;
+}
+
+static const vfs_inode_ops_t lambdafs_inode_ops = {
+    .lookup = lambdafs_lookup,
+    .create = lambdafs_create,
+    .unlink = lambdafs_unlink,
+    .readdir = lambdafs_readdir,
+    .truncate = lambdafs_truncate,
+    .readpage = lambdafs_readpage,
+    .writepage = lambdafs_writepage,
+    .dirty_page = lambdafs_dirty_page,
+};
+
+static int lambdafs_read_inode(vfs_inode_t* inode) {
+    lambdafs_t* fs = inode->sb->fs_data;
+    uint64_t max_ino = (uint64_t)fs->super->group_count * fs->super->inodes_per_group;
+    if (inode->ino < 1 || inode->ino > max_ino) return VFS_ERR_NOENT;
+
+    inode_info_t* info = memory_alloc(sizeof(inode_info_t));
+    if (!info) return VFS_ERR_NOMEM;
+    memset(info, 0, sizeof(inode_info_t));
+    info->inode = inode;
+
+    mutex_lock(&fs->lock);
+    int err = ino_allocated(fs, inode->ino) ? 0 : VFS_ERR_NOENT;
+    lambdafs_inode_t* raw;
+    buf_t* buf = err ? NULL : inode_buf(fs, inode->ino, &raw, &err);
+    if (buf) {
+        if (raw->type != VFS_TYPE_FILE && raw->type != VFS_TYPE_DIR) err = VFS_ERR_IO;
+        if (raw->type == VFS_TYPE_DIR && raw->size % BLOCK_SIZE) err = VFS_ERR_IO;
+        if ((raw->flags & LAMBDAFS_INODE_INDEXED) && (raw->type != VFS_TYPE_DIR || raw->size < 2 * BLOCK_SIZE)) {
+            err = VFS_ERR_IO;
+        }
+        if (!err) err = inode_load(fs, info, raw);
+        if (!err) {
+            inode->type = raw->type;
+            inode->nlink = raw->nlink;
+            inode->size = raw->size;
+            info->flags = raw->flags;
+        }
+        buf_put(buf);
+    }
+    mutex_unlock(&fs->lock);
+
+    if (err) {
+        info_free(info);
+        return err;
+    }
+    inode->ops = &lambdafs_inode_ops;
+    inode->fs_data = info;
+    return 0;
+}
+
+// Deleted files give back their blocks and inode here
+static void lambdafs_evict_inode(vfs_inode_t* inode) {
+    lambdafs_t* fs = fs_of(inode);
+    inode_info_t* info = info_of(inode);
+    mutex_lock(&fs->lock);
+    window_discard(fs, info);
+    fs->reserved -= delayed_truncate(info, 0);
+    if (inode->nlink == 0) {
+        extent_truncate(fs, info, 0);
+        while (info->chain_count) {
+            free_meta(fs, info->chain[--info->chain_count], 1);
+        }
+        free_inode(fs, inode->ino, inode->type == VFS_TYPE_DIR);
+        inode_clean(fs, info);
+    } else if (info->dirty) {
+        inode_store(fs, info);
+    }
+    mutex_unlock(&fs->lock);
+    info_free(info);
+    journal_maybe_commit(fs);
+}
+
+static int lambdafs_sync(vfs_super_t* sb) {
+    return journal_sync(sb->fs_data);
+}
+
+// Data operations leave the commit to here: writepage runs under the
+// inode lock, and from reclaim under another inode's
+static void lambdafs_balance(vfs_super_t* sb) {
+    journal_maybe_commit(sb->fs_data);
+}
+
+static void fs_free(lambdafs_t* fs) {
+    while (fs->lru_head) {
+        buf_free(fs, fs->lru_head);
+    }
+    if (fs->desc_bufs) memory_free(fs->desc_bufs);
+    if (fs->revokes) memory_free(fs->revokes);
+    if (fs->txs) memory_free(fs->txs);
+    memory_free(fs);
+}
+
+// Commit and checkpoint everything, leaving the log empty
+static void lambdafs_unmount(vfs_super_t* sb) {
+    lambdafs_t* fs = sb->fs_data;
+    mutex_lock(&mounts_lock);
+    lambdafs_t** link = &mounts;
+    while (*link && *link != fs) {
+        link = &(*link)->next;
+    }
+    if (*link) *link = fs->next;
+    mutex_unlock(&mounts_lock);
+
+    // Off the list, the journal thread can no longer claim it; sleep
+    // through any commit already running. Releasing the log again waits
+    // out the unlock that handed it over, so the lock is done with.
+    mutex_lock(&fs->journal_lock);
+    if (!journal_commit(fs)) journal_checkpoint(fs, false);
+    journal_release(fs);
+    fs_free(fs);
+}
+
+static const vfs_super_ops_t lambdafs_super_ops = {
+    .read_inode = lambdafs_read_inode,
+    .evict_inode = lambdafs_evict_inode,
+    .sync = lambdafs_sync,
+    .balance = lambdafs_balance,
+    .unmount = lambdafs_unmount,
+};
+
+static bool super_valid(const lambdafs_super_t* super, const blockdev_t* dev) {
+    if (super->magic != LAMBDAFS_MAGIC || super->version != LAMBDAFS_VERSION) return false;
+    if (super->block_size != BLOCK_SIZE || super->inode_size != LAMBDAFS_INODE_SIZE) return false;
+    if (super->block_count < MIN_BLOCKS || super->block_count > dev->block_count) return false;
+    uint64_t groups = (super->block_count + BLOCKS_PER_GROUP - 1) / BLOCKS_PER_GROUP;
+    if (super->group_count != groups) return false;
+    if (super->desc_blocks != (groups + LAMBDAFS_GROUPS_PER_BLOCK - 1) / LAMBDAFS_GROUPS_PER_BLOCK) return false;
+    if (!super->inodes_per_group || super->inodes_per_group > BLOCKS_PER_GROUP) return false;
+    if (super->inodes_per_group % LAMBDAFS_INODES_PER_BLOCK || super->root_ino != LAMBDAFS_ROOT_INO) return false;
+    // The journal lies in group 0
+    uint64_t group0 = super->block_count < BLOCKS_PER_GROUP ? super->block_count : BLOCKS_PER_GROUP;
+    if (super->journal_blocks < JOURNAL_MIN_BLOCKS || super->journal_start <= super->desc_blocks) return false;
+    return super->journal_start < group0 && super->journal_blocks <= group0 - super->journal_start;
+}
+
+// Each group's bitmaps and inode table lie inside the group, and group 0's
+// before the journal
+static bool group_valid(lambdafs_t* fs, uint32_t group) {
+    lambdafs_group_t* desc = group_desc(fs, group);
+    uint64_t first = group_first(group);
+    uint64_t end = first + group_length(fs, group);
+    return desc->block_bitmap >= first && desc->block_bitmap < end &&
+           desc->inode_bitmap >= first && desc->inode_bitmap < end &&
+           desc->inode_table >= first && desc->inode_table + itable_blocks(fs) <= end &&
+           desc->free_blocks <= group_length(fs, group) &&
+           desc->free_inodes <= fs->super->inodes_per_group &&
+           (group || desc->inode_table + itable_blocks(fs) <= fs->super->journal_start);
+}
+
+static int lambdafs_mount(vfs_super_t* sb, const char* source, const void* data) {
+    blockdev_t* dev = blockdev_find(source);
+    if (!dev) return VFS_ERR_NODEV;
+    if (dev->block_size != BLOCK_SIZE) return VFS_ERR_INVAL;
+
+    lambdafs_t* fs = memory_alloc(sizeof(lambdafs_t));
+    if (!fs) return VFS_ERR_NOMEM;
+    memset(fs, 0, sizeof(lambdafs_t));
+    fs->dev = dev;
+    mutex_init(&fs->lock);
+    mutex_init(&fs->journal_lock);
+
+    // Replay before anything is cached: the log may hold newer metadata,
+    // the superblock included
+    lambdafs_super_t* raw = memory_alloc(BLOCK_SIZE);
+    int err = raw ? blockdev_read(dev, 0, 1, raw) : VFS_ERR_NOMEM;
+    if (!err && !super_valid(raw, dev)) err = VFS_ERR_IO;
+    if (!err) {
+        fs->log_start = raw->journal_start + 1;
+        fs->log_blocks = raw->journal_blocks - 1;
+        // A commit takes at least three blocks
+        fs->tx_slots = fs->log_blocks / 3 + 2;
+        fs->txs = memory_alloc(fs->tx_slots * sizeof(journal_tx_t));
+        err = fs->txs ? journal_replay(fs, raw) : VFS_ERR_NOMEM;
+    }
+    if (raw) memory_free(raw);
+
+    if (!err) fs->super_buf = buf_get(fs, 0, true, &err);
+    if (fs->super_buf) {
+        fs->super = (lambdafs_super_t*)fs->super_buf->data;
+        if (!super_valid(fs->super, dev) || fs->super->journal_start + 1 != fs->log_start ||
+            fs->super->journal_blocks - 1 != fs->log_blocks) {
+            err = VFS_ERR_IO;
+        }
+    }
+    if (!err) {
+        fs->desc_bufs = memory_alloc(fs->super->desc_blocks * sizeof(buf_t*));
+        if (!fs->desc_bufs) err = VFS_ERR_NOMEM;
+    }
+    for (uint32_t i = 0; !err && i < fs->super->desc_blocks; i++) {
+        fs->desc_bufs[i] = buf_get(fs, 1 + i, true, &err);
+    }
+    for (uint32_t group = 0; !err && group < fs->super->group_count; group++) {
+        if (!group_valid(fs, group)) {
+            err = VFS_ERR_IO;
+            break;
+        }
+        fs->free_blocks += group_desc(fs, group)->free_blocks;
+        fs->free_inodes += group_desc(fs, group)->free_inodes;
+    }
+    if (err) {
+        fs_free(fs);
+        return err;
+    }
+
+    fs->last_commit_ns = time_get_ns();
+    mutex_lock(&mounts_lock);
+    fs->next = mounts;
+    mounts = fs;
+    mutex_unlock(&mounts_lock);
+    journal_start_thread();
+
+    sb->ops = &lambdafs_super_ops;
+    sb->root_ino = LAMBDAFS_ROOT_INO;
+    sb->fs_data = fs;
+    return 0;
+}
+
+static vfs_fs_type_t lambdafs_type = {
+    .name = "lambdafs",
+    .mount = lambdafs_mount,
+};
+
+void lambdafs_init(void) {
+    vfs_register_fs(&lambdafs_type);
+}
+
+// --- Formatting ---
+
+static uint64_t format_count;
+
+int lambdafs_format(blockdev_t* dev, uint32_t bytes_per_inode) {
+    if (!dev || dev->block_size != BLOCK_SIZE) return VFS_ERR_INVAL;
+    if (!bytes_per_inode) bytes_per_inode = LAMBDAFS_DEFAULT_INODE_RATIO;
+
+    uint64_t inodes = (uint64_t)BLOCKS_PER_GROUP * BLOCK_SIZE / bytes_per_inode;
+    inodes = (inodes + LAMBDAFS_INODES_PER_BLOCK - 1) / LAMBDAFS_INODES_PER_BLOCK * LAMBDAFS_INODES_PER_BLOCK;
+    if (inodes < LAMBDAFS_INODES_PER_BLOCK) inodes = LAMBDAFS_INODES_PER_BLOCK;
+    if (inodes > BLOCKS_PER_GROUP) inodes = BLOCKS_PER_GROUP;
+    uint32_t itable = (uint32_t)(inodes / LAMBDAFS_INODES_PER_BLOCK);
+
+    // A 64th of the disk for the journal, within limits
+    uint64_t block_count = dev->block_count;
+    uint64_t journal = block_count / 64;
+    if (journal < JOURNAL_MIN_BLOCKS) journal = JOURNAL_MIN_BLOCKS;
+    if (journal > JOURNAL_MAX_BLOCKS) journal = JOURNAL_MAX_BLOCKS;
+
+    // A last group too short to hold its own metadata is left off
+    uint64_t groups = (block_count + BLOCKS_PER_GROUP - 1) / BLOCKS_PER_GROUP;
+    uint32_t desc_blocks = (uint32_t)((groups + LAMBDAFS_GROUPS_PER_BLOCK - 1) / LAMBDAFS_GROUPS_PER_BLOCK);
+    uint64_t last = block_count - (groups - 1) * BLOCKS_PER_GROUP;
+    uint64_t overhead = 2 + itable + (groups == 1 ? 1 + desc_blocks + journal : 0);
+    if (last < overhead + MIN_BLOCKS) {
+        if (groups == 1) return VFS_ERR_NOSPC;
+        groups--;
+        block_count = groups * BLOCKS_PER_GROUP;
+    }
+
+    lambdafs_group_t* descs = memory_alloc(desc_blocks * BLOCK_SIZE);
+    uint8_t* block = memory_alloc(BLOCK_SIZE);
+    if (!descs || !block) {
+        if (descs) memory_free(descs);
+        if (block) memory_free(block);
+        return VFS_ERR_NOMEM;
+    }
+    memset(descs, 0, desc_blocks * BLOCK_SIZE);
+
+    int err = 0;
+    uint64_t free_blocks = 0;
+    for (uint32_t group = 0; group < groups && !err; group++) {
+        uint64_t first = group_first(group);
+        uint64_t length = block_count - first < BLOCKS_PER_GROUP ? block_count - first : BLOCKS_PER_GROUP;
+        uint64_t meta = first + (group == 0 ? 1 + desc_blocks : 0);
+        lambdafs_group_t* desc = &descs[group];
+        desc->block_bitmap = meta;
+        desc->inode_bitmap = meta + 1;
+        desc->inode_table = meta + 2;
+        uint32_t used = (uint32_t)(desc->inode_table + itable - first + (group == 0 ? journal : 0));
+        desc->free_blocks = (uint32_t)(length - used);
+        desc->free_inodes = (uint32_t)inodes - (group == 0);
+        desc->directories = group == 0;
+        free_blocks += desc->free_blocks;
+
+        // Blocks past the end of a short group count as used
+        memset(block, 0, BLOCK_SIZE);
+        bits_set(block, 0, used);
+        bits_set(block, (uint32_t)length, BLOCKS_PER_GROUP - (uint32_t)length);
+        err = blockdev_write(dev, desc->block_bitmap, 1, block);
+
+        memset(block, 0, BLOCK_SIZE);
+        if (group == 0) bits_set(block, 0, 1);
+        if (!err) err = blockdev_write(dev, desc->inode_bitmap, 1, block);
+    }
+
+    // The root directory, empty
+    if (!err) {
+        memset(block, 0, BLOCK_SIZE);
+        lambdafs_inode_t* root = (lambdafs_inode_t*)block;
+        root->type = VFS_TYPE_DIR;
+        root->nlink = 2;
+        err = blockdev_write(dev, descs[0].inode_table, 1, block);
+    }
+    if (!err) err = blockdev_write(dev, 1, desc_blocks, descs);
+
+    // An empty log: a header, and a first block that is no commit
+    uint64_t journal_start = descs[0].inode_table + itable;
+    uint64_t id = (time_get_ns() ^ (++format_count << 48) ^ block_count) * 0x9E3779B97F4A7C15ULL;
+    if (!err) err = journal_write_header(dev, journal_start, id ? id : 1, 1, 0);
+    if (!err) {
+        memset(block, 0, BLOCK_SIZE);
+        err = blockdev_write(dev, journal_start + 1, 1, block);
+    }
+
+    if (!err) {
+        memset(block, 0, BLOCK_SIZE);
+        lambdafs_super_t* super = (lambdafs_super_t*)block;
+        super->magic = LAMBDAFS_MAGIC;
+        super->version = LAMBDAFS_VERSION;
+        super->block_size = BLOCK_SIZE;
+        super->inode_size = LAMBDAFS_INODE_SIZE;
+        super->block_count = block_count;
+        super->group_count = (uint32_t)groups;
+        super->inodes_per_group = (uint32_t)inodes;
+        super->desc_blocks = desc_blocks;
+        super->root_ino = LAMBDAFS_ROOT_INO;
+        super->free_blocks = free_blocks;
+        super->free_inodes = groups * inodes - 1;
+        super->journal_start = journal_start;
+        super->journal_blocks = (uint32_t)journal;
+        super->hash_seed = (uint32_t)(id >> 32) ^ (uint32_t)id;
+        err = blockdev_write(dev, 0, 1, block);
+    }
+    if (!err) err = blockdev_flush(dev);
+
+    memory_free(descs);
+    memory_free(block);
+    return err;
+}
+
+void lambdafs_get_stats(lambdafs_stats_t* out) {
+    if (!out) return;
+    memset(out, 0, sizeof(lambdafs_stats_t));
+    mutex_lock(&mounts_lock);
+    for (lambdafs_t* fs = mounts; fs; fs = fs->next) {
+        mutex_lock(&fs->lock);
+        out->blocks += fs->super->block_count;
+        out->blocks_free += fs->free_blocks;
+        out->blocks_reserved += fs->reserved;
+        out->inodes_free += fs->free_inodes;
+        out->allocations += fs->stats.allocations;
+        out->blocks_allocated += fs->stats.blocks_allocated;
+        out->goal_hits += fs->stats.goal_hits;
+        out->buffer_hits += fs->stats.buffer_hits;
+        out->buffer_misses += fs->stats.buffer_misses;
+        out->buffer_writes += fs->stats.buffer_writes;
+        out->data_reads += fs->stats.data_reads;
+        out->data_writes += fs->stats.data_writes;
+        out->commits += fs->stats.commits;
+        out->commit_blocks += fs->stats.commit_blocks;
+        out->commit_joins += fs->stats.commit_joins;
+        out->checkpoints += fs->stats.checkpoints;
+        out->checkpoint_blocks += fs->stats.checkpoint_blocks;
+        out->replayed += fs->stats.replayed;
+        mutex_unlock(&fs->lock);
+    }
+    mutex_unlock(&mounts_lock);
+}
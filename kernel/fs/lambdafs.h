@@ -0,0 +1,199 @@
+#ifndef LAMBDAFS_H
+#define LAMBDAFS_H
+
+#include <stdint.h>
+#include "fs/blockdev.h"
+
+// Writable disk filesystem, mounted from a block device by name.
+//
+// The disk is cut into groups of 32768 blocks, each with a block bitmap,
+// an inode bitmap and an inode table at its start; group 0 is preceded by
+// the superblock and the group descriptors. Files map their blocks with
+// extents, four in the inode and the rest in a chain of extent blocks.
+// Directories are lists of variable-length entries in their own blocks.
+// One that outgrows its first block is indexed by a hash of the names:
+// block 0 becomes the root of a shallow tree over the entry blocks, each
+// of which holds a range of hashes. readdir walks the entries in hash
+// order, so its position survives blocks splitting under it.
+//
+// File data is allocated late. Writing a page only reserves a block; the
+// block is chosen when the page is written back, and the whole run of
+// reserved pages around it is allocated in one piece next to the file's
+// previous extent, so appends coalesce into long contiguous extents.
+//
+// Metadata goes through a block buffer cache and is journaled: every
+// change joins the one running transaction, and a commit writes all of
+// it to the journal in a single write followed by a single flush. fsync
+// callers that arrive while a commit is in flight wait for it and then
+// commit together, so concurrent syncs share the disk flushes. A
+// background thread commits old transactions and checkpoints committed
+// blocks to their home locations; mounting replays whatever the journal
+// still holds.
+
+#define LAMBDAFS_MAGIC              0x5346414c  // "LAFS"
+#define LAMBDAFS_VERSION            1
+#define LAMBDAFS_BLOCK_SIZE         4096
+#define LAMBDAFS_BLOCKS_PER_GROUP   (LAMBDAFS_BLOCK_SIZE * 8)
+#define LAMBDAFS_INODE_SIZE         128
+#define LAMBDAFS_INODES_PER_BLOCK   (LAMBDAFS_BLOCK_SIZE / LAMBDAFS_INODE_SIZE)
+#define LAMBDAFS_INLINE_EXTENTS     4
+#define LAMBDAFS_CHAIN_EXTENTS      255
+#define LAMBDAFS_ROOT_INO           1
+#define LAMBDAFS_DEFAULT_INODE_RATIO 16384      // Bytes of disk per inode
+#define LAMBDAFS_JOURNAL_MAGIC      0x4c4e524a  // "JRNL"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_size;
+    uint32_t inode_size;
+    uint64_t block_count;
+    uint32_t group_count;
+    uint32_t inodes_per_group;
+    uint32_t desc_blocks;
+    uint32_t root_ino;
+    uint64_t free_blocks;
+    uint64_t free_inodes;
+    uint64_t journal_start;         // Journal header block; the log follows
+    uint32_t journal_blocks;        // Header included
+    uint32_t hash_seed;             // Directory name hashes
+} lambdafs_super_t;
+
+typedef struct {
+    uint64_t block_bitmap;
+    uint64_t inode_bitmap;
+    uint64_t inode_table;
+    uint32_t free_blocks;
+    uint32_t free_inodes;
+    uint32_t directories;
+    uint32_t reserved;
+} lambdafs_group_t;
+
+#define LAMBDAFS_GROUPS_PER_BLOCK   (LAMBDAFS_BLOCK_SIZE / sizeof(lambdafs_group_t))
+
+// Blocks [logical, logical + length) of a file live at physical onwards
+typedef struct {
+    uint32_t logical;
+    uint32_t length;
+    uint64_t physical;
+} lambdafs_extent_t;
+
+typedef struct {
+    uint32_t type;                  // VFS_TYPE_*
+    uint32_t nlink;
+    uint64_t size;
+    uint32_t flags;
+    uint32_t extent_count;
+    uint64_t extent_block;          // First chain block, 0 if none
+    lambdafs_extent_t extents[LAMBDAFS_INLINE_EXTENTS];
+    uint8_t reserved[32];
+} lambdafs_inode_t;
+
+// Extents past the inline ones, in logical order
+typedef struct {
+    uint64_t next;
+    uint32_t count;
+    uint32_t reserved;
+    lambdafs_extent_t extents[LAMBDAFS_CHAIN_EXTENTS];
+} lambdafs_extent_block_t;
+
+// Entries fill their block; ino 0 is free space. rec_len covers the
+// entry and any slack after it and is a multiple of 8.
+typedef struct {
+    uint32_t ino;
+    uint16_t rec_len;
+    uint8_t name_len;
+    uint8_t type;
+    char name[];
+} lambdafs_dirent_t;
+
+#define LAMBDAFS_INODE_INDEXED      0x1     // Directory with a hash index
+
+// Index nodes of an indexed directory, the root in block 0. Entry i
+// covers hashes from its own up to the next entry's; the root's first
+// hash is 0. A hash with its low bit set continues the previous leaf:
+// names with that hash may be in either.
+typedef struct {
+    uint32_t hash;
+    uint32_t block;                 // Logical block in the directory
+} lambdafs_dx_entry_t;
+
+typedef struct {
+    uint16_t count;
+    uint16_t limit;
+    uint8_t levels;                 // Root only: index levels below it
+    uint8_t reserved[3];
+    lambdafs_dx_entry_t entries[];
+} lambdafs_dx_node_t;
+
+// --- Journal ---
+//
+// The log is a ring of commits, each a descriptor listing the home blocks
+// and revoked ranges, the block images, and a commit block whose CRC
+// covers the rest. The header names the oldest commit still needed.
+
+#define LAMBDAFS_JOURNAL_HEADER     1
+#define LAMBDAFS_JOURNAL_DESCRIPTOR 2
+#define LAMBDAFS_JOURNAL_COMMIT     3
+
+typedef struct {
+    uint32_t magic;
+    uint32_t type;                  // LAMBDAFS_JOURNAL_*
+    uint64_t id;                    // Chosen at format, so stale logs never match
+    uint64_t sequence;
+} lambdafs_journal_block_t;
+
+typedef struct {
+    lambdafs_journal_block_t header;    // sequence: the commit at tail
+    uint32_t tail;                      // Log offset to replay from
+    uint32_t reserved;
+} lambdafs_journal_super_t;
+
+// Followed by count home block numbers, then revoke_count (start, length)
+// pairs, running on into the following desc_blocks - 1 blocks
+typedef struct {
+    lambdafs_journal_block_t header;
+    uint32_t desc_blocks;
+    uint32_t count;
+    uint32_t revoke_count;
+    uint32_t reserved;
+    uint64_t entries[];
+} lambdafs_journal_desc_t;
+
+typedef struct {
+    lambdafs_journal_block_t header;
+    uint32_t checksum;              // CRC-32 of the descriptor and images
+    uint32_t blocks;                // Whole commit, this block included
+} lambdafs_journal_commit_t;
+
+typedef struct {
+    uint64_t blocks;
+    uint64_t blocks_free;
+    uint64_t blocks_reserved;       // Written but not yet allocated
+    uint64_t inodes_free;
+    uint64_t allocations;           // Block runs handed out
+    uint64_t blocks_allocated;
+    uint64_t goal_hits;             // ... that continued the file's last extent
+    uint64_t buffer_hits;
+    uint64_t buffer_misses;
+    uint64_t buffer_writes;
+    uint64_t data_reads;
+    uint64_t data_writes;
+    uint64_t commits;               // Journal writes, one flush each
+    uint64_t commit_blocks;
+    uint64_t commit_joins;          // Syncs satisfied by someone else's commit
+    uint64_t checkpoints;
+    uint64_t checkpoint_blocks;
+    uint64_t replayed;              // Commits replayed at mount
+} lambdafs_stats_t;
+
+// Write an empty filesystem over the whole device; bytes_per_inode of 0
+// picks the default
+int lambdafs_format(blockdev_t* dev, uint32_t bytes_per_inode);
+
+void lambdafs_init(void);
+
+// Summed over every mounted lambdafs
+void lambdafs_get_stats(lambdafs_stats_t* stats);
+
+#endif // LAMBDAFS_H
@@ -0,0 +1,728 @@
+#include "fs/pagecache.h"
+#include "memory.h"
+#include "mutex.h"
+#include "spinlock.h"
+#include <stddef.h>
+#include <string.h>
+
+// Reclaim is 2Q. New pages join a FIFO (A1in); a page only earns a place
+// on the LRU-ordered hot list (Am) when it is needed again shortly after
+// being evicted, which a ghost list of recently evicted pages (A1out)
+// remembers. One streaming pass over a large file cycles through the FIFO
+// without pushing out the pages that keep being reused.
+//
+// The page cache lock covers every inode's radix tree, both lists, the
+// ghosts and mapped regions. Page contents are accessed with only the
+// inode lock held, under a page reference that keeps reclaim away, and
+// the driver is never called with the page cache lock held: it may sleep.
+
+typedef struct {
+    cache_page_t* head;         // Next to go
+    cache_page_t* tail;
+    uint64_t count;
+} page_list_t;
+
+typedef struct {
+    const vfs_super_t* sb;      // NULL when the slot is unused
+    vfs_ino_t ino;
+    uint64_t index;
+    int32_t hash_next;
+} ghost_t;
+
+static spinlock_t pagecache_lock = SPINLOCK_INIT;
+static page_list_t a1in;
+static page_list_t am;
+static uint64_t a1in_target;
+
+static ghost_t* ghosts = NULL;
+static int32_t* ghost_buckets = NULL;
+static uint32_t ghost_slots = 0;
+static uint32_t ghost_bucket_count = 0;
+static uint32_t ghost_head = 0;     // Oldest, overwritten next
+
+static pagecache_stats_t stats;
+
+static void list_append(page_list_t* list, cache_page_t* page) {
+    page->lru_prev = list->tail;
+    page->lru_next = NULL;
+    if (list->tail) list->tail->lru_next = page;
+    else list->head = page;
+    list->tail = page;
+    list->count++;
+}
+
+static void list_remove(page_list_t* list, cache_page_t* page) {
+    if (page->lru_prev) page->lru_prev->lru_next = page->lru_next;
+    else list->head = page->lru_next;
+    if (page->lru_next) page->lru_next->lru_prev = page->lru_prev;
+    else list->tail = page->lru_prev;
+    page->lru_next = NULL;
+    page->lru_prev = NULL;
+    list->count--;
+}
+
+static inline page_list_t* page_list(const cache_page_t* page) {
+    return (page->flags & PAGE_ACTIVE) ? &am : &a1in;
+}
+
+// --- Ghost list ---
+
+static uint32_t ghost_bucket(const vfs_super_t* sb, vfs_ino_t ino, uint64_t index) {
+    uint64_t key = ((uint64_t)(uintptr_t)sb ^ (ino * 0x9E3779B97F4A7C15ULL)) + index;
+    key *= 0xFF51AFD7ED558CCDULL;
+    return (uint32_t)(key >> 32) & (ghost_bucket_count - 1);
+}
+
+static void ghost_unlink(uint32_t slot) {
+    ghost_t* ghost = &ghosts[slot];
+    int32_t* link = &ghost_buckets[ghost_bucket(ghost->sb, ghost->ino, ghost->index)];
+    while (*link >= 0 && *link != (int32_t)slot) {
+        link = &ghosts[*link].hash_next;
+    }
+    if (*link >= 0) *link = ghost->hash_next;
+    ghost->sb = NULL;
+}
+
+static void ghost_remember(const cache_page_t* page) {
+    if (!ghost_slots) return;
+
+    uint32_t slot = ghost_head;
+    ghost_head = (ghost_head + 1) % ghost_slots;
+    if (ghosts[slot].sb) ghost_unlink(slot);
+
+    ghost_t* ghost = &ghosts[slot];
+    ghost->sb = page->inode->sb;
+    ghost->ino = page->inode->ino;
+    ghost->index = page->index;
+    uint32_t bucket = ghost_bucket(ghost->sb, ghost->ino, ghost->index);
+    ghost->hash_next = ghost_buckets[bucket];
+    ghost_buckets[bucket] = (int32_t)slot;
+}
+
+// Forget the page if it was evicted recently; true if it was
+static bool ghost_take(const vfs_inode_t* inode, uint64_t index) {
+    if (!ghost_slots) return false;
+
+    int32_t slot = ghost_buckets[ghost_bucket(inode->sb, inode->ino, index)];
+    while (slot >= 0) {
+        ghost_t* ghost = &ghosts[slot];
+        if (ghost->sb == inode->sb && ghost->ino == inode->ino && ghost->index == index) {
+            ghost_unlink((uint32_t)slot);
+            return true;
+        }
+        slot = ghost->hash_next;
+    }
+    return false;
+}
+
+// A1out remembers half a cache worth of evictions
+static void ghost_resize(uint64_t max_pages) {
+    if (ghosts) memory_free(ghosts);
+    if (ghost_buckets) memory_free(ghost_buckets);
+    ghosts = NULL;
+    ghost_buckets = NULL;
+    ghost_slots = 0;
+    ghost_head = 0;
+
+    uint32_t slots = (uint32_t)(max_pages / 2);
+    if (!slots) return;
+    uint32_t buckets = 1;
+    while (buckets < slots) buckets <<= 1;
+
+    ghosts = memory_alloc(slots * sizeof(ghost_t));
+    ghost_buckets = memory_alloc(buckets * sizeof(int32_t));
+    if (!ghosts || !ghost_buckets) {
+        if (ghosts) memory_free(ghosts);
+        if (ghost_buckets) memory_free(ghost_buckets);
+        ghosts = NULL;
+        ghost_buckets = NULL;
+        return;
+    }
+    memset(ghosts, 0, slots * sizeof(ghost_t));
+    memset(ghost_buckets, 0xFF, buckets * sizeof(int32_t));
+    ghost_slots = slots;
+    ghost_bucket_count = buckets;
+}
+
+// --- Pages ---
+
+static inline uint8_t* region_slot(const page_region_t* region, uint64_t index) {
+    return region->base + (index - region->first) * PAGE_SIZE;
+}
+
+static void region_put_locked(page_region_t* region) {
+    if (--region->users) return;
+    memory_free(region->base);
+    memory_free(region);
+}
+
+// A page whose data is its slot in region, or its own memory without one.
+// It joins the region when it is inserted.
+static cache_page_t* page_alloc(vfs_inode_t* inode, uint64_t index, page_region_t* region) {
+    cache_page_t* page = memory_alloc(sizeof(cache_page_t));
+    if (!page) return NULL;
+    page->data = region ? region_slot(region, index) : memory_alloc(PAGE_SIZE);
+    if (!page->data) {
+        memory_free(page);
+        return NULL;
+    }
+    page->inode = inode;
+    page->index = index;
+    page->region = region;
+    page->flags = 0;
+    page->refcount = 1;
+    page->lru_next = NULL;
+    page->lru_prev = NULL;
+    return page;
+}
+
+// Free a page that never made it into the cache
+static void page_discard(cache_page_t* page) {
+    if (!page->region) memory_free(page->data);
+    memory_free(page);
+}
+
+static void page_free_locked(cache_page_t* page) {
+    if (page->region) region_put_locked(page->region);
+    else memory_free(page->data);
+    memory_free(page);
+}
+
+// Write a pinned dirty page back, then unpin it. The driver is called
+// without the page cache lock; the caller holds the inode lock, so the
+// page cannot be redirtied, moved or truncated meanwhile.
+static int writeback_page(cache_page_t* page) {
+    vfs_inode_t* inode = page->inode;
+    int err = inode->ops->writepage ? inode->ops->writepage(inode, page->index, page->data) : VFS_ERR_INVAL;
+
+    uint64_t flags = spin_lock_irqsave(&pagecache_lock);
+    if (err >= 0) {
+        page->flags &= ~PAGE_DIRTY;
+        stats.dirty_pages--;
+        stats.writebacks++;
+    }
+    page->refcount--;
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+    return err < 0 ? err : 0;
+}
+
+static void page_remove_locked(cache_page_t* page) {
+    radix_tree_delete(&page->inode->pages, page->index);
+    page->inode->nrpages--;
+    list_remove(page_list(page), page);
+    if (page->flags & PAGE_DIRTY) stats.dirty_pages--;
+    if (page->flags & PAGE_ACTIVE) stats.active_pages--;
+    stats.pages--;
+}
+
+// Free one unpinned page: the FIFO's oldest while it is over its share,
+// otherwise the hot list's least recently used. A dirty victim is left in
+// place and handed back pinned, with its inode locked, for the caller to
+// write back; the first skip of them are passed over. held is the inode
+// whose lock the caller already has. Any other is only tried, as the lock
+// order is inode lock first and a spinlock holder cannot sleep for it.
+static bool reclaim_one_locked(vfs_inode_t* held, uint32_t skip, cache_page_t** dirty) {
+    bool from_a1in = a1in.count > a1in_target || !am.count;
+    for (uint32_t pass = 0; pass < 2; pass++) {
+        page_list_t* list = from_a1in ? &a1in : &am;
+        for (cache_page_t* page = list->head; page; page = page->lru_next) {
+            if (page->refcount) continue;
+            if (page->flags & PAGE_DIRTY) {
+                if (page->inode != held && !mutex_trylock(&page->inode->lock)) continue;
+                if (skip) {
+                    skip--;
+                    if (page->inode != held) mutex_unlock(&page->inode->lock);
+                    continue;
+                }
+                page->refcount++;
+                *dirty = page;
+                return false;
+            }
+
+            page_remove_locked(page);
+            if (from_a1in) ghost_remember(page);
+            stats.evictions++;
+            page_free_locked(page);
+            return true;
+        }
+        from_a1in = !from_a1in;
+    }
+    return false;
+}
+
+// Shrink the cache to target pages. Dirty victims are written back with
+// the page cache lock dropped and interrupts on; ones that fail stay
+// cached.
+static void reclaim(vfs_inode_t* held, uint64_t target) {
+    uint32_t failed = 0;
+    uint64_t flags = spin_lock_irqsave(&pagecache_lock);
+    while (stats.pages > target) {
+        cache_page_t* dirty = NULL;
+        if (reclaim_one_locked(held, failed, &dirty)) continue;
+        if (!dirty) break;
+
+        vfs_inode_t* inode = dirty->inode;
+        spin_unlock_irqrestore(&pagecache_lock, flags);
+        if (writeback_page(dirty) < 0) failed++;
+        if (inode != held) mutex_unlock(&inode->lock);
+        flags = spin_lock_irqsave(&pagecache_lock);
+    }
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+}
+
+// Add a pinned page to the inode's tree and to the FIFO, or straight to
+// the hot list if it was evicted not long ago
+static bool page_insert_locked(cache_page_t* page) {
+    vfs_inode_t* inode = page->inode;
+    if (!radix_tree_insert(&inode->pages, page->index, page)) return false;
+    inode->nrpages++;
+    stats.pages++;
+    if (page->region) page->region->users++;
+
+    if (ghost_take(inode, page->index)) {
+        page->flags |= PAGE_ACTIVE;
+        stats.active_pages++;
+        stats.ghost_hits++;
+    }
+    list_append(page_list(page), page);
+    return true;
+}
+
+// Pinned page at index, or NULL. A hit on the hot list refreshes it;
+// FIFO pages are left alone so a burst of accesses counts as one.
+static cache_page_t* page_get_locked(vfs_inode_t* inode, uint64_t index) {
+    cache_page_t* page = radix_tree_lookup(&inode->pages, index);
+    if (!page) return NULL;
+    page->refcount++;
+    if (page->flags & PAGE_ACTIVE) {
+        list_remove(&am, page);
+        list_append(&am, page);
+    }
+    return page;
+}
+
+static cache_page_t* page_get(vfs_inode_t* inode, uint64_t index) {
+    uint64_t flags = spin_lock_irqsave(&pagecache_lock);
+    cache_page_t* page = page_get_locked(inode, index);
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+    return page;
+}
+
+static void page_put(cache_page_t* page) {
+    uint64_t flags = spin_lock_irqsave(&pagecache_lock);
+    page->refcount--;
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+}
+
+static bool page_cached(vfs_inode_t* inode, uint64_t index) {
+    uint64_t flags = spin_lock_irqsave(&pagecache_lock);
+    bool cached = radix_tree_lookup(&inode->pages, index) != NULL;
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+    return cached;
+}
+
+// Make room, then read the page from the driver and cache it. Pages past
+// EOF, or about to be overwritten whole (read is false), start zeroed.
+// With a region the data goes straight into the page's slot there.
+// Returns the page pinned.
+static cache_page_t* page_fill(vfs_inode_t* inode, uint64_t index, uint32_t page_flags, bool read,
+                               page_region_t* region, int* error) {
+    reclaim(inode, stats.limit ? stats.limit - 1 : 0);
+
+    cache_page_t* page = page_alloc(inode, index, region);
+    if (!page) {
+        *error = VFS_ERR_NOMEM;
+        return NULL;
+    }
+
+    int err = 0;
+    if (!read || index * PAGE_SIZE >= inode->size) {
+        memset(page->data, 0, PAGE_SIZE);
+    } else {
+        err = inode->ops->readpage(inode, index, page->data);
+    }
+    if (err < 0) {
+        page_discard(page);
+        *error = err;
+        return NULL;
+    }
+    page->flags = PAGE_UPTODATE | page_flags;
+
+    uint64_t flags = spin_lock_irqsave(&pagecache_lock);
+    bool inserted = page_insert_locked(page);
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+    if (!inserted) {
+        page_discard(page);
+        *error = VFS_ERR_NOMEM;
+        return NULL;
+    }
+    return page;
+}
+
+// --- Readahead ---
+
+static uint32_t roundup_pow2(uint64_t n) {
+    uint32_t v = 1;
+    while (v < n && v < READAHEAD_MAX_PAGES) v <<= 1;
+    return v;
+}
+
+// First window: a few times the request, so small reads ramp up quickly
+static uint32_t readahead_initial(uint64_t req_pages) {
+    uint32_t size = roundup_pow2(req_pages);
+    if (size <= READAHEAD_MAX_PAGES / 32) size *= 4;
+    else if (size <= READAHEAD_MAX_PAGES / 4) size *= 2;
+    else size = READAHEAD_MAX_PAGES;
+    return size < READAHEAD_MIN_PAGES ? READAHEAD_MIN_PAGES : size;
+}
+
+static uint32_t readahead_next(uint32_t size) {
+    size = size < READAHEAD_MAX_PAGES / 16 ? size * 4 : size * 2;
+    return size > READAHEAD_MAX_PAGES ? READAHEAD_MAX_PAGES : size;
+}
+
+// Bring in the current window up to EOF. Pages before demand_end were asked
+// for; the rest are speculative, and the one at the window's async mark
+// triggers the next window when it is first read.
+static void readahead_submit(vfs_inode_t* inode, const vfs_readahead_t* ra, uint64_t demand_end) {
+    uint64_t eof_page = (inode->size + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint64_t mark = ra->start + ra->size - ra->async_size;
+
+    for (uint64_t index = ra->start; index < ra->start + ra->size && index < eof_page; index++) {
+        if (page_cached(inode, index)) continue;
+
+        bool demand = index < demand_end;
+        uint32_t page_flags = demand ? 0 : PAGE_PREFETCHED;
+        if (index == mark && ra->async_size) page_flags |= PAGE_READAHEAD;
+
+        int err;
+        cache_page_t* page = page_fill(inode, index, page_flags, true, NULL, &err);
+        if (!page) break;
+        page_put(page);
+
+        uint64_t flags = spin_lock_irqsave(&pagecache_lock);
+        if (demand) stats.misses++;
+        else stats.readahead_pages++;
+        spin_unlock_irqrestore(&pagecache_lock, flags);
+    }
+}
+
+// A miss at index while reading req_pages. Continuing where the last read
+// or the last window ended is sequential: grow the window. Anything else
+// reads just what was asked and starts over.
+static void readahead_sync(vfs_inode_t* inode, vfs_readahead_t* ra, uint64_t index, uint64_t req_pages) {
+    bool sequential = index == 0 || index == ra->prev_index || (ra->size && index == ra->start + ra->size);
+
+    ra->start = index;
+    if (sequential) {
+        ra->size = ra->size ? readahead_next(ra->size) : readahead_initial(req_pages);
+        if (ra->size < req_pages) ra->size = (uint32_t)(req_pages < READAHEAD_MAX_PAGES ? req_pages : READAHEAD_MAX_PAGES);
+        ra->async_size = ra->size > req_pages ? ra->size - (uint32_t)req_pages : 0;
+    } else {
+        ra->size = (uint32_t)(req_pages < READAHEAD_MAX_PAGES ? req_pages : READAHEAD_MAX_PAGES);
+        ra->async_size = 0;
+    }
+    readahead_submit(inode, ra, index + req_pages);
+}
+
+// The reader reached the async mark: queue the following window, larger
+static void readahead_async(vfs_inode_t* inode, vfs_readahead_t* ra) {
+    ra->start += ra->size;
+    ra->size = readahead_next(ra->size);
+    ra->async_size = ra->size;
+    readahead_submit(inode, ra, 0);
+}
+
+// --- Interface ---
+
+void pagecache_init(uint64_t max_pages) {
+    uint64_t flags = spin_lock_irqsave(&pagecache_lock);
+    memset(&stats, 0, sizeof(stats));
+    memset(&a1in, 0, sizeof(a1in));
+    memset(&am, 0, sizeof(am));
+    stats.limit = max_pages;
+    a1in_target = max_pages / 4;
+    ghost_resize(max_pages);
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+}
+
+void pagecache_set_limit(uint64_t max_pages) {
+    uint64_t flags = spin_lock_irqsave(&pagecache_lock);
+    stats.limit = max_pages;
+    a1in_target = max_pages / 4;
+    ghost_resize(max_pages);
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+    reclaim(NULL, max_pages);
+}
+
+int64_t pagecache_read(vfs_inode_t* inode, vfs_readahead_t* ra, uint64_t pos, void* buffer, uint64_t len) {
+    if (pos >= inode->size || !len) return 0;
+    if (len > inode->size - pos) len = inode->size - pos;
+
+    vfs_readahead_t scratch = { 0 };
+    if (!ra) ra = &scratch;
+
+    uint8_t* out = buffer;
+    uint64_t index = pos / PAGE_SIZE;
+    uint64_t last = (pos + len - 1) / PAGE_SIZE;
+    uint64_t filled_until = index;      // Pages read on demand by this call
+    uint64_t copied = 0;
+
+    while (index <= last) {
+        cache_page_t* page = page_get(inode, index);
+        if (!page) {
+            readahead_sync(inode, ra, index, last - index + 1);
+            filled_until = index + (last - index + 1);
+            page = page_get(inode, index);
+        }
+        if (!page) {
+            // Readahead could not get it; read this one page alone
+            int err;
+            page = page_fill(inode, index, 0, true, NULL, &err);
+            if (!page) return copied ? (int64_t)copied : err;
+        }
+
+        uint32_t page_flags = page->flags;
+        if (index >= filled_until || (page_flags & PAGE_PREFETCHED)) {
+            uint64_t flags = spin_lock_irqsave(&pagecache_lock);
+            stats.hits++;
+            if (page_flags & PAGE_PREFETCHED) stats.readahead_used++;
+            page->flags &= ~(PAGE_PREFETCHED | PAGE_READAHEAD);
+            spin_unlock_irqrestore(&pagecache_lock, flags);
+        }
+
+        uint64_t offset = (pos + copied) % PAGE_SIZE;
+        uint64_t chunk = PAGE_SIZE - offset;
+        if (chunk > len - copied) chunk = len - copied;
+        memcpy(out + copied, page->data + offset, chunk);
+        page_put(page);
+        copied += chunk;
+
+        if (page_flags & PAGE_READAHEAD) readahead_async(inode, ra);
+        index++;
+    }
+
+    ra->prev_index = last + 1;
+    return (int64_t)copied;
+}
+
+int64_t pagecache_write(vfs_inode_t* inode, uint64_t pos, const void* buffer, uint64_t len) {
+    if (!inode->ops->writepage) return VFS_ERR_INVAL;
+    if (pos + len < pos) return VFS_ERR_INVAL;
+
+    const uint8_t* in = buffer;
+    uint64_t written = 0;
+    while (written < len) {
+        uint64_t index = (pos + written) / PAGE_SIZE;
+        uint64_t offset = (pos + written) % PAGE_SIZE;
+        uint64_t chunk = PAGE_SIZE - offset;
+        if (chunk > len - written) chunk = len - written;
+
+        cache_page_t* page = page_get(inode, index);
+        if (!page) {
+            // A whole-page overwrite need not read the old contents
+            int err;
+            page = page_fill(inode, index, 0, chunk != PAGE_SIZE, NULL, &err);
+            if (!page) return written ? (int64_t)written : err;
+        }
+
+        if (!(page->flags & PAGE_DIRTY) && inode->ops->dirty_page) {
+            int err = inode->ops->dirty_page(inode, index);
+            if (err < 0) {
+                page_put(page);
+                return written ? (int64_t)written : err;
+            }
+        }
+        memcpy(page->data + offset, in + written, chunk);
+
+        uint64_t flags = spin_lock_irqsave(&pagecache_lock);
+        if (!(page->flags & PAGE_DIRTY)) stats.dirty_pages++;
+        page->flags |= PAGE_DIRTY | PAGE_UPTODATE;
+        page->flags &= ~(PAGE_PREFETCHED | PAGE_READAHEAD);
+        page->refcount--;
+        spin_unlock_irqrestore(&pagecache_lock, flags);
+
+        written += chunk;
+        if (pos + written > inode->size) inode->size = pos + written;
+    }
+
+    // Keep dirty data to a fraction of the cache so reclaim stays cheap
+    if (stats.dirty_pages > stats.limit / 2) pagecache_writeback(inode);
+    return (int64_t)written;
+}
+
+// Pages are written one at a time with the page cache lock dropped
+int pagecache_writeback(vfs_inode_t* inode) {
+    int result = 0;
+    uint64_t index = 0;
+    for (;;) {
+        uint64_t flags = spin_lock_irqsave(&pagecache_lock);
+        cache_page_t* page;
+        while ((page = radix_tree_next(&inode->pages, &index)) && !(page->flags & PAGE_DIRTY)) {
+            if (++index == 0) break;
+        }
+        if (page && (page->flags & PAGE_DIRTY)) page->refcount++;
+        else page = NULL;
+        spin_unlock_irqrestore(&pagecache_lock, flags);
+        if (!page) break;
+
+        int err = writeback_page(page);
+        if (err < 0) result = err;
+        if (++index == 0) break;
+    }
+    return result;
+}
+
+void pagecache_truncate(vfs_inode_t* inode, uint64_t size) {
+    uint64_t flags = spin_lock_irqsave(&pagecache_lock);
+    uint64_t index = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    cache_page_t* page;
+    while ((page = radix_tree_next(&inode->pages, &index))) {
+        page_remove_locked(page);
+        // A mapping still using the page frees it when released
+        if (page->refcount) page->inode = NULL;
+        else page_free_locked(page);
+        if (++index == 0) break;
+    }
+
+    if (size % PAGE_SIZE) {
+        page = radix_tree_lookup(&inode->pages, size / PAGE_SIZE);
+        if (page) memset(page->data + size % PAGE_SIZE, 0, PAGE_SIZE - size % PAGE_SIZE);
+    }
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+}
+
+// --- Mappings ---
+
+// Move a cached page's contents into its slot in region
+static void page_move_locked(cache_page_t* page, page_region_t* region) {
+    uint8_t* slot = region_slot(region, page->index);
+    memcpy(slot, page->data, PAGE_SIZE);
+    if (page->region) region_put_locked(page->region);
+    else memory_free(page->data);
+    page->data = slot;
+    page->region = region;
+    region->users++;
+}
+
+// The region that already holds every page of the range in place, if one
+// does. Pages pinned by a mapping cannot be moved, so any other overlap
+// with a mapping is refused.
+static int map_find_region_locked(vfs_inode_t* inode, uint64_t first, uint64_t count, page_region_t** result) {
+    page_region_t* region = NULL;
+    bool in_place = true;
+    bool pinned = false;
+    for (uint64_t i = 0; i < count; i++) {
+        cache_page_t* page = radix_tree_lookup(&inode->pages, first + i);
+        if (!page) {
+            in_place = false;
+            continue;
+        }
+        if (page->refcount) pinned = true;
+        if (i == 0) region = page->region;
+        if (!region || page->region != region || page->data != region_slot(region, first + i)) in_place = false;
+    }
+
+    *result = in_place ? region : NULL;
+    return !in_place && pinned ? VFS_ERR_BUSY : 0;
+}
+
+int pagecache_map(vfs_inode_t* inode, uint64_t first, uint64_t count, pagecache_map_t** result) {
+    if (!count || first + count < first) return VFS_ERR_INVAL;
+
+    pagecache_map_t* map = memory_alloc(sizeof(pagecache_map_t) + count * sizeof(cache_page_t*));
+    if (!map) return VFS_ERR_NOMEM;
+    map->count = 0;
+
+    uint64_t flags = spin_lock_irqsave(&pagecache_lock);
+    page_region_t* region = NULL;
+    int err = stats.mapped_pages + count > stats.limit / 2 ? VFS_ERR_NOMEM : 0;
+    if (!err) err = map_find_region_locked(inode, first, count, &region);
+    if (region) {
+        // Laid out by an earlier mapping: share it
+        for (uint64_t i = 0; i < count; i++) {
+            map->pages[i] = page_get_locked(inode, first + i);
+        }
+        map->count = count;
+        region->users++;
+        stats.mapped_pages += count;
+        stats.hits += count;
+    }
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+
+    if (err) {
+        memory_free(map);
+        return err;
+    }
+    if (region) {
+        map->region = region;
+        map->addr = region_slot(region, first);
+        *result = map;
+        return 0;
+    }
+
+    region = memory_alloc(sizeof(page_region_t));
+    uint8_t* base = region ? memory_alloc(count * PAGE_SIZE) : NULL;
+    if (!base) {
+        if (region) memory_free(region);
+        memory_free(map);
+        return VFS_ERR_NOMEM;
+    }
+    region->base = base;
+    region->first = first;
+    region->users = 1;
+    map->region = region;
+    map->addr = base;
+
+    // Cached pages move into the region; the rest are read straight into it
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t index = first + i;
+        flags = spin_lock_irqsave(&pagecache_lock);
+        cache_page_t* page = page_get_locked(inode, index);
+        bool hit = page != NULL;
+        if (hit) {
+            page_move_locked(page, region);
+            page->flags &= ~(PAGE_PREFETCHED | PAGE_READAHEAD);
+        }
+        spin_unlock_irqrestore(&pagecache_lock, flags);
+
+        if (!hit) {
+            page = page_fill(inode, index, 0, true, region, &err);
+            if (!page) {
+                pagecache_unmap(map);
+                return err;
+            }
+        }
+
+        flags = spin_lock_irqsave(&pagecache_lock);
+        if (hit) stats.hits++;
+        else stats.misses++;
+        stats.mapped_pages++;
+        map->pages[map->count++] = page;
+        spin_unlock_irqrestore(&pagecache_lock, flags);
+    }
+
+    *result = map;
+    return 0;
+}
+
+void pagecache_unmap(pagecache_map_t* map) {
+    uint64_t flags = spin_lock_irqsave(&pagecache_lock);
+    for (uint64_t i = 0; i < map->count; i++) {
+        cache_page_t* page = map->pages[i];
+        page->refcount--;
+        // Truncated while mapped: the cache has already let go of it
+        if (!page->inode && !page->refcount) page_free_locked(page);
+    }
+    stats.mapped_pages -= map->count;
+    region_put_locked(map->region);
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+    memory_free(map);
+}
+
+void pagecache_get_stats(pagecache_stats_t* out) {
+    if (!out) return;
+    uint64_t flags = spin_lock_irqsave(&pagecache_lock);
+    *out = stats;
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+}
@@ -0,0 +1,91 @@
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fs/vfs.h"
+#include "mmu.h"
+
+// Page cache for drivers that provide readpage: file data is cached per
+// inode in PAGE_SIZE pages found through a radix tree on the inode, reads
+// detect sequential access and read ahead in growing windows, and writes
+// stay in dirty pages until writeback.
+//
+// A file range can also be mapped: its pages are gathered into one
+// contiguous region, which the caller reads directly. There are no page
+// tables, so the whole range is brought in when the mapping is made, and
+// its pages stay pinned until it is released.
+
+#define PAGECACHE_DEFAULT_PAGES 4096    // 16 MB
+#define READAHEAD_MIN_PAGES     4
+#define READAHEAD_MAX_PAGES     64      // 256 KB
+
+// Page flags
+#define PAGE_UPTODATE   0x1
+#define PAGE_DIRTY      0x2
+#define PAGE_READAHEAD  0x4     // First touch starts the next readahead window
+#define PAGE_ACTIVE     0x8     // On the hot list rather than the FIFO
+#define PAGE_PREFETCHED 0x10    // Read ahead and not used yet
+
+// Contiguous memory that the pages of a mapped range live in. It outlives
+// its mappings for as long as any of its pages are still cached.
+typedef struct page_region {
+    uint8_t* base;
+    uint64_t first;             // Page index at base
+    uint32_t users;             // Cached pages inside it, plus mappings
+} page_region_t;
+
+typedef struct cache_page {
+    vfs_inode_t* inode;         // NULL once truncated away while mapped
+    uint64_t index;
+    uint8_t* data;
+    page_region_t* region;      // Owner of data; NULL if the page has its own
+    uint32_t flags;
+    uint32_t refcount;          // Pins the page against reclaim
+    struct cache_page* lru_next;
+    struct cache_page* lru_prev;
+} cache_page_t;
+
+// A mapping: the pages it pins and where they start
+typedef struct pagecache_map {
+    page_region_t* region;
+    uint8_t* addr;
+    uint64_t count;
+    cache_page_t* pages[];
+} pagecache_map_t;
+
+typedef struct {
+    uint64_t pages;
+    uint64_t active_pages;
+    uint64_t dirty_pages;
+    uint64_t limit;
+    uint64_t hits;
+    uint64_t misses;            // Pages read on demand
+    uint64_t readahead_pages;   // Pages read speculatively
+    uint64_t readahead_used;    // ... of which were later read
+    uint64_t evictions;
+    uint64_t ghost_hits;        // Misses on recently evicted pages
+    uint64_t writebacks;
+    uint64_t mapped_pages;
+} pagecache_stats_t;
+
+void pagecache_init(uint64_t max_pages);
+void pagecache_set_limit(uint64_t max_pages);
+
+// Called with the inode lock held
+int64_t pagecache_read(vfs_inode_t* inode, vfs_readahead_t* ra, uint64_t pos, void* buffer, uint64_t len);
+int64_t pagecache_write(vfs_inode_t* inode, uint64_t pos, const void* buffer, uint64_t len);
+int pagecache_writeback(vfs_inode_t* inode);
+
+// Drop pages wholly past size and zero the tail of the last one
+void pagecache_truncate(vfs_inode_t* inode, uint64_t size);
+
+// Map count pages from first, read-only and shared with the cache; called
+// with the inode lock held. A mapping may pin at most half the cache, and
+// may only overlap an existing mapping that it lies entirely within.
+int pagecache_map(vfs_inode_t* inode, uint64_t first, uint64_t count, pagecache_map_t** result);
+void pagecache_unmap(pagecache_map_t* map);
+
+void pagecache_get_stats(pagecache_stats_t* stats);
+
+#endif // PAGECACHE_H
@@ -0,0 +1,365 @@
+#include "fs/sysimg.h"
+#include "fs/vfs.h"
+#include "lz4.h"
+#include "memory.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "time.h"
+#include "arch/cpu.h"
+#include <string.h>
+
+// Decompressed blocks shared by every mounted image. A slot being filled
+// or copied from is pinned by its users count; readers of a block that is
+// still being decompressed wait for it rather than decompressing it again.
+#define SYSIMG_CACHE_SLOTS  8
+
+typedef struct sysimg_fs {
+    const uint8_t* image;
+    const sysimg_super_t* super;
+    const sysimg_inode_t* inodes;
+    const sysimg_dirent_t* dirents;
+    const char* names;
+    const sysimg_block_t* index;
+} sysimg_fs_t;
+
+typedef struct {
+    const sysimg_fs_t* fs;      // NULL when unused
+    uint32_t block;
+    uint32_t users;
+    bool ready;
+    uint64_t last_used;
+    uint8_t* data;              // Allocated on first use
+} sysimg_slot_t;
+
+static sysimg_slot_t slots[SYSIMG_CACHE_SLOTS];
+static uint64_t cache_clock;
+static uint32_t mounted;
+static sysimg_stats_t stats;
+static spinlock_t cache_lock = SPINLOCK_INIT;
+
+// --- Image access ---
+
+static bool range_ok(uint64_t offset, uint64_t len, uint64_t limit) {
+    return offset <= limit && len <= limit - offset;
+}
+
+static uint32_t block_length(const sysimg_fs_t* fs, uint32_t block) {
+    uint64_t start = (uint64_t)block << SYSIMG_BLOCK_SHIFT;
+    uint64_t left = fs->super->data_size - start;
+    return left < SYSIMG_BLOCK_SIZE ? (uint32_t)left : SYSIMG_BLOCK_SIZE;
+}
+
+static int block_decompress(const sysimg_fs_t* fs, uint32_t block, uint8_t* out) {
+    const sysimg_block_t* entry = &fs->index[block];
+    uint32_t expect = block_length(fs, block);
+    if (!range_ok(entry->offset, entry->length, fs->super->image_size)) return VFS_ERR_IO;
+
+    const uint8_t* in = fs->image + entry->offset;
+    if (entry->flags & SYSIMG_BLOCK_STORED) {
+        if (entry->length != expect) return VFS_ERR_IO;
+        memcpy(out, in, expect);
+        return 0;
+    }
+    int64_t produced = lz4_decompress(in, entry->length, out, SYSIMG_BLOCK_SIZE);
+    return produced == expect ? 0 : VFS_ERR_IO;
+}
+
+// --- Block cache ---
+
+static sysimg_slot_t* slot_find_locked(const sysimg_fs_t* fs, uint32_t block) {
+    for (int i = 0; i < SYSIMG_CACHE_SLOTS; i++) {
+        if (slots[i].fs == fs && slots[i].block == block) return &slots[i];
+    }
+    return NULL;
+}
+
+// Least recently used slot nobody holds, preferring empty ones
+static sysimg_slot_t* slot_victim_locked(void) {
+    sysimg_slot_t* victim = NULL;
+    for (int i = 0; i < SYSIMG_CACHE_SLOTS; i++) {
+        sysimg_slot_t* slot = &slots[i];
+        if (slot->users) continue;
+        if (!slot->fs) return slot;
+        if (!victim || slot->last_used < victim->last_used) victim = slot;
+    }
+    return victim;
+}
+
+// Decompress into a slot claimed by the caller, then publish it
+static int slot_fill(sysimg_slot_t* slot, const sysimg_fs_t* fs, uint32_t block) {
+    if (!slot->data) slot->data = memory_alloc(SYSIMG_BLOCK_SIZE);
+    uint64_t start = time_get_ns();
+    int err = slot->data ? block_decompress(fs, block, slot->data) : VFS_ERR_NOMEM;
+    uint64_t elapsed = time_get_ns() - start;
+
+    uint64_t flags = spin_lock_irqsave(&cache_lock);
+    if (err) {
+        slot->fs = NULL;
+        slot->users--;
+    } else {
+        slot->ready = true;
+        stats.bytes_decompressed += block_length(fs, block);
+        stats.decompress_ns += elapsed;
+    }
+    spin_unlock_irqrestore(&cache_lock, flags);
+    return err;
+}
+
+// Every slot is pinned: decompress into a buffer of our own
+static int block_copy_uncached(const sysimg_fs_t* fs, uint32_t block, uint32_t offset,
+                               void* dst, uint32_t len) {
+    uint8_t* buffer = memory_alloc(SYSIMG_BLOCK_SIZE);
+    if (!buffer) return VFS_ERR_NOMEM;
+    int err = block_decompress(fs, block, buffer);
+    if (!err) memcpy(dst, buffer + offset, len);
+    memory_free(buffer);
+    return err;
+}
+
+// Copy len bytes at offset within a block out of the cache
+static int block_copy(const sysimg_fs_t* fs, uint32_t block, uint32_t offset, void* dst, uint32_t len) {
+    uint64_t flags = spin_lock_irqsave(&cache_lock);
+    sysimg_slot_t* slot;
+    for (;;) {
+        slot = slot_find_locked(fs, block);
+        if (!slot || slot->ready) break;
+        spin_unlock_irqrestore(&cache_lock, flags);
+        arch_cpu_relax();
+        flags = spin_lock_irqsave(&cache_lock);
+    }
+
+    if (slot) {
+        stats.block_hits++;
+    } else {
+        stats.block_misses++;
+        slot = slot_victim_locked();
+        if (!slot) {
+            spin_unlock_irqrestore(&cache_lock, flags);
+            return block_copy_uncached(fs, block, offset, dst, len);
+        }
+        slot->fs = fs;
+        slot->block = block;
+        slot->ready = false;
+    }
+    slot->users++;
+    slot->last_used = ++cache_clock;
+    bool fill = !slot->ready;
+    spin_unlock_irqrestore(&cache_lock, flags);
+
+    if (fill) {
+        int err = slot_fill(slot, fs, block);
+        if (err) return err;
+    }
+    memcpy(dst, slot->data + offset, len);
+
+    flags = spin_lock_irqsave(&cache_lock);
+    slot->users--;
+    spin_unlock_irqrestore(&cache_lock, flags);
+    return 0;
+}
+
+// Drop an unmounted image's blocks; the buffers go with the last image
+static void cache_release(const sysimg_fs_t* fs) {
+    uint64_t flags = spin_lock_irqsave(&cache_lock);
+    mounted--;
+    for (int i = 0; i < SYSIMG_CACHE_SLOTS; i++) {
+        sysimg_slot_t* slot = &slots[i];
+        if (slot->fs == fs) {
+            slot->fs = NULL;
+            slot->ready = false;
+        }
+        if (!mounted && slot->data) {
+            memory_free(slot->data);
+            slot->data = NULL;
+        }
+    }
+    spin_unlock_irqrestore(&cache_lock, flags);
+}
+
+// --- Operations ---
+
+static const sysimg_inode_t* sysimg_inode(const vfs_inode_t* inode) {
+    return inode->fs_data;
+}
+
+// A dirent is checked when it is used rather than at mount
+static const char* dirent_name(const sysimg_fs_t* fs, const sysimg_dirent_t* dirent) {
+    if (!dirent->name_len || dirent->name_len > VFS_NAME_MAX) return NULL;
+    if (!range_ok(dirent->name, dirent->name_len, fs->super->names_size)) return NULL;
+    if (dirent->ino < SYSIMG_ROOT_INO || dirent->ino > fs->super->inode_count) return NULL;
+    return fs->names + dirent->name;
+}
+
+static int name_compare(const char* a, size_t a_len, const char* b, size_t b_len) {
+    int diff = memcmp(a, b, a_len < b_len ? a_len : b_len);
+    if (diff) return diff;
+    return a_len < b_len ? -1 : a_len > b_len;
+}
+
+static int sysimg_lookup(vfs_inode_t* dir, const char* name, size_t len, vfs_ino_t* ino) {
+    const sysimg_fs_t* fs = dir->sb->fs_data;
+    const sysimg_inode_t* node = sysimg_inode(dir);
+    const sysimg_dirent_t* entries = fs->dirents + node->start;
+
+    uint32_t low = 0;
+    uint32_t high = node->count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        const char* mid_name = dirent_name(fs, &entries[mid]);
+        if (!mid_name) return VFS_ERR_IO;
+        int diff = name_compare(name, len, mid_name, entries[mid].name_len);
+        if (!diff) {
+            *ino = entries[mid].ino;
+            return 0;
+        }
+        if (diff < 0) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return VFS_ERR_NOENT;
+}
+
+// The cookie is the index of the next entry
+static int sysimg_readdir(vfs_inode_t* dir, uint64_t* cookie, vfs_dirent_t* dirent) {
+    const sysimg_fs_t* fs = dir->sb->fs_data;
+    const sysimg_inode_t* node = sysimg_inode(dir);
+    if (*cookie >= node->count) return 0;
+
+    const sysimg_dirent_t* entry = &fs->dirents[node->start + *cookie];
+    const char* name = dirent_name(fs, entry);
+    if (!name) return VFS_ERR_IO;
+    dirent->ino = entry->ino;
+    dirent->type = entry->type;
+    dirent->name_len = entry->name_len;
+    memcpy(dirent->name, name, entry->name_len);
+    dirent->name[entry->name_len] = '\0';
+    (*cookie)++;
+    return 1;
+}
+
+// Only the blocks under this page are decompressed
+static int sysimg_readpage(vfs_inode_t* inode, uint64_t index, void* page) {
+    const sysimg_fs_t* fs = inode->sb->fs_data;
+    const sysimg_inode_t* node = sysimg_inode(inode);
+    uint64_t pos = index * PAGE_SIZE;
+    uint64_t len = node->size - pos < PAGE_SIZE ? node->size - pos : PAGE_SIZE;
+
+    uint8_t* dst = page;
+    uint64_t stream = node->start + pos;
+    uint64_t done = 0;
+    while (done < len) {
+        uint32_t block = (uint32_t)(stream >> SYSIMG_BLOCK_SHIFT);
+        uint32_t offset = (uint32_t)(stream & (SYSIMG_BLOCK_SIZE - 1));
+        uint32_t chunk = SYSIMG_BLOCK_SIZE - offset;
+        if (chunk > len - done) chunk = (uint32_t)(len - done);
+        int err = block_copy(fs, block, offset, dst + done, chunk);
+        if (err) return err;
+        done += chunk;
+        stream += chunk;
+    }
+    memset(dst + len, 0, PAGE_SIZE - len);
+    return 0;
+}
+
+static const vfs_inode_ops_t sysimg_inode_ops = {
+    .lookup = sysimg_lookup,
+    .readdir = sysimg_readdir,
+    .readpage = sysimg_readpage,
+};
+
+static int sysimg_read_inode(vfs_inode_t* inode) {
+    const sysimg_fs_t* fs = inode->sb->fs_data;
+    if (inode->ino < SYSIMG_ROOT_INO || inode->ino > fs->super->inode_count) return VFS_ERR_NOENT;
+
+    const sysimg_inode_t* node = &fs->inodes[inode->ino - 1];
+    if (node->type == VFS_TYPE_DIR) {
+        if (!range_ok(node->start, node->count, fs->super->dirent_count)) return VFS_ERR_IO;
+        inode->size = 0;
+    } else if (node->type == VFS_TYPE_FILE) {
+        if (!range_ok(node->start, node->size, fs->super->data_size)) return VFS_ERR_IO;
+        inode->size = node->size;
+    } else {
+        return VFS_ERR_IO;
+    }
+    inode->type = node->type;
+    inode->nlink = node->type == VFS_TYPE_DIR ? 2 : 1;
+    inode->ops = &sysimg_inode_ops;
+    inode->fs_data = (void*)node;
+    return 0;
+}
+
+static void sysimg_unmount(vfs_super_t* sb) {
+    cache_release(sb->fs_data);
+    memory_free(sb->fs_data);
+}
+
+static const vfs_super_ops_t sysimg_super_ops = {
+    .read_inode = sysimg_read_inode,
+    .unmount = sysimg_unmount,
+};
+
+static bool table_ok(const sysimg_super_t* super, uint64_t offset, uint64_t count, uint64_t size) {
+    return offset % 8 == 0 && range_ok(offset, count * size, super->image_size);
+}
+
+static int sysimg_mount(vfs_super_t* sb, const char* source, const void* data) {
+    const sysimg_source_t* image = data;
+    if (!image || !image->start || image->size < sizeof(sysimg_super_t)) return VFS_ERR_INVAL;
+
+    const sysimg_super_t* super = image->start;
+    uint64_t blocks = (super->data_size + SYSIMG_BLOCK_SIZE - 1) >> SYSIMG_BLOCK_SHIFT;
+    if (super->magic != SYSIMG_MAGIC || super->version != SYSIMG_VERSION ||
+        super->block_shift != SYSIMG_BLOCK_SHIFT || super->image_size > image->size ||
+        super->block_count != blocks || super->inode_count < SYSIMG_ROOT_INO ||
+        !table_ok(super, super->inode_offset, super->inode_count, sizeof(sysimg_inode_t)) ||
+        !table_ok(super, super->dirent_offset, super->dirent_count, sizeof(sysimg_dirent_t)) ||
+        !range_ok(super->names_offset, super->names_size, super->image_size) ||
+        !table_ok(super, super->index_offset, super->block_count, sizeof(sysimg_block_t))) {
+        return VFS_ERR_IO;
+    }
+
+    sysimg_fs_t* fs = memory_alloc(sizeof(sysimg_fs_t));
+    if (!fs) return VFS_ERR_NOMEM;
+    fs->image = image->start;
+    fs->super = super;
+    fs->inodes = (const sysimg_inode_t*)(fs->image + super->inode_offset);
+    fs->dirents = (const sysimg_dirent_t*)(fs->image + super->dirent_offset);
+    fs->names = (const char*)(fs->image + super->names_offset);
+    fs->index = (const sysimg_block_t*)(fs->image + super->index_offset);
+    if (fs->inodes[SYSIMG_ROOT_INO - 1].type != VFS_TYPE_DIR) {
+        memory_free(fs);
+        return VFS_ERR_IO;
+    }
+
+    uint64_t flags = spin_lock_irqsave(&cache_lock);
+    mounted++;
+    spin_unlock_irqrestore(&cache_lock, flags);
+
+    sb->flags |= VFS_MOUNT_RDONLY;
+    sb->ops = &sysimg_super_ops;
+    sb->root_ino = SYSIMG_ROOT_INO;
+    sb->fs_data = fs;
+    return 0;
+}
+
+static vfs_fs_type_t sysimg_type = {
+    .name = "sysimg",
+    .mount = sysimg_mount,
+};
+
+void sysimg_init(void) {
+    vfs_register_fs(&sysimg_type);
+}
+
+void sysimg_get_stats(sysimg_stats_t* out) {
+    if (!out) return;
+    uint64_t flags = spin_lock_irqsave(&cache_lock);
+    *out = stats;
+    out->cached_blocks = 0;
+    for (int i = 0; i < SYSIMG_CACHE_SLOTS; i++) {
+        if (slots[i].ready) out->cached_blocks++;
+    }
+    spin_unlock_irqrestore(&cache_lock, flags);
+}
@@ -0,0 +1,85 @@
+#ifndef SYSIMG_H
+#define SYSIMG_H
+
+#include <stdint.h>
+
+// Read-only system image, built by tools/mksysimg.sh. File contents are
+// packed back to back into one data stream, which is cut into 64 KB
+// blocks compressed independently with LZ4, so any byte can be reached by
+// decompressing a single block. The inode, directory and block tables
+// stay uncompressed and are used where the image lies; mounting only
+// checks the superblock.
+//
+// Decompressed blocks are kept in a small cache shared by all mounted
+// images, and file pages go through the page cache on top of it.
+//
+// On-disk layout, little-endian, every table 8-byte aligned:
+//   superblock | inodes | dirents | names | block index | blocks
+
+#define SYSIMG_MAGIC        0x474d4953      // "SIMG"
+#define SYSIMG_VERSION      1
+#define SYSIMG_BLOCK_SHIFT  16
+#define SYSIMG_BLOCK_SIZE   (1u << SYSIMG_BLOCK_SHIFT)
+#define SYSIMG_ROOT_INO     1               // Inode n is table entry n - 1
+
+// Block flags
+#define SYSIMG_BLOCK_STORED 0x1             // Did not compress; kept as is
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t block_shift;
+    uint32_t inode_count;
+    uint32_t dirent_count;
+    uint32_t block_count;
+    uint32_t reserved;
+    uint64_t data_size;         // Length of the uncompressed data stream
+    uint64_t inode_offset;
+    uint64_t dirent_offset;
+    uint64_t names_offset;
+    uint64_t names_size;
+    uint64_t index_offset;
+    uint64_t image_size;
+} sysimg_super_t;
+
+// A directory's entries are dirents [start, start + count), sorted by name
+// with memcmp and then by length. A file is bytes [start, start + size) of
+// the data stream.
+typedef struct {
+    uint32_t type;              // VFS_TYPE_*
+    uint32_t count;
+    uint64_t start;
+    uint64_t size;
+} sysimg_inode_t;
+
+typedef struct {
+    uint32_t ino;
+    uint32_t name;              // Offset into the name table
+    uint16_t name_len;
+    uint16_t type;
+} sysimg_dirent_t;
+
+typedef struct {
+    uint64_t offset;            // From the start of the image
+    uint32_t length;
+    uint32_t flags;             // SYSIMG_BLOCK_*
+} sysimg_block_t;
+
+// Mount data: where the bootloader left the image
+typedef struct {
+    const void* start;
+    uint64_t size;
+} sysimg_source_t;
+
+typedef struct {
+    uint64_t block_hits;
+    uint64_t block_misses;
+    uint64_t bytes_decompressed;
+    uint64_t decompress_ns;
+    uint64_t cached_blocks;
+} sysimg_stats_t;
+
+void sysimg_init(void);
+void sysimg_get_stats(sysimg_stats_t* stats);
+
+#endif // SYSIMG_H
@@ -0,0 +1,329 @@
+#include "fs/tmpfs.h"
+#include "fs/vfs.h"
+#include "memory.h"
+#include <string.h>
+
+#define TMPFS_ROOT_INO      1
+#define TMPFS_NODES_INITIAL 64
+#define TMPFS_MIN_CAPACITY  64
+
+// Directory entries are kept in insertion order; each gets a sequence
+// number that serves as its readdir cookie, so cookies survive inserts
+// and removals of other entries
+typedef struct tmpfs_dirent {
+    struct tmpfs_dirent* next;
+    vfs_ino_t ino;
+    uint64_t seq;
+    uint16_t name_len;
+    char name[];
+} tmpfs_dirent_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t nlink;
+    uint64_t size;
+    uint64_t capacity;
+    uint8_t* data;              // Files; zero from size to capacity
+    uint32_t mappings;          // data cannot move while mapped
+    tmpfs_dirent_t* entries;    // Directories
+    tmpfs_dirent_t* last;
+    uint64_t next_seq;
+} tmpfs_node_t;
+
+// Nodes indexed by inode number; the table doubles when full
+typedef struct {
+    tmpfs_node_t** nodes;
+    uint64_t node_slots;
+    uint64_t next_ino;          // Next-fit hint
+} tmpfs_sb_t;
+
+static tmpfs_node_t* tmpfs_node(const vfs_inode_t* inode) {
+    return inode->fs_data;
+}
+
+static bool tmpfs_grow_table(tmpfs_sb_t* fs) {
+    uint64_t slots = fs->node_slots ? fs->node_slots * 2 : TMPFS_NODES_INITIAL;
+    tmpfs_node_t** nodes = memory_alloc(slots * sizeof(*nodes));
+    if (!nodes) return false;
+
+    memset(nodes, 0, slots * sizeof(*nodes));
+    if (fs->nodes) {
+        memcpy(nodes, fs->nodes, fs->node_slots * sizeof(*nodes));
+        memory_free(fs->nodes);
+    }
+    fs->nodes = nodes;
+    fs->node_slots = slots;
+    return true;
+}
+
+static vfs_ino_t tmpfs_alloc_node(tmpfs_sb_t* fs, uint32_t type) {
+    vfs_ino_t ino = 0;
+    for (uint64_t i = 0; i < fs->node_slots; i++) {
+        uint64_t candidate = (fs->next_ino + i) % fs->node_slots;
+        if (candidate >= TMPFS_ROOT_INO && !fs->nodes[candidate]) {
+            ino = candidate;
+            break;
+        }
+    }
+    if (!ino) {
+        uint64_t old_slots = fs->node_slots;
+        if (!tmpfs_grow_table(fs)) return 0;
+        ino = old_slots < TMPFS_ROOT_INO ? TMPFS_ROOT_INO : old_slots;
+    }
+
+    tmpfs_node_t* node = memory_alloc(sizeof(tmpfs_node_t));
+    if (!node) return 0;
+    memset(node, 0, sizeof(tmpfs_node_t));
+    node->type = type;
+    node->nlink = type == VFS_TYPE_DIR ? 2 : 1;
+
+    fs->nodes[ino] = node;
+    fs->next_ino = ino + 1;
+    return ino;
+}
+
+static void tmpfs_free_node(tmpfs_sb_t* fs, vfs_ino_t ino) {
+    tmpfs_node_t* node = fs->nodes[ino];
+    tmpfs_dirent_t* entry = node->entries;
+    while (entry) {
+        tmpfs_dirent_t* next = entry->next;
+        memory_free(entry);
+        entry = next;
+    }
+    if (node->data) memory_free(node->data);
+    memory_free(node);
+    fs->nodes[ino] = NULL;
+}
+
+static tmpfs_dirent_t* tmpfs_find(tmpfs_node_t* dir, const char* name, size_t len, tmpfs_dirent_t** prev) {
+    tmpfs_dirent_t* before = NULL;
+    for (tmpfs_dirent_t* entry = dir->entries; entry; before = entry, entry = entry->next) {
+        if (entry->name_len == len && memcmp(entry->name, name, len) == 0) {
+            if (prev) *prev = before;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static int tmpfs_lookup(vfs_inode_t* dir, const char* name, size_t len, vfs_ino_t* ino) {
+    tmpfs_dirent_t* entry = tmpfs_find(tmpfs_node(dir), name, len, NULL);
+    if (!entry) return VFS_ERR_NOENT;
+    *ino = entry->ino;
+    return 0;
+}
+
+static int tmpfs_create(vfs_inode_t* dir, const char* name, size_t len, uint32_t type, vfs_ino_t* ino) {
+    tmpfs_sb_t* fs = dir->sb->fs_data;
+    tmpfs_node_t* parent = tmpfs_node(dir);
+
+    tmpfs_dirent_t* entry = memory_alloc(sizeof(tmpfs_dirent_t) + len);
+    if (!entry) return VFS_ERR_NOMEM;
+
+    vfs_ino_t new_ino = tmpfs_alloc_node(fs, type);
+    if (!new_ino) {
+        memory_free(entry);
+        return VFS_ERR_NOSPC;
+    }
+
+    entry->next = NULL;
+    entry->ino = new_ino;
+    entry->seq = ++parent->next_seq;
+    entry->name_len = (uint16_t)len;
+    memcpy(entry->name, name, len);
+    if (parent->last) parent->last->next = entry;
+    else parent->entries = entry;
+    parent->last = entry;
+
+    if (type == VFS_TYPE_DIR) {
+        parent->nlink++;
+        dir->nlink = parent->nlink;
+    }
+    *ino = new_ino;
+    return 0;
+}
+
+static int tmpfs_unlink(vfs_inode_t* dir, const char* name, size_t len, vfs_inode_t* inode) {
+    tmpfs_node_t* parent = tmpfs_node(dir);
+    tmpfs_node_t* node = tmpfs_node(inode);
+    if (node->type == VFS_TYPE_DIR && node->entries) return VFS_ERR_NOTEMPTY;
+
+    tmpfs_dirent_t* prev = NULL;
+    tmpfs_dirent_t* entry = tmpfs_find(parent, name, len, &prev);
+    if (!entry) return VFS_ERR_NOENT;
+
+    if (prev) prev->next = entry->next;
+    else parent->entries = entry->next;
+    if (parent->last == entry) parent->last = prev;
+    memory_free(entry);
+
+    if (node->type == VFS_TYPE_DIR) {
+        parent->nlink--;
+        dir->nlink = parent->nlink;
+        node->nlink = 0;
+    } else {
+        node->nlink--;
+    }
+    // Storage goes once the VFS evicts the inode
+    inode->nlink = node->nlink;
+    return 0;
+}
+
+static int tmpfs_readdir(vfs_inode_t* dir, uint64_t* cookie, vfs_dirent_t* dirent) {
+    tmpfs_sb_t* fs = dir->sb->fs_data;
+    tmpfs_dirent_t* entry = tmpfs_node(dir)->entries;
+    while (entry && entry->seq < *cookie) {
+        entry = entry->next;
+    }
+    if (!entry) return 0;
+
+    dirent->ino = entry->ino;
+    dirent->type = fs->nodes[entry->ino]->type;
+    dirent->name_len = entry->name_len;
+    memcpy(dirent->name, entry->name, entry->name_len);
+    dirent->name[entry->name_len] = '\0';
+    *cookie = entry->seq + 1;
+    return 1;
+}
+
+// Grow the buffer geometrically, zeroing everything past the old size
+static int tmpfs_reserve(tmpfs_node_t* node, uint64_t size) {
+    if (size <= node->capacity) return 0;
+    if (node->mappings) return VFS_ERR_BUSY;
+
+    uint64_t capacity = node->capacity ? node->capacity : TMPFS_MIN_CAPACITY;
+    while (capacity < size) capacity *= 2;
+
+    uint8_t* data = memory_alloc(capacity);
+    if (!data) return VFS_ERR_NOSPC;
+    if (node->data) {
+        memcpy(data, node->data, node->size);
+        memory_free(node->data);
+    }
+    memset(data + node->size, 0, capacity - node->size);
+    node->data = data;
+    node->capacity = capacity;
+    return 0;
+}
+
+static int64_t tmpfs_read(vfs_inode_t* inode, uint64_t pos, void* buffer, uint64_t len) {
+    tmpfs_node_t* node = tmpfs_node(inode);
+    if (pos >= node->size) return 0;
+    if (len > node->size - pos) len = node->size - pos;
+    memcpy(buffer, node->data + pos, len);
+    return (int64_t)len;
+}
+
+static int64_t tmpfs_write(vfs_inode_t* inode, uint64_t pos, const void* buffer, uint64_t len) {
+    tmpfs_node_t* node = tmpfs_node(inode);
+    if (pos + len < pos) return VFS_ERR_INVAL;
+    int err = tmpfs_reserve(node, pos + len);
+    if (err) return err;
+
+    // Bytes past the old size are already zero, so a hole reads back as zeros
+    memcpy(node->data + pos, buffer, len);
+    if (pos + len > node->size) {
+        node->size = pos + len;
+        inode->size = node->size;
+    }
+    return (int64_t)len;
+}
+
+static int tmpfs_truncate(vfs_inode_t* inode, uint64_t size) {
+    tmpfs_node_t* node = tmpfs_node(inode);
+    if (size > node->size) {
+        int err = tmpfs_reserve(node, size);
+        if (err) return err;
+    } else if (node->data) {
+        // Keep the tail zeroed for a later extension
+        memset(node->data + size, 0, node->size - size);
+    }
+    node->size = size;
+    inode->size = size;
+    return 0;
+}
+
+// File data is already in memory: hand it out in place
+static int tmpfs_map(vfs_inode_t* inode, uint64_t pos, uint64_t len, void** addr) {
+    tmpfs_node_t* node = tmpfs_node(inode);
+    node->mappings++;
+    *addr = node->data + pos;
+    return 0;
+}
+
+static void tmpfs_unmap(vfs_inode_t* inode, uint64_t pos, uint64_t len) {
+    tmpfs_node(inode)->mappings--;
+}
+
+static const vfs_inode_ops_t tmpfs_inode_ops = {
+    .lookup = tmpfs_lookup,
+    .create = tmpfs_create,
+    .unlink = tmpfs_unlink,
+    .readdir = tmpfs_readdir,
+    .read = tmpfs_read,
+    .write = tmpfs_write,
+    .truncate = tmpfs_truncate,
+    .map = tmpfs_map,
+    .unmap = tmpfs_unmap,
+};
+
+static int tmpfs_read_inode(vfs_inode_t* inode) {
+    tmpfs_sb_t* fs = inode->sb->fs_data;
+    if (inode->ino >= fs->node_slots || !fs->nodes[inode->ino]) return VFS_ERR_NOENT;
+
+    tmpfs_node_t* node = fs->nodes[inode->ino];
+    inode->type = node->type;
+    inode->nlink = node->nlink;
+    inode->size = node->size;
+    inode->ops = &tmpfs_inode_ops;
+    inode->fs_data = node;
+    return 0;
+}
+
+static void tmpfs_evict_inode(vfs_inode_t* inode) {
+    if (inode->nlink == 0) {
+        tmpfs_free_node(inode->sb->fs_data, inode->ino);
+    }
+}
+
+static void tmpfs_unmount(vfs_super_t* sb) {
+    tmpfs_sb_t* fs = sb->fs_data;
+    for (uint64_t ino = 0; ino < fs->node_slots; ino++) {
+        if (fs->nodes[ino]) tmpfs_free_node(fs, ino);
+    }
+    memory_free(fs->nodes);
+    memory_free(fs);
+}
+
+static const vfs_super_ops_t tmpfs_super_ops = {
+    .read_inode = tmpfs_read_inode,
+    .evict_inode = tmpfs_evict_inode,
+    .unmount = tmpfs_unmount,
+};
+
+static int tmpfs_mount(vfs_super_t* sb, const char* source, const void* data) {
+    tmpfs_sb_t* fs = memory_alloc(sizeof(tmpfs_sb_t));
+    if (!fs) return VFS_ERR_NOMEM;
+    memset(fs, 0, sizeof(tmpfs_sb_t));
+    fs->next_ino = TMPFS_ROOT_INO;
+
+    if (!tmpfs_grow_table(fs) || tmpfs_alloc_node(fs, VFS_TYPE_DIR) != TMPFS_ROOT_INO) {
+        if (fs->nodes) memory_free(fs->nodes);
+        memory_free(fs);
+        return VFS_ERR_NOMEM;
+    }
+
+    sb->ops = &tmpfs_super_ops;
+    sb->root_ino = TMPFS_ROOT_INO;
+    sb->fs_data = fs;
+    return 0;
+}
+
+static vfs_fs_type_t tmpfs_type = {
+    .name = "tmpfs",
+    .mount = tmpfs_mount,
+};
+
+void tmpfs_init(void) {
+    vfs_register_fs(&tmpfs_type);
+}
@@ -0,0 +1,7 @@
+#ifndef TMPFS_H
+#define TMPFS_H
+
+// Memory-backed filesystem, used for the root and for scratch mounts
+void tmpfs_init(void);
+
+#endif // TMPFS_H
@@ -0,0 +1,884 @@
+#include "fs/vfs.h"
+#include "fs/pagecache.h"
+#include "memory.h"
+#include "mutex.h"
+#include <string.h>
+
+#define VFS_MAX_MOUNTS        16
+#define DCACHE_HASH_INITIAL   256
+#define ICACHE_HASH_INITIAL   256
+#define DCACHE_NAME_AVERAGE   16        // Bytes of name per dentry, for sizing
+
+// One lock covers the namespace: both caches, the mount table and the
+// driver's directory operations. It sleeps rather than spins, since those
+// operations go to the block device; interrupts stay enabled under it.
+// File data is under each inode's lock, which sleeps for the same reason.
+static mutex_t vfs_lock = MUTEX_INIT;
+
+static vfs_fs_type_t* fs_types = NULL;
+static vfs_mount_t mounts[VFS_MAX_MOUNTS];
+static vfs_mount_t* root_mount = NULL;
+
+static vfs_dentry_t** dentry_hash = NULL;
+static uint64_t dentry_hash_size = 0;
+static uint64_t dentry_hashed = 0;
+static vfs_dentry_t* dentry_lru_head = NULL;    // Least recently used first
+static vfs_dentry_t* dentry_lru_tail = NULL;
+
+static vfs_inode_t** inode_hash = NULL;
+static uint64_t inode_hash_size = 0;
+static vfs_inode_t* inode_lru_head = NULL;
+static vfs_inode_t* inode_lru_tail = NULL;
+
+static vfs_stats_t stats;
+
+// Unused dentries and inodes are kept while each cache stays within the
+// memory given to the page cache. A cached name or inode saves a driver
+// lookup that can cost a block read, just as a cached page does, and
+// costs a few dozen times less memory: a directory of 100k entries fits.
+static uint64_t dcache_max_unused = 0;
+static uint64_t icache_max_unused = 0;
+
+static void dput_locked(vfs_dentry_t* dentry);
+
+// FNV-1a
+static uint32_t name_hash(const char* name, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static inline uint64_t mix64(uint64_t key) {
+    key *= 0x9E3779B97F4A7C15ULL;
+    return key ^ (key >> 29);
+}
+
+static inline uint64_t dentry_hash_index(const vfs_dentry_t* parent, uint32_t hash, uint64_t size) {
+    return mix64((uint64_t)(uintptr_t)parent ^ hash) & (size - 1);
+}
+
+static inline uint64_t inode_hash_index(const vfs_super_t* sb, vfs_ino_t ino, uint64_t size) {
+    return mix64((uint64_t)(uintptr_t)sb ^ ino) & (size - 1);
+}
+
+// --- Inode cache ---
+
+static void inode_lru_add(vfs_inode_t* inode) {
+    inode->lru_prev = inode_lru_tail;
+    inode->lru_next = NULL;
+    if (inode_lru_tail) inode_lru_tail->lru_next = inode;
+    else inode_lru_head = inode;
+    inode_lru_tail = inode;
+    inode->on_lru = true;
+    stats.inodes_unused++;
+}
+
+static void inode_lru_del(vfs_inode_t* inode) {
+    if (inode->lru_prev) inode->lru_prev->lru_next = inode->lru_next;
+    else inode_lru_head = inode->lru_next;
+    if (inode->lru_next) inode->lru_next->lru_prev = inode->lru_prev;
+    else inode_lru_tail = inode->lru_prev;
+    inode->lru_next = NULL;
+    inode->lru_prev = NULL;
+    inode->on_lru = false;
+    stats.inodes_unused--;
+}
+
+// Rehash into a table twice the size once the load factor reaches 1
+static bool inode_hash_grow(void) {
+    uint64_t new_size = inode_hash_size ? inode_hash_size * 2 : ICACHE_HASH_INITIAL;
+    vfs_inode_t** table = memory_alloc(new_size * sizeof(*table));
+    if (!table) return false;
+
+    memset(table, 0, new_size * sizeof(*table));
+    for (uint64_t i = 0; i < inode_hash_size; i++) {
+        vfs_inode_t* inode = inode_hash[i];
+        while (inode) {
+            vfs_inode_t* next = inode->hash_next;
+            uint64_t index = inode_hash_index(inode->sb, inode->ino, new_size);
+            inode->hash_next = table[index];
+            table[index] = inode;
+            inode = next;
+        }
+    }
+
+    if (inode_hash) memory_free(inode_hash);
+    inode_hash = table;
+    inode_hash_size = new_size;
+    return true;
+}
+
+static void inode_hash_remove(vfs_inode_t* inode) {
+    vfs_inode_t** link = &inode_hash[inode_hash_index(inode->sb, inode->ino, inode_hash_size)];
+    while (*link && *link != inode) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) *link = inode->hash_next;
+    inode->hash_next = NULL;
+}
+
+static void inode_evict(vfs_inode_t* inode) {
+    if (inode->on_lru) inode_lru_del(inode);
+    inode_hash_remove(inode);
+    stats.inodes--;
+    if (inode->nrpages) {
+        // Data of a deleted file is simply dropped. The lock waits out
+        // reclaim writing back one of its pages.
+        mutex_lock(&inode->lock);
+        if (inode->nlink) pagecache_writeback(inode);
+        pagecache_truncate(inode, 0);
+        mutex_unlock(&inode->lock);
+    }
+    if (inode->sb->ops->evict_inode) inode->sb->ops->evict_inode(inode);
+    memory_free(inode);
+}
+
+static vfs_inode_t* iget_locked(vfs_super_t* sb, vfs_ino_t ino, int* error) {
+    vfs_inode_t* inode = inode_hash[inode_hash_index(sb, ino, inode_hash_size)];
+    while (inode && (inode->sb != sb || inode->ino != ino)) {
+        inode = inode->hash_next;
+    }
+    if (inode) {
+        if (inode->refcount++ == 0 && inode->on_lru) inode_lru_del(inode);
+        stats.icache_hits++;
+        return inode;
+    }
+
+    stats.icache_misses++;
+    inode = memory_alloc(sizeof(vfs_inode_t));
+    if (!inode) {
+        *error = VFS_ERR_NOMEM;
+        return NULL;
+    }
+    memset(inode, 0, sizeof(vfs_inode_t));
+    inode->ino = ino;
+    inode->sb = sb;
+    inode->refcount = 1;
+    mutex_init(&inode->lock);
+
+    int err = sb->ops->read_inode(inode);
+    if (err < 0) {
+        memory_free(inode);
+        *error = err;
+        return NULL;
+    }
+
+    if (stats.inodes + 1 > inode_hash_size) inode_hash_grow();
+    uint64_t index = inode_hash_index(sb, ino, inode_hash_size);
+    inode->hash_next = inode_hash[index];
+    inode_hash[index] = inode;
+    stats.inodes++;
+    return inode;
+}
+
+// Unlinked inodes go as soon as the last reference does; others stay
+// cached until the LRU limit pushes them out
+static void iput_locked(vfs_inode_t* inode) {
+    if (--inode->refcount > 0) return;
+
+    if (inode->nlink == 0) {
+        inode_evict(inode);
+        return;
+    }
+    inode_lru_add(inode);
+    while (stats.inodes_unused > icache_max_unused) {
+        inode_evict(inode_lru_head);
+    }
+}
+
+// --- Dentry cache ---
+
+static void dentry_lru_add(vfs_dentry_t* dentry) {
+    dentry->lru_prev = dentry_lru_tail;
+    dentry->lru_next = NULL;
+    if (dentry_lru_tail) dentry_lru_tail->lru_next = dentry;
+    else dentry_lru_head = dentry;
+    dentry_lru_tail = dentry;
+    dentry->on_lru = true;
+    stats.dentries_unused++;
+}
+
+static void dentry_lru_del(vfs_dentry_t* dentry) {
+    if (dentry->lru_prev) dentry->lru_prev->lru_next = dentry->lru_next;
+    else dentry_lru_head = dentry->lru_next;
+    if (dentry->lru_next) dentry->lru_next->lru_prev = dentry->lru_prev;
+    else dentry_lru_tail = dentry->lru_prev;
+    dentry->lru_next = NULL;
+    dentry->lru_prev = NULL;
+    dentry->on_lru = false;
+    stats.dentries_unused--;
+}
+
+static bool dentry_hash_grow(void) {
+    uint64_t new_size = dentry_hash_size ? dentry_hash_size * 2 : DCACHE_HASH_INITIAL;
+    vfs_dentry_t** table = memory_alloc(new_size * sizeof(*table));
+    if (!table) return false;
+
+    memset(table, 0, new_size * sizeof(*table));
+    for (uint64_t i = 0; i < dentry_hash_size; i++) {
+        vfs_dentry_t* dentry = dentry_hash[i];
+        while (dentry) {
+            vfs_dentry_t* next = dentry->hash_next;
+            uint64_t index = dentry_hash_index(dentry->parent, dentry->hash, new_size);
+            dentry->hash_next = table[index];
+            table[index] = dentry;
+            dentry = next;
+        }
+    }
+
+    if (dentry_hash) memory_free(dentry_hash);
+    dentry_hash = table;
+    dentry_hash_size = new_size;
+    return true;
+}
+
+static void dentry_hash_insert(vfs_dentry_t* dentry) {
+    if (dentry_hashed + 1 > dentry_hash_size) dentry_hash_grow();
+    uint64_t index = dentry_hash_index(dentry->parent, dentry->hash, dentry_hash_size);
+    dentry->hash_next = dentry_hash[index];
+    dentry_hash[index] = dentry;
+    dentry->hashed = true;
+    dentry_hashed++;
+}
+
+// Make the dentry unreachable by lookup; it is freed with its last reference
+static void dentry_unhash(vfs_dentry_t* dentry) {
+    if (!dentry->hashed) return;
+    vfs_dentry_t** link = &dentry_hash[dentry_hash_index(dentry->parent, dentry->hash, dentry_hash_size)];
+    while (*link && *link != dentry) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) *link = dentry->hash_next;
+    dentry->hash_next = NULL;
+    dentry->hashed = false;
+    dentry_hashed--;
+}
+
+static vfs_dentry_t* dentry_lookup(const vfs_dentry_t* parent, const char* name, size_t len, uint32_t hash) {
+    vfs_dentry_t* dentry = dentry_hash[dentry_hash_index(parent, hash, dentry_hash_size)];
+    while (dentry) {
+        if (dentry->parent == parent && dentry->hash == hash && dentry->name_len == len &&
+            memcmp(dentry->name, name, len) == 0) {
+            return dentry;
+        }
+        dentry = dentry->hash_next;
+    }
+    return NULL;
+}
+
+static vfs_dentry_t* dget_locked(vfs_dentry_t* dentry) {
+    if (dentry->refcount++ == 0 && dentry->on_lru) dentry_lru_del(dentry);
+    return dentry;
+}
+
+// New unreferenced, unhashed dentry; takes a reference on the parent
+static vfs_dentry_t* dentry_alloc(vfs_dentry_t* parent, const char* name, size_t len, uint32_t hash) {
+    vfs_dentry_t* dentry = memory_alloc(sizeof(vfs_dentry_t) + len + 1);
+    if (!dentry) return NULL;
+
+    memset(dentry, 0, sizeof(vfs_dentry_t));
+    memcpy(dentry->name, name, len);
+    dentry->name[len] = '\0';
+    dentry->name_len = (uint16_t)len;
+    dentry->hash = hash;
+    if (parent) {
+        dentry->parent = dget_locked(parent);
+        dentry->mnt = parent->mnt;
+    }
+    stats.dentries++;
+    return dentry;
+}
+
+// Free an unreferenced, unhashed dentry; returns the parent reference the
+// caller now has to drop
+static vfs_dentry_t* dentry_free(vfs_dentry_t* dentry) {
+    vfs_dentry_t* parent = dentry->parent;
+    if (dentry->inode) iput_locked(dentry->inode);
+    stats.dentries--;
+    memory_free(dentry);
+    return parent;
+}
+
+static void dput_locked(vfs_dentry_t* dentry) {
+    while (dentry) {
+        if (--dentry->refcount > 0) return;
+        if (dentry->hashed) {
+            dentry_lru_add(dentry);
+            return;
+        }
+        dentry = dentry_free(dentry);
+    }
+}
+
+static void dentry_prune(vfs_dentry_t* dentry) {
+    dentry_lru_del(dentry);
+    dentry_unhash(dentry);
+    vfs_dentry_t* parent = dentry_free(dentry);
+    if (parent) dput_locked(parent);
+}
+
+// Trim the unused list back to its limit, oldest first. A pruned leaf
+// can release its parent, which then queues at the young end.
+static void dcache_shrink(void) {
+    while (stats.dentries_unused > dcache_max_unused) {
+        dentry_prune(dentry_lru_head);
+    }
+}
+
+// --- Path walk ---
+
+static inline bool is_mount_root(const vfs_dentry_t* dentry) {
+    return dentry == dentry->mnt->root;
+}
+
+static vfs_dentry_t* follow_mounts(vfs_dentry_t* dentry) {
+    while (dentry->mounted) {
+        dentry = dentry->mounted->root;
+    }
+    return dentry;
+}
+
+// ".." crosses back over mount points; the root is its own parent
+static vfs_dentry_t* dentry_parent(vfs_dentry_t* dentry) {
+    while (is_mount_root(dentry) && dentry->mnt->mountpoint) {
+        dentry = dentry->mnt->mountpoint;
+    }
+    return dentry->parent ? dentry->parent : dentry;
+}
+
+// One component: dentry cache first, the driver only on a miss. Either
+// answer is cached, "does not exist" included.
+static int walk_component(vfs_dentry_t* parent, const char* name, size_t len, vfs_dentry_t** result) {
+    uint32_t hash = name_hash(name, len);
+    vfs_dentry_t* dentry = dentry_lookup(parent, name, len, hash);
+    if (dentry) {
+        if (dentry->inode) stats.dcache_hits++;
+        else stats.dcache_negative_hits++;
+    } else {
+        stats.dcache_misses++;
+        stats.fs_lookups++;
+
+        vfs_inode_t* dir = parent->inode;
+        vfs_inode_t* inode = NULL;
+        vfs_ino_t ino;
+        int err = dir->ops->lookup ? dir->ops->lookup(dir, name, len, &ino) : VFS_ERR_NOTDIR;
+        if (err == 0) {
+            inode = iget_locked(dir->sb, ino, &err);
+            if (!inode) return err;
+        } else if (err != VFS_ERR_NOENT) {
+            return err;
+        }
+
+        dentry = dentry_alloc(parent, name, len, hash);
+        if (!dentry) {
+            if (inode) iput_locked(inode);
+            return VFS_ERR_NOMEM;
+        }
+        dentry->inode = inode;
+        dentry_hash_insert(dentry);
+        dentry_lru_add(dentry);
+    }
+
+    *result = follow_mounts(dentry);
+    return 0;
+}
+
+// Resolve an absolute path to a referenced dentry. Every component but the
+// last must be an existing directory; the last may come back negative.
+static int path_walk(const char* path, vfs_dentry_t** result) {
+    if (!path || path[0] != '/') return VFS_ERR_INVAL;
+    if (!root_mount) return VFS_ERR_NOENT;
+
+    vfs_dentry_t* dentry = follow_mounts(root_mount->root);
+    const char* p = path;
+    while (true) {
+        while (*p == '/') p++;
+        if (!*p) break;
+
+        const char* name = p;
+        while (*p && *p != '/') p++;
+        size_t len = (size_t)(p - name);
+
+        if (len > VFS_NAME_MAX) return VFS_ERR_NAMETOOLONG;
+        if (!dentry->inode) return VFS_ERR_NOENT;
+        if (dentry->inode->type != VFS_TYPE_DIR) return VFS_ERR_NOTDIR;
+
+        if (len == 1 && name[0] == '.') continue;
+        if (len == 2 && name[0] == '.' && name[1] == '.') {
+            dentry = dentry_parent(dentry);
+            continue;
+        }
+
+        int err = walk_component(dentry, name, len, &dentry);
+        if (err) return err;
+    }
+
+    *result = dget_locked(dentry);
+    return 0;
+}
+
+// --- Public interface ---
+
+void vfs_init(void) {
+    mutex_lock(&vfs_lock);
+    memset(mounts, 0, sizeof(mounts));
+    memset(&stats, 0, sizeof(stats));
+    root_mount = NULL;
+    pagecache_init(PAGECACHE_DEFAULT_PAGES);
+    dcache_max_unused = PAGECACHE_DEFAULT_PAGES * PAGE_SIZE / (sizeof(vfs_dentry_t) + DCACHE_NAME_AVERAGE);
+    icache_max_unused = PAGECACHE_DEFAULT_PAGES * PAGE_SIZE / sizeof(vfs_inode_t);
+    dentry_hash_grow();
+    inode_hash_grow();
+    mutex_unlock(&vfs_lock);
+}
+
+bool vfs_register_fs(vfs_fs_type_t* type) {
+    if (!type || !type->name || !type->mount) return false;
+
+    mutex_lock(&vfs_lock);
+    for (vfs_fs_type_t* t = fs_types; t; t = t->next) {
+        if (strcmp(t->name, type->name) == 0) {
+            mutex_unlock(&vfs_lock);
+            return false;
+        }
+    }
+    type->next = fs_types;
+    fs_types = type;
+    mutex_unlock(&vfs_lock);
+    return true;
+}
+
+// Reserve a mount slot for type, for the driver to fill in unlocked
+static int mount_claim_locked(const char* type_name, uint32_t mount_flags, vfs_mount_t** result) {
+    vfs_fs_type_t* type = fs_types;
+    while (type && strcmp(type->name, type_name) != 0) {
+        type = type->next;
+    }
+    if (!type) return VFS_ERR_NODEV;
+
+    for (uint32_t i = 0; i < VFS_MAX_MOUNTS; i++) {
+        vfs_mount_t* mnt = &mounts[i];
+        if (!mnt->active && !mnt->claimed) {
+            memset(mnt, 0, sizeof(vfs_mount_t));
+            mnt->claimed = true;
+            mnt->sb.type = type;
+            mnt->sb.flags = mount_flags;
+            *result = mnt;
+            return 0;
+        }
+    }
+    return VFS_ERR_BUSY;
+}
+
+// Put a mounted superblock on target
+static int mount_attach_locked(vfs_mount_t* mnt, const char* target) {
+    vfs_dentry_t* mountpoint = NULL;
+    if (root_mount) {
+        int err = path_walk(target, &mountpoint);
+        if (err) return err;
+        if (!mountpoint->inode || mountpoint->inode->type != VFS_TYPE_DIR) {
+            err = mountpoint->inode ? VFS_ERR_NOTDIR : VFS_ERR_NOENT;
+            dput_locked(mountpoint);
+            return err;
+        }
+    } else if (strcmp(target, "/") != 0) {
+        return VFS_ERR_NOENT;
+    }
+
+    int err;
+    vfs_inode_t* root_inode = iget_locked(&mnt->sb, mnt->sb.root_ino, &err);
+    if (!root_inode) goto fail;
+
+    vfs_dentry_t* root = dentry_alloc(NULL, "/", 1, 0);
+    if (!root) {
+        iput_locked(root_inode);
+        err = VFS_ERR_NOMEM;
+        goto fail;
+    }
+    root->mnt = mnt;
+    root->inode = root_inode;
+    root->refcount = 1;             // Held by the mount
+
+    mnt->root = root;
+    mnt->mountpoint = mountpoint;   // Keeps the walk's reference
+    mnt->active = true;
+    mnt->claimed = false;
+    if (mountpoint) {
+        mountpoint->mounted = mnt;
+    } else {
+        root_mount = mnt;
+    }
+    return 0;
+
+fail:
+    if (mountpoint) dput_locked(mountpoint);
+    return err;
+}
+
+// The driver sets up the superblock outside the namespace lock, which an
+// image unpack or a disk read would otherwise hold for its whole length
+int vfs_mount(const char* type, const char* source, const char* target, uint32_t flags, const void* data) {
+    if (!type || !target) return VFS_ERR_INVAL;
+
+    vfs_mount_t* mnt;
+    mutex_lock(&vfs_lock);
+    int err = mount_claim_locked(type, flags, &mnt);
+    mutex_unlock(&vfs_lock);
+    if (err) return err;
+
+    err = mnt->sb.type->mount(&mnt->sb, source, data);
+    if (err >= 0) {
+        mutex_lock(&vfs_lock);
+        err = mount_attach_locked(mnt, target);
+        dcache_shrink();
+        mutex_unlock(&vfs_lock);
+        if (err && mnt->sb.ops && mnt->sb.ops->unmount) mnt->sb.ops->unmount(&mnt->sb);
+    }
+
+    if (err) {
+        mutex_lock(&vfs_lock);
+        mnt->claimed = false;
+        mutex_unlock(&vfs_lock);
+    }
+    return err;
+}
+
+// Detach the mount from the namespace. The slot stays claimed for the
+// driver's teardown, which runs after the lock is dropped.
+static int umount_locked(const char* target, vfs_mount_t** result) {
+    vfs_dentry_t* root;
+    int err = path_walk(target, &root);
+    if (err) return err;
+
+    vfs_mount_t* mnt = root->mnt;
+    dput_locked(root);
+    if (!is_mount_root(root) || mnt == root_mount) return VFS_ERR_INVAL;
+
+    // Drop every cached dentry of this mount that nobody holds. Pruning a
+    // leaf can queue its parent behind the cursor, so one pass suffices.
+    vfs_dentry_t* dentry = dentry_lru_head;
+    while (dentry) {
+        vfs_dentry_t* next = dentry->lru_next;
+        if (dentry->mnt == mnt) {
+            // The parent cannot be next: it was referenced until now. Behind
+            // the old tail, though, it is only found through the new one.
+            vfs_dentry_t* before = dentry->lru_prev;
+            dentry_prune(dentry);
+            if (!next && dentry_lru_tail != before) next = dentry_lru_tail;
+        }
+        dentry = next;
+    }
+
+    // Anything left hanging off the root is an open file or a mount
+    if (root->refcount != 1 || root->mounted) return VFS_ERR_BUSY;
+
+    root->refcount = 0;
+    dentry_free(root);
+
+    for (uint64_t i = 0; i < inode_hash_size; i++) {
+        vfs_inode_t* inode = inode_hash[i];
+        while (inode) {
+            vfs_inode_t* next = inode->hash_next;
+            if (inode->sb == &mnt->sb) inode_evict(inode);
+            inode = next;
+        }
+    }
+
+    mnt->mountpoint->mounted = NULL;
+    dput_locked(mnt->mountpoint);
+    mnt->active = false;
+    mnt->claimed = true;
+    *result = mnt;
+    return 0;
+}
+
+// The driver may wait for its own threads to finish with the superblock,
+// so it is torn down outside the namespace lock
+int vfs_umount(const char* target) {
+    vfs_mount_t* mnt;
+    mutex_lock(&vfs_lock);
+    int err = umount_locked(target, &mnt);
+    mutex_unlock(&vfs_lock);
+    if (err) return err;
+
+    if (mnt->sb.ops->unmount) mnt->sb.ops->unmount(&mnt->sb);
+    mutex_lock(&vfs_lock);
+    mnt->claimed = false;
+    mutex_unlock(&vfs_lock);
+    return 0;
+}
+
+int vfs_lookup(const char* path, vfs_dentry_t** result) {
+    mutex_lock(&vfs_lock);
+    vfs_dentry_t* dentry;
+    int err = path_walk(path, &dentry);
+    if (!err && !dentry->inode) {
+        dput_locked(dentry);
+        err = VFS_ERR_NOENT;
+    }
+    if (!err) *result = dentry;
+    dcache_shrink();
+    mutex_unlock(&vfs_lock);
+    return err;
+}
+
+static int create_locked(const char* path, uint32_t type, bool exclusive, vfs_dentry_t** result) {
+    vfs_dentry_t* dentry;
+    int err = path_walk(path, &dentry);
+    if (err) return err;
+
+    if (dentry->inode) {
+        if (exclusive) {
+            dput_locked(dentry);
+            return VFS_ERR_EXIST;
+        }
+        *result = dentry;
+        return 0;
+    }
+
+    // Negative entries always have a parent: mount roots exist
+    vfs_inode_t* dir = dentry->parent->inode;
+    if (dir->sb->flags & VFS_MOUNT_RDONLY) {
+        err = VFS_ERR_ROFS;
+    } else if (!dir->ops->create) {
+        err = VFS_ERR_INVAL;
+    } else {
+        vfs_ino_t ino;
+        err = dir->ops->create(dir, dentry->name, dentry->name_len, type, &ino);
+        if (!err) {
+            // The negative entry becomes the new file's
+            dentry->inode = iget_locked(dir->sb, ino, &err);
+            if (!dentry->inode) dentry_unhash(dentry);  // No longer known not to exist
+        }
+    }
+
+    if (err) {
+        dput_locked(dentry);
+        return err;
+    }
+    *result = dentry;
+    return 0;
+}
+
+int vfs_create(const char* path, uint32_t type, bool exclusive, vfs_dentry_t** result) {
+    if (type != VFS_TYPE_FILE && type != VFS_TYPE_DIR) return VFS_ERR_INVAL;
+
+    mutex_lock(&vfs_lock);
+    int err = create_locked(path, type, exclusive, result);
+    dcache_shrink();
+    mutex_unlock(&vfs_lock);
+    return err;
+}
+
+static int unlink_locked(const char* path, bool directory) {
+    vfs_dentry_t* dentry;
+    int err = path_walk(path, &dentry);
+    if (err) return err;
+
+    vfs_inode_t* inode = dentry->inode;
+    vfs_inode_t* dir = dentry->parent ? dentry->parent->inode : NULL;
+    if (!inode) {
+        err = VFS_ERR_NOENT;
+    } else if (is_mount_root(dentry)) {
+        err = VFS_ERR_BUSY;
+    } else if (directory && inode->type != VFS_TYPE_DIR) {
+        err = VFS_ERR_NOTDIR;
+    } else if (!directory && inode->type == VFS_TYPE_DIR) {
+        err = VFS_ERR_ISDIR;
+    } else if (dir->sb->flags & VFS_MOUNT_RDONLY) {
+        err = VFS_ERR_ROFS;
+    } else if (!dir->ops->unlink) {
+        err = VFS_ERR_INVAL;
+    } else {
+        err = dir->ops->unlink(dir, dentry->name, dentry->name_len, inode);
+    }
+
+    if (!err) {
+        if (dentry->refcount == 1) {
+            // Nobody else holds it: keep the name cached as a negative entry
+            dentry->inode = NULL;
+            iput_locked(inode);
+        } else {
+            // Open files keep their dentry; later lookups miss and go negative
+            dentry_unhash(dentry);
+        }
+    }
+    dput_locked(dentry);
+    return err;
+}
+
+int vfs_unlink(const char* path, bool directory) {
+    mutex_lock(&vfs_lock);
+    int err = unlink_locked(path, directory);
+    dcache_shrink();
+    mutex_unlock(&vfs_lock);
+    return err;
+}
+
+vfs_dentry_t* vfs_dget(vfs_dentry_t* dentry) {
+    mutex_lock(&vfs_lock);
+    dget_locked(dentry);
+    mutex_unlock(&vfs_lock);
+    return dentry;
+}
+
+void vfs_dput(vfs_dentry_t* dentry) {
+    if (!dentry) return;
+    mutex_lock(&vfs_lock);
+    dput_locked(dentry);
+    dcache_shrink();
+    mutex_unlock(&vfs_lock);
+}
+
+static void balance(vfs_inode_t* inode) {
+    if (inode->sb->ops->balance) inode->sb->ops->balance(inode->sb);
+}
+
+int64_t vfs_read(vfs_inode_t* inode, vfs_readahead_t* ra, uint64_t pos, void* buffer, uint64_t len) {
+    if (inode->type != VFS_TYPE_FILE) return VFS_ERR_ISDIR;
+    if (!inode->ops->readpage && !inode->ops->read) return VFS_ERR_INVAL;
+
+    mutex_lock(&inode->lock);
+    int64_t result = inode->ops->readpage ? pagecache_read(inode, ra, pos, buffer, len)
+                                          : inode->ops->read(inode, pos, buffer, len);
+    mutex_unlock(&inode->lock);
+    // Making room may have written back dirty pages
+    balance(inode);
+    return result;
+}
+
+static int write_check(const vfs_inode_t* inode) {
+    if (inode->type != VFS_TYPE_FILE) return VFS_ERR_ISDIR;
+    if (inode->sb->flags & VFS_MOUNT_RDONLY) return VFS_ERR_ROFS;
+    if (!inode->ops->readpage && !inode->ops->write) return VFS_ERR_INVAL;
+    return 0;
+}
+
+static int64_t write_locked(vfs_inode_t* inode, uint64_t pos, const void* buffer, uint64_t len) {
+    return inode->ops->readpage ? pagecache_write(inode, pos, buffer, len)
+                                : inode->ops->write(inode, pos, buffer, len);
+}
+
+int64_t vfs_write(vfs_inode_t* inode, uint64_t pos, const void* buffer, uint64_t len) {
+    int err = write_check(inode);
+    if (err) return err;
+
+    mutex_lock(&inode->lock);
+    int64_t result = write_locked(inode, pos, buffer, len);
+    mutex_unlock(&inode->lock);
+    balance(inode);
+    return result;
+}
+
+int64_t vfs_append(vfs_inode_t* inode, const void* buffer, uint64_t len, uint64_t* pos) {
+    int err = write_check(inode);
+    if (err) return err;
+
+    mutex_lock(&inode->lock);
+    *pos = inode->size;
+    int64_t result = write_locked(inode, *pos, buffer, len);
+    mutex_unlock(&inode->lock);
+    balance(inode);
+    return result;
+}
+
+int vfs_truncate(vfs_inode_t* inode, uint64_t size) {
+    if (inode->type != VFS_TYPE_FILE) return VFS_ERR_ISDIR;
+    if (inode->sb->flags & VFS_MOUNT_RDONLY) return VFS_ERR_ROFS;
+    if (!inode->ops->truncate) return VFS_ERR_INVAL;
+
+    mutex_lock(&inode->lock);
+    if (inode->ops->readpage) {
+        // Dirty pages past the new end must not be written back later
+        pagecache_truncate(inode, size);
+    }
+    int err = inode->ops->truncate(inode, size);
+    mutex_unlock(&inode->lock);
+    balance(inode);
+    return err;
+}
+
+int vfs_fsync(vfs_inode_t* inode) {
+    int err = 0;
+    if (inode->ops->readpage) {
+        mutex_lock(&inode->lock);
+        err = pagecache_writeback(inode);
+        mutex_unlock(&inode->lock);
+    }
+    if (!err && inode->sb->ops->sync) err = inode->sb->ops->sync(inode->sb);
+    return err;
+}
+
+int vfs_mmap(vfs_inode_t* inode, uint64_t pos, uint64_t len, vfs_mapping_t** result) {
+    if (inode->type != VFS_TYPE_FILE) return VFS_ERR_ISDIR;
+    if (pos % PAGE_SIZE || !len) return VFS_ERR_INVAL;
+    if (!inode->ops->readpage && !inode->ops->map) return VFS_ERR_NODEV;
+
+    vfs_mapping_t* mapping = memory_alloc(sizeof(vfs_mapping_t));
+    if (!mapping) return VFS_ERR_NOMEM;
+    mapping->inode = inode;
+    mapping->pos = pos;
+    mapping->len = len;
+    mapping->map = NULL;
+
+    mutex_lock(&inode->lock);
+    int err = 0;
+    if (pos >= inode->size || len > inode->size - pos) {
+        err = VFS_ERR_INVAL;
+    } else if (inode->ops->readpage) {
+        uint64_t pages = (len + PAGE_SIZE - 1) / PAGE_SIZE;
+        err = pagecache_map(inode, pos / PAGE_SIZE, pages, &mapping->map);
+        if (!err) mapping->addr = mapping->map->addr;
+    } else {
+        err = inode->ops->map(inode, pos, len, &mapping->addr);
+    }
+    mutex_unlock(&inode->lock);
+    balance(inode);
+
+    if (err) {
+        memory_free(mapping);
+        return err;
+    }
+    *result = mapping;
+    return 0;
+}
+
+void vfs_munmap(vfs_mapping_t* mapping) {
+    if (mapping->map) {
+        pagecache_unmap(mapping->map);
+    } else {
+        vfs_inode_t* inode = mapping->inode;
+        mutex_lock(&inode->lock);
+        if (inode->ops->unmap) inode->ops->unmap(inode, mapping->pos, mapping->len);
+        mutex_unlock(&inode->lock);
+    }
+    memory_free(mapping);
+}
+
+// Under the namespace lock so entries cannot change mid-call
+int vfs_readdir(vfs_inode_t* dir, uint64_t* cookie, vfs_dirent_t* dirent) {
+    if (dir->type != VFS_TYPE_DIR) return VFS_ERR_NOTDIR;
+    if (!dir->ops->readdir) return VFS_ERR_INVAL;
+
+    mutex_lock(&vfs_lock);
+    int result = dir->ops->readdir(dir, cookie, dirent);
+    mutex_unlock(&vfs_lock);
+    return result;
+}
+
+void vfs_stat(const vfs_inode_t* inode, vfs_stat_t* stat) {
+    stat->ino = inode->ino;
+    stat->type = inode->type;
+    stat->nlink = inode->nlink;
+    stat->size = inode->size;
+}
+
+void vfs_get_stats(vfs_stats_t* out) {
+    if (!out) return;
+    mutex_lock(&vfs_lock);
+    *out = stats;
+    mutex_unlock(&vfs_lock);
+}
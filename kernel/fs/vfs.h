@@ -0,0 +1,246 @@
+#ifndef VFS_H
+#define VFS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "mutex.h"
+#include "radix_tree.h"
+
+// Virtual filesystem: filesystem drivers register a type and are mounted
+// onto the namespace; the VFS caches what they return.
+//
+// Inodes are cached by (superblock, inode number) and reference counted.
+// Path components resolve through a dentry cache hashed by (parent, name)
+// that also remembers names known not to exist (negative entries), so a
+// repeated lookup of the same path never reaches the driver. Unused
+// dentries and inodes sit on LRU lists and are pruned past a limit.
+
+#define VFS_NAME_MAX    255
+#define VFS_PATH_MAX    1024
+
+// Errors, returned as negative values
+#define VFS_ERR_INVAL       (-1)
+#define VFS_ERR_NOENT       (-2)
+#define VFS_ERR_EXIST       (-3)
+#define VFS_ERR_NOTDIR      (-4)
+#define VFS_ERR_ISDIR       (-5)
+#define VFS_ERR_NOTEMPTY    (-6)
+#define VFS_ERR_NOSPC       (-7)
+#define VFS_ERR_NOMEM       (-8)
+#define VFS_ERR_ROFS        (-9)
+#define VFS_ERR_BUSY        (-10)
+#define VFS_ERR_NAMETOOLONG (-11)
+#define VFS_ERR_IO          (-12)
+#define VFS_ERR_NODEV       (-13)
+
+// Inode types
+#define VFS_TYPE_FILE   1
+#define VFS_TYPE_DIR    2
+
+// Mount flags
+#define VFS_MOUNT_RDONLY 0x1
+
+typedef uint64_t vfs_ino_t;
+
+struct vfs_inode;
+struct vfs_super;
+struct vfs_mount;
+struct pagecache_map;
+
+typedef struct vfs_dirent {
+    vfs_ino_t ino;
+    uint32_t type;
+    uint32_t name_len;
+    char name[VFS_NAME_MAX + 1];
+} vfs_dirent_t;
+
+typedef struct vfs_stat {
+    vfs_ino_t ino;
+    uint32_t type;
+    uint32_t nlink;
+    uint64_t size;
+} vfs_stat_t;
+
+// Sequential read detection for the page cache, one per open file
+typedef struct {
+    uint64_t start;                 // First page of the current window
+    uint32_t size;                  // Pages in the window
+    uint32_t async_size;            // Trailing pages read ahead of need
+    uint64_t prev_index;            // Page after the last read
+} vfs_readahead_t;
+
+// Namespace operations are called with the VFS lock held; data operations
+// with the inode's own lock held. Both are sleeping locks, so drivers may
+// block on the disk. Names are not NUL-terminated.
+typedef struct vfs_inode_ops {
+    // Directories
+    int (*lookup)(struct vfs_inode* dir, const char* name, size_t len, vfs_ino_t* ino);
+    int (*create)(struct vfs_inode* dir, const char* name, size_t len, uint32_t type, vfs_ino_t* ino);
+    // Remove the entry; directories must be empty. Updates inode->nlink.
+    int (*unlink)(struct vfs_inode* dir, const char* name, size_t len, struct vfs_inode* inode);
+    // Next entry at or after *cookie (0 starts); 1 with an entry, 0 at the end.
+    // Cookies stay valid while entries are added or removed.
+    int (*readdir)(struct vfs_inode* dir, uint64_t* cookie, vfs_dirent_t* dirent);
+
+    // Regular files; return bytes transferred or an error
+    int64_t (*read)(struct vfs_inode* inode, uint64_t pos, void* buffer, uint64_t len);
+    int64_t (*write)(struct vfs_inode* inode, uint64_t pos, const void* buffer, uint64_t len);
+    int (*truncate)(struct vfs_inode* inode, uint64_t size);
+
+    // Backing for the page cache. With readpage set, file data goes through
+    // the cache instead of read/write, and truncate is called after the
+    // cache has been trimmed. readpage fills a whole page, zeros past EOF;
+    // writepage is called for dirty pages at writeback and reclaim, with the
+    // inode lock held, and must not take it again. Any of these may sleep.
+    int (*readpage)(struct vfs_inode* inode, uint64_t index, void* page);
+    int (*writepage)(struct vfs_inode* inode, uint64_t index, const void* page);
+    // Optional: a clean page is about to be written into. Drivers that only
+    // allocate at writepage reserve space here; an error fails the write.
+    int (*dirty_page)(struct vfs_inode* inode, uint64_t index);
+
+    // Drivers without readpage whose file data already sits in memory can
+    // map it in place: the len bytes at pos must stay where they are until
+    // unmap.
+    int (*map)(struct vfs_inode* inode, uint64_t pos, uint64_t len, void** addr);
+    void (*unmap)(struct vfs_inode* inode, uint64_t pos, uint64_t len);
+} vfs_inode_ops_t;
+
+typedef struct vfs_super_ops {
+    // Fill in type, size, nlink, ops and fs_data for inode->ino
+    int (*read_inode)(struct vfs_inode* inode);
+    // The inode left the cache; free the file too if nlink is 0
+    void (*evict_inode)(struct vfs_inode* inode);
+    // Optional: make everything written so far durable
+    int (*sync)(struct vfs_super* sb);
+    // Optional: called after a data operation once the inode lock is
+    // dropped, to catch up on work the page operations put off
+    void (*balance)(struct vfs_super* sb);
+    void (*unmount)(struct vfs_super* sb);
+} vfs_super_ops_t;
+
+typedef struct vfs_super {
+    const struct vfs_fs_type* type;
+    const vfs_super_ops_t* ops;
+    vfs_ino_t root_ino;
+    uint32_t flags;                 // VFS_MOUNT_*
+    void* fs_data;
+} vfs_super_t;
+
+typedef struct vfs_fs_type {
+    const char* name;
+    // Set up sb (ops, root_ino, fs_data) from source; flags are already
+    // set. Called without the VFS lock, so it may read a disk or unpack.
+    int (*mount)(vfs_super_t* sb, const char* source, const void* data);
+    struct vfs_fs_type* next;
+} vfs_fs_type_t;
+
+typedef struct vfs_inode {
+    vfs_ino_t ino;
+    vfs_super_t* sb;
+    uint32_t type;
+    uint32_t nlink;
+    uint64_t size;
+    const vfs_inode_ops_t* ops;
+    void* fs_data;
+    mutex_t lock;                   // Serializes data operations
+
+    // Cached pages, under the page cache lock
+    radix_tree_t pages;
+    uint64_t nrpages;
+
+    // Cache bookkeeping, under the VFS lock
+    uint32_t refcount;
+    bool on_lru;
+    struct vfs_inode* hash_next;
+    struct vfs_inode* lru_next;
+    struct vfs_inode* lru_prev;
+} vfs_inode_t;
+
+typedef struct vfs_dentry {
+    struct vfs_dentry* parent;      // Holds a reference; NULL for a mount root
+    struct vfs_mount* mnt;
+    vfs_inode_t* inode;             // NULL: negative entry
+    struct vfs_mount* mounted;      // Filesystem mounted on this directory
+
+    uint32_t refcount;
+    uint32_t hash;
+    bool hashed;
+    bool on_lru;
+    struct vfs_dentry* hash_next;
+    struct vfs_dentry* lru_next;
+    struct vfs_dentry* lru_prev;
+
+    uint16_t name_len;
+    char name[];
+} vfs_dentry_t;
+
+typedef struct vfs_mount {
+    vfs_super_t sb;
+    vfs_dentry_t* root;
+    vfs_dentry_t* mountpoint;       // Covered directory, NULL for "/"
+    bool active;
+    bool claimed;                   // Slot held by a mount or unmount in progress
+} vfs_mount_t;
+
+// A shared read-only view of part of a file. Writes through the file show
+// up in it; the caller keeps the inode referenced until it is unmapped.
+typedef struct vfs_mapping {
+    vfs_inode_t* inode;
+    void* addr;
+    uint64_t pos;
+    uint64_t len;
+    struct pagecache_map* map;      // NULL when the driver mapped it
+} vfs_mapping_t;
+
+typedef struct {
+    uint64_t dcache_hits;
+    uint64_t dcache_negative_hits;
+    uint64_t dcache_misses;
+    uint64_t dentries;
+    uint64_t dentries_unused;
+    uint64_t icache_hits;
+    uint64_t icache_misses;
+    uint64_t inodes;
+    uint64_t inodes_unused;
+    uint64_t fs_lookups;            // Lookups that reached a driver
+} vfs_stats_t;
+
+void vfs_init(void);
+bool vfs_register_fs(vfs_fs_type_t* type);
+
+// The first mount must be on "/"
+int vfs_mount(const char* type, const char* source, const char* target, uint32_t flags, const void* data);
+int vfs_umount(const char* target);
+
+// Resolve an absolute path to a referenced positive dentry
+int vfs_lookup(const char* path, vfs_dentry_t** result);
+
+// Resolve path, creating the last component as type if it does not exist.
+// With exclusive set an existing entry is an error.
+int vfs_create(const char* path, uint32_t type, bool exclusive, vfs_dentry_t** result);
+
+// Remove a file, or an empty directory when directory is set
+int vfs_unlink(const char* path, bool directory);
+
+vfs_dentry_t* vfs_dget(vfs_dentry_t* dentry);
+void vfs_dput(vfs_dentry_t* dentry);
+
+// ra may be NULL for one-off reads
+int64_t vfs_read(vfs_inode_t* inode, vfs_readahead_t* ra, uint64_t pos, void* buffer, uint64_t len);
+int64_t vfs_write(vfs_inode_t* inode, uint64_t pos, const void* buffer, uint64_t len);
+// Write at the end of the file as of taking the inode lock, so appends
+// never overlap; *pos receives where the data went
+int64_t vfs_append(vfs_inode_t* inode, const void* buffer, uint64_t len, uint64_t* pos);
+int vfs_truncate(vfs_inode_t* inode, uint64_t size);
+int vfs_fsync(vfs_inode_t* inode);
+
+// Map len bytes of a file from a page-aligned pos, all within the file
+int vfs_mmap(vfs_inode_t* inode, uint64_t pos, uint64_t len, vfs_mapping_t** result);
+void vfs_munmap(vfs_mapping_t* mapping);
+int vfs_readdir(vfs_inode_t* dir, uint64_t* cookie, vfs_dirent_t* dirent);
+void vfs_stat(const vfs_inode_t* inode, vfs_stat_t* stat);
+
+void vfs_get_stats(vfs_stats_t* stats);
+
+#endif // VFS_H
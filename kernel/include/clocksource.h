@@ -0,0 +1,61 @@
+#ifndef CLOCKSOURCE_H
+#define CLOCKSOURCE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// A free-running hardware counter the timekeeper can build time on. The
+// architecture registers one or more from arch_time_init(); the highest
+// rated becomes the system clock.
+//
+// Cycles convert to nanoseconds as (cycles * mult) >> shift. mult and
+// shift are chosen at registration so that the product cannot overflow
+// 64 bits for up to max_cycles, and the timekeeper re-anchors well before
+// that (or before the counter wraps, whichever comes first).
+
+#define CLOCKSOURCE_MASK(bits)      ((bits) >= 64 ? UINT64_MAX : (1ULL << (bits)) - 1)
+
+// Longest interval one conversion has to cover
+#define CLOCKSOURCE_MAX_SECONDS     600
+
+// Flags
+#define CLOCKSOURCE_SUSPEND_NONSTOP 0x1     // Keeps counting through suspend
+
+typedef struct clocksource {
+    const char* name;
+    uint64_t (*read)(void);
+    uint64_t mask;              // Counter width, CLOCKSOURCE_MASK(bits)
+    uint64_t freq_hz;
+    uint32_t rating;            // Higher is better
+    uint32_t flags;
+    uint32_t vdso_mode;         // VDSO_CLOCK_* for user-space reads
+
+    // Filled in by clocksource_register()
+    uint32_t mult;
+    uint32_t shift;
+    uint64_t max_cycles;        // Largest delta the 64-bit conversion covers
+    uint64_t max_idle_ns;       // Re-anchor at least this often
+    struct clocksource* next;
+} clocksource_t;
+
+// Compute mult/shift converting from_hz to to_hz, as precise as possible
+// while max_seconds worth of from_hz ticks times mult still fits 64 bits
+void clocksource_calc_mult_shift(uint32_t* mult, uint32_t* shift, uint64_t from_hz, uint64_t to_hz,
+                                 uint64_t max_seconds);
+
+// Add a clocksource (freq_hz must be set); switches the system clock to
+// it if it outranks the current one
+bool clocksource_register(clocksource_t* cs);
+
+// Highest-rated registered clocksource, NULL if none
+clocksource_t* clocksource_best(void);
+
+// Cycles to nanoseconds with the clocksource's own constants
+static inline uint64_t clocksource_cyc2ns(const clocksource_t* cs, uint64_t cycles) {
+    if (cycles <= cs->max_cycles) {
+        return (cycles * cs->mult) >> cs->shift;
+    }
+    return (uint64_t)(((unsigned __int128)cycles * cs->mult) >> cs->shift);
+}
+
+#endif // CLOCKSOURCE_H
@@ -0,0 +1,33 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FORMAT_MAX_ARGS 16
+
+// Argument classes of a printf-style format, in order
+typedef enum {
+    FORMAT_ARG_INT,         // Any integer or char, sign-extended to 64 bits
+    FORMAT_ARG_UINT,        // Any unsigned integer, zero-extended
+    FORMAT_ARG_POINTER,     // %p
+    FORMAT_ARG_STRING       // %s
+} format_arg_class_t;
+
+// One parsed conversion: its argument class and the C type it was passed as
+typedef struct {
+    format_arg_class_t cls;
+    uint8_t size;           // sizeof the promoted argument: 4 or 8
+} format_arg_t;
+
+// Walk fmt and describe each argument it consumes, including '*' widths
+// and precisions. Returns the number of arguments, at most max.
+uint32_t format_parse_args(const char* fmt, format_arg_t* args, uint32_t max);
+
+// Format into out (always NUL-terminated when size > 0) from pre-captured
+// 64-bit argument values; %s arguments are pointers. Supports the d i u x
+// X o p c s % conversions with flags, width, precision and length
+// modifiers. Returns the length of the full output, as snprintf does.
+size_t format_args(char* out, size_t size, const char* fmt, const uint64_t* args, uint32_t nargs);
+
+#endif // FORMAT_H
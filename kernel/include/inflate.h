@@ -0,0 +1,45 @@
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// DEFLATE decompression (RFC 1951) into a caller-provided buffer, and the
+// gzip wrapper around it (RFC 1952). The output buffer doubles as the
+// history window, so it must hold the whole result.
+//
+// Output is reported as it is produced, which lets a consumer work on the
+// start of the data while the rest is still being decompressed.
+
+#define INFLATE_OK          0
+#define INFLATE_ERR_DATA    (-1)    // Malformed stream
+#define INFLATE_ERR_SPACE   (-2)    // Output buffer too small
+#define INFLATE_ERR_INPUT   (-3)    // Stream ends early
+#define INFLATE_ERR_CHECK   (-4)    // gzip CRC or length mismatch
+
+// Bytes of output between progress calls
+#define INFLATE_PROGRESS_STEP (64 * 1024)
+
+// Called with the total output so far; return false to stop with
+// INFLATE_ERR_DATA
+typedef bool (*inflate_progress_fn)(void* ctx, size_t produced);
+
+// Decompress a raw DEFLATE stream. *in_used is set to the bytes consumed
+// up to the end of the final block.
+int inflate_raw(const uint8_t* in, size_t in_len, size_t* in_used,
+                uint8_t* out, size_t out_cap, size_t* out_len,
+                inflate_progress_fn progress, void* ctx);
+
+bool gzip_is_gzip(const uint8_t* in, size_t in_len);
+
+// Uncompressed size recorded in a gzip trailer (modulo 4 GB)
+size_t gzip_original_size(const uint8_t* in, size_t in_len);
+
+// Decompress one gzip member, checking its CRC and length
+int gzip_inflate(const uint8_t* in, size_t in_len, uint8_t* out, size_t out_cap, size_t* out_len,
+                 inflate_progress_fn progress, void* ctx);
+
+uint32_t crc32_update(uint32_t crc, const void* data, size_t len);
+
+#endif // INFLATE_H
@@ -0,0 +1,117 @@
+#ifndef IORING_H
+#define IORING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Shared submission/completion rings for batched asynchronous I/O.
+//
+// The ring region is one allocation shared between the process and the
+// kernel: an ioring_shared_t header, then the SQE array, then the CQE array.
+// The process fills SQEs and advances sq.tail; the kernel consumes them,
+// advances sq.head and posts one CQE per SQE at cq.tail. The process reaps
+// completions from cq.head without entering the kernel.
+//
+// Index updates use release stores and are read with acquire loads, so an
+// entry is always fully written before the index that publishes it.
+
+#define IORING_MAX_RINGS      16
+#define IORING_MAX_ENTRIES    256
+
+// Setup flags
+#define IORING_SETUP_SQPOLL   (1U << 0)   // Kernel thread polls the SQ; no syscall per batch
+
+// sq.flags, written by the kernel
+#define IORING_SQ_NEED_WAKEUP (1U << 0)   // SQ poller is parked; call ioring_enter with IORING_ENTER_SQ_WAKEUP
+
+// ioring_enter flags
+#define IORING_ENTER_SQ_WAKEUP (1U << 0)
+
+// Opcodes
+#define IORING_OP_NOP         0
+#define IORING_OP_FS_READ     1   // fd = file descriptor, addr/len = buffer, off = position
+#define IORING_OP_FS_WRITE    2   // fd = file descriptor, addr/len = buffer, off = position
+#define IORING_OP_NET_SEND    3   // fd = socket id, addr/len = data
+#define IORING_OP_IPC_SEND    4   // fd = channel id, addr/len = message, off = receiver pid
+#define IORING_OP_COUNT       5
+
+// Use and advance the file's own position instead of off
+#define IORING_OFF_CURRENT    UINT64_MAX
+
+// Negative CQE results
+#define IORING_ERR_INVAL      (-1)   // Unknown opcode or bad arguments
+#define IORING_ERR_BADF       (-2)   // No such file, socket or channel
+#define IORING_ERR_IO         (-3)   // The operation itself failed
+
+// Submission queue entry
+typedef struct {
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t reserved;
+    uint32_t len;
+    uint64_t fd;
+    uint64_t addr;
+    uint64_t off;
+    uint64_t user_data;
+} ioring_sqe_t;
+
+// Completion queue entry
+typedef struct {
+    uint64_t user_data;
+    int64_t res;
+} ioring_cqe_t;
+
+// One direction of the ring. head and tail are free-running; slot = index & mask.
+typedef struct {
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    uint32_t mask;
+    uint32_t entries;
+    volatile uint32_t flags;
+    uint32_t dropped;       // SQEs rejected as malformed (sq), unused (cq)
+    uint64_t offset;        // Byte offset of the entry array from the start of the region
+} ioring_queue_t;
+
+// Header at the start of the shared region
+typedef struct {
+    ioring_queue_t sq;
+    ioring_queue_t cq;
+} ioring_shared_t;
+
+static inline ioring_sqe_t* ioring_sqes(ioring_shared_t* shared) {
+    return (ioring_sqe_t*)((uint8_t*)shared + shared->sq.offset);
+}
+
+static inline ioring_cqe_t* ioring_cqes(ioring_shared_t* shared) {
+    return (ioring_cqe_t*)((uint8_t*)shared + shared->cq.offset);
+}
+
+// Ring statistics
+typedef struct {
+    uint64_t submitted;
+    uint64_t completed;
+    uint64_t enters;
+    uint64_t sqpoll_wakeups;
+    uint64_t cq_full_stalls;
+} ioring_stats_t;
+
+// Kernel API
+void ioring_init(void);
+
+// Create a ring of sq_entries (rounded up to a power of two; CQ is twice
+// that) for the calling process. Returns the ring id, or -1; *shared
+// receives the shared region.
+int64_t ioring_setup(uint32_t sq_entries, uint32_t flags, ioring_shared_t** shared);
+
+// Consume up to to_submit SQEs. Returns the number submitted, or -1.
+int64_t ioring_enter(uint64_t ring_id, uint32_t to_submit, uint32_t flags);
+
+// Tear down a ring of the calling process
+bool ioring_destroy(uint64_t ring_id);
+
+// Tear down every ring owned by a process
+void ioring_release_process(uint64_t pid);
+
+bool ioring_get_stats(uint64_t ring_id, ioring_stats_t* stats);
+
+#endif // IORING_H
@@ -0,0 +1,15 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// LZ4 block format decompression: one independently compressed block, no
+// frame header or checksum. The compressor lives in the image tools.
+
+#define LZ4_ERR_DATA    (-1)    // Malformed block or output buffer too small
+
+// Decompress in_len bytes into out; returns the decompressed length
+int64_t lz4_decompress(const uint8_t* in, size_t in_len, uint8_t* out, size_t out_cap);
+
+#endif // LZ4_H
@@ -23,11 +23,31 @@ typedef enum {
     PRIORITY_REALTIME = 4
 } process_priority_t;
 
-// Process control block (PCB)
+#define PROCESS_NAME_MAX 32
+
+// Scheduler latency histogram: bucket i counts samples in [2^i, 2^(i+1)) ns
+#define SCHED_HIST_BUCKETS 32
+
 typedef struct {
+    uint64_t buckets[SCHED_HIST_BUCKETS];
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+} sched_histogram_t;
+
+// Scheduler latency statistics
+typedef struct {
+    sched_histogram_t wakeup_latency;  // Wakeup to switch-in
+    sched_histogram_t runqueue_wait;   // Enqueue (wakeup or preemption) to switch-in
+    sched_histogram_t time_slice;      // Switch-in to switch-out
+} sched_latency_stats_t;
+
+// Process control block (PCB)
+typedef struct process_control_block {
     uint64_t pid;                    // Process ID
-    char name[32];                   // Process name
+    char name[PROCESS_NAME_MAX];     // Process name
     process_state_t state;           // Current state
+    uint32_t refcount;               // See process_get()
     process_priority_t priority;     // Priority level
     uint64_t stack_pointer;          // Stack pointer
     uint64_t program_counter;        // Program counter
@@ -37,6 +57,17 @@ typedef struct {
     uint64_t exit_code;              // Exit code when terminated
     uint64_t cpu_time;               // CPU time used
     uint64_t creation_time;          // Process creation timestamp
+    uint32_t cpu;                    // CPU whose run queue holds this task
+    uint64_t affinity;               // Allowed CPUs, bit per CPU
+    uint64_t last_run_ns;            // Timestamp of last switch-in
+    uint64_t wakeup_ns;              // Timestamp of last wakeup, 0 once running
+    uint64_t enqueue_ns;             // Timestamp of last run queue insertion
+    sched_latency_stats_t sched_stats; // Per-task latency histograms
+    struct fs_fd_table* files;       // Open descriptors, NULL until the first
+    struct process_control_block* next; // Run queue links
+    struct process_control_block* prev;
+    bool queued;                     // On a run queue
+    struct process_control_block* hash_next; // PID hash chain
 } process_control_block_t;
 
 // Initialize process management
@@ -45,7 +76,25 @@ void process_init(void);
 // Create a new process
 int process_create(void (*entry)(void), size_t stack_size);
 
-// Destroy a process
+// Destroy a process, tearing down its rings, mappings and descriptors
 void process_destroy(int pid);
 
+// Look up a process by PID. The PCB comes with a reference that the
+// caller drops with process_put(); it is freed with the last one. The PID
+// table holds one until process_destroy() and a CPU one while it runs the
+// task.
+process_control_block_t* process_get(uint64_t pid);
+void process_hold(process_control_block_t* process);
+void process_put(process_control_block_t* process);
+
+// Number of live processes
+uint64_t process_get_count(void);
+
+// Copy the name of a live process into name (size bytes, NUL-terminated)
+bool process_get_name(uint64_t pid, char* name, size_t size);
+
+// CPU affinity by PID (0 for the calling process)
+bool process_set_affinity(uint64_t pid, uint64_t mask);
+uint64_t process_get_affinity(uint64_t pid);
+
 #endif // PROCESS_H 
\ No newline at end of file
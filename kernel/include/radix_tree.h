@@ -0,0 +1,39 @@
+#ifndef RADIX_TREE_H
+#define RADIX_TREE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Sparse array of pointers keyed by a 64-bit index. Nodes are 64-way and
+// the tree is only as tall as the largest index needs, so the dense low
+// indices of a file's pages cost one or two levels. Not synchronized.
+
+#define RADIX_TREE_MAP_SHIFT 6
+#define RADIX_TREE_MAP_SIZE  (1U << RADIX_TREE_MAP_SHIFT)
+
+typedef struct radix_tree_node {
+    void* slots[RADIX_TREE_MAP_SIZE];
+    uint32_t count;
+} radix_tree_node_t;
+
+typedef struct {
+    radix_tree_node_t* root;
+    uint32_t height;            // 0 when empty
+} radix_tree_t;
+
+#define RADIX_TREE_INIT { NULL, 0 }
+
+void radix_tree_init(radix_tree_t* tree);
+
+void* radix_tree_lookup(const radix_tree_t* tree, uint64_t index);
+
+// Fails if the slot is taken or a node cannot be allocated
+bool radix_tree_insert(radix_tree_t* tree, uint64_t index, void* item);
+
+// Returns the removed item, NULL if there was none
+void* radix_tree_delete(radix_tree_t* tree, uint64_t index);
+
+// First item at or after *index, which is updated to its index
+void* radix_tree_next(const radix_tree_t* tree, uint64_t* index);
+
+#endif // RADIX_TREE_H
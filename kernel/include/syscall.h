@@ -2,11 +2,58 @@
 #define OPENACE_SYSCALL_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
+// Syscall numbers, passed in x8; arguments in x0-x5, result in x0
 #define SYSCALL_WRITE  0
 #define SYSCALL_EXIT   1
+#define SYSCALL_SCHED_SETAFFINITY  2
+#define SYSCALL_SCHED_GETAFFINITY  3
+#define SYSCALL_SCHED_STATS        4
+#define SYSCALL_READ               5
+#define SYSCALL_SYSCALL_STATS      6
+#define SYSCALL_IORING_SETUP       7
+#define SYSCALL_IORING_ENTER       8
+#define SYSCALL_IORING_DESTROY     9
+#define SYSCALL_VDSO_CLOCK         10
+#define SYSCALL_TRACE_CTL          11
+#define SYSCALL_PROFILE_CTL        12
+#define SYSCALL_MMAP               13
+#define SYSCALL_MUNMAP             14
+#define SYSCALL_OPEN               15
+#define SYSCALL_CLOSE              16
+#define SYSCALL_DUP                17
 // Add more syscall numbers here
 
-uint64_t syscall_handler(uint64_t syscall_number, uint64_t arg1, uint64_t arg2, uint64_t arg3);
+#define SYSCALL_COUNT  18
+
+// Returned for unknown or failed syscalls
+#define SYSCALL_ERROR  ((uint64_t)-1)
+
+// SYSCALL_SCHED_STATS selectors
+#define SCHED_STATS_TASK      0   // arg2 = pid (0 for self)
+#define SCHED_STATS_PRIORITY  1   // arg2 = priority level
+
+// SYSCALL_TRACE_CTL operations
+#define TRACE_CTL_ENABLE   0   // arg2 = event pattern ("name", "subsystem:*" or "*")
+#define TRACE_CTL_DISABLE  1   // arg2 = event pattern
+#define TRACE_CTL_EXPORT   2   // Write recorded events to the console; fails while another export runs
+
+// SYSCALL_PROFILE_CTL operations
+#define PROFILE_CTL_START  0   // arg2 = samples per second per CPU
+#define PROFILE_CTL_STOP   1
+#define PROFILE_CTL_EXPORT 2   // Write samples to the console; fails while another export runs
+
+// Per-syscall counters, summed over all CPUs
+typedef struct {
+    uint64_t calls;
+    uint64_t cycles;
+} syscall_stats_t;
+
+uint64_t syscall_handler(uint64_t syscall_number, uint64_t arg1, uint64_t arg2, uint64_t arg3,
+                         uint64_t arg4, uint64_t arg5, uint64_t arg6);
+
+bool syscall_get_stats(uint64_t syscall_number, syscall_stats_t* stats);
+void syscall_reset_stats(void);
 
 #endif
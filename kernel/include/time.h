@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+struct clocksource;
+
 // Get current system time in milliseconds since boot
 uint64_t time_get_ms(void);
 
@@ -18,4 +20,23 @@ uint64_t time_get_seconds(void);
 // Initialize time system
 void time_init(void);
 
-#endif // TIME_H 
\ No newline at end of file
+// Start periodic re-anchoring of the timeline; needs the timer subsystem
+void time_late_init(void);
+
+// Counter value of the current clocksource at which time_get_ns() reaches
+// deadline_ns, for programming compare-based event timers
+uint64_t time_ns_to_cycles(uint64_t deadline_ns);
+
+// Counter ticks in a duration
+uint64_t time_ns_to_cycle_delta(uint64_t ns);
+
+// Clocksource the timeline is built on, NULL before time_init()
+const struct clocksource* time_get_clocksource(void);
+void time_set_clocksource(struct clocksource* cs);
+
+// Freeze the timeline before suspend and continue it after resume. Time
+// spent suspended is counted if the clocksource keeps running.
+void time_suspend(void);
+void time_resume(void);
+
+#endif // TIME_H
@@ -0,0 +1,22 @@
+#ifndef UACCESS_H
+#define UACCESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Top of the user half of the address space (TTBR0, 48-bit VA)
+#define USER_ADDRESS_LIMIT (1ULL << 48)
+
+// True if [addr, addr + n) is a plausible user range
+bool user_range_ok(const void* addr, size_t n);
+
+// Copy between kernel and user buffers; false if the user range is invalid
+bool copy_to_user(void* user_dst, const void* src, size_t n);
+bool copy_from_user(void* dst, const void* user_src, size_t n);
+
+// Copy a NUL-terminated string into a buffer of size bytes; returns its
+// length, or -1 if the user range is invalid or the string does not fit
+int64_t strncpy_from_user(char* dst, const char* user_src, size_t size);
+
+#endif // UACCESS_H
@@ -0,0 +1,81 @@
+#ifndef VDSO_H
+#define VDSO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Read-only clock page shared with every process. It carries the
+// clocksource parameters so user space can turn a raw counter read into
+// monotonic nanoseconds without a syscall:
+//
+//     ns = base_ns + (((counter - cycle_last) & mask) * mult) >> shift
+//
+// The kernel updates it under a sequence counter: seq is odd while an
+// update is in progress, and readers retry if it changed underneath them.
+
+#define VDSO_CLOCK_VERSION  1
+
+// clock_mode values
+#define VDSO_CLOCK_NONE     0   // No usable counter; fall back to a syscall
+#define VDSO_CLOCK_CNTVCT   1   // aarch64 generic timer virtual count
+#define VDSO_CLOCK_TSC      2   // x86-64 time stamp counter
+
+typedef struct {
+    volatile uint32_t seq;
+    uint32_t version;
+    uint32_t clock_mode;
+    uint32_t shift;
+    uint64_t mult;
+    uint64_t mask;
+    uint64_t cycle_last;    // Counter value at base_ns
+    uint64_t base_ns;       // Monotonic time at cycle_last
+    uint64_t freq_hz;
+} vdso_clock_page_t;
+
+static inline uint64_t vdso_read_counter(void) {
+#if defined(__aarch64__)
+    uint64_t counter;
+    __asm__ volatile("isb; mrs %0, cntvct_el0" : "=r"(counter) :: "memory");
+    return counter;
+#elif defined(__x86_64__)
+    uint32_t lo, hi;
+    __asm__ volatile("lfence; rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+    return ((uint64_t)hi << 32) | lo;
+#else
+    return 0;
+#endif
+}
+
+static inline uint64_t vdso_cycles_to_ns(const volatile vdso_clock_page_t* page, uint64_t counter) {
+    uint64_t delta = (counter - page->cycle_last) & page->mask;
+    return page->base_ns + (uint64_t)(((unsigned __int128)delta * page->mult) >> page->shift);
+}
+
+// Monotonic nanoseconds since boot. Returns false if the page has no
+// usable clock, in which case the caller should ask the kernel instead.
+static inline bool vdso_clock_get_ns(const volatile vdso_clock_page_t* page, uint64_t* ns) {
+    uint32_t seq;
+    uint64_t result = 0;
+    do {
+        seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) continue;
+        if (page->clock_mode == VDSO_CLOCK_NONE) return false;
+        result = vdso_cycles_to_ns(page, vdso_read_counter());
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&page->seq, __ATOMIC_RELAXED));
+
+    *ns = result;
+    return true;
+}
+
+// Kernel API
+void vdso_init(void);
+
+// Publish new clock parameters; cycle_last/base_ns re-anchor the timeline
+void vdso_update_clock(uint32_t clock_mode, uint64_t mult, uint32_t shift, uint64_t mask,
+                       uint64_t cycle_last, uint64_t base_ns, uint64_t freq_hz);
+
+// Address of the clock page as seen by processes
+const vdso_clock_page_t* vdso_get_clock_page(void);
+
+#endif // VDSO_H
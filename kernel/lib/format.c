@@ -0,0 +1,284 @@
+// kernel/lib/format.c
+//
+// printf-style formatting from pre-captured argument values. The log
+// records raw arguments on the hot path and formats them here, later,
+// when a reader drains it.
+#include "format.h"
+#include <stdbool.h>
+
+typedef enum {
+    LEN_DEFAULT,
+    LEN_HH,
+    LEN_H,
+    LEN_L,      // l, ll, z, t, j: all 64-bit here
+} length_t;
+
+typedef struct {
+    bool left;
+    bool zero;
+    bool plus;
+    bool space;
+    bool alt;
+    bool width_arg;     // '*'
+    bool prec_arg;      // '.*'
+    int width;
+    int precision;      // -1 if none
+    length_t length;
+    char conv;
+} spec_t;
+
+// Parse one conversion after its '%'; returns the character after it
+static const char* parse_spec(const char* p, spec_t* spec) {
+    spec->left = spec->zero = spec->plus = spec->space = spec->alt = false;
+    spec->width_arg = spec->prec_arg = false;
+    spec->width = 0;
+    spec->precision = -1;
+    spec->length = LEN_DEFAULT;
+
+    for (;; p++) {
+        if (*p == '-') spec->left = true;
+        else if (*p == '0') spec->zero = true;
+        else if (*p == '+') spec->plus = true;
+        else if (*p == ' ') spec->space = true;
+        else if (*p == '#') spec->alt = true;
+        else break;
+    }
+
+    if (*p == '*') {
+        spec->width_arg = true;
+        p++;
+    } else {
+        while (*p >= '0' && *p <= '9') spec->width = spec->width * 10 + (*p++ - '0');
+    }
+
+    if (*p == '.') {
+        p++;
+        spec->precision = 0;
+        if (*p == '*') {
+            spec->prec_arg = true;
+            p++;
+        } else {
+            while (*p >= '0' && *p <= '9') spec->precision = spec->precision * 10 + (*p++ - '0');
+        }
+    }
+
+    if (*p == 'h') {
+        p++;
+        spec->length = LEN_H;
+        if (*p == 'h') {
+            p++;
+            spec->length = LEN_HH;
+        }
+    } else if (*p == 'l') {
+        p++;
+        spec->length = LEN_L;
+        if (*p == 'l') p++;
+    } else if (*p == 'z' || *p == 't' || *p == 'j') {
+        p++;
+        spec->length = LEN_L;
+    }
+
+    spec->conv = *p;
+    return *p ? p + 1 : p;
+}
+
+static bool conv_is_signed(char conv) {
+    return conv == 'd' || conv == 'i' || conv == 'c';
+}
+
+static bool conv_is_unsigned(char conv) {
+    return conv == 'u' || conv == 'x' || conv == 'X' || conv == 'o';
+}
+
+uint32_t format_parse_args(const char* fmt, format_arg_t* args, uint32_t max) {
+    uint32_t count = 0;
+    const char* p = fmt;
+
+    while (*p) {
+        if (*p++ != '%') continue;
+        if (*p == '%') {
+            p++;
+            continue;
+        }
+
+        spec_t spec;
+        p = parse_spec(p, &spec);
+
+        if (spec.width_arg && count < max) {
+            args[count++] = (format_arg_t){ FORMAT_ARG_INT, 4 };
+        }
+        if (spec.prec_arg && count < max) {
+            args[count++] = (format_arg_t){ FORMAT_ARG_INT, 4 };
+        }
+        if (count >= max) break;
+
+        uint8_t size = (spec.length == LEN_L) ? 8 : 4;
+        if (conv_is_signed(spec.conv)) {
+            args[count++] = (format_arg_t){ FORMAT_ARG_INT, spec.conv == 'c' ? 4 : size };
+        } else if (conv_is_unsigned(spec.conv)) {
+            args[count++] = (format_arg_t){ FORMAT_ARG_UINT, size };
+        } else if (spec.conv == 'p') {
+            args[count++] = (format_arg_t){ FORMAT_ARG_POINTER, 8 };
+        } else if (spec.conv == 's') {
+            args[count++] = (format_arg_t){ FORMAT_ARG_STRING, 8 };
+        } else if (!spec.conv) {
+            break;
+        }
+    }
+    return count;
+}
+
+// Bounded output cursor; counts everything, stores what fits
+typedef struct {
+    char* out;
+    size_t size;
+    size_t len;
+} sink_t;
+
+static void emit(sink_t* sink, char c) {
+    if (sink->len + 1 < sink->size) {
+        sink->out[sink->len] = c;
+    }
+    sink->len++;
+}
+
+static void emit_repeat(sink_t* sink, char c, int count) {
+    while (count-- > 0) emit(sink, c);
+}
+
+static void emit_padded(sink_t* sink, const spec_t* spec, const char* prefix, const char* body, int body_len,
+                        int zero_pad) {
+    int prefix_len = 0;
+    while (prefix[prefix_len]) prefix_len++;
+
+    int pad = spec->width - prefix_len - zero_pad - body_len;
+    if (!spec->left) emit_repeat(sink, ' ', pad);
+    for (int i = 0; i < prefix_len; i++) emit(sink, prefix[i]);
+    emit_repeat(sink, '0', zero_pad);
+    for (int i = 0; i < body_len; i++) emit(sink, body[i]);
+    if (spec->left) emit_repeat(sink, ' ', pad);
+}
+
+static void emit_integer(sink_t* sink, const spec_t* spec, uint64_t raw) {
+    bool negative = false;
+    uint64_t value;
+
+    if (conv_is_signed(spec->conv)) {
+        int64_t v;
+        switch (spec->length) {
+            case LEN_HH: v = (int8_t)raw; break;
+            case LEN_H: v = (int16_t)raw; break;
+            case LEN_L: v = (int64_t)raw; break;
+            default: v = (int32_t)raw; break;
+        }
+        negative = v < 0;
+        value = negative ? (uint64_t)0 - (uint64_t)v : (uint64_t)v;
+    } else {
+        switch (spec->length) {
+            case LEN_HH: value = (uint8_t)raw; break;
+            case LEN_H: value = (uint16_t)raw; break;
+            case LEN_L: value = raw; break;
+            default: value = (uint32_t)raw; break;
+        }
+    }
+
+    uint32_t base = 10;
+    const char* digits = "0123456789abcdef";
+    if (spec->conv == 'x' || spec->conv == 'p') base = 16;
+    if (spec->conv == 'X') {
+        base = 16;
+        digits = "0123456789ABCDEF";
+    }
+    if (spec->conv == 'o') base = 8;
+
+    char buf[24];
+    int len = 0;
+    if (value || spec->precision != 0) {
+        do {
+            buf[sizeof(buf) - 1 - len++] = digits[value % base];
+            value /= base;
+        } while (value);
+    }
+
+    const char* prefix = "";
+    if (negative) prefix = "-";
+    else if (spec->plus && conv_is_signed(spec->conv)) prefix = "+";
+    else if (spec->space && conv_is_signed(spec->conv)) prefix = " ";
+    else if ((spec->alt && base == 16 && len) || spec->conv == 'p') prefix = spec->conv == 'X' ? "0X" : "0x";
+    else if (spec->alt && base == 8) prefix = "0";
+
+    int zero_pad = 0;
+    if (spec->precision > len) {
+        zero_pad = spec->precision - len;
+    } else if (spec->zero && !spec->left && spec->precision < 0) {
+        int prefix_len = 0;
+        while (prefix[prefix_len]) prefix_len++;
+        zero_pad = spec->width - prefix_len - len;
+    }
+    if (zero_pad < 0) zero_pad = 0;
+
+    emit_padded(sink, spec, prefix, buf + sizeof(buf) - len, len, zero_pad);
+}
+
+size_t format_args(char* out, size_t size, const char* fmt, const uint64_t* args, uint32_t nargs) {
+    sink_t sink = { out, size, 0 };
+    uint32_t next = 0;
+    const char* p = fmt;
+
+#define NEXT_ARG() (next < nargs ? args[next++] : 0)
+
+    while (*p) {
+        if (*p != '%') {
+            emit(&sink, *p++);
+            continue;
+        }
+        p++;
+        if (*p == '%') {
+            emit(&sink, *p++);
+            continue;
+        }
+
+        spec_t spec;
+        p = parse_spec(p, &spec);
+        if (spec.width_arg) {
+            int width = (int32_t)NEXT_ARG();
+            if (width < 0) {
+                spec.left = true;
+                width = -width;
+            }
+            spec.width = width;
+        }
+        if (spec.prec_arg) {
+            int precision = (int32_t)NEXT_ARG();
+            spec.precision = precision < 0 ? -1 : precision;
+        }
+
+        if (conv_is_signed(spec.conv) && spec.conv != 'c') {
+            emit_integer(&sink, &spec, NEXT_ARG());
+        } else if (conv_is_unsigned(spec.conv) || spec.conv == 'p') {
+            if (spec.conv == 'p') spec.length = LEN_L;
+            emit_integer(&sink, &spec, NEXT_ARG());
+        } else if (spec.conv == 'c') {
+            char c = (char)NEXT_ARG();
+            spec.precision = -1;
+            emit_padded(&sink, &spec, "", &c, 1, 0);
+        } else if (spec.conv == 's') {
+            const char* s = (const char*)(uintptr_t)NEXT_ARG();
+            if (!s) s = "(null)";
+            int len = 0;
+            while (s[len] && (spec.precision < 0 || len < spec.precision)) len++;
+            emit_padded(&sink, &spec, "", s, len, 0);
+        } else if (spec.conv) {
+            // Unknown conversion: print it verbatim
+            emit(&sink, '%');
+            emit(&sink, spec.conv);
+        }
+    }
+
+#undef NEXT_ARG
+
+    if (size) {
+        out[sink.len < size ? sink.len : size - 1] = '\0';
+    }
+    return sink.len;
+}
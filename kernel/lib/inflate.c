@@ -0,0 +1,437 @@
+#include "inflate.h"
+#include "memory.h"
+#include <string.h>
+
+// Huffman codes decode through a table indexed by the next FAST_BITS bits
+// of input, which resolves almost every symbol in one lookup; the rare
+// longer codes are walked bit by bit from the canonical code counts.
+
+#define MAX_BITS        15
+#define FAST_BITS       10
+#define MAX_LITLEN      288
+#define MAX_DIST        30
+#define MAX_CODELEN     19
+
+typedef struct {
+    uint16_t fast[1 << FAST_BITS];  // symbol << 4 | length; 0 if the code is longer
+    uint16_t count[MAX_BITS + 1];   // Codes of each length
+    uint16_t symbol[MAX_LITLEN];    // Symbols in canonical order
+} huffman_t;
+
+typedef struct {
+    const uint8_t* in;
+    size_t in_len;
+    size_t in_pos;
+    uint64_t bits;
+    uint32_t nbits;
+
+    uint8_t* out;
+    size_t out_cap;
+    size_t out_pos;
+    size_t reported;
+    inflate_progress_fn progress;
+    void* ctx;
+
+    huffman_t litlen;
+    huffman_t dist;
+} inflate_state_t;
+
+static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+static const uint8_t codelen_order[MAX_CODELEN] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+// --- Bit input ---
+
+static inline void refill(inflate_state_t* s) {
+    while (s->nbits <= 56 && s->in_pos < s->in_len) {
+        s->bits |= (uint64_t)s->in[s->in_pos++] << s->nbits;
+        s->nbits += 8;
+    }
+}
+
+static inline bool need(inflate_state_t* s, uint32_t n) {
+    if (s->nbits < n) refill(s);
+    return s->nbits >= n;
+}
+
+static inline uint32_t take(inflate_state_t* s, uint32_t n) {
+    uint32_t value = (uint32_t)(s->bits & ((1ULL << n) - 1));
+    s->bits >>= n;
+    s->nbits -= n;
+    return value;
+}
+
+// Drop to a byte boundary and hand buffered whole bytes back to the input
+static void align_input(inflate_state_t* s) {
+    take(s, s->nbits % 8);
+    s->in_pos -= s->nbits / 8;
+    s->bits = 0;
+    s->nbits = 0;
+}
+
+// --- Huffman tables ---
+
+static uint32_t reverse_bits(uint32_t code, uint32_t len) {
+    uint32_t out = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        out = (out << 1) | (code & 1);
+        code >>= 1;
+    }
+    return out;
+}
+
+// Build from code lengths; incomplete codes are allowed, since an unused
+// code simply fails to decode, but oversubscribed ones are not
+static bool huffman_build(huffman_t* h, const uint8_t* lengths, uint32_t n) {
+    memset(h->count, 0, sizeof(h->count));
+    for (uint32_t i = 0; i < n; i++) h->count[lengths[i]]++;
+    h->count[0] = 0;
+
+    int32_t left = 1;
+    for (uint32_t len = 1; len <= MAX_BITS; len++) {
+        left = (left << 1) - h->count[len];
+        if (left < 0) return false;
+    }
+
+    uint16_t offsets[MAX_BITS + 2];
+    uint16_t next_code[MAX_BITS + 1];
+    offsets[1] = 0;
+    uint32_t code = 0;
+    for (uint32_t len = 1; len <= MAX_BITS; len++) {
+        offsets[len + 1] = offsets[len] + h->count[len];
+        code = (code + (len > 1 ? h->count[len - 1] : 0)) << 1;
+        next_code[len] = (uint16_t)code;
+    }
+
+    memset(h->fast, 0, sizeof(h->fast));
+    for (uint32_t sym = 0; sym < n; sym++) {
+        uint32_t len = lengths[sym];
+        if (!len) continue;
+        h->symbol[offsets[len]++] = (uint16_t)sym;
+
+        uint32_t c = next_code[len]++;
+        if (len > FAST_BITS) continue;
+        // The stream holds codes most significant bit first
+        for (uint32_t i = reverse_bits(c, len); i < (1u << FAST_BITS); i += 1u << len) {
+            h->fast[i] = (uint16_t)(sym << 4 | len);
+        }
+    }
+    return true;
+}
+
+// Next symbol, or -1 on bad or missing input
+static int decode(inflate_state_t* s, const huffman_t* h) {
+    if (s->nbits < MAX_BITS) refill(s);
+
+    uint16_t entry = h->fast[s->bits & ((1u << FAST_BITS) - 1)];
+    if (entry) {
+        uint32_t len = entry & 15;
+        if (len > s->nbits) return -1;
+        take(s, len);
+        return entry >> 4;
+    }
+
+    int32_t code = 0;
+    int32_t first = 0;
+    int32_t index = 0;
+    for (uint32_t len = 1; len <= MAX_BITS && len <= s->nbits; len++) {
+        code |= (int32_t)((s->bits >> (len - 1)) & 1);
+        int32_t count = h->count[len];
+        if (code - count < first) {
+            take(s, len);
+            return h->symbol[index + (code - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+// --- Blocks ---
+
+static inline int report(inflate_state_t* s) {
+    s->reported = s->out_pos;
+    if (s->progress && !s->progress(s->ctx, s->out_pos)) return INFLATE_ERR_DATA;
+    return INFLATE_OK;
+}
+
+static int inflate_stored(inflate_state_t* s) {
+    align_input(s);
+    if (s->in_len - s->in_pos < 4) return INFLATE_ERR_INPUT;
+
+    const uint8_t* p = s->in + s->in_pos;
+    uint32_t len = p[0] | (uint32_t)p[1] << 8;
+    uint32_t nlen = p[2] | (uint32_t)p[3] << 8;
+    if (len != (~nlen & 0xFFFF)) return INFLATE_ERR_DATA;
+    s->in_pos += 4;
+
+    if (s->in_len - s->in_pos < len) return INFLATE_ERR_INPUT;
+    if (s->out_cap - s->out_pos < len) return INFLATE_ERR_SPACE;
+    memcpy(s->out + s->out_pos, s->in + s->in_pos, len);
+    s->in_pos += len;
+    s->out_pos += len;
+    return INFLATE_OK;
+}
+
+static int inflate_codes(inflate_state_t* s) {
+    for (;;) {
+        int sym = decode(s, &s->litlen);
+        if (sym < 0) return INFLATE_ERR_DATA;
+
+        if (sym < 256) {
+            if (s->out_pos == s->out_cap) return INFLATE_ERR_SPACE;
+            s->out[s->out_pos++] = (uint8_t)sym;
+        } else if (sym == 256) {
+            return INFLATE_OK;
+        } else {
+            sym -= 257;
+            if (sym >= 29) return INFLATE_ERR_DATA;
+            if (!need(s, length_extra[sym])) return INFLATE_ERR_INPUT;
+            uint32_t len = length_base[sym] + take(s, length_extra[sym]);
+
+            int dsym = decode(s, &s->dist);
+            if (dsym < 0 || dsym >= MAX_DIST) return INFLATE_ERR_DATA;
+            if (!need(s, dist_extra[dsym])) return INFLATE_ERR_INPUT;
+            uint32_t dist = dist_base[dsym] + take(s, dist_extra[dsym]);
+
+            if (dist > s->out_pos) return INFLATE_ERR_DATA;
+            if (s->out_cap - s->out_pos < len) return INFLATE_ERR_SPACE;
+            uint8_t* dst = s->out + s->out_pos;
+            const uint8_t* src = dst - dist;
+            if (dist >= len) {
+                memcpy(dst, src, len);
+            } else {
+                // Overlapping: the match repeats bytes it is producing
+                for (uint32_t i = 0; i < len; i++) dst[i] = src[i];
+            }
+            s->out_pos += len;
+        }
+
+        if (s->out_pos - s->reported >= INFLATE_PROGRESS_STEP) {
+            int err = report(s);
+            if (err) return err;
+        }
+    }
+}
+
+static void build_fixed(inflate_state_t* s) {
+    uint8_t lengths[MAX_LITLEN];
+    uint32_t sym = 0;
+    for (; sym < 144; sym++) lengths[sym] = 8;
+    for (; sym < 256; sym++) lengths[sym] = 9;
+    for (; sym < 280; sym++) lengths[sym] = 7;
+    for (; sym < MAX_LITLEN; sym++) lengths[sym] = 8;
+    huffman_build(&s->litlen, lengths, MAX_LITLEN);
+
+    for (sym = 0; sym < MAX_DIST; sym++) lengths[sym] = 5;
+    huffman_build(&s->dist, lengths, MAX_DIST);
+}
+
+static int build_dynamic(inflate_state_t* s) {
+    if (!need(s, 14)) return INFLATE_ERR_INPUT;
+    uint32_t nlen = take(s, 5) + 257;
+    uint32_t ndist = take(s, 5) + 1;
+    uint32_t ncode = take(s, 4) + 4;
+    if (nlen > 286 || ndist > MAX_DIST) return INFLATE_ERR_DATA;
+
+    uint8_t lengths[MAX_LITLEN + MAX_DIST];
+    memset(lengths, 0, MAX_CODELEN);
+    for (uint32_t i = 0; i < ncode; i++) {
+        if (!need(s, 3)) return INFLATE_ERR_INPUT;
+        lengths[codelen_order[i]] = (uint8_t)take(s, 3);
+    }
+    // The code length code is decoded with the litlen table's storage
+    if (!huffman_build(&s->litlen, lengths, MAX_CODELEN)) return INFLATE_ERR_DATA;
+
+    uint32_t index = 0;
+    while (index < nlen + ndist) {
+        int sym = decode(s, &s->litlen);
+        if (sym < 0) return INFLATE_ERR_DATA;
+        if (sym < 16) {
+            lengths[index++] = (uint8_t)sym;
+            continue;
+        }
+
+        uint8_t value = 0;
+        uint32_t repeat;
+        if (sym == 16) {
+            if (!index) return INFLATE_ERR_DATA;
+            value = lengths[index - 1];
+            if (!need(s, 2)) return INFLATE_ERR_INPUT;
+            repeat = 3 + take(s, 2);
+        } else if (sym == 17) {
+            if (!need(s, 3)) return INFLATE_ERR_INPUT;
+            repeat = 3 + take(s, 3);
+        } else {
+            if (!need(s, 7)) return INFLATE_ERR_INPUT;
+            repeat = 11 + take(s, 7);
+        }
+        if (index + repeat > nlen + ndist) return INFLATE_ERR_DATA;
+        memset(lengths + index, value, repeat);
+        index += repeat;
+    }
+
+    // A block without an end-of-block code could never finish
+    if (!lengths[256]) return INFLATE_ERR_DATA;
+    if (!huffman_build(&s->litlen, lengths, nlen)) return INFLATE_ERR_DATA;
+    if (!huffman_build(&s->dist, lengths + nlen, ndist)) return INFLATE_ERR_DATA;
+    return INFLATE_OK;
+}
+
+// --- Interface ---
+
+int inflate_raw(const uint8_t* in, size_t in_len, size_t* in_used,
+                uint8_t* out, size_t out_cap, size_t* out_len,
+                inflate_progress_fn progress, void* ctx) {
+    // Too large for the boot stack
+    inflate_state_t* s = memory_alloc(sizeof(inflate_state_t));
+    if (!s) return INFLATE_ERR_SPACE;
+    s->in = in;
+    s->in_len = in_len;
+    s->in_pos = 0;
+    s->bits = 0;
+    s->nbits = 0;
+    s->out = out;
+    s->out_cap = out_cap;
+    s->out_pos = 0;
+    s->reported = 0;
+    s->progress = progress;
+    s->ctx = ctx;
+
+    int err = INFLATE_OK;
+    bool last = false;
+    while (!err && !last) {
+        if (!need(s, 3)) {
+            err = INFLATE_ERR_INPUT;
+            break;
+        }
+        last = take(s, 1);
+        uint32_t type = take(s, 2);
+        if (type == 0) {
+            err = inflate_stored(s);
+        } else if (type == 1) {
+            build_fixed(s);
+            err = inflate_codes(s);
+        } else if (type == 2) {
+            err = build_dynamic(s);
+            if (!err) err = inflate_codes(s);
+        } else {
+            err = INFLATE_ERR_DATA;
+        }
+        if (!err && s->out_pos - s->reported >= INFLATE_PROGRESS_STEP) err = report(s);
+    }
+
+    if (!err) {
+        align_input(s);
+        err = report(s);
+    }
+    if (in_used) *in_used = s->in_pos;
+    if (out_len) *out_len = s->out_pos;
+    memory_free(s);
+    return err;
+}
+
+// --- gzip ---
+
+#define GZIP_FHCRC      0x02
+#define GZIP_FEXTRA     0x04
+#define GZIP_FNAME      0x08
+#define GZIP_FCOMMENT   0x10
+
+static uint32_t crc_table[256];
+static bool crc_table_ready = false;
+
+uint32_t crc32_update(uint32_t crc, const void* data, size_t len) {
+    if (!crc_table_ready) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            crc_table[i] = c;
+        }
+        crc_table_ready = true;
+    }
+
+    const uint8_t* p = data;
+    crc = ~crc;
+    while (len--) crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+bool gzip_is_gzip(const uint8_t* in, size_t in_len) {
+    return in_len >= 18 && in[0] == 0x1F && in[1] == 0x8B && in[2] == 8;
+}
+
+size_t gzip_original_size(const uint8_t* in, size_t in_len) {
+    if (!gzip_is_gzip(in, in_len)) return 0;
+    const uint8_t* p = in + in_len - 4;
+    return p[0] | (size_t)p[1] << 8 | (size_t)p[2] << 16 | (size_t)p[3] << 24;
+}
+
+// Checksums each stretch of output while it is still in cache, then
+// passes the progress on
+typedef struct {
+    const uint8_t* out;
+    size_t checked;
+    uint32_t crc;
+    inflate_progress_fn progress;
+    void* ctx;
+} gzip_progress_t;
+
+static bool gzip_progress(void* ctx, size_t produced) {
+    gzip_progress_t* gz = ctx;
+    gz->crc = crc32_update(gz->crc, gz->out + gz->checked, produced - gz->checked);
+    gz->checked = produced;
+    return !gz->progress || gz->progress(gz->ctx, produced);
+}
+
+int gzip_inflate(const uint8_t* in, size_t in_len, uint8_t* out, size_t out_cap, size_t* out_len,
+                 inflate_progress_fn progress, void* ctx) {
+    if (!gzip_is_gzip(in, in_len)) return INFLATE_ERR_DATA;
+
+    uint8_t flags = in[3];
+    size_t pos = 10;
+    if (flags & GZIP_FEXTRA) {
+        if (in_len - pos < 2) return INFLATE_ERR_INPUT;
+        pos += 2 + (in[pos] | (size_t)in[pos + 1] << 8);
+    }
+    if (flags & GZIP_FNAME) {
+        while (pos < in_len && in[pos]) pos++;
+        pos++;
+    }
+    if (flags & GZIP_FCOMMENT) {
+        while (pos < in_len && in[pos]) pos++;
+        pos++;
+    }
+    if (flags & GZIP_FHCRC) pos += 2;
+    if (pos + 8 > in_len) return INFLATE_ERR_INPUT;
+
+    gzip_progress_t gz = { .out = out, .checked = 0, .crc = 0, .progress = progress, .ctx = ctx };
+    size_t used;
+    size_t produced;
+    int err = inflate_raw(in + pos, in_len - pos - 8, &used, out, out_cap, &produced, gzip_progress, &gz);
+    if (out_len) *out_len = produced;
+    if (err) return err;
+
+    const uint8_t* trailer = in + pos + used;
+    uint32_t crc = trailer[0] | (uint32_t)trailer[1] << 8 | (uint32_t)trailer[2] << 16 | (uint32_t)trailer[3] << 24;
+    uint32_t size = trailer[4] | (uint32_t)trailer[5] << 8 | (uint32_t)trailer[6] << 16 | (uint32_t)trailer[7] << 24;
+    if (crc != gz.crc || size != (uint32_t)produced) return INFLATE_ERR_CHECK;
+    return INFLATE_OK;
+}
@@ -0,0 +1,77 @@
+#include "lz4.h"
+#include <string.h>
+
+// A block is a run of sequences: a token whose high nibble is the literal
+// count and low nibble the match length less 4 (15 in either continues in
+// bytes of 255), the literals, then a 16-bit little-endian offset back into
+// the output. The last sequence stops after its literals.
+//
+// Copies go 8 or 16 bytes at a time while the buffers have room past the
+// end of the copy, and fall back to exact copies near the edges.
+
+#define MIN_MATCH   4
+#define WILD_COPY   8
+
+static inline void copy8(uint8_t* dst, const uint8_t* src) {
+    memcpy(dst, src, 8);
+}
+
+// Add the continuation bytes of an extended length
+static inline int read_length(const uint8_t** ip, const uint8_t* iend, size_t* len) {
+    uint8_t byte;
+    do {
+        if (*ip >= iend) return LZ4_ERR_DATA;
+        byte = *(*ip)++;
+        *len += byte;
+    } while (byte == 255);
+    return 0;
+}
+
+int64_t lz4_decompress(const uint8_t* in, size_t in_len, uint8_t* out, size_t out_cap) {
+    const uint8_t* ip = in;
+    const uint8_t* iend = in + in_len;
+    uint8_t* op = out;
+    uint8_t* oend = out + out_cap;
+
+    for (;;) {
+        if (ip >= iend) return LZ4_ERR_DATA;
+        uint32_t token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15 && read_length(&ip, iend, &literals)) return LZ4_ERR_DATA;
+        if (literals > (size_t)(iend - ip) || literals > (size_t)(oend - op)) return LZ4_ERR_DATA;
+        if (literals <= 16 && iend - ip >= 16 && oend - op >= 16) {
+            memcpy(op, ip, 16);
+        } else {
+            memcpy(op, ip, literals);
+        }
+        ip += literals;
+        op += literals;
+        if (ip == iend) break;
+
+        if (iend - ip < 2) return LZ4_ERR_DATA;
+        size_t offset = (size_t)ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        if (!offset || offset > (size_t)(op - out)) return LZ4_ERR_DATA;
+
+        size_t length = token & 15;
+        if (length == 15 && read_length(&ip, iend, &length)) return LZ4_ERR_DATA;
+        length += MIN_MATCH;
+        if (length > (size_t)(oend - op)) return LZ4_ERR_DATA;
+
+        const uint8_t* match = op - offset;
+        uint8_t* end = op + length;
+        if (offset >= WILD_COPY && (size_t)(oend - end) >= WILD_COPY) {
+            // Each 8-byte step reads only output that is already final
+            do {
+                copy8(op, match);
+                op += 8;
+                match += 8;
+            } while (op < end);
+        } else {
+            while (op < end) *op++ = *match++;
+        }
+        op = end;
+    }
+    return op - out;
+}
@@ -0,0 +1,154 @@
+#include "radix_tree.h"
+#include "memory.h"
+#include <stddef.h>
+#include <string.h>
+
+#define RADIX_TREE_MAP_MASK  (RADIX_TREE_MAP_SIZE - 1)
+#define RADIX_TREE_MAX_PATH  ((64 + RADIX_TREE_MAP_SHIFT - 1) / RADIX_TREE_MAP_SHIFT)
+
+static uint64_t radix_tree_max_index(uint32_t height) {
+    uint32_t bits = height * RADIX_TREE_MAP_SHIFT;
+    if (bits >= 64) return UINT64_MAX;
+    return (1ULL << bits) - 1;
+}
+
+static radix_tree_node_t* radix_node_alloc(void) {
+    radix_tree_node_t* node = memory_alloc(sizeof(radix_tree_node_t));
+    if (node) memset(node, 0, sizeof(radix_tree_node_t));
+    return node;
+}
+
+void radix_tree_init(radix_tree_t* tree) {
+    tree->root = NULL;
+    tree->height = 0;
+}
+
+void* radix_tree_lookup(const radix_tree_t* tree, uint64_t index) {
+    if (!tree->root || index > radix_tree_max_index(tree->height)) return NULL;
+
+    radix_tree_node_t* node = tree->root;
+    for (uint32_t level = tree->height; level > 1; level--) {
+        uint32_t shift = (level - 1) * RADIX_TREE_MAP_SHIFT;
+        node = node->slots[(index >> shift) & RADIX_TREE_MAP_MASK];
+        if (!node) return NULL;
+    }
+    return node->slots[index & RADIX_TREE_MAP_MASK];
+}
+
+bool radix_tree_insert(radix_tree_t* tree, uint64_t index, void* item) {
+    if (!item) return false;
+
+    // Add levels on top until the index fits; the old root becomes slot 0
+    while (!tree->root || index > radix_tree_max_index(tree->height)) {
+        radix_tree_node_t* node = radix_node_alloc();
+        if (!node) return false;
+        if (tree->root) {
+            node->slots[0] = tree->root;
+            node->count = 1;
+        }
+        tree->root = node;
+        tree->height++;
+    }
+
+    radix_tree_node_t* node = tree->root;
+    for (uint32_t level = tree->height; level > 1; level--) {
+        uint32_t shift = (level - 1) * RADIX_TREE_MAP_SHIFT;
+        uint32_t slot = (index >> shift) & RADIX_TREE_MAP_MASK;
+        if (!node->slots[slot]) {
+            radix_tree_node_t* child = radix_node_alloc();
+            if (!child) return false;
+            node->slots[slot] = child;
+            node->count++;
+        }
+        node = node->slots[slot];
+    }
+
+    uint32_t slot = index & RADIX_TREE_MAP_MASK;
+    if (node->slots[slot]) return false;
+    node->slots[slot] = item;
+    node->count++;
+    return true;
+}
+
+void* radix_tree_delete(radix_tree_t* tree, uint64_t index) {
+    if (!tree->root || index > radix_tree_max_index(tree->height)) return NULL;
+
+    radix_tree_node_t* path[RADIX_TREE_MAX_PATH];
+    uint32_t slots[RADIX_TREE_MAX_PATH];
+    radix_tree_node_t* node = tree->root;
+    uint32_t depth = 0;
+    for (uint32_t level = tree->height; level > 0; level--) {
+        uint32_t shift = (level - 1) * RADIX_TREE_MAP_SHIFT;
+        path[depth] = node;
+        slots[depth] = (index >> shift) & RADIX_TREE_MAP_MASK;
+        if (level > 1) {
+            node = node->slots[slots[depth]];
+            if (!node) return NULL;
+        }
+        depth++;
+    }
+
+    void* item = path[depth - 1]->slots[slots[depth - 1]];
+    if (!item) return NULL;
+
+    // Clear the slot and free nodes that became empty, bottom up
+    while (depth > 0) {
+        depth--;
+        node = path[depth];
+        node->slots[slots[depth]] = NULL;
+        if (--node->count > 0) break;
+        memory_free(node);
+        if (depth == 0) {
+            tree->root = NULL;
+            tree->height = 0;
+        }
+    }
+
+    // Drop root levels that only lead to slot 0
+    while (tree->height > 1 && tree->root->count == 1 && tree->root->slots[0]) {
+        radix_tree_node_t* root = tree->root;
+        tree->root = root->slots[0];
+        tree->height--;
+        memory_free(root);
+    }
+    return item;
+}
+
+void* radix_tree_next(const radix_tree_t* tree, uint64_t* index) {
+    if (!tree->root) return NULL;
+
+    uint64_t max = radix_tree_max_index(tree->height);
+    uint64_t i = *index;
+    while (i <= max) {
+        radix_tree_node_t* node = tree->root;
+        uint32_t level = tree->height;
+        bool skipped = false;
+
+        // Descend; an empty subtree moves i to the start of the next one
+        while (level > 1) {
+            uint32_t shift = (level - 1) * RADIX_TREE_MAP_SHIFT;
+            radix_tree_node_t* child = node->slots[(i >> shift) & RADIX_TREE_MAP_MASK];
+            if (!child) {
+                uint64_t next = ((i >> shift) + 1) << shift;
+                if (next <= i) return NULL;     // Wrapped past the end
+                i = next;
+                skipped = true;
+                break;
+            }
+            node = child;
+            level--;
+        }
+        if (skipped) continue;
+
+        for (uint32_t slot = i & RADIX_TREE_MAP_MASK; slot < RADIX_TREE_MAP_SIZE; slot++) {
+            if (node->slots[slot]) {
+                *index = (i & ~(uint64_t)RADIX_TREE_MAP_MASK) | slot;
+                return node->slots[slot];
+            }
+        }
+        uint64_t next = (i | RADIX_TREE_MAP_MASK) + 1;
+        if (next <= i) return NULL;
+        i = next;
+    }
+    return NULL;
+}
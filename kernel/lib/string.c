@@ -0,0 +1,349 @@
+// kernel/lib/string.c
+//
+// memcpy, memmove and memset for the kernel, plus the user-copy routines
+// built on them. Every call picks a strategy by size class:
+//
+//   0..15 B     overlapping 8/4/2/1-byte unaligned accesses, no loop
+//   16..127 B   overlapping 16-byte head/tail pairs, no per-byte work
+//   128 B..     64-byte blocks from an aligned destination, then the tail
+//               as one overlapping 64-byte block. On x86-64 copies of
+//               STRING_REP_THRESHOLD bytes and up use rep movsb/stosb.
+//
+// This file must not call the functions it defines, so it includes no
+// libc headers and is built with -fno-builtin and without loop-to-call
+// pattern replacement (see CMakeLists.txt).
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "uaccess.h"
+
+#define STRING_SMALL        16
+#define STRING_MEDIUM       128
+#define STRING_BLOCK        64
+#define STRING_REP_THRESHOLD 512
+
+// Unaligned, alias-safe access types; both targets handle unaligned loads
+// in hardware, so these compile to single ldr/str or mov instructions
+typedef uint64_t __attribute__((may_alias, aligned(1))) u64_u;
+typedef uint32_t __attribute__((may_alias, aligned(1))) u32_u;
+typedef uint16_t __attribute__((may_alias, aligned(1))) u16_u;
+
+static inline uint64_t load64(const uint8_t* p) { return *(const u64_u*)p; }
+static inline uint32_t load32(const uint8_t* p) { return *(const u32_u*)p; }
+static inline uint16_t load16(const uint8_t* p) { return *(const u16_u*)p; }
+static inline void store64(uint8_t* p, uint64_t v) { *(u64_u*)p = v; }
+static inline void store32(uint8_t* p, uint32_t v) { *(u32_u*)p = v; }
+static inline void store16(uint8_t* p, uint16_t v) { *(u16_u*)p = v; }
+
+// 0..15 bytes. All loads happen before any store, so this is also safe
+// for overlapping buffers in either direction.
+static inline void copy_small(uint8_t* d, const uint8_t* s, size_t n) {
+    if (n >= 8) {
+        uint64_t a = load64(s), b = load64(s + n - 8);
+        store64(d, a);
+        store64(d + n - 8, b);
+    } else if (n >= 4) {
+        uint32_t a = load32(s), b = load32(s + n - 4);
+        store32(d, a);
+        store32(d + n - 4, b);
+    } else if (n >= 2) {
+        uint16_t a = load16(s), b = load16(s + n - 2);
+        store16(d, a);
+        store16(d + n - 2, b);
+    } else if (n) {
+        *d = *s;
+    }
+}
+
+// One 16-byte chunk
+typedef struct { uint64_t lo, hi; } chunk16_t;
+
+static inline chunk16_t load16b(const uint8_t* p) {
+    chunk16_t c = { load64(p), load64(p + 8) };
+    return c;
+}
+
+static inline void store16b(uint8_t* p, chunk16_t c) {
+    store64(p, c.lo);
+    store64(p + 8, c.hi);
+}
+
+// 16..127 bytes as head and tail chunk pairs that overlap in the middle.
+// Loads precede stores, so overlapping buffers are fine here too.
+static inline void copy_medium(uint8_t* d, const uint8_t* s, size_t n) {
+    if (n <= 32) {
+        chunk16_t a = load16b(s), b = load16b(s + n - 16);
+        store16b(d, a);
+        store16b(d + n - 16, b);
+    } else if (n <= 64) {
+        chunk16_t a = load16b(s), b = load16b(s + 16);
+        chunk16_t c = load16b(s + n - 32), e = load16b(s + n - 16);
+        store16b(d, a);
+        store16b(d + 16, b);
+        store16b(d + n - 32, c);
+        store16b(d + n - 16, e);
+    } else {
+        chunk16_t a = load16b(s), b = load16b(s + 16), c = load16b(s + 32), e = load16b(s + 48);
+        chunk16_t f = load16b(s + n - 64), g = load16b(s + n - 48);
+        chunk16_t h = load16b(s + n - 32), i = load16b(s + n - 16);
+        store16b(d, a);
+        store16b(d + 16, b);
+        store16b(d + 32, c);
+        store16b(d + 48, e);
+        store16b(d + n - 64, f);
+        store16b(d + n - 48, g);
+        store16b(d + n - 32, h);
+        store16b(d + n - 16, i);
+    }
+}
+
+// One 64-byte block. NEON is only used when the target enables it, the
+// same condition under which the compiler itself emits SIMD code.
+static inline void copy_block(uint8_t* d, const uint8_t* s) {
+#if defined(__aarch64__) && defined(__ARM_NEON)
+    __asm__ volatile("ldp q0, q1, [%1]\n\t"
+                     "ldp q2, q3, [%1, #32]\n\t"
+                     "stp q0, q1, [%0]\n\t"
+                     "stp q2, q3, [%0, #32]"
+                     :: "r"(d), "r"(s) : "v0", "v1", "v2", "v3", "memory");
+#else
+    uint64_t a = load64(s), b = load64(s + 8), c = load64(s + 16), e = load64(s + 24);
+    uint64_t f = load64(s + 32), g = load64(s + 40), h = load64(s + 48), i = load64(s + 56);
+    store64(d, a);
+    store64(d + 8, b);
+    store64(d + 16, c);
+    store64(d + 24, e);
+    store64(d + 32, f);
+    store64(d + 40, g);
+    store64(d + 48, h);
+    store64(d + 56, i);
+#endif
+}
+
+// 128 bytes and up, copying forward. Only safe when the buffers do not
+// overlap or d is at least one block below s.
+static void copy_large_forward(uint8_t* d, const uint8_t* s, size_t n) {
+    // Copy the first block unaligned, then continue from the next aligned
+    // destination address; the overlap re-copies a few identical bytes
+    uint8_t* end = d + n;
+    const uint8_t* tail_src = s + n - STRING_BLOCK;
+    uint8_t* tail_dst = end - STRING_BLOCK;
+    chunk16_t t0 = load16b(tail_src), t1 = load16b(tail_src + 16);
+    chunk16_t t2 = load16b(tail_src + 32), t3 = load16b(tail_src + 48);
+
+    copy_block(d, s);
+    size_t skew = STRING_BLOCK - ((uintptr_t)d & (STRING_BLOCK - 1));
+    d += skew;
+    s += skew;
+
+    while (d + STRING_BLOCK < end) {
+        copy_block(d, s);
+        d += STRING_BLOCK;
+        s += STRING_BLOCK;
+    }
+
+    // The tail was loaded up front, before any store could clobber it
+    store16b(tail_dst, t0);
+    store16b(tail_dst + 16, t1);
+    store16b(tail_dst + 32, t2);
+    store16b(tail_dst + 48, t3);
+}
+
+// 128 bytes and up, copying backward; d must be at least one block above s
+static void copy_large_backward(uint8_t* d, const uint8_t* s, size_t n) {
+    chunk16_t h0 = load16b(s), h1 = load16b(s + 16), h2 = load16b(s + 32), h3 = load16b(s + 48);
+    uint8_t* head = d;
+
+    uint8_t* dend = d + n;
+    const uint8_t* send = s + n;
+    copy_block(dend - STRING_BLOCK, send - STRING_BLOCK);
+    size_t skew = (uintptr_t)dend & (STRING_BLOCK - 1);
+    if (!skew) skew = STRING_BLOCK;
+    dend -= skew;
+    send -= skew;
+
+    while (dend - STRING_BLOCK > head) {
+        dend -= STRING_BLOCK;
+        send -= STRING_BLOCK;
+        copy_block(dend, send);
+    }
+
+    store16b(head, h0);
+    store16b(head + 16, h1);
+    store16b(head + 32, h2);
+    store16b(head + 48, h3);
+}
+
+// Overlapping moves whose buffers are less than a block apart: the block
+// paths above would re-read bytes they have already overwritten
+static void move_forward_near(uint8_t* d, const uint8_t* s, size_t n) {
+    if ((uintptr_t)s - (uintptr_t)d >= 8) {
+        for (; n >= 8; n -= 8, d += 8, s += 8) {
+            store64(d, load64(s));
+        }
+    }
+    while (n--) {
+        *d++ = *s++;
+    }
+}
+
+static void move_backward_near(uint8_t* d, const uint8_t* s, size_t n) {
+    d += n;
+    s += n;
+    if ((uintptr_t)d - (uintptr_t)s >= 8) {
+        for (; n >= 8; n -= 8) {
+            d -= 8;
+            s -= 8;
+            store64(d, load64(s));
+        }
+    }
+    while (n--) {
+        *--d = *--s;
+    }
+}
+
+#if defined(__x86_64__)
+// Fast-string microcode (ERMS) beats any register loop for large copies
+static inline void rep_movsb(uint8_t* d, const uint8_t* s, size_t n) {
+    __asm__ volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(n) :: "memory");
+}
+
+static inline void rep_stosb(uint8_t* d, uint8_t c, size_t n) {
+    __asm__ volatile("rep stosb" : "+D"(d), "+c"(n) : "a"(c) : "memory");
+}
+#endif
+
+void* memcpy(void* restrict dst, const void* restrict src, size_t n) {
+    uint8_t* d = dst;
+    const uint8_t* s = src;
+
+    if (n < STRING_SMALL) {
+        copy_small(d, s, n);
+    } else if (n < STRING_MEDIUM) {
+        copy_medium(d, s, n);
+    } else {
+#if defined(__x86_64__)
+        if (n >= STRING_REP_THRESHOLD) {
+            rep_movsb(d, s, n);
+            return dst;
+        }
+#endif
+        copy_large_forward(d, s, n);
+    }
+    return dst;
+}
+
+void* memmove(void* dst, const void* src, size_t n) {
+    uint8_t* d = dst;
+    const uint8_t* s = src;
+
+    // Small and medium copies load everything before storing
+    if (n < STRING_SMALL) {
+        copy_small(d, s, n);
+    } else if (n < STRING_MEDIUM) {
+        copy_medium(d, s, n);
+    } else if (d == s) {
+        return dst;
+    } else if (d < s) {
+        if ((uintptr_t)s - (uintptr_t)d >= STRING_BLOCK) {
+            copy_large_forward(d, s, n);
+        } else {
+            move_forward_near(d, s, n);
+        }
+    } else {
+        if ((uintptr_t)d - (uintptr_t)s >= STRING_BLOCK) {
+            copy_large_backward(d, s, n);
+        } else {
+            move_backward_near(d, s, n);
+        }
+    }
+    return dst;
+}
+
+void* memset(void* dst, int c, size_t n) {
+    uint8_t* d = dst;
+    uint64_t v = 0x0101010101010101ULL * (uint8_t)c;
+
+    if (n < STRING_SMALL) {
+        if (n >= 8) {
+            store64(d, v);
+            store64(d + n - 8, v);
+        } else if (n >= 4) {
+            store32(d, (uint32_t)v);
+            store32(d + n - 4, (uint32_t)v);
+        } else if (n >= 2) {
+            store16(d, (uint16_t)v);
+            store16(d + n - 2, (uint16_t)v);
+        } else if (n) {
+            *d = (uint8_t)c;
+        }
+        return dst;
+    }
+
+#if defined(__x86_64__)
+    if (n >= STRING_REP_THRESHOLD) {
+        rep_stosb(d, (uint8_t)c, n);
+        return dst;
+    }
+#endif
+
+    // Overlapping 16-byte stores at both ends, aligned 16-byte stores between
+    uint8_t* end = d + n;
+    store64(d, v);
+    store64(d + 8, v);
+    store64(end - 16, v);
+    store64(end - 8, v);
+
+    uint8_t* p = (uint8_t*)(((uintptr_t)d + 16) & ~(uintptr_t)15);
+#if defined(__aarch64__) && defined(__ARM_NEON)
+    typedef uint8_t v16u8 __attribute__((vector_size(16)));
+    v16u8 vec = (v16u8){0} + (uint8_t)c;
+    while (p + 64 <= end) {
+        __asm__ volatile("stp %q1, %q1, [%0]\n\t"
+                         "stp %q1, %q1, [%0, #32]"
+                         :: "r"(p), "w"(vec) : "memory");
+        p += 64;
+    }
+#endif
+    while (p + 16 <= end) {
+        store64(p, v);
+        store64(p + 8, v);
+        p += 16;
+    }
+    return dst;
+}
+
+// User copies. The kernel and processes share one address space for now,
+// so the checks are limited to rejecting NULL, wrap-around and ranges
+// above USER_ADDRESS_LIMIT.
+bool user_range_ok(const void* addr, size_t n) {
+    uintptr_t start = (uintptr_t)addr;
+    if (!start) return false;
+    if (start + n < start) return false;
+    return start + n <= USER_ADDRESS_LIMIT;
+}
+
+bool copy_to_user(void* user_dst, const void* src, size_t n) {
+    if (!n) return true;
+    if (!user_range_ok(user_dst, n)) return false;
+    memcpy(user_dst, src, n);
+    return true;
+}
+
+bool copy_from_user(void* dst, const void* user_src, size_t n) {
+    if (!n) return true;
+    if (!user_range_ok(user_src, n)) return false;
+    memcpy(dst, user_src, n);
+    return true;
+}
+
+// The length is only known at the NUL, so each byte is checked on its own
+int64_t strncpy_from_user(char* dst, const char* user_src, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (!user_range_ok(user_src + i, 1)) return -1;
+        dst[i] = user_src[i];
+        if (!dst[i]) return (int64_t)i;
+    }
+    return -1;
+}
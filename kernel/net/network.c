@@ -1,5 +1,6 @@
 #include "network.h"
 #include "memory.h"
+#include "trace.h"
 #include <string.h>
 
 #define MAX_INTERFACES 16
@@ -40,12 +41,18 @@ typedef struct {
     bool active;
 } network_socket_t;
 
+TRACE_EVENT(net, net_send, "socket", "size", "packet", NULL);
+TRACE_EVENT(net, net_receive, "socket", "size", NULL, NULL);
+
 // Network stack state
 static network_interface_t interfaces[MAX_INTERFACES];
 static network_socket_t sockets[MAX_SOCKETS];
 static network_packet_t packets[MAX_PACKETS];
 static uint64_t next_socket_id = 1;
 
+network_socket_t* network_get_socket(uint64_t socket_id);
+network_interface_t* network_get_interface(const char* name);
+
 // Initialize network stack
 void network_init(void) {
     memset(interfaces, 0, sizeof(interfaces));
@@ -100,7 +107,7 @@ uint64_t network_create_socket(socket_type_t type) {
     socket->local_port = 0;
     socket->remote_address = 0;
     socket->remote_port = 0;
-    socket->receive_buffer = memory_allocate(MAX_PACKET_SIZE * 32); // 32 packet buffer
+    socket->receive_buffer = memory_alloc(MAX_PACKET_SIZE * 32); // 32 packet buffer
     if (!socket->receive_buffer) {
         return 0;
     }
@@ -155,6 +162,7 @@ bool network_send(uint64_t socket_id, const void* data, uint64_t size) {
     packet->size = size;
     packet->timestamp = 0; // TODO: Get system time
     packet->active = true;
+    TRACE(net_send, socket_id, size, packet_id, 0);
 
     // TODO: Send packet through network interface
     return true;
@@ -181,6 +189,7 @@ bool network_receive(uint64_t socket_id, void* data, uint64_t* size) {
 
     // Update buffer
     socket->receive_buffer_head = (socket->receive_buffer_head + sizeof(network_packet_t)) % socket->receive_buffer_size;
+    TRACE(net_receive, socket_id, packet->size, 0, 0);
 
     return true;
 }
@@ -0,0 +1,59 @@
+#ifndef NETWORK_H
+#define NETWORK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Socket types
+typedef enum {
+    SOCKET_TYPE_STREAM,
+    SOCKET_TYPE_DATAGRAM,
+    SOCKET_TYPE_RAW
+} socket_type_t;
+
+// Network interface info structure
+typedef struct {
+    char name[32];
+    uint8_t mac_address[6];
+    uint32_t ip_address;
+    uint32_t netmask;
+    uint32_t gateway;
+} network_interface_info_t;
+
+// Network socket info structure
+typedef struct {
+    uint64_t socket_id;
+    socket_type_t type;
+    uint32_t local_address;
+    uint16_t local_port;
+    uint32_t remote_address;
+    uint16_t remote_port;
+} network_socket_info_t;
+
+// System stats structure
+typedef struct {
+    uint64_t total_interfaces;
+    uint64_t active_interfaces;
+    uint64_t total_sockets;
+    uint64_t active_sockets;
+    uint64_t total_packets;
+    uint64_t active_packets;
+} network_system_stats_t;
+
+// Function declarations
+void network_init(void);
+bool network_register_interface(const char* name, const uint8_t* mac_address, uint32_t ip_address, uint32_t netmask, uint32_t gateway);
+uint64_t network_create_socket(socket_type_t type);
+bool network_bind_socket(uint64_t socket_id, uint32_t address, uint16_t port);
+bool network_connect_socket(uint64_t socket_id, uint32_t address, uint16_t port);
+bool network_send(uint64_t socket_id, const void* data, uint64_t size);
+bool network_receive(uint64_t socket_id, void* data, uint64_t* size);
+uint64_t network_get_interface_count(void);
+bool network_get_interface_list(char** names, uint64_t* count);
+uint64_t network_get_socket_count(void);
+bool network_get_socket_list(uint64_t* socket_ids, uint64_t* count);
+bool network_get_interface_info(const char* name, network_interface_info_t* info);
+bool network_get_socket_info(uint64_t socket_id, network_socket_info_t* info);
+void network_get_system_stats(network_system_stats_t* stats);
+
+#endif // NETWORK_H
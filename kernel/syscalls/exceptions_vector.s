@@ -1,6 +1,120 @@
+// AArch64 exception vector table, installed in VBAR_EL1 by arch_cpu_init().
+// Every entry saves a trap_frame_t (arch/aarch64/trap.h) on the kernel stack.
+
+.equ TRAP_FRAME_SIZE, 272
+.equ ESR_EC_SVC64, 0x15
+
+.macro kernel_entry
+    sub sp, sp, #TRAP_FRAME_SIZE
+    stp x0, x1, [sp, #16 * 0]
+    stp x2, x3, [sp, #16 * 1]
+    stp x4, x5, [sp, #16 * 2]
+    stp x6, x7, [sp, #16 * 3]
+    stp x8, x9, [sp, #16 * 4]
+    stp x10, x11, [sp, #16 * 5]
+    stp x12, x13, [sp, #16 * 6]
+    stp x14, x15, [sp, #16 * 7]
+    stp x16, x17, [sp, #16 * 8]
+    stp x18, x19, [sp, #16 * 9]
+    stp x20, x21, [sp, #16 * 10]
+    stp x22, x23, [sp, #16 * 11]
+    stp x24, x25, [sp, #16 * 12]
+    stp x26, x27, [sp, #16 * 13]
+    stp x28, x29, [sp, #16 * 14]
+    mrs x21, sp_el0
+    mrs x22, elr_el1
+    mrs x23, spsr_el1
+    stp x30, x21, [sp, #16 * 15]
+    stp x22, x23, [sp, #16 * 16]
+.endm
+
+.macro kernel_exit
+    ldp x22, x23, [sp, #16 * 16]
+    ldp x30, x21, [sp, #16 * 15]
+    msr sp_el0, x21
+    msr elr_el1, x22
+    msr spsr_el1, x23
+    ldp x0, x1, [sp, #16 * 0]
+    ldp x2, x3, [sp, #16 * 1]
+    ldp x4, x5, [sp, #16 * 2]
+    ldp x6, x7, [sp, #16 * 3]
+    ldp x8, x9, [sp, #16 * 4]
+    ldp x10, x11, [sp, #16 * 5]
+    ldp x12, x13, [sp, #16 * 6]
+    ldp x14, x15, [sp, #16 * 7]
+    ldp x16, x17, [sp, #16 * 8]
+    ldp x18, x19, [sp, #16 * 9]
+    ldp x20, x21, [sp, #16 * 10]
+    ldp x22, x23, [sp, #16 * 11]
+    ldp x24, x25, [sp, #16 * 12]
+    ldp x26, x27, [sp, #16 * 13]
+    ldp x28, x29, [sp, #16 * 14]
+    add sp, sp, #TRAP_FRAME_SIZE
+    eret
+.endm
+
+.macro vector_entry label
+    .balign 0x80
+    b \label
+.endm
+
+.section .text
+.global exception_vectors
+.balign 0x800
+exception_vectors:
+    // Current EL with SP_EL0
+    vector_entry sync_handler
+    vector_entry irq_handler
+    vector_entry unhandled_handler
+    vector_entry unhandled_handler
+    // Current EL with SP_ELx
+    vector_entry sync_handler
+    vector_entry irq_handler
+    vector_entry unhandled_handler
+    vector_entry unhandled_handler
+    // Lower EL, AArch64
+    vector_entry svc_handler
+    vector_entry irq_handler
+    vector_entry unhandled_handler
+    vector_entry unhandled_handler
+    // Lower EL, AArch32 (unsupported)
+    vector_entry unhandled_handler
+    vector_entry unhandled_handler
+    vector_entry unhandled_handler
+    vector_entry unhandled_handler
+
 svc_handler:
     // Save registers
-    // Load syscall number from x8
-    // Call syscall_handler in C
-    // Restore registers
-    eret
+    kernel_entry
+    // SVC goes straight to the syscall table, anything else to C
+    mrs x1, esr_el1
+    lsr x2, x1, #26
+    cmp x2, #ESR_EC_SVC64
+    b.ne 1f
+    mov x0, sp
+    bl handle_syscall
+    // Restore registers; x0 now holds the result
+    kernel_exit
+1:  mov x0, sp
+    bl handle_sync_exception
+    kernel_exit
+
+sync_handler:
+    kernel_entry
+    mov x0, sp
+    mrs x1, esr_el1
+    bl handle_sync_exception
+    kernel_exit
+
+irq_handler:
+    kernel_entry
+    mov x0, sp
+    bl arch_handle_irq
+    kernel_exit
+
+unhandled_handler:
+    kernel_entry
+    mov x0, sp
+    mrs x1, esr_el1
+    bl handle_sync_exception
+    kernel_exit
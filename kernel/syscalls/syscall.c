@@ -1,24 +1,36 @@
 #include "syscall.h"
-#include "drivers/console.h" // Hypothetical console driver
+#include "drivers/console.h"
+#include "process.h"
+#include "scheduler.h"
+#include "ioring.h"
+#include "fs.h"
+#include "vdso.h"
+#include "time.h"
+#include "uaccess.h"
+#include "trace.h"
+#include "core/security.h"
+#include "profile.h"
+#include "arch/cpu.h"
 #include <stddef.h> // For size_t
-
-uint64_t syscall_handler(uint64_t syscall_number, uint64_t arg1, uint64_t arg2, uint64_t arg3) {
-    switch (syscall_number) {
-        case SYSCALL_WRITE:
-            console_write((const char *)arg1, (size_t)arg2);
-            return 0;
-        case SYSCALL_EXIT:
-            // In real kernel: clean up and terminate the process
-            return 0;
-        default:
-            return (uint64_t)-1; // Invalid syscall
-    }
-}
+#include <string.h>
 
 typedef uint64_t (*syscall_fn_t)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t);
+
+// arg1 = buffer, arg2 = length; returns bytes queued. Output is buffered
+// per CPU and drained in the background, so this never waits on the UART.
 uint64_t sys_write(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5, uint64_t arg6) {
-    // Example implementation using console_write
-    console_write((const char *)arg1, (size_t)arg2);
+    if (!user_range_ok((const void*)arg1, (size_t)arg2)) return SYSCALL_ERROR;
+    return console_write_buffer((const char *)arg1, (size_t)arg2);
+}
+
+// arg1 = exit code
+uint64_t sys_exit(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5, uint64_t arg6) {
+    process_control_block_t* current = scheduler_get_current();
+    if (current) {
+        current->exit_code = arg1;
+        process_destroy((int)current->pid);
+    }
+    scheduler_schedule();
     return 0;
 }
 
@@ -27,10 +39,223 @@ uint64_t sys_read(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, ui
     return 0;
 }
 
-static syscall_fn_t syscall_table[] = {
-    sys_write,  // syscall 0
-    sys_read,   // syscall 1
+// arg1 = pid (0 for self), arg2 = CPU mask; another task's only with kernel privilege
+uint64_t sys_sched_setaffinity(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5, uint64_t arg6) {
+    process_control_block_t* current = scheduler_get_current();
+    uint64_t self = current ? current->pid : 0;
+    if (arg1 && arg1 != self && security_get_privilege((uint32_t)self) != PRIVILEGE_KERNEL) {
+        return SYSCALL_ERROR;
+    }
+    return process_set_affinity(arg1, arg2) ? 0 : SYSCALL_ERROR;
+}
+
+// arg1 = pid (0 for self); returns the CPU mask, 0 if no such process
+uint64_t sys_sched_getaffinity(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5, uint64_t arg6) {
+    return process_get_affinity(arg1);
+}
+
+// arg1 = SCHED_STATS_* selector, arg2 = pid or priority, arg3 = sched_latency_stats_t*
+uint64_t sys_sched_stats(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5, uint64_t arg6) {
+    sched_latency_stats_t stats;
+    bool ok = false;
+    if (arg1 == SCHED_STATS_TASK && arg2) {
+        process_control_block_t* process = process_get(arg2);
+        ok = scheduler_get_task_stats(process, &stats);
+        process_put(process);
+    } else if (arg1 == SCHED_STATS_TASK) {
+        ok = scheduler_get_task_stats(scheduler_get_current(), &stats);
+    } else if (arg1 == SCHED_STATS_PRIORITY) {
+        ok = scheduler_get_priority_stats((process_priority_t)arg2, &stats);
+    }
+    if (!ok || !copy_to_user((void*)arg3, &stats, sizeof(stats))) return SYSCALL_ERROR;
+    return 0;
+}
+
+// arg1 = syscall number, arg2 = syscall_stats_t*
+uint64_t sys_syscall_stats(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5, uint64_t arg6) {
+    syscall_stats_t stats;
+    if (!syscall_get_stats(arg1, &stats)) return SYSCALL_ERROR;
+    return copy_to_user((void*)arg2, &stats, sizeof(stats)) ? 0 : SYSCALL_ERROR;
+}
+
+// arg1 = SQ entries, arg2 = IORING_SETUP_* flags, arg3 = ioring_shared_t** for the region
+uint64_t sys_ioring_setup(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5, uint64_t arg6) {
+    ioring_shared_t* shared;
+    int64_t id = ioring_setup((uint32_t)arg1, (uint32_t)arg2, &shared);
+    if (id < 0) return SYSCALL_ERROR;
+    if (!copy_to_user((void*)arg3, &shared, sizeof(shared))) {
+        ioring_destroy((uint64_t)id);
+        return SYSCALL_ERROR;
+    }
+    return (uint64_t)id;
+}
+
+// arg1 = ring id, arg2 = SQEs to submit, arg3 = IORING_ENTER_* flags; returns the number submitted
+uint64_t sys_ioring_enter(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5, uint64_t arg6) {
+    int64_t submitted = ioring_enter(arg1, (uint32_t)arg2, (uint32_t)arg3);
+    return submitted < 0 ? SYSCALL_ERROR : (uint64_t)submitted;
+}
+
+// arg1 = ring id
+uint64_t sys_ioring_destroy(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5, uint64_t arg6) {
+    return ioring_destroy(arg1) ? 0 : SYSCALL_ERROR;
+}
+
+// Returns the address of the read-only vDSO clock page; arg1 = uint64_t* that
+// also receives the current time, for callers that cannot use the page
+uint64_t sys_vdso_clock(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5, uint64_t arg6) {
+    if (arg1) {
+        uint64_t now = time_get_ns();
+        if (!copy_to_user((void*)arg1, &now, sizeof(now))) return SYSCALL_ERROR;
+    }
+    return (uint64_t)vdso_get_clock_page();
+}
+
+// Lines an export writes between giving up the CPU
+#define EXPORT_CHUNK_LINES 64
+
+// Trace and profile exports are far larger than the console rings: wait
+// for room instead of dropping lines, and let other tasks run between
+// chunks rather than hold the CPU for the seconds an export takes
+static size_t export_console_write(const char* buf, size_t len) {
+    static uint32_t lines = 0;
+    size_t written = console_write_all(buf, len);
+    if (__atomic_add_fetch(&lines, 1, __ATOMIC_RELAXED) % EXPORT_CHUNK_LINES == 0) {
+        scheduler_yield();
+    }
+    return written;
+}
+
+// arg1 = TRACE_CTL_* operation, arg2 = event pattern; returns the number
+// of events changed, or 0 for an export
+uint64_t sys_trace_ctl(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5, uint64_t arg6) {
+    switch (arg1) {
+        case TRACE_CTL_ENABLE:
+        case TRACE_CTL_DISABLE:
+        {
+            char pattern[TRACE_PATTERN_MAX];
+            if (strncpy_from_user(pattern, (const char*)arg2, sizeof(pattern)) < 0) return SYSCALL_ERROR;
+            return trace_set_enabled(pattern, arg1 == TRACE_CTL_ENABLE);
+        }
+        case TRACE_CTL_EXPORT:
+            return trace_export(export_console_write) ? 0 : SYSCALL_ERROR;
+        default:
+            return SYSCALL_ERROR;
+    }
+}
+
+// arg1 = PROFILE_CTL_* operation, arg2 = sampling rate in Hz for a start
+uint64_t sys_profile_ctl(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5, uint64_t arg6) {
+    switch (arg1) {
+        case PROFILE_CTL_START:
+            return profile_start((uint32_t)arg2) ? 0 : SYSCALL_ERROR;
+        case PROFILE_CTL_STOP:
+            profile_stop();
+            return 0;
+        case PROFILE_CTL_EXPORT:
+            return profile_export(export_console_write) ? 0 : SYSCALL_ERROR;
+        default:
+            return SYSCALL_ERROR;
+    }
+}
+
+// arg1 = file descriptor, arg2 = page-aligned offset, arg3 = length; returns
+// the address of a shared read-only mapping of the file's cached data
+uint64_t sys_mmap(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5, uint64_t arg6) {
+    if (arg1 > INT32_MAX) return SYSCALL_ERROR;
+    file_t* file = fs_fd_get(0, (int)arg1);
+    if (!file) return SYSCALL_ERROR;
+    void* addr;
+    int err = fs_mmap(file, arg2, arg3, &addr);
+    fs_close(file);
+    return err ? SYSCALL_ERROR : (uint64_t)addr;
+}
+
+// arg1 = address returned by SYSCALL_MMAP
+uint64_t sys_munmap(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5, uint64_t arg6) {
+    return fs_munmap((void*)arg1) ? SYSCALL_ERROR : 0;
+}
+
+static bool copy_path_from_user(char* path, const char* user_path) {
+    return strncpy_from_user(path, user_path, VFS_PATH_MAX) >= 0;
+}
+
+// arg1 = path, arg2 = FS_O_* flags; returns the lowest free file descriptor
+uint64_t sys_open(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5, uint64_t arg6) {
+    char path[VFS_PATH_MAX];
+    if (!copy_path_from_user(path, (const char*)arg1)) return SYSCALL_ERROR;
+    int fd = fs_fd_open(path, (uint32_t)arg2);
+    return fd < 0 ? SYSCALL_ERROR : (uint64_t)fd;
+}
+
+// arg1 = file descriptor
+uint64_t sys_close(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5, uint64_t arg6) {
+    if (arg1 > INT32_MAX) return SYSCALL_ERROR;
+    return fs_fd_close((int)arg1) ? SYSCALL_ERROR : 0;
+}
+
+// arg1 = file descriptor; returns a new one sharing its file and position
+uint64_t sys_dup(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5, uint64_t arg6) {
+    if (arg1 > INT32_MAX) return SYSCALL_ERROR;
+    int fd = fs_fd_dup((int)arg1);
+    return fd < 0 ? SYSCALL_ERROR : (uint64_t)fd;
+}
+
+static const syscall_fn_t syscall_table[SYSCALL_COUNT] = {
+    [SYSCALL_WRITE]             = sys_write,
+    [SYSCALL_EXIT]              = sys_exit,
+    [SYSCALL_SCHED_SETAFFINITY] = sys_sched_setaffinity,
+    [SYSCALL_SCHED_GETAFFINITY] = sys_sched_getaffinity,
+    [SYSCALL_SCHED_STATS]       = sys_sched_stats,
+    [SYSCALL_READ]              = sys_read,
+    [SYSCALL_SYSCALL_STATS]     = sys_syscall_stats,
+    [SYSCALL_IORING_SETUP]      = sys_ioring_setup,
+    [SYSCALL_IORING_ENTER]      = sys_ioring_enter,
+    [SYSCALL_IORING_DESTROY]    = sys_ioring_destroy,
+    [SYSCALL_VDSO_CLOCK]        = sys_vdso_clock,
+    [SYSCALL_TRACE_CTL]         = sys_trace_ctl,
+    [SYSCALL_PROFILE_CTL]       = sys_profile_ctl,
+    [SYSCALL_MMAP]              = sys_mmap,
+    [SYSCALL_MUNMAP]            = sys_munmap,
+    [SYSCALL_OPEN]              = sys_open,
+    [SYSCALL_CLOSE]             = sys_close,
+    [SYSCALL_DUP]               = sys_dup,
     // Add more here
 };
 
+// Per-CPU counters so the entry path never shares a cache line between CPUs
+static syscall_stats_t syscall_stats[MAX_CPUS][SYSCALL_COUNT];
+
+// Single entry point for all syscalls: bounds-checked table dispatch
+uint64_t syscall_handler(uint64_t syscall_number, uint64_t arg1, uint64_t arg2, uint64_t arg3,
+                         uint64_t arg4, uint64_t arg5, uint64_t arg6) {
+    if (syscall_number >= SYSCALL_COUNT || !syscall_table[syscall_number]) {
+        return SYSCALL_ERROR; // Invalid syscall
+    }
+
+    uint64_t start = arch_cycles();
+    uint64_t result = syscall_table[syscall_number](arg1, arg2, arg3, arg4, arg5, arg6);
 
+    // The task may have migrated during the call; account on the CPU it returns on
+    syscall_stats_t* stats = &syscall_stats[arch_cpu_id()][syscall_number];
+    stats->calls++;
+    stats->cycles += arch_cycles() - start;
+
+    return result;
+}
+
+bool syscall_get_stats(uint64_t syscall_number, syscall_stats_t* stats) {
+    if (syscall_number >= SYSCALL_COUNT || !stats) return false;
+
+    stats->calls = 0;
+    stats->cycles = 0;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        stats->calls += syscall_stats[cpu][syscall_number].calls;
+        stats->cycles += syscall_stats[cpu][syscall_number].cycles;
+    }
+    return true;
+}
+
+void syscall_reset_stats(void) {
+    memset(syscall_stats, 0, sizeof(syscall_stats));
+}
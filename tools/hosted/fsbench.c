@@ -0,0 +1,381 @@
+// Filesystem microbenchmarks on a RAM disk: the fs_* calls, the VFS and
+// page cache under them, and a filesystem driver at the bottom
+// (kernel/core/fs.c, kernel/fs/), timed with the host clock.
+//
+// Streams one file sequentially and at random offsets, creates and
+// unlinks a batch of empty files, and looks names up in one large
+// directory. Each test reports throughput, per-call latency percentiles
+// and what it cost the block device. On a filesystem with a device, reads
+// and the first lookups start from a fresh mount, so they go to the disk
+// rather than the caches; writes are timed up to and including the fsync.
+//
+//   fsbench [--fs lambdafs|tmpfs] [--file-mb N] [--io-kb N] [--files N]
+//           [--dir-entries N] [--seed N]
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "host_arch.h"
+#include "scheduler.h"
+#include "process.h"
+#include "fs.h"
+#include "fs/lambdafs.h"
+#include "ramdisk.h"
+
+#define MOUNT_POINT     "/bench"
+#define DEVICE_NAME     "bench0"
+
+typedef struct {
+    const char* name;
+    int (*format)(blockdev_t* dev);     // NULL: no device, nothing survives a remount
+} fs_type_t;
+
+static int format_lambdafs(blockdev_t* dev) {
+    return lambdafs_format(dev, 0);
+}
+
+static const fs_type_t fs_types[] = {
+    { "lambdafs", format_lambdafs },
+    { "tmpfs", NULL },
+};
+
+// One test's measurements
+typedef struct {
+    const char* name;
+    uint64_t* samples;              // Nanoseconds per call
+    uint64_t count;
+    uint64_t bytes;
+    uint64_t start_ns;
+    blockdev_stats_t disk;          // At the start
+} bench_t;
+
+static const fs_type_t* fs_type;
+static blockdev_t* device;
+static uint64_t* samples;
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static uint64_t wall_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void check(int err, const char* what) {
+    if (err < 0) {
+        fprintf(stderr, "fsbench: %s failed: %d\n", what, err);
+        exit(1);
+    }
+}
+
+static void disk_stats(blockdev_stats_t* stats) {
+    if (device) {
+        blockdev_get_stats(device, stats);
+    } else {
+        memset(stats, 0, sizeof(*stats));
+    }
+}
+
+// Drop every cache above the device; a no-op for filesystems without one
+static void remount(void) {
+    if (!device) return;
+    check(vfs_umount(MOUNT_POINT), "umount");
+    check(fs_mount(fs_type->name, DEVICE_NAME, MOUNT_POINT, 0), "mount");
+}
+
+static void bench_begin(bench_t* bench, const char* name) {
+    bench->name = name;
+    bench->samples = samples;
+    bench->count = 0;
+    bench->bytes = 0;
+    disk_stats(&bench->disk);
+    bench->start_ns = wall_ns();
+}
+
+static inline void bench_sample(bench_t* bench, uint64_t start_ns) {
+    bench->samples[bench->count++] = wall_ns() - start_ns;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile_us(const bench_t* bench, double fraction) {
+    uint64_t index = (uint64_t)(bench->count * fraction);
+    if (index >= bench->count) index = bench->count - 1;
+    return bench->samples[index] / 1000.0;
+}
+
+static void bench_end(bench_t* bench) {
+    uint64_t elapsed = wall_ns() - bench->start_ns;
+    blockdev_stats_t disk;
+    disk_stats(&disk);
+    if (!bench->count) return;
+
+    qsort(bench->samples, bench->count, sizeof(uint64_t), compare_u64);
+    double seconds = elapsed / 1e9;
+    char rate[16] = "-";
+    if (bench->bytes) snprintf(rate, sizeof(rate), "%.1f", bench->bytes / seconds / (1024.0 * 1024.0));
+    printf("%-12s %8" PRIu64 " %9s %10.0f | %8.2f %8.2f %8.2f %8.2f %9.2f | %8.1f %8.1f\n",
+           bench->name, bench->count, rate, bench->count / seconds,
+           percentile_us(bench, 0.50), percentile_us(bench, 0.90), percentile_us(bench, 0.99),
+           percentile_us(bench, 0.999), bench->samples[bench->count - 1] / 1000.0,
+           (disk.blocks_read - bench->disk.blocks_read) * (double)RAMDISK_BLOCK_SIZE / (1024.0 * 1024.0),
+           (disk.blocks_written - bench->disk.blocks_written) * (double)RAMDISK_BLOCK_SIZE / (1024.0 * 1024.0));
+}
+
+// --- File data ---
+
+static void bench_stream(uint64_t file_bytes, uint32_t io_size) {
+    const char* path = MOUNT_POINT "/stream";
+    uint64_t ops = file_bytes / io_size;
+    uint8_t* buffer = malloc(io_size);
+    if (!buffer) check(VFS_ERR_NOMEM, "buffer");
+    for (uint32_t i = 0; i < io_size; i++) buffer[i] = (uint8_t)(i * 7 + 1);
+    bench_t bench;
+
+    int fd = fs_fd_open(path, FS_O_CREAT | FS_O_TRUNC | FS_O_WRONLY);
+    check(fd, "open for writing");
+    file_t* file = fs_fd_get(0, fd);
+    bench_begin(&bench, "seq-write");
+    for (uint64_t i = 0; i < ops; i++) {
+        uint64_t start = wall_ns();
+        check(fs_write(file, buffer, io_size), "write");
+        bench_sample(&bench, start);
+    }
+    check(fs_fsync(file), "fsync");
+    bench.bytes = ops * io_size;
+    bench_end(&bench);
+    fs_close(file);
+    check(fs_fd_close(fd), "close");
+
+    remount();
+    fd = fs_fd_open(path, FS_O_RDONLY);
+    check(fd, "open for reading");
+    file = fs_fd_get(0, fd);
+    bench_begin(&bench, "seq-read");
+    for (uint64_t i = 0; i < ops; i++) {
+        uint64_t start = wall_ns();
+        check(fs_read(file, buffer, io_size), "read");
+        bench_sample(&bench, start);
+    }
+    bench.bytes = ops * io_size;
+    bench_end(&bench);
+    fs_close(file);
+    check(fs_fd_close(fd), "close");
+
+    fd = fs_fd_open(path, FS_O_RDWR);
+    check(fd, "open for random writes");
+    file = fs_fd_get(0, fd);
+    bench_begin(&bench, "rand-write");
+    for (uint64_t i = 0; i < ops; i++) {
+        uint64_t offset = rng_next() % ops * io_size;
+        uint64_t start = wall_ns();
+        check(fs_pwrite(file, buffer, io_size, offset), "pwrite");
+        bench_sample(&bench, start);
+    }
+    check(fs_fsync(file), "fsync");
+    bench.bytes = ops * io_size;
+    bench_end(&bench);
+    fs_close(file);
+    check(fs_fd_close(fd), "close");
+
+    remount();
+    fd = fs_fd_open(path, FS_O_RDONLY);
+    check(fd, "open for random reads");
+    file = fs_fd_get(0, fd);
+    bench_begin(&bench, "rand-read");
+    for (uint64_t i = 0; i < ops; i++) {
+        uint64_t offset = rng_next() % ops * io_size;
+        uint64_t start = wall_ns();
+        check(fs_pread(file, buffer, io_size, offset), "pread");
+        bench_sample(&bench, start);
+    }
+    bench.bytes = ops * io_size;
+    bench_end(&bench);
+    fs_close(file);
+    check(fs_fd_close(fd), "close");
+
+    check(fs_unlink(path), "unlink");
+    free(buffer);
+}
+
+// --- Metadata ---
+
+static void entry_path(char* path, size_t size, const char* dir, uint64_t n) {
+    snprintf(path, size, "%s/entry-%08" PRIx64, dir, n);
+}
+
+// Untimed setup for the lookups
+static void fill_dir(const char* dir, uint32_t count) {
+    char path[VFS_PATH_MAX];
+    check(fs_mkdir(dir), "mkdir");
+    for (uint32_t i = 0; i < count; i++) {
+        entry_path(path, sizeof(path), dir, i);
+        int fd = fs_fd_open(path, FS_O_CREAT | FS_O_EXCL | FS_O_WRONLY);
+        check(fd, "create");
+        check(fs_fd_close(fd), "close");
+    }
+}
+
+static void bench_create_unlink(uint32_t files) {
+    const char* dir = MOUNT_POINT "/small";
+    char path[VFS_PATH_MAX];
+    bench_t bench;
+
+    check(fs_mkdir(dir), "mkdir");
+    bench_begin(&bench, "create");
+    for (uint32_t i = 0; i < files; i++) {
+        entry_path(path, sizeof(path), dir, i);
+        uint64_t start = wall_ns();
+        int fd = fs_fd_open(path, FS_O_CREAT | FS_O_EXCL | FS_O_WRONLY);
+        check(fd, "create");
+        check(fs_fd_close(fd), "close");
+        bench_sample(&bench, start);
+    }
+    bench_end(&bench);
+
+    bench_begin(&bench, "unlink");
+    for (uint32_t i = 0; i < files; i++) {
+        entry_path(path, sizeof(path), dir, i);
+        uint64_t start = wall_ns();
+        check(fs_unlink(path), "unlink");
+        bench_sample(&bench, start);
+    }
+    bench_end(&bench);
+    check(fs_rmdir(dir), "rmdir");
+}
+
+// Random names out of one directory of entries files: cold from the
+// disk, then a second pass through whatever the caches kept, then names
+// that are not there
+static void bench_lookup(uint32_t entries) {
+    const char* dir = MOUNT_POINT "/large";
+    char path[VFS_PATH_MAX];
+    fs_stat_t stat;
+    bench_t bench;
+
+    fill_dir(dir, entries);
+    remount();
+
+    const char* names[] = { device ? "lookup-cold" : "lookup", "lookup-again", "lookup-miss" };
+    for (uint32_t pass = 0; pass < 3; pass++) {
+        bench_begin(&bench, names[pass]);
+        for (uint32_t i = 0; i < entries; i++) {
+            uint64_t n = rng_next() % entries;
+            if (pass == 2) n += entries;
+            entry_path(path, sizeof(path), dir, n);
+            uint64_t start = wall_ns();
+            int err = fs_stat(path, &stat);
+            bench_sample(&bench, start);
+            if (pass < 2) {
+                check(err, "lookup");
+            } else if (err != VFS_ERR_NOENT) {
+                check(err ? err : VFS_ERR_EXIST, "lookup of a missing name");
+            }
+        }
+        bench_end(&bench);
+    }
+
+    for (uint32_t i = 0; i < entries; i++) {
+        entry_path(path, sizeof(path), dir, i);
+        check(fs_unlink(path), "unlink");
+    }
+    check(fs_rmdir(dir), "rmdir");
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: fsbench [--fs lambdafs|tmpfs] [--file-mb N] [--io-kb N] [--files N]\n"
+            "               [--dir-entries N] [--seed N]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    const char* fs_name = "lambdafs";
+    uint64_t file_mb = 64;
+    uint32_t io_kb = 4;
+    uint32_t files = 20000;
+    uint32_t dir_entries = 100000;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!value) usage();
+        if (!strcmp(arg, "--fs")) {
+            fs_name = value;
+        } else if (!strcmp(arg, "--file-mb")) {
+            file_mb = strtoull(value, NULL, 10);
+        } else if (!strcmp(arg, "--io-kb")) {
+            io_kb = (uint32_t)atoi(value);
+        } else if (!strcmp(arg, "--files")) {
+            files = (uint32_t)atoi(value);
+        } else if (!strcmp(arg, "--dir-entries")) {
+            dir_entries = (uint32_t)atoi(value);
+        } else if (!strcmp(arg, "--seed")) {
+            rng_state = strtoull(value, NULL, 10) | 1;
+        } else {
+            usage();
+        }
+        i++;
+    }
+    for (uint32_t i = 0; i < sizeof(fs_types) / sizeof(fs_types[0]); i++) {
+        if (!strcmp(fs_name, fs_types[i].name)) fs_type = &fs_types[i];
+    }
+    if (!fs_type || !io_kb || (file_mb && file_mb * 1024 < io_kb)) usage();
+
+    uint64_t file_bytes = file_mb << 20;
+    uint32_t io_size = io_kb << 10;
+    uint64_t max_samples = file_bytes / io_size;
+    if (files > max_samples) max_samples = files;
+    if (dir_entries > max_samples) max_samples = dir_entries;
+    samples = malloc(max_samples * sizeof(uint64_t));
+    if (!samples && max_samples) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    host_arch_reset(1);
+    process_init();
+    scheduler_init(SCHED_RR);
+    fs_init();
+    check(fs_mkdir(MOUNT_POINT), "mkdir " MOUNT_POINT);
+
+    // The RAM disk only allocates what is written, so size it generously:
+    // the file twice over, an inode's share of disk per entry, and slack
+    uint64_t disk_bytes = 2 * file_bytes + ((uint64_t)files + dir_entries) * 16384 + (256ULL << 20);
+    if (fs_type->format) {
+        device = ramdisk_create(DEVICE_NAME, disk_bytes / RAMDISK_BLOCK_SIZE);
+        if (!device) check(VFS_ERR_NOMEM, "ramdisk");
+        check(fs_type->format(device), "format");
+    }
+    check(fs_mount(fs_type->name, device ? DEVICE_NAME : NULL, MOUNT_POINT, 0), "mount");
+
+    printf("%s: %" PRIu64 " MB file in %u KB calls, %u files, %u directory entries\n",
+           fs_type->name, file_mb, io_kb, files, dir_entries);
+    printf("%-12s %8s %9s %10s | %8s %8s %8s %8s %9s | %8s %8s\n",
+           "test", "calls", "MB/s", "calls/s", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us",
+           "disk rMB", "disk wMB");
+
+    if (file_bytes) bench_stream(file_bytes, io_size);
+    if (files) bench_create_unlink(files);
+    if (dir_entries) bench_lookup(dir_entries);
+
+    check(vfs_umount(MOUNT_POINT), "umount");
+    if (device) ramdisk_destroy(device);
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include "host_arch.h"
+#include "time.h"
+
+uint64_t host_now_ns = 0;
+uint32_t host_cpu = 0;
+uint32_t host_cpus = 1;
+uint64_t host_timer_deadline[MAX_CPUS];
+bool host_ipi_pending[MAX_CPUS];
+
+uint64_t host_timer_programs = 0;
+uint64_t host_idle_entries = 0;
+uint64_t host_ipis_sent = 0;
+
+void host_arch_reset(uint32_t cpus) {
+    host_now_ns = 0;
+    host_cpu = 0;
+    host_cpus = cpus > MAX_CPUS ? MAX_CPUS : (cpus ? cpus : 1);
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        host_timer_deadline[cpu] = HOST_TIMER_OFF;
+        host_ipi_pending[cpu] = false;
+    }
+    host_timer_programs = 0;
+    host_idle_entries = 0;
+    host_ipis_sent = 0;
+}
+
+// arch/cpu.h
+
+void arch_cpu_init(void) {
+}
+
+uint32_t arch_cpu_id(void) {
+    return host_cpu;
+}
+
+uint32_t arch_cpu_count(void) {
+    return host_cpus;
+}
+
+void arch_cpu_idle(void) {
+    host_idle_entries++;
+}
+
+void arch_cpu_relax(void) {
+}
+
+void arch_cpu_kick(uint32_t cpu) {
+    host_ipi_pending[cpu % MAX_CPUS] = true;
+    host_ipis_sent++;
+}
+
+uint64_t arch_cycles(void) {
+    return host_now_ns;
+}
+
+uint64_t arch_irq_save(void) {
+    return 0;
+}
+
+void arch_irq_restore(uint64_t flags) {
+    (void)flags;
+}
+
+void arch_irq_enable(void) {
+}
+
+void arch_timer_program(uint64_t deadline_ns) {
+    host_timer_deadline[host_cpu] = deadline_ns;
+    host_timer_programs++;
+}
+
+void arch_timer_stop(void) {
+    host_timer_deadline[host_cpu] = HOST_TIMER_OFF;
+}
+
+// time.h
+
+void time_init(void) {
+}
+
+uint64_t time_get_ns(void) {
+    return host_now_ns;
+}
+
+uint64_t time_get_us(void) {
+    return host_now_ns / 1000;
+}
+
+uint64_t time_get_ms(void) {
+    return host_now_ns / 1000000;
+}
+
+uint64_t time_get_seconds(void) {
+    return host_now_ns / 1000000000;
+}
@@ -0,0 +1,26 @@
+#ifndef HOST_ARCH_H
+#define HOST_ARCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "arch/cpu.h"
+
+// Hosted stand-ins for arch/cpu.h and the system clock. Kernel code sees
+// a simulated clock and whichever simulated CPU host_cpu selects.
+
+#define HOST_TIMER_OFF UINT64_MAX
+
+extern uint64_t host_now_ns;                      // Simulated time_get_ns()
+extern uint32_t host_cpu;                         // CPU the kernel code runs on
+extern uint32_t host_cpus;                        // Simulated CPU count
+extern uint64_t host_timer_deadline[MAX_CPUS];    // Programmed event timers
+extern bool host_ipi_pending[MAX_CPUS];           // Undelivered reschedule IPIs
+
+// Event counters
+extern uint64_t host_timer_programs;
+extern uint64_t host_idle_entries;
+extern uint64_t host_ipis_sent;
+
+void host_arch_reset(uint32_t cpus);
+
+#endif // HOST_ARCH_H
@@ -0,0 +1,353 @@
+// Correctness check of the gzip decoder (kernel/lib/inflate.c) and the
+// initrd filesystem (kernel/fs/initrd.c).
+//
+// Builds a newc cpio archive in memory, compresses it with the host's
+// gzip at levels 1 and 9, and checks that each inflates back to the same
+// bytes and mounts with every file, directory and size intact, plain
+// archive included. Truncated, corrupted and oversized inputs must fail
+// cleanly, and leave the mount table usable.
+//
+//   initrdtest
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "host_arch.h"
+#include "scheduler.h"
+#include "process.h"
+#include "fs.h"
+#include "fs/initrd.h"
+#include "inflate.h"
+
+#define MOUNT_POINT     "/initrd"
+#define APP_SIZE        300000      // Several progress steps, past the window
+
+typedef struct {
+    uint8_t* data;
+    size_t len;
+    size_t cap;
+} buffer_t;
+
+typedef struct {
+    const char* path;
+    uint32_t mode;
+    size_t size;
+} entry_t;
+
+static const entry_t entries[] = {
+    { ".",                  0040755, 0 },
+    { "init",               0100755, 61 },
+    { "dev",                0040755, 0 },
+    { "bin/app",            0100755, APP_SIZE },
+    { "etc/conf",           0100644, 4099 },
+    { "empty",              0100644, 0 },
+    { "lib/link",           0120777, 7 },       // Skipped
+    { "deep/a/b/c/leaf",    0100644, 12 },      // Directories only implied
+};
+
+#define ENTRY_COUNT (sizeof(entries) / sizeof(entries[0]))
+
+static uint32_t failures;
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static void fail(const char* what, const char* detail) {
+    if (failures++ < 20) fprintf(stderr, "FAIL %s: %s\n", what, detail);
+}
+
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static void buffer_put(buffer_t* buf, const void* data, size_t len) {
+    if (buf->len + len > buf->cap) {
+        buf->cap = (buf->len + len) * 2;
+        buf->data = realloc(buf->data, buf->cap);
+        if (!buf->data) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+static void buffer_pad4(buffer_t* buf) {
+    static const uint8_t zeros[4];
+    buffer_put(buf, zeros, (4 - buf->len % 4) % 4);
+}
+
+// Contents of entry i: runs of noise and repeats, so the compressor emits
+// literals, short matches and long ones
+static void entry_fill(size_t i, uint8_t* data, size_t size) {
+    rng_state = 0x9E3779B97F4A7C15ULL + i;
+    size_t pos = 0;
+    while (pos < size) {
+        size_t run = 1 + rng_next() % 512;
+        if (run > size - pos) run = size - pos;
+        if (pos >= 1024 && rng_next() % 2) {
+            size_t distance = 1 + rng_next() % (pos < 40000 ? pos : 40000);
+            for (size_t k = 0; k < run; k++) data[pos + k] = data[pos + k - distance];
+        } else {
+            for (size_t k = 0; k < run; k++) data[pos + k] = (uint8_t)("abcdefgh"[rng_next() % 8] + (rng_next() % 4 == 0));
+        }
+        pos += run;
+    }
+}
+
+static void cpio_header(buffer_t* buf, uint32_t ino, uint32_t mode, size_t size, const char* name) {
+    char header[111];
+    snprintf(header, sizeof(header), "070701%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X",
+             ino, mode, 0, 0, 1, 0, (uint32_t)size, 0, 0, 0, 0, (uint32_t)strlen(name) + 1, 0);
+    buffer_put(buf, header, 110);
+    buffer_put(buf, name, strlen(name) + 1);
+    buffer_pad4(buf);
+}
+
+static void cpio_build(buffer_t* archive) {
+    for (size_t i = 0; i < ENTRY_COUNT; i++) {
+        const entry_t* entry = &entries[i];
+        cpio_header(archive, (uint32_t)i + 1, entry->mode, entry->size, entry->path);
+        uint8_t* data = malloc(entry->size + 1);
+        entry_fill(i, data, entry->size);
+        buffer_put(archive, data, entry->size);
+        buffer_pad4(archive);
+        free(data);
+    }
+    cpio_header(archive, 0, 0, 0, "TRAILER!!!");
+}
+
+// Compress with the host gzip at level
+static bool gzip_host(const buffer_t* in, int level, buffer_t* out) {
+    char path[] = "/tmp/initrdtest-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return false;
+    bool ok = write(fd, in->data, in->len) == (ssize_t)in->len;
+    close(fd);
+
+    char command[128];
+    snprintf(command, sizeof(command), "gzip -c -%d < %s", level, path);
+    FILE* pipe = ok ? popen(command, "r") : NULL;
+    if (pipe) {
+        uint8_t chunk[65536];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), pipe)) > 0) buffer_put(out, chunk, n);
+        ok = pclose(pipe) == 0 && out->len > 0;
+    } else {
+        ok = false;
+    }
+    unlink(path);
+    return ok;
+}
+
+// --- Decoder ---
+
+typedef struct {
+    size_t calls;
+    size_t last;
+    bool backwards;
+} progress_t;
+
+static bool progress_count(void* ctx, size_t produced) {
+    progress_t* progress = ctx;
+    if (produced < progress->last) progress->backwards = true;
+    progress->last = produced;
+    progress->calls++;
+    return true;
+}
+
+static void test_inflate(const char* name, const buffer_t* archive, const buffer_t* gz) {
+    if (!gzip_is_gzip(gz->data, gz->len)) fail(name, "not recognised as gzip");
+    if (gzip_is_gzip(archive->data, archive->len)) fail(name, "plain archive taken for gzip");
+    if (gzip_original_size(gz->data, gz->len) != archive->len) fail(name, "trailer size");
+
+    uint8_t* out = malloc(archive->len);
+    size_t out_len = 0;
+    progress_t progress = { 0 };
+    int err = gzip_inflate(gz->data, gz->len, out, archive->len, &out_len, progress_count, &progress);
+    if (err != INFLATE_OK) fail(name, "inflate failed");
+    else if (out_len != archive->len || memcmp(out, archive->data, archive->len)) fail(name, "round trip differs");
+    if (progress.calls < archive->len / INFLATE_PROGRESS_STEP || progress.backwards || progress.last != out_len) {
+        fail(name, "progress reports");
+    }
+
+    // Every prefix is a stream that ends early
+    for (size_t cut = 0; cut < gz->len; cut += 1 + cut / 3) {
+        if (gzip_inflate(gz->data, cut, out, archive->len, NULL, NULL, NULL) == INFLATE_OK) {
+            fail(name, "truncated stream accepted");
+            break;
+        }
+    }
+
+    if (gzip_inflate(gz->data, gz->len, out, archive->len / 2, NULL, NULL, NULL) != INFLATE_ERR_SPACE) {
+        fail(name, "small buffer not reported");
+    }
+
+    // Damage in the compressed data is caught, at the latest by the CRC
+    uint8_t* copy = malloc(gz->len);
+    for (uint32_t trial = 0; trial < 200; trial++) {
+        memcpy(copy, gz->data, gz->len);
+        size_t at = 10 + rng_next() % (gz->len - 18);
+        copy[at] ^= (uint8_t)(1 + rng_next() % 255);
+        if (gzip_inflate(copy, gz->len, out, archive->len, NULL, NULL, NULL) == INFLATE_OK) {
+            fail(name, "corrupt stream accepted");
+            break;
+        }
+    }
+    memcpy(copy, gz->data, gz->len);
+    copy[gz->len - 8] ^= 1;
+    if (gzip_inflate(copy, gz->len, out, archive->len, NULL, NULL, NULL) != INFLATE_ERR_CHECK) {
+        fail(name, "bad CRC not reported");
+    }
+    free(copy);
+    free(out);
+}
+
+// --- Filesystem ---
+
+static bool mount_image(const void* start, size_t size) {
+    initrd_source_t source = { .start = start, .size = size };
+    return vfs_mount("initrd", NULL, MOUNT_POINT, VFS_MOUNT_RDONLY, &source) == 0;
+}
+
+static void check_file(const char* name, size_t i) {
+    const entry_t* entry = &entries[i];
+    char path[128];
+    snprintf(path, sizeof(path), MOUNT_POINT "/%s", entry->path);
+
+    fs_stat_t stat;
+    if (fs_stat(path, &stat) != 0 || stat.type != VFS_TYPE_FILE || stat.size != entry->size) {
+        fail(name, path);
+        return;
+    }
+
+    uint8_t* expected = malloc(entry->size + 1);
+    uint8_t* data = malloc(entry->size + 1);
+    entry_fill(i, expected, entry->size);
+    file_t* file = fs_open(path, FS_O_RDONLY);
+    int got = file ? fs_read(file, data, entry->size + 1) : -1;
+    if (got != (int)entry->size || memcmp(data, expected, entry->size)) fail(name, path);
+    if (file && fs_write(file, "x", 1) >= 0) fail(name, "write to a read-only file");
+    if (file) fs_close(file);
+    free(expected);
+    free(data);
+}
+
+static uint32_t count_entries(const char* path) {
+    file_t* dir = fs_open(path, FS_O_RDONLY | FS_O_DIRECTORY);
+    if (!dir) return 0;
+    uint32_t count = 0;
+    fs_dirent_t dirent;
+    while (fs_readdir(dir, &dirent) == 1) count++;
+    fs_close(dir);
+    return count;
+}
+
+static void test_mount(const char* name, const buffer_t* image, bool compressed) {
+    if (!mount_image(image->data, image->len)) {
+        fail(name, "mount failed");
+        return;
+    }
+
+    for (size_t i = 0; i < ENTRY_COUNT; i++) {
+        if ((entries[i].mode & 0170000) == 0100000) check_file(name, i);
+    }
+
+    fs_stat_t stat;
+    if (fs_stat(MOUNT_POINT "/lib/link", &stat) == 0) fail(name, "symlink not skipped");
+    if (fs_stat(MOUNT_POINT "/deep/a/b/c", &stat) != 0 || stat.type != VFS_TYPE_DIR) fail(name, "implied directory");
+    if (fs_stat(MOUNT_POINT "/missing", &stat) != VFS_ERR_NOENT) fail(name, "lookup of a missing name");
+    if (fs_mkdir(MOUNT_POINT "/new") == 0) fail(name, "mkdir on a read-only mount");
+    // init dev bin etc empty deep: lib held only the symlink
+    if (count_entries(MOUNT_POINT) != 6) fail(name, "root entries");
+    if (fs_stat(MOUNT_POINT "/lib", &stat) == 0) fail(name, "directory of a skipped entry");
+
+    initrd_stats_t stats;
+    initrd_get_stats(&stats);
+    if (stats.files != 5 || stats.directories != 8 || stats.skipped != 1) fail(name, "entry counts");
+    if (stats.image_bytes != (compressed ? gzip_original_size(image->data, image->len) : image->len)) {
+        fail(name, "image size");
+    }
+    if ((stats.compressed_bytes != 0) != compressed) fail(name, "compressed size");
+
+    if (vfs_umount(MOUNT_POINT) != 0) fail(name, "umount");
+}
+
+static void test_mount_fails(const char* name, const void* start, size_t size) {
+    if (mount_image(start, size)) {
+        fail(name, "damaged image mounted");
+        vfs_umount(MOUNT_POINT);
+    }
+}
+
+static void test_bad_images(const buffer_t* archive, const buffer_t* gz) {
+    test_mount_fails("truncated gzip", gz->data, gz->len / 2);
+    test_mount_fails("truncated archive", archive->data, archive->len / 2);
+    test_mount_fails("garbage", "this is not an archive at all, not even close...........................................................................................", 128);
+
+    uint8_t* copy = malloc(gz->len);
+    memcpy(copy, gz->data, gz->len);
+    copy[gz->len / 2] ^= 0x55;
+    test_mount_fails("corrupt gzip", copy, gz->len);
+
+    // A trailer claiming less than the data inflates to
+    memcpy(copy, gz->data, gz->len);
+    copy[gz->len - 4] = 0x10;
+    copy[gz->len - 3] = 0;
+    copy[gz->len - 2] = 0;
+    copy[gz->len - 1] = 0;
+    test_mount_fails("short trailer size", copy, gz->len);
+    free(copy);
+
+    copy = malloc(archive->len);
+    memcpy(copy, archive->data, archive->len);
+    memcpy(copy + 112, "07X701", 6);    // Second header, after "."
+    test_mount_fails("bad header", copy, archive->len);
+    free(copy);
+
+    // Every failure left its mount slot free
+    for (int i = 0; i < 20; i++) {
+        test_mount_fails("repeated failure", gz->data, gz->len - 1);
+    }
+}
+
+int main(void) {
+    host_arch_reset(1);
+    process_init();
+    scheduler_init(SCHED_RR);
+    fs_init();
+    if (fs_mkdir(MOUNT_POINT) != 0) {
+        fprintf(stderr, "cannot make " MOUNT_POINT "\n");
+        return 1;
+    }
+
+    buffer_t archive = { 0 };
+    cpio_build(&archive);
+    test_mount("plain", &archive, false);
+
+    for (int level = 1; level <= 9; level += 8) {
+        buffer_t gz = { 0 };
+        if (!gzip_host(&archive, level, &gz)) {
+            fprintf(stderr, "gzip -%d failed\n", level);
+            return 1;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "gzip -%d", level);
+        printf("%-8s %zu -> %zu bytes\n", name, archive.len, gz.len);
+        test_inflate(name, &archive, &gz);
+        test_mount(name, &gz, true);
+        if (level == 9) test_bad_images(&archive, &gz);
+        free(gz.data);
+    }
+
+    free(archive.data);
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
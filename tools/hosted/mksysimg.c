@@ -0,0 +1,317 @@
+// Builds a read-only system image (kernel/fs/sysimg.h) from a directory
+// tree.
+//
+// Files are laid out breadth first with each directory's entries in name
+// order, so files that sit together in the tree sit together in the data
+// stream and small ones share blocks. Each 64 KB block is compressed with
+// a greedy LZ4 matcher and kept uncompressed if that does not make it
+// smaller; every block is decompressed again with the kernel's decoder
+// before the image is written.
+//
+//   mksysimg <directory> <image>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "fs/sysimg.h"
+#include "fs/vfs.h"
+#include "lz4.h"
+
+#define HASH_BITS       14
+#define MIN_MATCH       4
+#define MAX_OFFSET      65535
+#define LAST_LITERALS   5       // A block ends with at least this many literals
+#define MATCH_LIMIT     12      // No match starts closer than this to the end
+
+typedef struct {
+    char* path;
+    sysimg_inode_t inode;
+} node_t;
+
+typedef struct {
+    uint8_t* data;
+    size_t len;
+    size_t cap;
+} buffer_t;
+
+static node_t* nodes;
+static uint32_t node_count;
+static uint32_t node_cap;
+static sysimg_dirent_t* dirents;
+static uint32_t dirent_count;
+static uint32_t dirent_cap;
+static buffer_t names;
+static buffer_t stream;
+static uint32_t skipped;
+
+static void fail(const char* what, const char* path) {
+    fprintf(stderr, "mksysimg: %s%s%s\n", what, path ? ": " : "", path ? path : "");
+    exit(1);
+}
+
+static void* grow(void* array, uint32_t* cap, size_t size) {
+    *cap = *cap ? *cap * 2 : 64;
+    array = realloc(array, *cap * size);
+    if (!array) fail("out of memory", NULL);
+    return array;
+}
+
+static void append(buffer_t* buffer, const void* data, size_t len) {
+    if (buffer->len + len > buffer->cap) {
+        while (buffer->len + len > buffer->cap) buffer->cap = buffer->cap ? buffer->cap * 2 : 65536;
+        buffer->data = realloc(buffer->data, buffer->cap);
+        if (!buffer->data) fail("out of memory", NULL);
+    }
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+}
+
+static void pad8(buffer_t* buffer) {
+    static const uint8_t zero[8];
+    append(buffer, zero, (8 - buffer->len % 8) % 8);
+}
+
+// --- Tree walk ---
+
+static uint32_t add_node(char* path, uint32_t type) {
+    if (node_count == node_cap) nodes = grow(nodes, &node_cap, sizeof(node_t));
+    node_t* node = &nodes[node_count];
+    memset(node, 0, sizeof(node_t));
+    node->path = path;
+    node->inode.type = type;
+    return ++node_count;
+}
+
+static void add_file(node_t* node) {
+    FILE* file = fopen(node->path, "rb");
+    if (!file) fail("cannot open", node->path);
+    node->inode.start = stream.len;
+    uint8_t chunk[65536];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0) append(&stream, chunk, got);
+    if (ferror(file)) fail("cannot read", node->path);
+    fclose(file);
+    node->inode.size = stream.len - node->inode.start;
+}
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Give a directory its entries, which become nodes at the end of the list
+static void add_directory(uint32_t index) {
+    DIR* dir = opendir(nodes[index].path);
+    if (!dir) fail("cannot open", nodes[index].path);
+    char** entries = NULL;
+    uint32_t count = 0;
+    uint32_t cap = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
+        if (strlen(entry->d_name) > VFS_NAME_MAX) fail("name too long", entry->d_name);
+        if (count == cap) entries = grow(entries, &cap, sizeof(char*));
+        entries[count++] = strdup(entry->d_name);
+    }
+    closedir(dir);
+    qsort(entries, count, sizeof(char*), compare_names);
+
+    nodes[index].inode.start = dirent_count;
+    for (uint32_t i = 0; i < count; i++) {
+        size_t len = strlen(nodes[index].path) + strlen(entries[i]) + 2;
+        char* path = malloc(len);
+        snprintf(path, len, "%s/%s", nodes[index].path, entries[i]);
+
+        struct stat st;
+        uint32_t type = 0;
+        if (lstat(path, &st) == 0) {
+            if (S_ISREG(st.st_mode)) type = VFS_TYPE_FILE;
+            if (S_ISDIR(st.st_mode)) type = VFS_TYPE_DIR;
+        }
+        if (!type) {
+            fprintf(stderr, "mksysimg: skipping %s\n", path);
+            skipped++;
+            free(path);
+            free(entries[i]);
+            continue;
+        }
+
+        if (dirent_count == dirent_cap) dirents = grow(dirents, &dirent_cap, sizeof(sysimg_dirent_t));
+        sysimg_dirent_t* dirent = &dirents[dirent_count++];
+        dirent->ino = add_node(path, type);
+        dirent->name = (uint32_t)names.len;
+        dirent->name_len = (uint16_t)strlen(entries[i]);
+        dirent->type = (uint16_t)type;
+        append(&names, entries[i], dirent->name_len);
+        if (type == VFS_TYPE_FILE) add_file(&nodes[dirent->ino - 1]);
+        free(entries[i]);
+    }
+    nodes[index].inode.count = dirent_count - (uint32_t)nodes[index].inode.start;
+    free(entries);
+}
+
+// --- LZ4 ---
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, 4);
+    return value;
+}
+
+static inline uint32_t hash4(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static bool put_length(uint8_t** op, const uint8_t* oend, size_t len) {
+    for (; len >= 255; len -= 255) {
+        if (*op >= oend) return false;
+        *(*op)++ = 255;
+    }
+    if (*op >= oend) return false;
+    *(*op)++ = (uint8_t)len;
+    return true;
+}
+
+// One sequence; a match length of 0 ends the block after the literals
+static bool put_sequence(uint8_t** op, const uint8_t* oend, const uint8_t* literals, size_t literal_len,
+                         size_t offset, size_t match_len) {
+    if (*op >= oend) return false;
+    uint8_t* token = (*op)++;
+    *token = (uint8_t)((literal_len < 15 ? literal_len : 15) << 4);
+    if (literal_len >= 15 && !put_length(op, oend, literal_len - 15)) return false;
+    if ((size_t)(oend - *op) < literal_len) return false;
+    memcpy(*op, literals, literal_len);
+    *op += literal_len;
+    if (!match_len) return true;
+
+    if (oend - *op < 2) return false;
+    *(*op)++ = (uint8_t)offset;
+    *(*op)++ = (uint8_t)(offset >> 8);
+    size_t code = match_len - MIN_MATCH;
+    *token |= code < 15 ? code : 15;
+    return code < 15 || put_length(op, oend, code - 15);
+}
+
+// Returns the compressed length, 0 if it would not be smaller than len
+static size_t lz4_compress(const uint8_t* src, size_t len, uint8_t* dst) {
+    static uint32_t table[1 << HASH_BITS];     // Position + 1 of the last sighting
+    memset(table, 0, sizeof(table));
+    uint8_t* op = dst;
+    const uint8_t* oend = dst + len - 1;
+    size_t anchor = 0;
+    size_t pos = 0;
+    size_t match_end = len > LAST_LITERALS ? len - LAST_LITERALS : 0;
+    size_t search_end = len > MATCH_LIMIT ? len - MATCH_LIMIT : 0;
+
+    while (pos < search_end) {
+        uint32_t sequence = read32(src + pos);
+        uint32_t* slot = &table[hash4(sequence)];
+        size_t candidate = *slot;
+        *slot = (uint32_t)pos + 1;
+        if (!candidate || pos - (candidate - 1) > MAX_OFFSET || read32(src + candidate - 1) != sequence) {
+            // Step faster through data that keeps missing
+            pos += 1 + ((pos - anchor) >> 6);
+            continue;
+        }
+
+        size_t match = candidate - 1;
+        size_t match_len = MIN_MATCH;
+        while (pos + match_len < match_end && src[match + match_len] == src[pos + match_len]) match_len++;
+        while (pos > anchor && match > 0 && src[pos - 1] == src[match - 1]) {
+            pos--;
+            match--;
+            match_len++;
+        }
+        if (!put_sequence(&op, oend, src + anchor, pos - anchor, pos - match, match_len)) return 0;
+        pos += match_len;
+        anchor = pos;
+        if (pos - 2 < search_end) table[hash4(read32(src + pos - 2))] = (uint32_t)(pos - 2) + 1;
+    }
+    if (!put_sequence(&op, oend, src + anchor, len - anchor, 0, 0)) return 0;
+    return (size_t)(op - dst);
+}
+
+// --- Image ---
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: mksysimg <directory> <image>\n");
+        return 1;
+    }
+
+    // Breadth first: every directory's entries are appended as one run
+    add_node(strdup(argv[1]), VFS_TYPE_DIR);
+    for (uint32_t i = 0; i < node_count; i++) {
+        if (nodes[i].inode.type == VFS_TYPE_DIR) add_directory(i);
+    }
+
+    uint32_t block_count = (uint32_t)((stream.len + SYSIMG_BLOCK_SIZE - 1) >> SYSIMG_BLOCK_SHIFT);
+    sysimg_super_t super = {
+        .magic = SYSIMG_MAGIC,
+        .version = SYSIMG_VERSION,
+        .block_shift = SYSIMG_BLOCK_SHIFT,
+        .inode_count = node_count,
+        .dirent_count = dirent_count,
+        .block_count = block_count,
+        .data_size = stream.len,
+    };
+
+    buffer_t image = {0};
+    append(&image, &super, sizeof(super));
+    pad8(&image);
+    super.inode_offset = image.len;
+    for (uint32_t i = 0; i < node_count; i++) append(&image, &nodes[i].inode, sizeof(sysimg_inode_t));
+    pad8(&image);
+    super.dirent_offset = image.len;
+    append(&image, dirents, (size_t)dirent_count * sizeof(sysimg_dirent_t));
+    pad8(&image);
+    super.names_offset = image.len;
+    super.names_size = names.len;
+    append(&image, names.data, names.len);
+    pad8(&image);
+    super.index_offset = image.len;
+    sysimg_block_t* index = calloc(block_count ? block_count : 1, sizeof(sysimg_block_t));
+    append(&image, index, (size_t)block_count * sizeof(sysimg_block_t));
+
+    static uint8_t packed[SYSIMG_BLOCK_SIZE];
+    static uint8_t check[SYSIMG_BLOCK_SIZE];
+    uint32_t stored = 0;
+    for (uint32_t i = 0; i < block_count; i++) {
+        const uint8_t* raw = stream.data + ((size_t)i << SYSIMG_BLOCK_SHIFT);
+        size_t raw_len = stream.len - ((size_t)i << SYSIMG_BLOCK_SHIFT);
+        if (raw_len > SYSIMG_BLOCK_SIZE) raw_len = SYSIMG_BLOCK_SIZE;
+
+        size_t packed_len = lz4_compress(raw, raw_len, packed);
+        index[i].offset = image.len;
+        if (packed_len) {
+            int64_t produced = lz4_decompress(packed, packed_len, check, sizeof(check));
+            if (produced != (int64_t)raw_len || memcmp(check, raw, raw_len)) fail("block does not round-trip", NULL);
+            index[i].length = (uint32_t)packed_len;
+            append(&image, packed, packed_len);
+        } else {
+            index[i].length = (uint32_t)raw_len;
+            index[i].flags = SYSIMG_BLOCK_STORED;
+            append(&image, raw, raw_len);
+            stored++;
+        }
+    }
+    super.image_size = image.len;
+    memcpy(image.data, &super, sizeof(super));
+    memcpy(image.data + super.index_offset, index, (size_t)block_count * sizeof(sysimg_block_t));
+
+    FILE* out = fopen(argv[2], "wb");
+    if (!out || fwrite(image.data, 1, image.len, out) != image.len || fclose(out)) fail("cannot write", argv[2]);
+
+    uint32_t files = 0;
+    for (uint32_t i = 0; i < node_count; i++) files += nodes[i].inode.type == VFS_TYPE_FILE;
+    printf("%s: %u files, %u directories, %u skipped\n", argv[2], files, node_count - files, skipped);
+    printf("  data %zu bytes in %u blocks (%u stored), image %zu bytes (%.1f%%)\n",
+           stream.len, block_count, stored, image.len,
+           stream.len ? 100.0 * (double)image.len / (double)stream.len : 0.0);
+    return 0;
+}
@@ -0,0 +1,491 @@
+// Host-side scheduler simulator
+//
+// Runs kernel/core/scheduler.c and process.c against simulated CPUs and a
+// simulated clock, replays a workload and reports throughput, fairness and
+// latency percentiles.
+//
+//   schedsim [--cpus N] [--policy rr|priority] [--duration MS] [--seed N]
+//            [--trace FILE | --synthetic mixed|batch|interactive] [--tasks N]
+//            [--trace-out FILE]
+//
+// --trace-out enables the sched:* tracepoints and writes the recorded
+// events to FILE for tools/trace2json.py.
+//
+// Trace format, one task per line, '#' starts a comment:
+//   <arrival_us> <name> <priority 0-4> <affinity hex, 0 = default> <run_us> <sleep_us> <cycles>
+// A task alternates run_us of CPU work with sleep_us blocked, cycles times.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "host_arch.h"
+#include "scheduler.h"
+#include "process.h"
+#include "trace.h"
+
+#define MAX_SIM_TASKS 4096
+#define NS_PER_US 1000ULL
+#define NS_PER_MS 1000000ULL
+
+typedef struct {
+    char name[32];
+    uint64_t arrival_ns;
+    uint64_t run_ns;
+    uint64_t sleep_ns;
+    uint32_t cycles;
+    process_priority_t priority;
+    uint64_t affinity;
+    uint32_t jitter_pct;            // Random +/- variation of each burst
+
+    // Simulation state
+    process_control_block_t* pcb;
+    uint64_t pid;
+    uint64_t remaining_ns;          // Work left in the current burst
+    uint64_t wake_ns;               // Wake time while sleeping, 0 otherwise
+    uint32_t cycles_done;
+    uint64_t cpu_ns;
+    uint64_t finish_ns;
+    bool started;
+    bool finished;
+    sched_latency_stats_t stats;    // Snapshot taken when the task exits
+} sim_task_t;
+
+static sim_task_t tasks[MAX_SIM_TASKS];
+static uint32_t task_count = 0;
+static sim_task_t* pid_to_task[MAX_SIM_TASKS + 1];
+static uint64_t busy_ns[MAX_CPUS];
+static uint64_t timer_interrupts = 0;
+static uint64_t bursts_completed = 0;
+static uint64_t rng_state = 1;
+
+static uint64_t rng_next(void) {
+    rng_state = rng_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return rng_state >> 33;
+}
+
+static uint64_t rng_range(uint64_t lo, uint64_t hi) {
+    return hi > lo ? lo + rng_next() % (hi - lo + 1) : lo;
+}
+
+static uint64_t burst_length(const sim_task_t* task, uint64_t base) {
+    if (!task->jitter_pct || !base) return base;
+    uint64_t spread = base * task->jitter_pct / 100;
+    return rng_range(base - spread, base + spread);
+}
+
+static sim_task_t* add_task(const char* name, uint64_t arrival_ns, process_priority_t priority,
+                            uint64_t affinity, uint64_t run_ns, uint64_t sleep_ns, uint32_t cycles) {
+    if (task_count >= MAX_SIM_TASKS) return NULL;
+    sim_task_t* task = &tasks[task_count++];
+    memset(task, 0, sizeof(*task));
+    snprintf(task->name, sizeof(task->name), "%s", name);
+    task->arrival_ns = arrival_ns;
+    task->priority = priority;
+    task->affinity = affinity;
+    task->run_ns = run_ns ? run_ns : NS_PER_US;
+    task->sleep_ns = sleep_ns;
+    task->cycles = cycles ? cycles : 1;
+    return task;
+}
+
+static bool load_trace(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+
+    char line[256];
+    uint32_t line_no = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_no++;
+        char* comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+
+        uint64_t arrival_us, affinity, run_us, sleep_us;
+        unsigned priority, cycles;
+        char name[32];
+        int fields = sscanf(line, "%" SCNu64 " %31s %u %" SCNx64 " %" SCNu64 " %" SCNu64 " %u",
+                            &arrival_us, name, &priority, &affinity, &run_us, &sleep_us, &cycles);
+        if (fields <= 0) continue;
+        if (fields != 7 || priority > PRIORITY_REALTIME) {
+            fprintf(stderr, "%s:%u: malformed task line\n", path, line_no);
+            fclose(file);
+            return false;
+        }
+        add_task(name, arrival_us * NS_PER_US, (process_priority_t)priority, affinity,
+                 run_us * NS_PER_US, sleep_us * NS_PER_US, cycles);
+    }
+
+    fclose(file);
+    return true;
+}
+
+static void add_batch(uint32_t count, uint64_t duration_ns) {
+    for (uint32_t i = 0; i < count; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "batch%u", i);
+        uint64_t run = rng_range(20, 80) * NS_PER_MS;
+        sim_task_t* task = add_task(name, rng_range(0, 10) * NS_PER_MS,
+                                    (i % 4 == 0) ? PRIORITY_LOW : PRIORITY_NORMAL, 0,
+                                    run, 0, (uint32_t)(duration_ns / run / 2 + 1));
+        if (task) task->jitter_pct = 25;
+    }
+}
+
+static void add_interactive(uint32_t count, uint64_t duration_ns) {
+    for (uint32_t i = 0; i < count; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "interactive%u", i);
+        uint64_t run = rng_range(200, 2000) * NS_PER_US;
+        uint64_t sleep = rng_range(5, 16) * NS_PER_MS;
+        sim_task_t* task = add_task(name, rng_range(0, 10) * NS_PER_MS,
+                                    (i % 3 == 0) ? PRIORITY_HIGH : PRIORITY_NORMAL, 0,
+                                    run, sleep, (uint32_t)(duration_ns / (run + sleep) + 1));
+        if (task) task->jitter_pct = 50;
+    }
+}
+
+// Compositor at 60 fps pinned to core 0, an audio thread, and background load
+static void add_mixed(uint32_t count, uint64_t duration_ns) {
+    uint64_t frame = 16667 * NS_PER_US;
+    sim_task_t* ui = add_task("ui", 0, PRIORITY_HIGH, SCHED_RESERVED_CPUS,
+                              4 * NS_PER_MS, frame - 4 * NS_PER_MS, (uint32_t)(duration_ns / frame));
+    if (ui) ui->jitter_pct = 30;
+    add_task("audio", 0, PRIORITY_REALTIME, 0, 500 * NS_PER_US, 4500 * NS_PER_US,
+             (uint32_t)(duration_ns / (5 * NS_PER_MS)));
+    uint32_t rest = count > 2 ? count - 2 : 0;
+    add_batch(rest / 2, duration_ns);
+    add_interactive(rest - rest / 2, duration_ns);
+}
+
+static sim_task_t* current_task(uint32_t cpu) {
+    host_cpu = cpu;
+    process_control_block_t* pcb = scheduler_get_current();
+    return pcb && pcb->pid <= MAX_SIM_TASKS ? pid_to_task[pcb->pid] : NULL;
+}
+
+static void spawn(sim_task_t* task) {
+    host_cpu = 0;
+    int pid = process_create(NULL, 4096);
+    if (pid <= 0 || pid > MAX_SIM_TASKS) {
+        fprintf(stderr, "schedsim: process_create failed for %s\n", task->name);
+        exit(1);
+    }
+
+    process_control_block_t* pcb = process_get((uint64_t)pid);
+    if (snprintf(pcb->name, sizeof(pcb->name), "%s", task->name) >= (int)sizeof(pcb->name)) {
+        fprintf(stderr, "schedsim: task name %s truncated\n", task->name);
+    }
+    scheduler_set_priority(pcb, task->priority);
+    // Workload tasks have no parent: don't inherit from whatever runs on CPU 0
+    scheduler_set_affinity(pcb, task->affinity ? task->affinity : scheduler_get_default_affinity());
+
+    task->pcb = pcb;
+    task->pid = (uint64_t)pid;
+    task->started = true;
+    task->remaining_ns = burst_length(task, task->run_ns);
+    pid_to_task[pid] = task;
+}
+
+// Current burst on this CPU finished: sleep, continue, or exit
+static void burst_done(uint32_t cpu, sim_task_t* task) {
+    host_cpu = cpu;
+    bursts_completed++;
+    task->cycles_done++;
+
+    if (task->cycles_done >= task->cycles) {
+        task->finished = true;
+        task->finish_ns = host_now_ns;
+        scheduler_get_task_stats(task->pcb, &task->stats);
+        pid_to_task[task->pid] = NULL;
+        process_destroy((int)task->pid);
+        process_put(task->pcb);
+        task->pcb = NULL;
+        scheduler_schedule();
+        return;
+    }
+
+    task->remaining_ns = burst_length(task, task->run_ns);
+    if (task->sleep_ns) {
+        task->wake_ns = host_now_ns + burst_length(task, task->sleep_ns);
+        scheduler_block();
+    }
+}
+
+static void deliver_ipis(void) {
+    bool pending = true;
+    while (pending) {
+        pending = false;
+        for (uint32_t cpu = 0; cpu < host_cpus; cpu++) {
+            if (!host_ipi_pending[cpu]) continue;
+            host_ipi_pending[cpu] = false;
+            host_cpu = cpu;
+            scheduler_ipi();
+            scheduler_schedule();
+            pending = true;
+        }
+    }
+}
+
+// What each CPU's idle loop does between events
+static void run_idle_loops(void) {
+    for (uint32_t cpu = 0; cpu < host_cpus; cpu++) {
+        host_cpu = cpu;
+        scheduler_schedule();
+        if (!scheduler_get_current()) {
+            scheduler_idle();
+            scheduler_schedule();
+        }
+    }
+    deliver_ipis();
+}
+
+static void simulate(uint64_t duration_ns) {
+    uint64_t iterations = 0;
+
+    while (host_now_ns < duration_ns) {
+        if (++iterations > 100000000ULL) {
+            fprintf(stderr, "schedsim: no forward progress, stopping\n");
+            break;
+        }
+
+        // Next event
+        uint64_t next = duration_ns;
+        bool live = false;
+        for (uint32_t i = 0; i < task_count; i++) {
+            sim_task_t* task = &tasks[i];
+            if (task->finished) continue;
+            live = true;
+            if (!task->started && task->arrival_ns < next) next = task->arrival_ns;
+            if (task->wake_ns && task->wake_ns < next) next = task->wake_ns;
+        }
+        if (!live) break;
+
+        sim_task_t* running[MAX_CPUS];
+        for (uint32_t cpu = 0; cpu < host_cpus; cpu++) {
+            running[cpu] = current_task(cpu);
+            if (running[cpu] && host_now_ns + running[cpu]->remaining_ns < next) {
+                next = host_now_ns + running[cpu]->remaining_ns;
+            }
+            if (host_timer_deadline[cpu] < next) {
+                next = host_timer_deadline[cpu] > host_now_ns ? host_timer_deadline[cpu] : host_now_ns;
+            }
+        }
+
+        // Advance the clock, charging work to running tasks
+        uint64_t elapsed = next - host_now_ns;
+        for (uint32_t cpu = 0; cpu < host_cpus; cpu++) {
+            sim_task_t* task = running[cpu];
+            if (!task) continue;
+            uint64_t used = elapsed < task->remaining_ns ? elapsed : task->remaining_ns;
+            task->remaining_ns -= used;
+            task->cpu_ns += used;
+            busy_ns[cpu] += used;
+        }
+        host_now_ns = next;
+
+        for (uint32_t i = 0; i < task_count; i++) {
+            sim_task_t* task = &tasks[i];
+            if (!task->started && task->arrival_ns <= host_now_ns) {
+                spawn(task);
+            }
+            if (task->wake_ns && task->wake_ns <= host_now_ns) {
+                task->wake_ns = 0;
+                host_cpu = task->pcb->cpu;
+                scheduler_wakeup(task->pcb);
+            }
+        }
+        deliver_ipis();
+
+        for (uint32_t cpu = 0; cpu < host_cpus; cpu++) {
+            if (running[cpu] && running[cpu]->remaining_ns == 0 && current_task(cpu) == running[cpu]) {
+                burst_done(cpu, running[cpu]);
+            }
+        }
+
+        for (uint32_t cpu = 0; cpu < host_cpus; cpu++) {
+            if (host_timer_deadline[cpu] <= host_now_ns) {
+                host_timer_deadline[cpu] = HOST_TIMER_OFF;
+                host_cpu = cpu;
+                timer_interrupts++;
+                scheduler_tick();
+                scheduler_schedule();
+            }
+        }
+        deliver_ipis();
+
+        run_idle_loops();
+    }
+
+    // Snapshot tasks still alive at the end
+    for (uint32_t i = 0; i < task_count; i++) {
+        if (tasks[i].pcb) scheduler_get_task_stats(tasks[i].pcb, &tasks[i].stats);
+    }
+}
+
+static void print_histogram(const char* label, const sched_histogram_t* hist) {
+    if (!hist->count) {
+        printf("    %-14s %10s\n", label, "-");
+        return;
+    }
+    printf("    %-14s %10" PRIu64 " %10.1f %10.1f %10.1f %10.1f %10.1f\n", label, hist->count,
+           hist->total_ns / 1000.0 / hist->count,
+           sched_histogram_percentile(hist, 50) / 1000.0,
+           sched_histogram_percentile(hist, 90) / 1000.0,
+           sched_histogram_percentile(hist, 99) / 1000.0,
+           hist->max_ns / 1000.0);
+}
+
+// Jain's fairness index over the CPU share each task received while alive
+static double fairness(bool cpu_bound_only) {
+    double sum = 0, sum_sq = 0;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < task_count; i++) {
+        sim_task_t* task = &tasks[i];
+        if (!task->started || (cpu_bound_only && task->sleep_ns)) continue;
+        uint64_t end = task->finished ? task->finish_ns : host_now_ns;
+        if (end <= task->arrival_ns) continue;
+        double share = (double)task->cpu_ns / (double)(end - task->arrival_ns);
+        sum += share;
+        sum_sq += share * share;
+        n++;
+    }
+    return n && sum_sq > 0 ? (sum * sum) / (n * sum_sq) : 1.0;
+}
+
+static void report(const char* workload, const char* policy) {
+    static const char* priority_names[] = { "idle", "low", "normal", "high", "realtime" };
+    double seconds = host_now_ns / 1e9;
+    uint32_t finished = 0;
+    for (uint32_t i = 0; i < task_count; i++) {
+        if (tasks[i].finished) finished++;
+    }
+
+    printf("schedsim: %s workload, %u tasks, %u CPUs, %s policy, %.3f s simulated\n",
+           workload, task_count, host_cpus, policy, seconds);
+    printf("throughput: %u tasks completed, %.1f bursts/s\n",
+           finished, seconds > 0 ? bursts_completed / seconds : 0.0);
+
+    printf("utilization:");
+    for (uint32_t cpu = 0; cpu < host_cpus; cpu++) {
+        printf(" cpu%u %.1f%%", cpu, host_now_ns ? 100.0 * busy_ns[cpu] / host_now_ns : 0.0);
+    }
+    printf("\n");
+
+    printf("fairness (Jain): cpu-bound %.3f, all tasks %.3f\n", fairness(true), fairness(false));
+    printf("timer: %" PRIu64 " interrupts (%.1f per CPU-second), %" PRIu64 " programs, "
+           "%" PRIu64 " idle entries, %" PRIu64 " IPIs\n",
+           timer_interrupts, seconds > 0 ? timer_interrupts / seconds / host_cpus : 0.0,
+           host_timer_programs, host_idle_entries, host_ipis_sent);
+
+    printf("latency by priority (us)      count       mean        p50        p90        p99        max\n");
+    for (uint32_t prio = 0; prio <= PRIORITY_REALTIME; prio++) {
+        sched_latency_stats_t stats;
+        scheduler_get_priority_stats((process_priority_t)prio, &stats);
+        if (!stats.time_slice.count && !stats.runqueue_wait.count) continue;
+        printf("  %s\n", priority_names[prio]);
+        print_histogram("wakeup-to-run", &stats.wakeup_latency);
+        print_histogram("runqueue wait", &stats.runqueue_wait);
+        print_histogram("time slice", &stats.time_slice);
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: schedsim [--cpus N] [--policy rr|priority] [--duration MS] [--seed N]\n"
+            "                [--trace FILE | --synthetic mixed|batch|interactive] [--tasks N]\n"
+            "                [--trace-out FILE]\n");
+    exit(2);
+}
+
+static FILE* trace_file;
+
+static size_t write_trace(const char* buf, size_t len) {
+    return fwrite(buf, 1, len, trace_file);
+}
+
+int main(int argc, char** argv) {
+    uint32_t cpus = 4;
+    uint32_t count = 32;
+    uint64_t duration_ns = 10000 * NS_PER_MS;
+    const char* policy = "rr";
+    const char* trace = NULL;
+    const char* synthetic = "mixed";
+    const char* trace_out = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!value) usage();
+        if (!strcmp(arg, "--cpus")) {
+            cpus = (uint32_t)atoi(value);
+        } else if (!strcmp(arg, "--policy")) {
+            policy = value;
+        } else if (!strcmp(arg, "--duration")) {
+            duration_ns = strtoull(value, NULL, 10) * NS_PER_MS;
+        } else if (!strcmp(arg, "--seed")) {
+            rng_state = strtoull(value, NULL, 10);
+        } else if (!strcmp(arg, "--trace")) {
+            trace = value;
+        } else if (!strcmp(arg, "--synthetic")) {
+            synthetic = value;
+        } else if (!strcmp(arg, "--trace-out")) {
+            trace_out = value;
+        } else if (!strcmp(arg, "--tasks")) {
+            count = (uint32_t)atoi(value);
+        } else {
+            usage();
+        }
+        i++;
+    }
+
+    scheduler_policy_t sched_policy;
+    if (!strcmp(policy, "rr")) {
+        sched_policy = SCHED_RR;
+    } else if (!strcmp(policy, "priority")) {
+        sched_policy = SCHED_PRIORITY;
+    } else {
+        usage();
+    }
+
+    host_arch_reset(cpus);
+    process_init();
+    scheduler_init(sched_policy);
+    trace_init();
+    if (trace_out) {
+        trace_file = fopen(trace_out, "w");
+        if (!trace_file) {
+            perror(trace_out);
+            return 1;
+        }
+        trace_set_enabled("sched:*", true);
+    }
+
+    if (trace) {
+        if (!load_trace(trace)) return 1;
+    } else if (!strcmp(synthetic, "mixed")) {
+        add_mixed(count, duration_ns);
+    } else if (!strcmp(synthetic, "batch")) {
+        add_batch(count, duration_ns);
+    } else if (!strcmp(synthetic, "interactive")) {
+        add_interactive(count, duration_ns);
+    } else {
+        usage();
+    }
+
+    simulate(duration_ns);
+    report(trace ? trace : synthetic, policy);
+
+    if (trace_file) {
+        trace_stats_t stats;
+        trace_get_stats(&stats);
+        trace_export(write_trace);
+        fclose(trace_file);
+        printf("\ntrace: %" PRIu64 " events recorded, %" PRIu64 " lost -> %s\n",
+               stats.recorded, stats.lost, trace_out);
+    }
+    return 0;
+}
@@ -0,0 +1,389 @@
+// Correctness check of the LZ4 decoder (kernel/lib/lz4.c) and the system
+// image filesystem (kernel/fs/sysimg.c) on images built by mksysimg.
+//
+// Lays out a directory tree of compressible, incompressible, empty and
+// many small files, runs mksysimg over it and mounts the result. Every
+// file must read back whole and at random offsets across block edges,
+// directories must list in name order, and mounting must decompress
+// nothing. The decoder is then fed every block of the image cut short,
+// squeezed and corrupted, and the image itself damaged: all of it must
+// fail cleanly.
+//
+//   sysimgtest
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "host_arch.h"
+#include "scheduler.h"
+#include "process.h"
+#include "fs.h"
+#include "fs/sysimg.h"
+#include "lz4.h"
+
+#define MOUNT_POINT     "/system"
+#define MANY_FILES      150
+#define RANDOM_READS    300
+
+typedef enum {
+    CONTENT_TEXT,               // Compresses well
+    CONTENT_NOISE,              // Does not: stored blocks
+} content_t;
+
+typedef struct {
+    char path[64];
+    size_t size;
+    content_t content;
+} entry_t;
+
+static entry_t entries[MANY_FILES + 16];
+static uint32_t entry_count;
+
+static uint32_t failures;
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static void fail(const char* what, const char* detail) {
+    if (failures++ < 20) fprintf(stderr, "FAIL %s: %s\n", what, detail);
+}
+
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static void entry_add(const char* path, size_t size, content_t content) {
+    entry_t* entry = &entries[entry_count++];
+    snprintf(entry->path, sizeof(entry->path), "%s", path);
+    entry->size = size;
+    entry->content = content;
+}
+
+// Contents of entry i, the same every time
+static void entry_fill(uint32_t i, uint8_t* data) {
+    const entry_t* entry = &entries[i];
+    uint64_t state = 0x2545F4914F6CDD1DULL * (i + 1);
+    for (size_t pos = 0; pos < entry->size; pos++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        if (entry->content == CONTENT_NOISE) {
+            data[pos] = (uint8_t)state;
+        } else if (pos >= 64 && state % 4) {
+            data[pos] = data[pos - 1 - (state >> 8) % 64];
+        } else {
+            data[pos] = (uint8_t)("<svg path=\"M0 0L1 1\"/>\n"[state % 23]);
+        }
+    }
+}
+
+static bool tree_write(const char* root) {
+    for (uint32_t i = 0; i < entry_count; i++) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%s", root, entries[i].path);
+        for (char* slash = strchr(path + strlen(root) + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+            *slash = '\0';
+            mkdir(path, 0755);
+            *slash = '/';
+        }
+
+        uint8_t* data = malloc(entries[i].size + 1);
+        entry_fill(i, data);
+        FILE* file = fopen(path, "wb");
+        bool ok = file && fwrite(data, 1, entries[i].size, file) == entries[i].size;
+        if (file) fclose(file);
+        free(data);
+        if (!ok) return false;
+    }
+    return true;
+}
+
+static uint8_t* image_build(size_t* size) {
+    char root[] = "/tmp/sysimgtest-XXXXXX";
+    if (!mkdtemp(root)) return NULL;
+    char image_path[300];
+    snprintf(image_path, sizeof(image_path), "%s.img", root);
+
+    char command[700];
+    snprintf(command, sizeof(command), "%s %s %s > /dev/null", MKSYSIMG, root, image_path);
+    uint8_t* image = NULL;
+    if (tree_write(root) && system(command) == 0) {
+        FILE* file = fopen(image_path, "rb");
+        if (file) {
+            fseek(file, 0, SEEK_END);
+            *size = (size_t)ftell(file);
+            fseek(file, 0, SEEK_SET);
+            image = malloc(*size);
+            if (fread(image, 1, *size, file) != *size) {
+                free(image);
+                image = NULL;
+            }
+            fclose(file);
+        }
+    }
+
+    snprintf(command, sizeof(command), "rm -rf %s %s", root, image_path);
+    if (system(command) != 0) fprintf(stderr, "could not remove %s\n", root);
+    return image;
+}
+
+// --- Filesystem ---
+
+static bool mount_image(const void* start, size_t size) {
+    sysimg_source_t source = { .start = start, .size = size };
+    return vfs_mount("sysimg", NULL, MOUNT_POINT, VFS_MOUNT_RDONLY, &source) == 0;
+}
+
+static void check_file(uint32_t i) {
+    const entry_t* entry = &entries[i];
+    char path[128];
+    snprintf(path, sizeof(path), MOUNT_POINT "/%s", entry->path);
+
+    fs_stat_t stat;
+    if (fs_stat(path, &stat) != 0 || stat.type != VFS_TYPE_FILE || stat.size != entry->size) {
+        fail("stat", path);
+        return;
+    }
+
+    uint8_t* expected = malloc(entry->size + 1);
+    uint8_t* data = malloc(entry->size + 1);
+    entry_fill(i, expected);
+    file_t* file = fs_open(path, FS_O_RDONLY);
+    if (!file) {
+        fail("open", path);
+    } else {
+        int got = fs_read(file, data, entry->size + 1);
+        if (got != (int)entry->size || memcmp(data, expected, entry->size)) fail("read", path);
+        for (uint32_t n = 0; entry->size && n < RANDOM_READS / 10; n++) {
+            uint64_t offset = rng_next() % entry->size;
+            uint64_t len = 1 + rng_next() % (2 * SYSIMG_BLOCK_SIZE);
+            if (len > entry->size - offset) len = entry->size - offset;
+            got = fs_pread(file, data, len, offset);
+            if (got != (int)len || memcmp(data, expected + offset, len)) {
+                fail("pread", path);
+                break;
+            }
+        }
+        if (fs_write(file, "x", 1) >= 0) fail("write to a read-only file", path);
+        fs_close(file);
+    }
+    free(expected);
+    free(data);
+}
+
+// Entries in order, by memcmp and then length like the lookup
+static void check_dir(const char* path, uint32_t expected) {
+    file_t* dir = fs_open(path, FS_O_RDONLY | FS_O_DIRECTORY);
+    if (!dir) {
+        fail("open directory", path);
+        return;
+    }
+    uint32_t count = 0;
+    fs_dirent_t dirent;
+    char prev[VFS_NAME_MAX + 1] = "";
+    size_t prev_len = 0;
+    while (fs_readdir(dir, &dirent) == 1) {
+        size_t common = prev_len < dirent.name_len ? prev_len : dirent.name_len;
+        int order = memcmp(prev, dirent.name, common);
+        if (count && (order > 0 || (order == 0 && prev_len >= dirent.name_len))) fail("directory order", path);
+        memcpy(prev, dirent.name, dirent.name_len);
+        prev_len = dirent.name_len;
+        count++;
+    }
+    fs_close(dir);
+    if (count != expected) fail("directory entries", path);
+}
+
+static void test_mount(const uint8_t* image, size_t size) {
+    sysimg_stats_t before;
+    sysimg_get_stats(&before);
+    if (!mount_image(image, size)) {
+        fail("mount", "built image");
+        return;
+    }
+
+    // Walking the tree touches no data block
+    fs_stat_t stat;
+    for (uint32_t i = 0; i < entry_count; i++) {
+        char path[128];
+        snprintf(path, sizeof(path), MOUNT_POINT "/%s", entries[i].path);
+        if (fs_stat(path, &stat) != 0) fail("stat", path);
+    }
+    check_dir(MOUNT_POINT, 3);
+    check_dir(MOUNT_POINT "/ui", 5);
+    check_dir(MOUNT_POINT "/ui/many", MANY_FILES);
+    sysimg_stats_t after;
+    sysimg_get_stats(&after);
+    if (after.bytes_decompressed != before.bytes_decompressed) fail("mount", "decompressed data up front");
+
+    for (uint32_t i = 0; i < entry_count; i++) check_file(i);
+    if (fs_stat(MOUNT_POINT "/ui/abc", &stat) != VFS_ERR_NOENT) fail("lookup", "missing name found");
+    if (fs_stat(MOUNT_POINT "/ui/a/x", &stat) == 0) fail("lookup", "file used as a directory");
+    if (fs_mkdir(MOUNT_POINT "/new") == 0) fail("mkdir", "on a read-only mount");
+
+    sysimg_get_stats(&after);
+    if (after.block_misses == before.block_misses || !after.cached_blocks) fail("stats", "block cache unused");
+    if (vfs_umount(MOUNT_POINT) != 0) fail("umount", "built image");
+}
+
+// --- Decoder ---
+
+static void test_decoder(const uint8_t* image) {
+    const sysimg_super_t* super = (const sysimg_super_t*)image;
+    const sysimg_block_t* index = (const sysimg_block_t*)(image + super->index_offset);
+    uint32_t compressed = 0;
+    uint32_t stored = 0;
+
+    for (uint32_t block = 0; block < super->block_count; block++) {
+        const sysimg_block_t* entry = &index[block];
+        if (entry->flags & SYSIMG_BLOCK_STORED) {
+            stored++;
+            continue;
+        }
+        compressed++;
+        uint64_t start = (uint64_t)block << SYSIMG_BLOCK_SHIFT;
+        size_t expect = super->data_size - start < SYSIMG_BLOCK_SIZE ? super->data_size - start : SYSIMG_BLOCK_SIZE;
+        const uint8_t* in = image + entry->offset;
+
+        // Exactly sized buffers, so any overrun is caught by the sanitizers
+        uint8_t* out = malloc(expect);
+        if (lz4_decompress(in, entry->length, out, expect) != (int64_t)expect) fail("lz4", "block did not decode");
+        if (lz4_decompress(in, entry->length, out, expect - 1) != LZ4_ERR_DATA) fail("lz4", "short buffer accepted");
+        for (size_t cut = 0; cut < entry->length; cut += 1 + cut / 5) {
+            if (lz4_decompress(in, cut, out, expect) == (int64_t)expect) {
+                fail("lz4", "truncated block decoded whole");
+                break;
+            }
+        }
+
+        uint8_t* copy = malloc(entry->length);
+        for (uint32_t trial = 0; trial < 100; trial++) {
+            memcpy(copy, in, entry->length);
+            copy[rng_next() % entry->length] ^= (uint8_t)(1 + rng_next() % 255);
+            int64_t produced = lz4_decompress(copy, entry->length, out, expect);
+            if (produced != LZ4_ERR_DATA && (produced < 0 || produced > (int64_t)expect)) fail("lz4", "bad result");
+        }
+        free(copy);
+        free(out);
+    }
+    if (!compressed || !stored) fail("lz4", "image lacks compressed or stored blocks");
+
+    // A match reaching before the output, and one with offset 0
+    uint8_t out[64];
+    static const uint8_t before_start[] = { 0x14, 'a', 0x05, 0x00, 0x10, 'b' };
+    static const uint8_t zero_offset[] = { 0x14, 'a', 0x00, 0x00, 0x10, 'b' };
+    static const uint8_t long_literals[] = { 0xF0, 0xFF, 0x10, 'a', 'b' };
+    static const uint8_t valid[] = { 0x14, 'a', 0x01, 0x00, 0x10, 'b' };
+    if (lz4_decompress(before_start, sizeof(before_start), out, sizeof(out)) != LZ4_ERR_DATA) fail("lz4", "offset past start");
+    if (lz4_decompress(zero_offset, sizeof(zero_offset), out, sizeof(out)) != LZ4_ERR_DATA) fail("lz4", "zero offset");
+    if (lz4_decompress(long_literals, sizeof(long_literals), out, sizeof(out)) != LZ4_ERR_DATA) fail("lz4", "literals past input");
+    if (lz4_decompress(valid, sizeof(valid), out, sizeof(out)) != 10 || memcmp(out, "aaaaaaaaab", 10)) fail("lz4", "overlapping match");
+}
+
+// --- Damaged images ---
+
+static void read_all_files(void) {
+    uint8_t* data = malloc(512 * 1024);
+    for (uint32_t i = 0; i < entry_count; i++) {
+        char path[128];
+        snprintf(path, sizeof(path), MOUNT_POINT "/%s", entries[i].path);
+        file_t* file = fs_open(path, FS_O_RDONLY);
+        if (!file) continue;
+        fs_read(file, data, 512 * 1024);
+        fs_close(file);
+    }
+    free(data);
+}
+
+static void test_damage(const uint8_t* image, size_t size) {
+    uint8_t* copy = malloc(size);
+    sysimg_super_t* super = (sysimg_super_t*)copy;
+
+    memcpy(copy, image, size);
+    super->magic ^= 1;
+    if (mount_image(copy, size)) fail("damage", "bad magic mounted");
+    if (mount_image(image, size - 1)) fail("damage", "truncated image mounted");
+
+    memcpy(copy, image, size);
+    super->block_count++;
+    if (mount_image(copy, size)) fail("damage", "block count mismatch mounted");
+
+    memcpy(copy, image, size);
+    super->index_offset = size;
+    if (mount_image(copy, size)) fail("damage", "index past the end mounted");
+
+    // Bad blocks only fail the reads that reach them
+    memcpy(copy, image, size);
+    sysimg_block_t* index = (sysimg_block_t*)(copy + super->index_offset);
+    index[0].offset = size;
+    for (uint32_t block = 1; block < super->block_count; block++) {
+        if (index[block].flags & SYSIMG_BLOCK_STORED) index[block].length--;
+        else copy[index[block].offset + rng_next() % index[block].length] ^= 0x5A;
+    }
+    if (!mount_image(copy, size)) {
+        fail("damage", "image with bad blocks did not mount");
+    } else {
+        char path[128];
+        snprintf(path, sizeof(path), MOUNT_POINT "/%s", entries[0].path);
+        file_t* file = fs_open(path, FS_O_RDONLY);
+        uint8_t byte;
+        if (!file || fs_read(file, &byte, 1) >= 0) fail("damage", "read of an unreachable block");
+        if (file) fs_close(file);
+        read_all_files();
+        if (vfs_umount(MOUNT_POINT) != 0) fail("damage", "umount");
+    }
+    free(copy);
+
+    // Still mountable after all that
+    if (!mount_image(image, size)) fail("damage", "remount");
+    else vfs_umount(MOUNT_POINT);
+}
+
+int main(void) {
+    // The first file in the data stream sits in block 0
+    entry_add("apps/clock/app.bin", 200000, CONTENT_TEXT);
+    entry_add("apps/clock/icon.svg", 3000, CONTENT_TEXT);
+    entry_add("apps/noise.dat", 150000, CONTENT_NOISE);
+    entry_add("ui/empty", 0, CONTENT_TEXT);
+    entry_add("ui/a", 1, CONTENT_TEXT);
+    entry_add("ui/ab", 2, CONTENT_TEXT);
+    entry_add("ui/b", 70000, CONTENT_NOISE);
+    entry_add("deep/x/y/z/leaf", 12, CONTENT_TEXT);
+    for (uint32_t i = 0; i < MANY_FILES; i++) {
+        char path[64];
+        snprintf(path, sizeof(path), "ui/many/icon-%03u.svg", (i * 37) % MANY_FILES);
+        entry_add(path, rng_next() % 3000, CONTENT_TEXT);
+    }
+
+    size_t size = 0;
+    uint8_t* image = image_build(&size);
+    if (!image) {
+        fprintf(stderr, "could not build an image with %s\n", MKSYSIMG);
+        return 1;
+    }
+    printf("image: %u files, %zu bytes\n", entry_count, size);
+
+    host_arch_reset(1);
+    process_init();
+    scheduler_init(SCHED_RR);
+    fs_init();
+    if (fs_mkdir(MOUNT_POINT) != 0) {
+        fprintf(stderr, "cannot make " MOUNT_POINT "\n");
+        return 1;
+    }
+
+    test_mount(image, size);
+    test_decoder(image);
+    test_damage(image, size);
+    free(image);
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,213 @@
+// Scaling and correctness check of the kernel timer subsystem
+// (kernel/core/timer.c) on one simulated CPU.
+//
+// Arms N wheel timeouts spread over up to an hour plus a set of
+// high-resolution timers, cancels a share of them, then runs simulated
+// time forward one programmed event at a time. Every surviving timer must
+// fire exactly once, never early, wheel timers within one tick and
+// hrtimers on their exact nanosecond.
+//
+//   timerbench [--timers N] [--hrtimers N] [--cancel PERCENT] [--max-ms N] [--seed N]
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "host_arch.h"
+#include "scheduler.h"
+#include "process.h"
+#include "timer.h"
+
+#define PERIODIC_NS      7000000ULL     // Self re-arming timer period
+#define PERIODIC_COUNT   50
+
+typedef struct {
+    timer_list_t timer;
+    hrtimer_t hrtimer;
+    uint64_t expires_ns;
+    uint32_t fired;
+    bool cancelled;
+} entry_t;
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+static uint32_t failures;
+static uint64_t max_late_ns;
+
+static timer_list_t periodic;
+static uint32_t periodic_fired;
+static uint64_t periodic_last_ns;
+
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static uint64_t wall_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void fail(const char* what, const entry_t* entry) {
+    if (failures++ < 10) {
+        fprintf(stderr, "FAIL %s: expires %" PRIu64 " now %" PRIu64 " fired %u\n",
+                what, entry->expires_ns, host_now_ns, entry->fired);
+    }
+}
+
+static void check_fire(entry_t* entry, uint64_t allowed_late_ns) {
+    entry->fired++;
+    if (entry->cancelled) fail("cancelled timer fired", entry);
+    if (entry->fired > 1) fail("fired twice", entry);
+    if (host_now_ns < entry->expires_ns) fail("fired early", entry);
+
+    uint64_t late = host_now_ns - entry->expires_ns;
+    if (late > allowed_late_ns) fail("fired late", entry);
+    if (late > max_late_ns) max_late_ns = late;
+}
+
+static void wheel_fired(void* data) {
+    check_fire(data, TIMER_TICK_NS);
+}
+
+static void hr_fired(void* data) {
+    check_fire(data, 0);
+}
+
+static void periodic_fired_fn(void* data) {
+    (void)data;
+    if (periodic_fired && host_now_ns - periodic_last_ns < PERIODIC_NS) {
+        failures++;
+        fprintf(stderr, "FAIL periodic timer re-fired after %" PRIu64 " ns\n", host_now_ns - periodic_last_ns);
+    }
+    periodic_last_ns = host_now_ns;
+    if (++periodic_fired < PERIODIC_COUNT) timer_add(&periodic, PERIODIC_NS);
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: timerbench [--timers N] [--hrtimers N] [--cancel PERCENT] [--max-ms N] [--seed N]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    uint32_t count = 100000;
+    uint32_t hr_count = 1000;
+    uint32_t cancel_percent = 30;
+    uint64_t max_ns = 3600ULL * 1000 * 1000000ULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!value) usage();
+        if (!strcmp(arg, "--timers")) {
+            count = (uint32_t)atoi(value);
+        } else if (!strcmp(arg, "--hrtimers")) {
+            hr_count = (uint32_t)atoi(value);
+        } else if (!strcmp(arg, "--cancel")) {
+            cancel_percent = (uint32_t)atoi(value);
+        } else if (!strcmp(arg, "--max-ms")) {
+            max_ns = strtoull(value, NULL, 10) * 1000000ULL;
+        } else if (!strcmp(arg, "--seed")) {
+            rng_state = strtoull(value, NULL, 10) | 1;
+        } else {
+            usage();
+        }
+        i++;
+    }
+    if (hr_count > HRTIMER_MAX_PER_CPU) hr_count = HRTIMER_MAX_PER_CPU;
+    if (!max_ns) usage();
+
+    entry_t* entries = calloc(count + hr_count, sizeof(entry_t));
+    if (!entries) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    host_arch_reset(1);
+    host_now_ns = 12345678;     // Off a tick boundary
+    process_init();
+    scheduler_init(SCHED_RR);
+    timer_init();
+
+    uint64_t start = wall_ns();
+    for (uint32_t i = 0; i < count; i++) {
+        entry_t* entry = &entries[i];
+        uint64_t delay = rng_next() % max_ns;
+        timer_setup(&entry->timer, wheel_fired, entry);
+        timer_add(&entry->timer, delay);
+        entry->expires_ns = host_now_ns + delay;
+    }
+    uint64_t add_ns = wall_ns() - start;
+
+    for (uint32_t i = 0; i < hr_count; i++) {
+        entry_t* entry = &entries[count + i];
+        uint64_t delay = rng_next() % (max_ns < 100000000ULL ? max_ns : 100000000ULL);
+        hrtimer_setup(&entry->hrtimer, hr_fired, entry);
+        entry->expires_ns = host_now_ns + delay;
+        if (!hrtimer_start(&entry->hrtimer, entry->expires_ns)) {
+            fprintf(stderr, "hrtimer_start failed at %u\n", i);
+            return 1;
+        }
+    }
+
+    timer_setup(&periodic, periodic_fired_fn, NULL);
+    timer_add(&periodic, PERIODIC_NS);
+
+    uint32_t cancelled = 0;
+    start = wall_ns();
+    for (uint32_t i = 0; i < count + hr_count; i++) {
+        if (rng_next() % 100 >= cancel_percent) continue;
+        entry_t* entry = &entries[i];
+        bool was_pending = i < count ? timer_cancel(&entry->timer) : hrtimer_cancel(&entry->hrtimer);
+        if (!was_pending) fail("cancel of pending timer returned false", entry);
+        entry->cancelled = true;
+        cancelled++;
+    }
+    uint64_t cancel_ns = wall_ns() - start;
+
+    // Run forward the way the hardware would: jump to the programmed
+    // deadline, take the interrupt, let the scheduler re-arm
+    uint64_t interrupts = 0;
+    scheduler_idle();
+    start = wall_ns();
+    while (host_timer_deadline[0] != HOST_TIMER_OFF) {
+        if (host_timer_deadline[0] > host_now_ns) host_now_ns = host_timer_deadline[0];
+        timer_interrupt();
+        scheduler_tick();
+        interrupts++;
+    }
+    uint64_t run_ns = wall_ns() - start;
+
+    for (uint32_t i = 0; i < count + hr_count; i++) {
+        if (!entries[i].cancelled && entries[i].fired != 1) fail("never fired", &entries[i]);
+    }
+    if (periodic_fired != PERIODIC_COUNT) {
+        failures++;
+        fprintf(stderr, "FAIL periodic timer fired %u times\n", periodic_fired);
+    }
+
+    timer_stats_t stats;
+    timer_get_stats(&stats);
+    uint32_t armed = count + hr_count;
+
+    printf("timers           %u wheel + %u hrtimer, %u cancelled, horizon %" PRIu64 " ms\n",
+           count, hr_count, cancelled, max_ns / 1000000);
+    printf("insert           %.1f ns/op\n", count ? (double)add_ns / count : 0.0);
+    printf("cancel           %.1f ns/op\n", cancelled ? (double)cancel_ns / cancelled : 0.0);
+    printf("expiry           %.1f ns/timer, %" PRIu64 " interrupts\n",
+           armed - cancelled ? (double)run_ns / (armed - cancelled) : 0.0, interrupts);
+    printf("cascades         %.2f per wheel timer\n", count ? (double)stats.cascaded / count : 0.0);
+    printf("max lateness     %" PRIu64 " ns\n", max_late_ns);
+    printf("pending at end   %" PRIu64 " wheel, %" PRIu64 " hrtimer\n", stats.pending, stats.hr_pending);
+    printf("%s\n", failures ? "FAILED" : "OK");
+
+    free(entries);
+    return failures ? 1 : 0;
+}
@@ -5,7 +5,7 @@ TMPDIR=$(mktemp -d)
 trap 'rm -rf "$TMPDIR"' EXIT
 
 # Create basic directory structure
-mkdir -p "$TMPDIR"/{bin,dev,etc,lib,proc,sys}
+mkdir -p "$TMPDIR"/{bin,dev,etc,lib,proc,sys,system,tmp}
 
 # Copy essential files
 cp build/WebCppApp "$TMPDIR/bin/"
@@ -0,0 +1,25 @@
+#!/bin/bash
+
+# Build the compressed read-only system image from the app and UI assets.
+# The kernel mounts it on /system.
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+HOSTED_BUILD="$ROOT/build-hosted"
+
+# The image builder is one of the hosted tools
+cmake -S "$ROOT/tools/hosted" -B "$HOSTED_BUILD" > /dev/null
+cmake --build "$HOSTED_BUILD" --target mksysimg > /dev/null
+
+TMPDIR=$(mktemp -d)
+trap 'rm -rf "$TMPDIR"' EXIT
+
+# Everything under apps/ and ui/ except sources and build files
+for tree in apps ui; do
+    (cd "$ROOT" && find "$tree" -type f \
+        ! -name '*.cpp' ! -name '*.h' ! -name 'CMakeLists.txt' ! -name '*.md' \
+        -exec cp --parents {} "$TMPDIR" \;)
+done
+
+mkdir -p "$ROOT/build"
+"$HOSTED_BUILD/mksysimg" "$TMPDIR" "$ROOT/build/system.img"
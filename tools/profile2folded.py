@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""Symbolize kernel profiler samples into folded stacks for flame graphs.
+
+Reads the "PROFILE ..." lines written by profile_export() (SYSCALL_PROFILE_CTL
+export) from a file or a captured serial log, resolves every address against
+kernel.bin or the sampled process's app binary, and writes one folded stack
+per line:
+
+    process;outer_function;...;leaf_function count
+
+which flamegraph.pl, speedscope or inferno take directly. Kernel frames get
+a "_[k]" suffix so flamegraph.pl colours them separately.
+
+    tools/profile2folded.py --kernel build/kernel.bin \\
+        --app Browser=build/apps/Browser/Browser serial.log > out.folded
+    flamegraph.pl out.folded > profile.svg
+
+--app takes NAME=PATH or PID=PATH, with an optional @LOAD_ADDRESS suffix
+for position-independent binaries.
+"""
+
+import argparse
+import bisect
+import collections
+import shutil
+import subprocess
+import sys
+
+NM_CANDIDATES = ("aarch64-linux-gnu-nm", "aarch64-none-elf-nm", "llvm-nm", "nm")
+
+
+class SymbolTable:
+    """Function symbols of one binary, looked up by address."""
+
+    def __init__(self, nm, path, base=0):
+        self.path = path
+        self.starts = []
+        self.entries = []
+        out = subprocess.run([nm, "-n", "-S", "-C", "--defined-only", path],
+                             check=True, capture_output=True, text=True).stdout
+        for line in out.splitlines():
+            fields = line.split(None, 3)
+            if len(fields) == 4:
+                addr, size, kind, name = fields
+                size = int(size, 16)
+            elif len(fields) == 3:
+                addr, kind, name = fields
+                size = 0
+            else:
+                continue
+            if kind not in "tTwW":
+                continue
+            start = int(addr, 16) + base
+            self.starts.append(start)
+            self.entries.append((start, size, name))
+
+        self.low = self.starts[0] if self.starts else 0
+        last = self.entries[-1] if self.entries else (0, 0, "")
+        self.high = last[0] + max(last[1], 1)
+
+    def contains(self, addr):
+        return self.low <= addr < self.high
+
+    def lookup(self, addr):
+        i = bisect.bisect_right(self.starts, addr) - 1
+        if i < 0:
+            return None
+        start, size, name = self.entries[i]
+        # Without a size, trust the nearest preceding symbol
+        if size and addr >= start + size:
+            return None
+        return name
+
+
+def find_nm(requested):
+    if requested:
+        return requested
+    for candidate in NM_CANDIDATES:
+        if shutil.which(candidate):
+            return candidate
+    sys.exit("profile2folded: no nm found, pass --nm")
+
+
+def parse(lines):
+    samples = []
+    names = {}
+    summary = None
+
+    for line in lines:
+        start = line.find("PROFILE ")
+        if start < 0:
+            continue
+        fields = line[start:].rstrip("\r\n").split(" ", 6)
+        kind = fields[1] if len(fields) > 1 else ""
+
+        if kind == "S" and len(fields) >= 7:
+            pid = int(fields[4])
+            user = fields[5] == "u"
+            pcs = [int(pc, 16) for pc in fields[6].split(",") if pc]
+            samples.append((pid, user, pcs))
+        elif kind == "P" and len(fields) >= 4:
+            names[int(fields[2])] = " ".join(fields[3:])
+        elif kind == "end" and len(fields) >= 5:
+            summary = tuple(int(f) for f in fields[2:5])
+
+    return samples, names, summary
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Fold profiler samples for flame graphs")
+    parser.add_argument("log", nargs="?", help="serial log or export file (default: stdin)")
+    parser.add_argument("--kernel", default="build/kernel.bin", help="kernel ELF (default: %(default)s)")
+    parser.add_argument("--app", action="append", default=[], metavar="NAME=PATH[@BASE]",
+                        help="app binary for a process name or PID; may be repeated")
+    parser.add_argument("--nm", help="nm to use (default: first of %s found)" % ", ".join(NM_CANDIDATES))
+    parser.add_argument("--no-process", action="store_true", help="do not root stacks at the process name")
+    args = parser.parse_args()
+
+    nm = find_nm(args.nm)
+    kernel = SymbolTable(nm, args.kernel)
+
+    apps = {}
+    for spec in args.app:
+        key, _, path = spec.partition("=")
+        if not path:
+            parser.error("--app expects NAME=PATH, got %r" % spec)
+        path, _, base = path.partition("@")
+        apps[key] = SymbolTable(nm, path, int(base, 0) if base else 0)
+
+    if args.log:
+        with open(args.log, errors="replace") as f:
+            samples, names, summary = parse(f)
+    else:
+        samples, names, summary = parse(sys.stdin)
+
+    if not samples:
+        sys.exit("profile2folded: no PROFILE samples found")
+    if summary and summary[1]:
+        sys.stderr.write("profile2folded: %d samples lost (buffer full); export more often\n" % summary[1])
+
+    folded = collections.Counter()
+    for pid, user, pcs in samples:
+        process = names.get(pid, "pid %d" % pid if pid else "kernel")
+        app = apps.get(str(pid)) or apps.get(names.get(pid, ""))
+
+        frames = []
+        for depth, pc in enumerate(pcs):
+            # Return addresses point after the call; look up the call itself
+            addr = pc - 1 if depth else pc
+            if not user and kernel.contains(addr):
+                name = kernel.lookup(addr)
+                frames.append((name or "0x%x" % pc) + "_[k]")
+            elif app and app.contains(addr):
+                frames.append(app.lookup(addr) or "0x%x" % pc)
+            elif kernel.contains(addr):
+                frames.append((kernel.lookup(addr) or "0x%x" % pc) + "_[k]")
+            else:
+                frames.append("0x%x" % pc)
+
+        frames.reverse()
+        if not args.no_process:
+            frames.insert(0, process)
+        folded[";".join(f.replace(";", ":") for f in frames)] += 1
+
+    for stack, count in sorted(folded.items()):
+        sys.stdout.write("%s %d\n" % (stack, count))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+"""Convert kernel tracepoint output to Chrome Trace Event JSON.
+
+Reads the "TRACE ..." lines written by trace_export() (SYSCALL_TRACE_CTL
+export, or schedsim --trace-out) from a file or a captured serial log and
+writes JSON that loads in Perfetto (ui.perfetto.dev) or chrome://tracing.
+
+Every record becomes an instant event on its CPU's track with named
+arguments; sched_switch records are additionally turned into per-CPU
+slices showing which pid was running.
+
+    tools/trace2json.py serial.log > trace.json
+"""
+
+import json
+import sys
+
+
+def parse(lines):
+    events = {}
+    records = []
+    cpus = 0
+    recorded = lost = None
+
+    for line in lines:
+        start = line.find("TRACE ")
+        if start < 0:
+            continue
+        fields = line[start:].split()
+        kind = fields[1] if len(fields) > 1 else ""
+
+        if kind == "begin" and len(fields) >= 4:
+            cpus = int(fields[3])
+        elif kind == "E" and len(fields) >= 6:
+            names = [n if n != "-" else None for n in fields[5].split(",")]
+            events[int(fields[2])] = (fields[3], fields[4], names)
+        elif kind == "R" and len(fields) >= 10:
+            cpu, ts, pid, event = (int(f) for f in fields[2:6])
+            args = [int(f, 16) for f in fields[6:10]]
+            records.append((ts, cpu, pid, event, args))
+        elif kind == "end" and len(fields) >= 4:
+            recorded, lost = int(fields[2]), int(fields[3])
+
+    records.sort(key=lambda r: (r[0], r[1]))
+    return events, records, cpus, recorded, lost
+
+
+def convert(events, records, cpus):
+    out = []
+    for cpu in range(cpus):
+        out.append({"ph": "M", "name": "thread_name", "pid": 0, "tid": cpu,
+                    "args": {"name": "cpu%d" % cpu}})
+
+    running = {}    # cpu -> (pid, start_ns)
+    last_ts = 0
+    for ts, cpu, pid, event, args in records:
+        last_ts = ts
+        subsystem, name, arg_names = events.get(event, ("unknown", "event%d" % event, []))
+        named = {}
+        for i, value in enumerate(args):
+            key = arg_names[i] if i < len(arg_names) else None
+            if key:
+                named[key] = value
+        named["pid"] = pid
+
+        out.append({"ph": "i", "s": "t", "name": name, "cat": subsystem,
+                    "ts": ts / 1000.0, "pid": 0, "tid": cpu, "args": named})
+
+        if name == "sched_switch":
+            prev = running.pop(cpu, None)
+            if prev is not None:
+                out.append(slice_event(cpu, prev[0], prev[1], ts))
+            running[cpu] = (args[2], ts)
+
+    for cpu, (pid, start) in running.items():
+        out.append(slice_event(cpu, pid, start, last_ts))
+    return out
+
+
+def slice_event(cpu, pid, start_ns, end_ns):
+    return {"ph": "X", "name": "pid %d" % pid if pid else "idle", "cat": "sched",
+            "ts": start_ns / 1000.0, "dur": (end_ns - start_ns) / 1000.0,
+            "pid": 0, "tid": cpu, "args": {"pid": pid}}
+
+
+def main(argv):
+    if len(argv) > 2 or (len(argv) == 2 and argv[1] in ("-h", "--help")):
+        sys.stderr.write("usage: trace2json.py [TRACE_LOG]\n")
+        return 2
+
+    if len(argv) == 2:
+        with open(argv[1], errors="replace") as f:
+            events, records, cpus, recorded, lost = parse(f)
+    else:
+        events, records, cpus, recorded, lost = parse(sys.stdin)
+
+    if not events:
+        sys.stderr.write("trace2json: no TRACE output found\n")
+        return 1
+    if lost:
+        sys.stderr.write("trace2json: %d of %d events were lost (buffer full)\n"
+                         % (lost, recorded + lost))
+
+    cpus = max([cpus] + [r[1] + 1 for r in records])
+    json.dump({"traceEvents": convert(events, records, cpus),
+               "displayTimeUnit": "ns"}, sys.stdout)
+    sys.stdout.write("\n")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -4,8 +4,13 @@
 #include "../../ui/include/aceui_widget.h"
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <dirent.h> // For directory listing
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h> // Files are mapped rather than read into buffers
+#include <sys/stat.h>
 #include <vector> // For argument processing in V8 callbacks
 
 // V8 Integration - Ensure V8 headers are in your include path.
@@ -103,7 +108,8 @@ webcpp_context_t* webcpp_create_context(void) {
     return context;
 }
 
-bool webcpp_eval_js(webcpp_context_t* context, const char* js_code) {
+// Compile and run length bytes of source, which need not be NUL-terminated
+static bool webcpp_eval_js_buffer(webcpp_context_t* context, const char* js_code, size_t length) {
     if (!context || !js_code || !context->js_context) return false;
 
     webcpp_v8_engine_context_t* v8_ctx = (webcpp_v8_engine_context_t*)context->js_context;
@@ -115,7 +121,7 @@ bool webcpp_eval_js(webcpp_context_t* context, const char* js_code) {
     v8::Context::Scope context_scope(local_v8_context);
 
     v8::Local<v8::String> source;
-    if (!v8::String::NewFromUtf8(isolate, js_code, v8::NewStringType::kNormal).ToLocal(&source)) {
+    if (!v8::String::NewFromUtf8(isolate, js_code, v8::NewStringType::kNormal, (int)length).ToLocal(&source)) {
         fprintf(stderr, "WebCpp Error: Could not create V8 string from JS code.\n");
         return false;
     }
@@ -137,15 +143,64 @@ bool webcpp_eval_js(webcpp_context_t* context, const char* js_code) {
     return true;
 }
 
+bool webcpp_eval_js(webcpp_context_t* context, const char* js_code) {
+    if (!js_code) return false;
+    return webcpp_eval_js_buffer(context, js_code, strlen(js_code));
+}
+
+// A file mapped read-only. The mapping shares the system's page cache, so
+// the contents are used in place instead of being copied into a buffer.
+// The data is not NUL-terminated.
+typedef struct {
+    const char* data;
+    size_t size;
+} webcpp_mapped_file_t;
+
+static bool webcpp_map_file(const char* file_path, webcpp_mapped_file_t* file) {
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0) {
+        // In a real library, you might have a WebCpp-specific error logging mechanism
+        fprintf(stderr, "WebCpp Error: Could not open file %s\n", file_path);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "WebCpp Error: Could not stat file %s\n", file_path);
+        close(fd);
+        return false;
+    }
+
+    // An empty file cannot be mapped and needs no memory anyway
+    file->data = "";
+    file->size = (size_t)st.st_size;
+    if (file->size) {
+        void* addr = mmap(NULL, file->size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            fprintf(stderr, "WebCpp Error: Could not map file %s\n", file_path);
+            close(fd);
+            return false;
+        }
+        file->data = (const char*)addr;
+    }
+    close(fd); // The mapping stays valid without the descriptor
+    return true;
+}
+
+static void webcpp_unmap_file(webcpp_mapped_file_t* file) {
+    if (file->size) munmap((void*)file->data, file->size);
+}
+
 bool webcpp_load_js_file(webcpp_context_t* context, const char* file_path) {
     if (!context || !file_path) return false;
-    char* js_code = webcpp_read_entire_file(file_path);
-    if (!js_code) {
+    webcpp_mapped_file_t js_file;
+    if (!webcpp_map_file(file_path, &js_file)) {
         fprintf(stderr, "WebCpp Error: Could not read JS file %s\n", file_path);
         return false;
     }
-    bool success = webcpp_eval_js(context, js_code);
-    free(js_code);
+    // V8 takes its own copy of the source, straight from the mapping
+    bool success = webcpp_eval_js_buffer(context, js_file.data, js_file.size);
+    webcpp_unmap_file(&js_file);
     return success;
 }
 
@@ -367,35 +422,13 @@ bool webcpp_register_function(webcpp_context_t* context, const char* name, void*
                  // a real implementation needs robust cleanup, e.g., when context is destroyed.
 }
 
-static char* webcpp_read_entire_file(const char* file_path) {
-    FILE* file = fopen(file_path, "rb");
-    if (!file) {
-        // In a real library, you might have a WebCpp-specific error logging mechanism
-        fprintf(stderr, "WebCpp Error: Could not open file %s\n", file_path);
-        return NULL;
-    }
-
-    fseek(file, 0, SEEK_END);
-    long length = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    char* buffer = (char*)malloc(length + 1);
-    if (!buffer) {
-        fprintf(stderr, "WebCpp Error: Could not allocate memory to read file %s\n", file_path);
-        fclose(file);
-        return NULL;
+// Case-insensitive search in a buffer that need not be NUL-terminated
+static const char* webcpp_find_case(const char* data, size_t size, const char* needle) {
+    size_t needle_len = strlen(needle);
+    for (size_t i = 0; i + needle_len <= size; i++) {
+        if (strncasecmp(data + i, needle, needle_len) == 0) return data + i;
     }
-
-    if (fread(buffer, 1, length, file) != (size_t)length) {
-        fprintf(stderr, "WebCpp Error: Could not read entire file %s\n", file_path);
-        fclose(file);
-        free(buffer);
-        return NULL;
-    }
-
-    buffer[length] = '\0';
-    fclose(file);
-    return buffer;
+    return NULL;
 }
 
 // Helper function to escape HTML content for safe embedding in a JS string literal
@@ -444,8 +477,8 @@ bool webcpp_load_html_file(webcpp_context_t* context, const char* file_path) {
         return false; // Invalid arguments
     }
 
-    char* html_content = webcpp_read_entire_file(file_path);
-    if (!html_content) {
+    webcpp_mapped_file_t html;
+    if (!webcpp_map_file(file_path, &html)) {
         return false; // Failed to read file
     }
 
@@ -458,43 +491,32 @@ bool webcpp_load_html_file(webcpp_context_t* context, const char* file_path) {
 
     // Find the end of the <head> tag to insert our tags.
     // A more robust solution would use a proper HTML parser, but string manipulation can work for well-formed simple HTML.
-    char* head_end_tag_pos = strcasestr(html_content, "</head>");
-    char* final_html_content;
-
+    const char* head_end_tag_pos = webcpp_find_case(html.data, html.size, "</head>");
+    size_t head_len = 0;
     if (head_end_tag_pos) {
-        size_t head_len = head_end_tag_pos - html_content;
-        size_t total_len = strlen(html_content) + strlen(theme_css_tag) + strlen(acegui_css_tag) + strlen(acegui_js_tag) + 1;
-        final_html_content = (char*)malloc(total_len);
-        if (!final_html_content) {
-            fprintf(stderr, "WebCpp Error: Failed to allocate memory for modified HTML content.\n");
-            free(html_content);
-            return false;
-        }
-        // Copy content before </head>
-        strncpy(final_html_content, html_content, head_len);
-        final_html_content[head_len] = '\0'; // Null-terminate
-        // Append our tags
-        strcat(final_html_content, theme_css_tag);
-        strcat(final_html_content, acegui_css_tag);
-        strcat(final_html_content, acegui_js_tag);
-        // Append the rest of the original HTML (including </head> and <body> etc.)
-        strcat(final_html_content, head_end_tag_pos);
+        head_len = head_end_tag_pos - html.data;
     } else {
         // Fallback: if no </head> tag, prepend to the whole content. This is less ideal.
         fprintf(stderr, "WebCpp Warning: No </head> tag found in %s. Prepending framework assets.\n", file_path);
-        size_t total_len = strlen(html_content) + strlen(theme_css_tag) + strlen(acegui_css_tag) + strlen(acegui_js_tag) + 1;
-        final_html_content = (char*)malloc(total_len);
-         if (!final_html_content) {
-            fprintf(stderr, "WebCpp Error: Failed to allocate memory for modified HTML content (fallback).\n");
-            free(html_content);
-            return false;
-        }
-        strcpy(final_html_content, theme_css_tag);
-        strcat(final_html_content, acegui_css_tag);
-        strcat(final_html_content, acegui_js_tag);
-        strcat(final_html_content, html_content);
     }
-    free(html_content); // Free original content
+
+    size_t total_len = html.size + strlen(theme_css_tag) + strlen(acegui_css_tag) + strlen(acegui_js_tag) + 1;
+    char* final_html_content = (char*)malloc(total_len);
+    if (!final_html_content) {
+        fprintf(stderr, "WebCpp Error: Failed to allocate memory for modified HTML content.\n");
+        webcpp_unmap_file(&html);
+        return false;
+    }
+    // Content before </head> comes straight from the mapping, then our tags,
+    // then the rest of the original HTML (including </head> and <body> etc.)
+    memcpy(final_html_content, html.data, head_len);
+    char* out = final_html_content + head_len;
+    out = stpcpy(out, theme_css_tag);
+    out = stpcpy(out, acegui_css_tag);
+    out = stpcpy(out, acegui_js_tag);
+    memcpy(out, html.data + head_len, html.size - head_len);
+    out[html.size - head_len] = '\0';
+    webcpp_unmap_file(&html);
 
     char* escaped_html = webcpp_escape_html_for_js_injection(final_html_content);
     free(final_html_content); // Free the combined HTML string
@@ -532,10 +554,13 @@ bool webcpp_load_html_file(webcpp_context_t* context, const char* file_path) {
 // Basic Base64 encoding (simplified, no line breaks)
 static const char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
-static char* webcpp_base64_encode(const unsigned char *data, size_t input_length, size_t *output_length) {
-    *output_length = 4 * ((input_length + 2) / 3);
-    char *encoded_data = (char*)malloc(*output_length + 1); // +1 for null terminator
-    if (encoded_data == NULL) return NULL;
+static size_t webcpp_base64_encoded_length(size_t input_length) {
+    return 4 * ((input_length + 2) / 3);
+}
+
+// Encode into encoded_data, which has room for the encoded length plus a null terminator
+static void webcpp_base64_encode(const unsigned char *data, size_t input_length, char *encoded_data) {
+    size_t output_length = webcpp_base64_encoded_length(input_length);
 
     for (size_t i = 0, j = 0; i < input_length;) {
         uint32_t octet_a = i < input_length ? data[i++] : 0;
@@ -553,10 +578,9 @@ static char* webcpp_base64_encode(const unsigned char *data, size_t input_length
     // Pad with '='
     size_t mod_table[] = {0, 2, 1};
     for (size_t i = 0; i < mod_table[input_length % 3]; i++)
-        encoded_data[*output_length - 1 - i] = '=';
+        encoded_data[output_length - 1 - i] = '=';
 
-    encoded_data[*output_length] = '\0';
-    return encoded_data;
+    encoded_data[output_length] = '\0';
 }
 
 // Basic Base64 decoding
@@ -628,9 +652,6 @@ bool webcpp_list_directory_items(webcpp_context_t* context, const char* director
 
     DIR *dir;
     struct dirent *entry;
-    char buffer[2048]; // Buffer for constructing JSON string
-    strcpy(buffer, "[");
-    bool first_item = true;
 
     if ((dir = opendir(directory_path)) == NULL) {
         perror("opendir() error");
@@ -638,16 +659,24 @@ bool webcpp_list_directory_items(webcpp_context_t* context, const char* director
         return false;
     }
 
+    // Photo libraries run to thousands of entries, so the JSON grows as
+    // readdir goes rather than living in a fixed buffer
+    size_t capacity = 4096;
+    size_t length = 1;
+    char* buffer = (char*)malloc(capacity);
+    if (!buffer) {
+        closedir(dir);
+        *result_json = strdup("[]");
+        return false;
+    }
+    buffer[0] = '[';
+    bool first_item = true;
+
     while ((entry = readdir(dir)) != NULL) {
         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
             continue; // Skip . and ..
         }
 
-        if (!first_item) {
-            strcat(buffer, ",");
-        }
-        first_item = false;
-
         char item_path[1024];
         snprintf(item_path, sizeof(item_path), "%s/%s", directory_path, entry->d_name);
 
@@ -666,54 +695,42 @@ bool webcpp_list_directory_items(webcpp_context_t* context, const char* director
                  escaped_name,
                  (entry->d_type == DT_DIR) ? "dir" : "file",
                  escaped_path);
-        strcat(buffer, item_json);
+
+        // Room for a separating comma and the closing "]\0"
+        size_t item_length = strlen(item_json);
+        if (length + item_length + 3 > capacity) {
+            while (length + item_length + 3 > capacity) capacity *= 2;
+            char* grown = (char*)realloc(buffer, capacity);
+            if (!grown) {
+                free(buffer);
+                closedir(dir);
+                *result_json = strdup("[]");
+                return false;
+            }
+            buffer = grown;
+        }
+        if (!first_item) buffer[length++] = ',';
+        first_item = false;
+        memcpy(buffer + length, item_json, item_length);
+        length += item_length;
     }
     closedir(dir);
-    strcat(buffer, "]");
-
-    *result_json = strdup(buffer);
-    if (!*result_json) return false; // strdup failed
+    buffer[length++] = ']';
+    buffer[length] = '\0';
 
+    *result_json = buffer;
     return true;
 }
 
 bool webcpp_get_image_data_url(webcpp_context_t* context, const char* image_path, char** data_url_string) {
     if (!context || !image_path || !data_url_string) return false;
 
-    FILE* image_file = fopen(image_path, "rb");
-    if (!image_file) {
+    webcpp_mapped_file_t image;
+    if (!webcpp_map_file(image_path, &image)) {
         fprintf(stderr, "WebCpp Error: Could not open image file %s\n", image_path);
         return false;
     }
 
-    fseek(image_file, 0, SEEK_END);
-    long file_size = ftell(image_file);
-    fseek(image_file, 0, SEEK_SET);
-
-    unsigned char* image_data = (unsigned char*)malloc(file_size);
-    if (!image_data) {
-        fprintf(stderr, "WebCpp Error: Could not allocate memory for image data.\n");
-        fclose(image_file);
-        return false;
-    }
-
-    if (fread(image_data, 1, file_size, image_file) != (size_t)file_size) {
-        fprintf(stderr, "WebCpp Error: Could not read image file %s\n", image_path);
-        fclose(image_file);
-        free(image_data);
-        return false;
-    }
-    fclose(image_file);
-
-    size_t base64_len;
-    char* base64_data = webcpp_base64_encode(image_data, file_size, &base64_len);
-    free(image_data);
-
-    if (!base64_data) {
-        fprintf(stderr, "WebCpp Error: Base64 encoding failed for %s\n", image_path);
-        return false;
-    }
-
     // Determine MIME type (very basic, based on extension)
     const char* mime_type = "image/jpeg"; // Default
     const char* ext = strrchr(image_path, '.');
@@ -724,16 +741,20 @@ bool webcpp_get_image_data_url(webcpp_context_t* context, const char* image_path
     }
 
     // Format: "data:[<mime_type>];base64,<data>"
-    size_t data_url_len = strlen("data:") + strlen(mime_type) + strlen(";base64,") + base64_len + 1;
+    // The image is encoded straight from the mapping into the URL, so no
+    // other copy of it is ever made.
+    size_t prefix_len = strlen("data:") + strlen(mime_type) + strlen(";base64,");
+    size_t data_url_len = prefix_len + webcpp_base64_encoded_length(image.size) + 1;
     *data_url_string = (char*)malloc(data_url_len);
     if (!*data_url_string) {
         fprintf(stderr, "WebCpp Error: Could not allocate memory for data URL string.\n");
-        free(base64_data);
+        webcpp_unmap_file(&image);
         return false;
     }
 
-    sprintf(*data_url_string, "data:%s;base64,%s", mime_type, base64_data);
-    free(base64_data);
+    sprintf(*data_url_string, "data:%s;base64,", mime_type);
+    webcpp_base64_encode((const unsigned char*)image.data, image.size, *data_url_string + prefix_len);
+    webcpp_unmap_file(&image);
 
     return true;
 }